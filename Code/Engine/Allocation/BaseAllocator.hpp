@@ -1,25 +1,72 @@
 #pragma once
 #include "Core/NumberDef.hpp"
 #include "Memory/AllocationTracker.hpp"
+#include "Memory/MemoryTag.hpp"
+#include "Multithreading/Epoch.hpp"
+#include <new>
 
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Objects made through an allocator are charged to its memory tag, and their
+//	constructors and destructors run with it as the current tag, so whatever
+//	they allocate on the heap lands under the same tag.
+//
+//////////////////////////////////////////////////////////////////////////////////////
 class BaseAllocator
 {
 protected:
+	explicit BaseAllocator(memory_tag tag = MEMORY_TAG_UNTAGGED)
+		: m_tag(tag)
+	{
+	};
+
 	virtual void* Allocate(U64 size) = 0;
 	virtual void Free(void* pointer, U64 size) = 0;
 
 public:
+	// Pools and heaps are owned and deleted through the base
+	virtual ~BaseAllocator() {};
+
+	inline memory_tag GetTag() const { return m_tag; };
+	inline void SetTag(memory_tag tag) { m_tag = tag; };
+
 	template <typename Object, typename ...ARGS>
 	Object* Create(ARGS ...args)
 	{
 		void* pointer = Allocate((U64)sizeof(Object));
+		if (nullptr == pointer)
+			return nullptr;
+
+		MemoryTagAddBytes(m_tag, (int64_t)sizeof(Object));
+		SCOPE_MEMORY_TAG(m_tag);
 		return new (pointer) Object(args...);
 	}
 
 	template <typename Object>
 	void Destroy(Object* obj)
 	{
-		obj->~Object();
+		{
+			SCOPE_MEMORY_TAG(m_tag);
+			obj->~Object();
+		}
 		Free(obj, (U64)sizeof(Object));
+		MemoryTagAddBytes(m_tag, -(int64_t)sizeof(Object));
+	}
+
+	// Destroyed once no reader can still see it, see Epoch.hpp.  The allocator
+	// has to outlive every object retired to it.
+	template <typename Object>
+	void Retire(Object* obj)
+	{
+		EpochRetire(obj, &DestroyRetired<Object>, this);
+	}
+
+private:
+	memory_tag m_tag;
+
+	template <typename Object>
+	static void DestroyRetired(void* pointer, void* allocator)
+	{
+		((BaseAllocator*)allocator)->Destroy((Object*)pointer);
 	}
 };
\ No newline at end of file
@@ -1,7 +1,8 @@
 #pragma once
 #include "Allocation/BaseAllocator.hpp"
-#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Mutex.hpp"
 #include "Math/Utils.hpp"
+#include <stdlib.h>
 
 
 //////////////////////////////////////////////////////////////////////////////////////
@@ -16,8 +17,9 @@ template<typename SmallestBlock>
 class BuddyAllocator : public BaseAllocator
 {
 private:
-	explicit BuddyAllocator(U64 obj_count)
-		:m_allocCount(0)
+	explicit BuddyAllocator(U64 obj_count, memory_tag tag = MEMORY_TAG_UNTAGGED)
+		: BaseAllocator(tag)
+		, m_allocCount(0)
 	{
 		obj_count = UpperPowerOfTwo(obj_count);
 		block_size = UpperPowerOfTwo((U64)sizeof(SmallestBlock));
@@ -38,8 +40,6 @@ private:
 
 			m_freeList[loop] = nullptr;
 		}
-
-		m_lock = new CriticalSection();
 	};
 
 	~BuddyAllocator()
@@ -68,8 +68,6 @@ private:
 
 			free(m_freeList[index]);
 		}
-
-		delete m_lock;
 	};
 
 	struct Node
@@ -124,7 +122,7 @@ private:
 			return addr;
 
 		{
-			SCOPE_LOCK(m_lock);
+			SCOPE_LOCK(&m_lock);
 			if (!m_freeList[index - 1])
 			{
 				InitFreeList(index - 1, addr);
@@ -157,7 +155,7 @@ protected:
 		Node* head_of_list = m_freeList[request_index]->m_head;
 		void* last_alloc = end_of_list->m_data;
 		{
-			SCOPE_LOCK(m_lock);
+			SCOPE_LOCK(&m_lock);
 			// Pop last
 			if (head_of_list == end_of_list)
 			{
@@ -201,7 +199,7 @@ protected:
 		--m_allocCount;
 
 		{
-			SCOPE_LOCK(m_lock);
+			SCOPE_LOCK(&m_lock);
 
 			if (m_freeList[index])
 			{
@@ -236,6 +234,6 @@ private:
 	void* m_memory;
 	void* m_lastAddr;
 	MemList* m_freeList[64];
-	CriticalSection* m_lock;
+	Mutex m_lock;
 	U64 m_allocCount;
 };
@@ -1,7 +1,8 @@
 #pragma once
 #include "Allocation/BaseAllocator.hpp"
-#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Mutex.hpp"
 #include "Math/Utils.hpp"
+#include <stdlib.h>
 
 
 //////////////////////////////////////////////////////////////////////////////////////
@@ -16,18 +17,17 @@ template<typename Block>
 class PoolAllocator : public BaseAllocator
 {
 public:
-	explicit PoolAllocator(U64 obj_count)
-		: m_freeList(nullptr)
+	explicit PoolAllocator(U64 obj_count, memory_tag tag = MEMORY_TAG_UNTAGGED)
+		: BaseAllocator(tag)
+		, m_freeList(nullptr)
 		, m_memory(nullptr)
 		, m_allocCount(0)
 	{
 		m_blockSize = obj_count * (U64)Max(sizeof(Block), sizeof(Node));
-		m_lock = new CriticalSection();
 	};
 
 	~PoolAllocator()
 	{
-		delete m_lock;
 		::free(m_memory);
 	};
 
@@ -49,7 +49,7 @@ protected:
 
 		// For the Scope Lock
 		{
-			SCOPE_LOCK(m_lock);
+			SCOPE_LOCK(&m_lock);
 			if (nullptr == m_freeList) 
 			{ 
 				if (nullptr == m_memory)
@@ -83,7 +83,7 @@ protected:
 	{
 		if (nullptr != ptr) 
 		{
-			SCOPE_LOCK(m_lock);
+			SCOPE_LOCK(&m_lock);
 			Node* block = (Node*)ptr;
 			block->next = m_freeList;
 			m_freeList = block;
@@ -100,7 +100,7 @@ private:
 private:
 	void* m_memory;
 	Node* m_freeList;
-	CriticalSection* m_lock;
+	Mutex m_lock;
 	U64 m_blockSize;
 	U64 m_allocCount;
 };
\ No newline at end of file
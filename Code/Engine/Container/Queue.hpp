@@ -1,5 +1,6 @@
 #pragma once
-#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Synchronization.hpp"
 #include <cstdint>
 
 template <typename Object>
@@ -8,7 +9,7 @@ class Queue
 public:
 	void Push(const Object& data)
 	{
-		SCOPE_LOCK(m_lock);
+		SCOPE_LOCK(&m_lock);
 
 		Node* node = new Node();				// create node
 		node->m_item = data;					// set node pointers
@@ -21,22 +22,24 @@ public:
 
 		m_rear = node;							// have rear point to new node
 		++m_count;						// increment count
+		m_available.Release();			// one more item to claim
 	}
 
 	bool IsEmpty()
 	{
-		SCOPE_LOCK(m_lock);
+		SCOPE_LOCK(&m_lock);
 
 		return 0 == m_count;
 	}
 
 	bool Pop()
 	{
-		SCOPE_LOCK(m_lock);
-
-		if (IsEmpty())
+		// Claimed first, so an item a blocked PopWait was promised stays there
+		if (!m_available.TryAcquire())
 			return false;
 
+		SCOPE_LOCK(&m_lock);
+
 		Node* temp = m_front; 				// save location of first item
 
 		m_front = m_front->m_next; 				// reset front to next item
@@ -50,11 +53,33 @@ public:
 		return true;
 	}
 
+	// Sleeps until an item is pushed, false if none came within the timeout
+	bool PopWait(Object* out_item, U32 timeout_ms = FUTEX_WAIT_INFINITE)
+	{
+		if (!m_available.Acquire(timeout_ms))
+			return false;
+
+		SCOPE_LOCK(&m_lock);
+
+		Node* temp = m_front;
+		*out_item = temp->m_item;
+
+		m_front = m_front->m_next;
+		delete temp;
+
+		if (nullptr == m_front)
+			m_rear = nullptr;
+
+		--m_count;
+
+		return true;
+	}
+
 	Object Front()
 	{
-		SCOPE_LOCK(m_lock);
+		SCOPE_LOCK(&m_lock);
 
-		if (IsEmpty())
+		if (0 == m_count)
 			return (Object)0;
 
 		return m_front->m_item;
@@ -62,9 +87,9 @@ public:
 
 	Object Rear()
 	{
-		SCOPE_LOCK(m_lock);
+		SCOPE_LOCK(&m_lock);
 
-		if (IsEmpty())
+		if (0 == m_count)
 			return (Object)0;
 
 		return m_rear->m_item;
@@ -87,8 +112,6 @@ public:
 			m_front = m_front->m_next;
 			delete temp;
 		}
-
-		delete m_lock;
 	}
 
 	Queue()
@@ -96,7 +119,6 @@ public:
 		, m_rear(nullptr)
 		, m_count(0)
 	{
-		m_lock = new CriticalSection();
 	}
 
 private:
@@ -108,6 +130,7 @@ private:
 
 	Node* m_front;
 	Node* m_rear;
-	CriticalSection* m_lock;
+	Mutex m_lock;
+	Semaphore m_available;
 	uint16_t m_count;
 };
\ No newline at end of file
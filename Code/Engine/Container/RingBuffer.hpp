@@ -1,8 +1,12 @@
 #pragma once
 #include "Core/NumberDef.hpp"
 #include "Memory/AllocationTracker.hpp"
-#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Synchronization.hpp"
 #include "Math/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 template<typename Object>
 Object DefaultError()
@@ -27,7 +31,6 @@ public:
 	explicit RingBuffer(U64 obj_count) 
 		:m_canWrap(true)
 	{
-		m_lock = new CriticalSection();
 		m_memory = malloc(sizeof(Object) * obj_count);
 		m_endOfBuffer = (Object*)m_memory + obj_count;
 		m_head = m_memory;
@@ -37,13 +40,12 @@ public:
 
 	~RingBuffer()
 	{
-		delete m_lock;
 		free(m_memory);
 	};
 
 	void Push(Object item)
 	{
-		SCOPE_LOCK(m_lock);
+		SCOPE_LOCK(&m_lock);
 
 		*(Object*)m_head = item;
 
@@ -62,32 +64,55 @@ public:
 			m_head = m_memory;
 		else
 			m_head = (Object*)m_head + 1;
+
+		// Wrapping replaced the oldest item, the count stays the same
+		if (!is_full)
+			m_available.Release();
 	};
 	
 	Object Pop()
 	{
-		SCOPE_LOCK(m_lock);
-
 		// throw error?
+		if (!m_available.TryAcquire())
+		{
+			return m_emptyError();
+		}
+
+		SCOPE_LOCK(&m_lock);
+
+		// A Reset may have taken it since
 		if (Empty())
 		{
 			return m_emptyError();
 		}
 
-		Object obj = *(Object*)m_tail;
+		return TakeTail();
+	};
 
-		if ((Object*)m_tail + 1 > m_endOfBuffer)
-			m_tail = m_memory;
-		else
-			m_tail = (Object*)m_tail + 1;
+	// Sleeps until an item is pushed, false if none came within the timeout
+	bool PopWait(Object* out_item, U32 timeout_ms = FUTEX_WAIT_INFINITE)
+	{
+		for (;;)
+		{
+			if (!m_available.Acquire(timeout_ms))
+				return false;
 
-		return obj;
+			SCOPE_LOCK(&m_lock);
+
+			if (!Empty())
+			{
+				*out_item = TakeTail();
+				return true;
+			}
+		}
 	};
 
 	void Reset()
 	{
-		SCOPE_LOCK(m_lock);
+		SCOPE_LOCK(&m_lock);
 		m_head = m_tail;
+
+		while (m_available.TryAcquire()) {}
 	};
 
 	inline bool Empty() const
@@ -167,10 +192,28 @@ public:
 		m_tail = (Object*)m_memory + my_tail_idx;
 		m_endOfBuffer = (Object*)m_memory + my_cap;
 		m_canWrap = buffer.m_canWrap;
+
+		while (m_available.TryAcquire()) {}
+		if (!Empty())
+			m_available.Release((U32)Size());
+	};
+
+private:
+	Object TakeTail()
+	{
+		Object obj = *(Object*)m_tail;
+
+		if ((Object*)m_tail + 1 > m_endOfBuffer)
+			m_tail = m_memory;
+		else
+			m_tail = (Object*)m_tail + 1;
+
+		return obj;
 	};
 
 private:
-	CriticalSection* m_lock;
+	Mutex m_lock;
+	Semaphore m_available;
 	void* m_memory;
 	void* m_head;
 	void* m_tail;
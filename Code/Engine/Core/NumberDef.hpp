@@ -5,11 +5,11 @@
 typedef unsigned char Byte;
 typedef char I8;
 typedef short int I16;
-typedef long int I32;
+typedef int I32;
 typedef long long int I64;
 typedef unsigned char U8;
 typedef unsigned short int U16;
-typedef unsigned long int U32;
+typedef unsigned int U32;
 typedef unsigned long long int U64;
 typedef float F32;
 typedef double D64;
@@ -1,9 +1,29 @@
-#include "IO/CallStack.hpp"
+#include "IO/Callstack.hpp"
+#include "IO/Symbolizer.hpp"
 #include "Time/Utils.hpp"
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include <stddef.h>
 #include <stdlib.h>
-#include <DbgHelp.h>
+#include <string.h>
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+	#include <DbgHelp.h>
+	#define CALLSTACK_NOINLINE __declspec(noinline)
+#else
+	#include <cxxabi.h>
+	#include <dlfcn.h>
+	#include <elf.h>
+	#include <fcntl.h>
+	#include <link.h>
+	#include <pthread.h>
+	#include <stdio.h>
+	#include <sys/auxv.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <unwind.h>
+	#define CALLSTACK_NOINLINE __attribute__((noinline))
+#endif
 
 
 //////////////////////////////////////////////////////
@@ -11,19 +31,46 @@
 //					Typedefs						//
 //													//
 //////////////////////////////////////////////////////
+#if defined(_WIN32)
 typedef BOOL(__stdcall *sym_initialize_t)(IN HANDLE hProcess, IN PSTR UserSearchPath, IN BOOL fInvadeProcess);
 typedef BOOL(__stdcall *sym_cleanup_t)(IN HANDLE hProcess);
 typedef BOOL(__stdcall *sym_from_addr_t)(IN HANDLE hProcess, IN DWORD64 Address, OUT PDWORD64 Displacement, OUT PSYMBOL_INFO Symbol);
 typedef BOOL(__stdcall *sym_get_line_t)(IN HANDLE hProcess, IN DWORD64 dwAddr, OUT PDWORD pdwDisplacement, OUT PIMAGEHLP_LINE64 Symbol);
+#else
+struct callstack_unwind_state
+{
+	void** m_frames;
+	uint8_t m_max;
+	uint8_t m_skip;
+	uint8_t m_count;
+};
+
+// Run time address, the name points into the mapped file
+struct elf_symbol
+{
+	uintptr_t m_address;
+	uint64_t m_size;
+	const char* m_name;
+};
+
+// Loaded the first time an address lands in the module
+struct elf_module
+{
+	const void* m_base;
+	elf_symbol* m_symbols;
+	uint32_t m_symbol_count;
+};
+#endif
 
 //////////////////////////////////////////////////////
 //													//
 //					Definitions						//
 //													//
 //////////////////////////////////////////////////////
+static volatile uint8_t g_callstack_max_depth = MAX_FRAMES_PER_CALLSTACK;
+#if defined(_WIN32)
 const uint16_t MAX_SYMBOL_NAME_LENGTH = 128;
 const uint32_t MAX_FILENAME_LENGTH = 1024;
-const uint16_t MAX_DEPTH = 128;
 static HMODULE g_debug_help;
 static HANDLE g_process;
 static SYMBOL_INFO* g_symbol;
@@ -31,7 +78,16 @@ static sym_initialize_t g_sym_initialize;
 static sym_cleanup_t g_sym_cleanup;
 static sym_from_addr_t g_sym_from_addr;
 static sym_get_line_t g_sym_get_line_from_addr_64;
-static int g_callstack_count = 0;
+#else
+const uint32_t MAX_ELF_MODULES = 256;
+// Only touched by CallstackResolveAddress, under the symbolizer lock
+static elf_module g_elf_modules[MAX_ELF_MODULES];
+static uint32_t g_elf_module_count = 0;
+#if defined(CALLSTACK_FRAME_POINTERS)
+// One past the highest address of this thread's stack, 0 until looked up
+static thread_local uintptr_t g_callstack_stack_top = 0;
+#endif
+#endif
 
 //////////////////////////////////////////////////////
 //													//
@@ -42,6 +98,7 @@ CallStack::CallStack()
 	: m_hash(0)
 	, m_frame_count(0) {}
 
+#if defined(_WIN32)
 bool CallstackSystemInit()
 {
 	// Load the dll, similar to OpenGL function fecthing.
@@ -82,94 +139,386 @@ void CallstackSystemDeinit()
 	g_debug_help = NULL;
 }
 
-// Can not be static - called when
-// the callstack is freed.
-void DestroyCallstack(CallStack *ptr)
+// Frames only, into the caller's buffer, so it can run where nothing may be
+// allocated
+CALLSTACK_NOINLINE uint8_t CallstackCapture(void** out_frames, uint8_t max_frames, uint8_t skip_frames)
 {
-	::free(ptr);
+	return (uint8_t)CaptureStackBackTrace(1 + skip_frames, max_frames, out_frames, nullptr);
 }
 
-CallStack* CreateCallstack(uint8_t skip_frames)
+// Uncached, CallstackGetLines goes through the symbolizer instead
+bool CallstackResolveAddress(void* address, callstack_line_t* out_line)
 {
-	// Capture the callstack frames - uses a windows call
-	void *stack[MAX_DEPTH];
-	DWORD hash;
+	IMAGEHLP_LINE64 line_info;
+	DWORD line_offset = 0; // Displacement from the beginning of the line 
+	line_info.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
 
-	// skip_frames:  number of frames to skip [starting at the top - so don't return the frames for "CreateCallstack" (+1), plus "skip_frame_" layers.
-	// max_frames to return
-	// memory to put this information into.
-	// out pointer to back trace hash.
-	uint8_t frames = (uint8_t)CaptureStackBackTrace(1 + skip_frames, MAX_DEPTH, stack, &hash);
+	DWORD64 ptr = (DWORD64)address;
+	if (false == g_sym_from_addr(g_process, ptr, 0, g_symbol)) 
+	{
+		return false;
+	}
 
-	// create the callstack using an untracked allocation
-	CallStack *cs = (CallStack*) ::calloc(1, sizeof(CallStack));
+	strcpy_s(out_line->function_name, 256, g_symbol->Name);
 
-	// force call the constructor (new in-place)
-	//cs = new (cs) CallStack(); 
-	cs->m_hash = 0;
-	cs->m_frame_count = 0;
-	
+	BOOL bRet = g_sym_get_line_from_addr_64(
+		GetCurrentProcess(), // Process handle of the current process 
+		ptr,				 // Address 
+		&line_offset,		 // Displacement will be stored here by the function 
+		&line_info);         // File name / line information will be stored here 
 
-	// copy the frames to our callstack object
-	uint8_t frame_count = min(MAX_FRAMES_PER_CALLSTACK, frames);
-	cs->m_frame_count = frame_count;
-	::memcpy(cs->m_frames, stack, sizeof(void*) * frame_count);
+	if (bRet) 
+	{
+		out_line->line = line_info.LineNumber;
+		strcpy_s(out_line->file_name, 128, line_info.FileName);
+		out_line->offset = line_offset;
+	}
+	else {
+		// no information
+		out_line->line = 0;
+		out_line->offset = 0;
+		strcpy_s(out_line->file_name, 128, "N/A");
+	}
 
-	cs->m_time = GetCurrentTimeSeconds();
-	cs->m_hash = hash;
+	return true;
+}
+#else
+bool CallstackSystemInit() { return true; }
+void CallstackSystemDeinit() {}
 
-	return cs;
+#if defined(CALLSTACK_FRAME_POINTERS)
+static uintptr_t CallstackGetStackTop()
+{
+	if (0 == g_callstack_stack_top)
+	{
+		// Mallocs, but never through operator new, so the tracker can call it
+		void* stack_low = nullptr;
+		size_t stack_size = 0;
+		pthread_attr_t attributes;
+		if (0 == pthread_getattr_np(pthread_self(), &attributes))
+		{
+			pthread_attr_getstack(&attributes, &stack_low, &stack_size);
+			pthread_attr_destroy(&attributes);
+		}
+		// Unknown bounds break the chain at the first frame, for the unwinder
+		g_callstack_stack_top = (uintptr_t)stack_low + stack_size;
+	}
+	return g_callstack_stack_top;
+}
+#endif
+
+static _Unwind_Reason_Code CallstackUnwindFrame(struct _Unwind_Context* context, void* data)
+{
+	callstack_unwind_state* state = (callstack_unwind_state*)data;
+	uintptr_t address = (uintptr_t)_Unwind_GetIP(context);
+	if (0 == address)
+		return _URC_END_OF_STACK;
+
+	if (0 < state->m_skip)
+	{
+		--state->m_skip;
+		return _URC_NO_REASON;
+	}
+
+	state->m_frames[state->m_count++] = (void*)address;
+	return (state->m_count < state->m_max) ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+#if defined(CALLSTACK_FRAME_POINTERS)
+// Each frame starts with the caller's frame pointer and then the return
+// address, so the chain is followed without reading anything else.  It
+// stops early at a module built without frame pointers, like the C
+// library's start up; when the very first link is already broken the
+// caller was built without them, and the unwinder takes the capture over
+CALLSTACK_NOINLINE uint8_t CallstackCapture(void** out_frames, uint8_t max_frames, uint8_t skip_frames)
+{
+	uintptr_t stack_top = CallstackGetStackTop();
+	void** frame = (void**)__builtin_frame_address(0);
+	uint8_t frame_count = 0;
+	uint8_t skip_left = skip_frames;
+	uint32_t link_count = 0;
+
+	while (frame_count < max_frames)
+	{
+		void** next = (void**)frame[0];
+		void* return_address = frame[1];
+		if (nullptr == return_address)
+			break;
+
+		if (0 < skip_left)
+			--skip_left;
+		else
+			out_frames[frame_count++] = return_address;
+
+		// Frames only run toward the top of the stack
+		if (nullptr == next || next <= frame || 0 != ((uintptr_t)next & (sizeof(void*) - 1)) || (uintptr_t)(next + 2) > stack_top)
+			break;
+		frame = next;
+		++link_count;
+	}
+
+	if (0 != link_count || 0 == max_frames)
+		return frame_count;
+
+	// The unwinder's first frame is this function
+	callstack_unwind_state state = { out_frames, max_frames, (uint8_t)(1 + skip_frames), 0 };
+	_Unwind_Backtrace(&CallstackUnwindFrame, &state);
+	return state.m_count;
+}
+#else
+// The unwinder's first frame is this function, skipped like on Windows
+CALLSTACK_NOINLINE uint8_t CallstackCapture(void** out_frames, uint8_t max_frames, uint8_t skip_frames)
+{
+	if (0 == max_frames)
+		return 0;
+
+	callstack_unwind_state state = { out_frames, max_frames, (uint8_t)(1 + skip_frames), 0 };
+	_Unwind_Backtrace(&CallstackUnwindFrame, &state);
+	return state.m_count;
+}
+#endif
+
+static int CompareElfSymbols(const void* a, const void* b)
+{
+	uintptr_t a_address = ((const elf_symbol*)a)->m_address;
+	uintptr_t b_address = ((const elf_symbol*)b)->m_address;
+	return (a_address < b_address) ? -1 : (a_address > b_address) ? 1 : 0;
+}
+
+// The path dladdr gives the main program is argv[0], which may be relative
+static int CallstackOpenModule(const void* base, const char* path)
+{
+	int file = open(path, O_RDONLY | O_CLOEXEC);
+	if (0 <= file)
+		return file;
+
+	Dl_info main_info;
+	if (0 != dladdr((void*)getauxval(AT_PHDR), &main_info) && base == main_info.dli_fbase)
+		return open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+	return -1;
+}
+
+// Function symbols from .symtab, or .dynsym for stripped modules, sorted by
+// address.  The file stays mapped for the names.
+static void CallstackLoadElfSymbols(elf_module* module, const char* path)
+{
+	int file = CallstackOpenModule(module->m_base, path);
+	if (0 > file)
+		return;
+
+	struct stat file_status;
+	size_t file_size = (0 == fstat(file, &file_status)) ? (size_t)file_status.st_size : 0;
+	void* mapping = (sizeof(ElfW(Ehdr)) <= file_size) ? mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	close(file);
+	if (MAP_FAILED == mapping)
+		return;
+
+	const uint8_t* image = (const uint8_t*)mapping;
+	const ElfW(Ehdr)* header = (const ElfW(Ehdr)*)image;
+	const uint8_t elf_class = (8 == sizeof(void*)) ? ELFCLASS64 : ELFCLASS32;
+	if (0 != memcmp(header->e_ident, ELFMAG, SELFMAG) || elf_class != header->e_ident[EI_CLASS] ||
+		header->e_shoff + (size_t)header->e_shnum * sizeof(ElfW(Shdr)) > file_size ||
+		header->e_phoff + (size_t)header->e_phnum * sizeof(ElfW(Phdr)) > file_size)
+	{
+		munmap(mapping, file_size);
+		return;
+	}
+
+	// The module is mapped from its first load segment, page aligned
+	uintptr_t link_base = UINTPTR_MAX;
+	const ElfW(Phdr)* segments = (const ElfW(Phdr)*)(image + header->e_phoff);
+	for (uint32_t index = 0; index < header->e_phnum; ++index)
+	{
+		if (PT_LOAD == segments[index].p_type && segments[index].p_vaddr < link_base)
+			link_base = segments[index].p_vaddr;
+	}
+	uintptr_t bias = (uintptr_t)module->m_base - (link_base & ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1));
+
+	const ElfW(Shdr)* sections = (const ElfW(Shdr)*)(image + header->e_shoff);
+	const ElfW(Shdr)* table = nullptr;
+	for (uint32_t index = 0; index < header->e_shnum; ++index)
+	{
+		if (SHT_SYMTAB == sections[index].sh_type || (SHT_DYNSYM == sections[index].sh_type && nullptr == table))
+			table = &sections[index];
+	}
+
+	if (nullptr == table || table->sh_link >= header->e_shnum || table->sh_offset + table->sh_size > file_size ||
+		sections[table->sh_link].sh_offset + sections[table->sh_link].sh_size > file_size)
+	{
+		munmap(mapping, file_size);
+		return;
+	}
+
+	const ElfW(Shdr)* names = &sections[table->sh_link];
+	const ElfW(Sym)* symbols = (const ElfW(Sym)*)(image + table->sh_offset);
+	size_t symbol_count = table->sh_size / sizeof(ElfW(Sym));
+	module->m_symbols = (elf_symbol*) ::malloc((symbol_count + 1) * sizeof(elf_symbol));
+	for (size_t index = 0; index < symbol_count; ++index)
+	{
+		const ElfW(Sym)& symbol = symbols[index];
+		if (STT_FUNC != ELF64_ST_TYPE(symbol.st_info) || 0 == symbol.st_value || SHN_UNDEF == symbol.st_shndx || symbol.st_name >= names->sh_size)
+			continue;
+
+		elf_symbol& out = module->m_symbols[module->m_symbol_count++];
+		out.m_address = (uintptr_t)symbol.st_value + bias;
+		out.m_size = (uint64_t)symbol.st_size;
+		out.m_name = (const char*)(image + names->sh_offset + symbol.st_name);
+	}
+
+	::qsort(module->m_symbols, module->m_symbol_count, sizeof(elf_symbol), CompareElfSymbols);
+}
+
+static elf_module* CallstackGetElfModule(const void* base, const char* path)
+{
+	for (uint32_t index = 0; index < g_elf_module_count; ++index)
+	{
+		if (base == g_elf_modules[index].m_base)
+			return &g_elf_modules[index];
+	}
+
+	if (g_elf_module_count >= MAX_ELF_MODULES)
+		return nullptr;
+
+	elf_module* module = &g_elf_modules[g_elf_module_count++];
+	module->m_base = base;
+	CallstackLoadElfSymbols(module, path);
+	return module;
+}
+
+// The last symbol starting at or below address, if address is inside it
+static const elf_symbol* CallstackFindElfSymbol(const elf_module* module, uintptr_t address)
+{
+	uint32_t low = 0;
+	uint32_t high = module->m_symbol_count;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (module->m_symbols[middle].m_address <= address)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (0 == low)
+		return nullptr;
+
+	const elf_symbol* symbol = &module->m_symbols[low - 1];
+	if (0 != symbol->m_size && address >= symbol->m_address + symbol->m_size)
+		return nullptr;
+	return symbol;
 }
 
+// Uncached, CallstackGetLines goes through the symbolizer instead.  dladdr
+// finds the module and its exported symbols, the module's own symbol table
+// names the static and hidden functions dladdr can not.  There are no line
+// numbers, the file is the module the address is in.
+bool CallstackResolveAddress(void* address, callstack_line_t* out_line)
+{
+	Dl_info info;
+	if (0 == dladdr(address, &info))
+		return false;
+
+	const char* name = info.dli_sname;
+	uintptr_t symbol_address = (uintptr_t)info.dli_saddr;
+
+	// A return address can sit just past the end of a call to a function
+	// that never returns, one byte back is still inside the caller
+	elf_module* module = CallstackGetElfModule(info.dli_fbase, info.dli_fname);
+	const elf_symbol* symbol = (nullptr != module) ? CallstackFindElfSymbol(module, (uintptr_t)address - 1) : nullptr;
+	if (nullptr != symbol)
+	{
+		name = symbol->m_name;
+		symbol_address = symbol->m_address;
+	}
+
+	// Demangled with malloc, never through operator new
+	int status = -1;
+	char* demangled = (nullptr != name) ? abi::__cxa_demangle(name, nullptr, nullptr, &status) : nullptr;
+	snprintf(out_line->function_name, sizeof(out_line->function_name), "%s", (nullptr != demangled) ? demangled : (nullptr != name) ? name : "??");
+	::free(demangled);
+
+	snprintf(out_line->file_name, sizeof(out_line->file_name), "%s", (nullptr != info.dli_fname) ? info.dli_fname : "N/A");
+	out_line->line = 0;
+	out_line->offset = (uint32_t)((uintptr_t)address - ((0 != symbol_address) ? symbol_address : (uintptr_t)info.dli_fbase));
+	return true;
+}
+#endif
+
 // Fills lines with human readable data for the given callstack
 // Fills from top to bottom (top being most recently called, with each next one being the calling function of the previous)
+// Frames that can not be named are left out.
 //
 // Additional features you can add;
 // [ ] If a file exists in yoru src directory, clip the filename
 // [ ] Be able to specify a list of function names which will cause this trace to stop.
 uint16_t CallstackGetLines(callstack_line_t *line_buffer, const uint16_t max_lines, CallStack *cs)
 {
-	IMAGEHLP_LINE64 line_info;
-	DWORD line_offset = 0; // Displacement from the beginning of the line 
-	line_info.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
-
-
-	uint count = min(max_lines, cs->m_frame_count);
+	uint16_t count = (max_lines < cs->m_frame_count) ? max_lines : cs->m_frame_count;
 	uint16_t idx = 0;
 
-	for (uint i = 0; i < count; ++i) 
+	for (uint16_t i = 0; i < count; ++i)
 	{
-		callstack_line_t *line = &(line_buffer[idx]);
-		DWORD64 ptr = (DWORD64)(cs->m_frames[i]);
+		if (SymbolizerResolve(cs->m_frames[i], &line_buffer[idx]))
+			++idx;
+	}
 
-		if (false == g_sym_from_addr(g_process, ptr, 0, g_symbol)) 
-		{
-			continue;
-		}
+	return idx;
+}
+
+// Can not be static - called when
+// the callstack is freed.
+void DestroyCallstack(CallStack *ptr)
+{
+	::free(ptr);
+}
 
-		strcpy_s(line->function_name, 256, g_symbol->Name);
+// Sized to the frames captured, using an untracked allocation
+CallStack* CreateCallstack(uint8_t skip_frames)
+{
+	// Skips this function as well as skip_frames callers
+	void* frames[MAX_FRAMES_PER_CALLSTACK];
+	uint8_t frame_count = CallstackCapture(frames, CallstackGetMaxDepth(), 1 + skip_frames);
 
-		BOOL bRet = g_sym_get_line_from_addr_64(
-			GetCurrentProcess(), // Process handle of the current process 
-			ptr,				 // Address 
-			&line_offset,		 // Displacement will be stored here by the function 
-			&line_info);         // File name / line information will be stored here 
+	CallStack* cs = (CallStack*) ::calloc(1, offsetof(CallStack, m_frames) + frame_count * sizeof(void*));
+	cs->m_frame_count = frame_count;
+	::memcpy(cs->m_frames, frames, sizeof(void*) * frame_count);
+	cs->m_time = GetCurrentTimeSeconds();
+	cs->m_hash = CallstackHashFrames(frames, frame_count);
 
-		if (bRet) 
-		{
-			line->line = line_info.LineNumber;
-			strcpy_s(line->file_name, 128, line_info.FileName);
-			line->offset = line_offset;
-		}
-		else {
-			// no information
-			line->line = 0;
-			line->offset = 0;
-			strcpy_s(line->file_name, 128, "N/A");
-		}
+	return cs;
+}
 
-		++idx;
+// Mixes a whole frame address per step, finished with the murmur3 finalizer
+uint64_t CallstackHashFrames(void* const* frames, uint8_t frame_count)
+{
+	uint64_t hash = 0x9E3779B97F4A7C15ULL ^ frame_count;
+	for (uint8_t index = 0; index < frame_count; ++index)
+	{
+		hash ^= (uint64_t)(uintptr_t)frames[index];
+		hash *= 0xFF51AFD7ED558CCDULL;
+		hash ^= hash >> 32;
 	}
 
-	return idx;
-}
\ No newline at end of file
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+uint8_t CallstackGetMaxDepth() { return g_callstack_max_depth; }
+
+//////////////////////////////////////////////////////
+//													//
+//					Setters							//
+//													//
+//////////////////////////////////////////////////////
+// Clamped to [1, MAX_FRAMES_PER_CALLSTACK]
+void CallstackSetMaxDepth(uint8_t max_depth)
+{
+	g_callstack_max_depth = (0 == max_depth) ? 1 : (max_depth > MAX_FRAMES_PER_CALLSTACK) ? MAX_FRAMES_PER_CALLSTACK : max_depth;
+}
@@ -2,6 +2,23 @@
 #include <stdint.h>
 
 
+// Defines
+// Unoptimized builds always keep frame pointers; optimized ones built with
+// -fno-omit-frame-pointer define it themselves
+#if !defined(_WIN32) && !defined(CALLSTACK_FRAME_POINTERS) && !defined(__OPTIMIZE__)
+	#define CALLSTACK_FRAME_POINTERS
+#endif
+
+	// Capture takes the fastest walk the build allows.  Windows always asks
+	// CaptureStackBackTrace.  Elsewhere CALLSTACK_FRAME_POINTERS walks the
+	// saved frame pointer chain, which stops early at any module built
+	// without frame pointers, and hands the capture to the unwinder when the
+	// caller itself was; without it the unwinder reads the .eh_frame tables
+	// through _Unwind_Backtrace for every capture, which is about a hundred
+	// times slower per frame but needs nothing from the build.
+	// CallstackSetMaxDepth caps how many frames CreateCallstack and
+	// CallstackIntern keep.
+
 // Datatypes
 const uint8_t MAX_FRAMES_PER_CALLSTACK = 128;
 
@@ -13,12 +30,13 @@ struct callstack_line_t
 	uint32_t offset;
 };
 
+// Allocated to fit, only the first m_frame_count frames exist
 class CallStack
 {
 public:
 	CallStack();
 public:
-	uint32_t m_hash;
+	uint64_t m_hash;
 	uint8_t m_frame_count;
 	double m_time;
 	void* m_frames[MAX_FRAMES_PER_CALLSTACK];
@@ -29,5 +47,10 @@ public:
 bool CallstackSystemInit();
 void CallstackSystemDeinit();
 CallStack* CreateCallstack(uint8_t skip_frames);
+uint8_t CallstackCapture(void** out_frames, uint8_t max_frames, uint8_t skip_frames);
+uint64_t CallstackHashFrames(void* const* frames, uint8_t frame_count);
+uint8_t CallstackGetMaxDepth();
+void CallstackSetMaxDepth(uint8_t max_depth);
 void DestroyCallstack(CallStack *c);
-uint16_t CallstackGetLines(callstack_line_t *line_buffer, const uint16_t max_lines, CallStack *cs);
\ No newline at end of file
+uint16_t CallstackGetLines(callstack_line_t *line_buffer, const uint16_t max_lines, CallStack *cs);
+bool CallstackResolveAddress(void* address, callstack_line_t* out_line);
\ No newline at end of file
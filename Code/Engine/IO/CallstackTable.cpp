@@ -0,0 +1,147 @@
+#include "IO/CallstackTable.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Time/Utils.hpp"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct callstack_entry
+{
+	CallStack* m_stack;
+	// Next ID in the same bucket, CALLSTACK_INVALID_ID ends the chain
+	uint32_t m_next;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// Bucket heads hold ID + 1, so the zeroed table starts out empty
+static volatile uint32_t g_callstack_buckets[CALLSTACK_TABLE_BUCKETS];
+static callstack_entry* volatile g_callstack_pages[CALLSTACK_TABLE_MAX_PAGES];
+static volatile uint32_t g_callstack_interned_count = 0;
+// Stacks are packed back to back in blocks that are never freed
+static uint8_t* g_callstack_arena_cursor = nullptr;
+static uint8_t* g_callstack_arena_end = nullptr;
+// Only taken to add a stack
+static Mutex g_callstack_table_lock;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Taken under the table lock
+static void* CallstackArenaAlloc(size_t size)
+{
+	size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	if ((size_t)(g_callstack_arena_end - g_callstack_arena_cursor) < size)
+	{
+		g_callstack_arena_cursor = (uint8_t*) ::malloc(CALLSTACK_TABLE_ARENA_BLOCK);
+		g_callstack_arena_end = g_callstack_arena_cursor + CALLSTACK_TABLE_ARENA_BLOCK;
+	}
+
+	void* record = g_callstack_arena_cursor;
+	g_callstack_arena_cursor += size;
+	return record;
+}
+
+static inline callstack_entry* CallstackGetEntry(uint32_t id)
+{
+	callstack_entry* page = AtomicLoad(&g_callstack_pages[id / CALLSTACK_TABLE_PAGE_SIZE], ATOMIC_ACQUIRE);
+	return &page[id % CALLSTACK_TABLE_PAGE_SIZE];
+}
+
+static uint32_t CallstackFind(uint32_t bucket, uint64_t hash, void* const* frames, uint8_t frame_count)
+{
+	uint32_t id = AtomicLoad(&g_callstack_buckets[bucket], ATOMIC_ACQUIRE) - 1;
+	while (CALLSTACK_INVALID_ID != id)
+	{
+		callstack_entry* entry = CallstackGetEntry(id);
+		CallStack* stack = entry->m_stack;
+		if (hash == stack->m_hash && frame_count == stack->m_frame_count &&
+			0 == memcmp(stack->m_frames, frames, frame_count * sizeof(void*)))
+		{
+			return id;
+		}
+		id = entry->m_next;
+	}
+
+	return CALLSTACK_INVALID_ID;
+}
+
+uint32_t CallstackInternFrames(void* const* frames, uint8_t frame_count)
+{
+	uint64_t hash = CallstackHashFrames(frames, frame_count);
+	uint32_t bucket = (uint32_t)(hash & (CALLSTACK_TABLE_BUCKETS - 1));
+
+	uint32_t id = CallstackFind(bucket, hash, frames, frame_count);
+	if (CALLSTACK_INVALID_ID != id)
+		return id;
+
+	SCOPE_LOCK(&g_callstack_table_lock);
+
+	// Someone may have added it since the lookup
+	id = CallstackFind(bucket, hash, frames, frame_count);
+	if (CALLSTACK_INVALID_ID != id)
+		return id;
+
+	id = AtomicLoad(&g_callstack_interned_count, ATOMIC_RELAXED);
+	uint32_t page_index = id / CALLSTACK_TABLE_PAGE_SIZE;
+	if (page_index >= CALLSTACK_TABLE_MAX_PAGES)
+		return CALLSTACK_INVALID_ID;
+
+	if (nullptr == g_callstack_pages[page_index])
+	{
+		callstack_entry* page = (callstack_entry*) ::calloc(CALLSTACK_TABLE_PAGE_SIZE, sizeof(callstack_entry));
+		AtomicStore(&g_callstack_pages[page_index], page, ATOMIC_RELEASE);
+	}
+
+	// Only as many frames as it has, the rest of m_frames is never read
+	size_t stack_size = offsetof(CallStack, m_frames) + frame_count * sizeof(void*);
+	CallStack* stack = (CallStack*)CallstackArenaAlloc(stack_size);
+	stack->m_hash = hash;
+	stack->m_frame_count = frame_count;
+	stack->m_time = GetCurrentTimeSeconds();
+	memcpy(stack->m_frames, frames, frame_count * sizeof(void*));
+
+	callstack_entry* entry = CallstackGetEntry(id);
+	entry->m_stack = stack;
+	entry->m_next = AtomicLoad(&g_callstack_buckets[bucket], ATOMIC_RELAXED) - 1;
+
+	// The entry is complete before either store makes it reachable
+	AtomicStore(&g_callstack_buckets[bucket], id + 1, ATOMIC_RELEASE);
+	AtomicStore(&g_callstack_interned_count, id + 1, ATOMIC_RELEASE);
+	return id;
+}
+
+uint32_t CallstackIntern(uint8_t skip_frames)
+{
+	void* frames[MAX_FRAMES_PER_CALLSTACK];
+	uint8_t frame_count = CallstackCapture(frames, CallstackGetMaxDepth(), 1 + skip_frames);
+	return CallstackInternFrames(frames, frame_count);
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+CallStack* CallstackGetInterned(uint32_t id)
+{
+	if (id >= AtomicLoad(&g_callstack_interned_count, ATOMIC_ACQUIRE))
+		return nullptr;
+	return CallstackGetEntry(id)->m_stack;
+}
+
+uint32_t CallstackGetInternedCount()
+{
+	return AtomicLoad(&g_callstack_interned_count, ATOMIC_ACQUIRE);
+}
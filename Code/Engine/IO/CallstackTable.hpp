@@ -0,0 +1,28 @@
+#pragma once
+#include "IO/Callstack.hpp"
+
+// Defines
+#define CALLSTACK_TABLE_BUCKETS     (16384)
+#define CALLSTACK_TABLE_PAGE_SIZE   (1024)
+#define CALLSTACK_TABLE_MAX_PAGES   (256)
+#define CALLSTACK_TABLE_ARENA_BLOCK (64 * 1024)
+#define CALLSTACK_INVALID_ID        (0xFFFFFFFFu)
+
+	// Intern table for callstacks.  Each distinct stack is stored once, keyed
+	// by a hash of its frames plus the frames themselves, and named by a 32 bit
+	// ID handed out in order from 0.  A stack is never removed, so an ID stays
+	// valid, and CallstackGetInterned is a plain read from any thread.  Lookups
+	// of stacks already in the table take no lock; only adding a new one does.
+	// Stacks are packed into arena blocks of CALLSTACK_TABLE_ARENA_BLOCK bytes,
+	// each taking only the frames it has.  The table allocates with malloc and
+	// never through operator new, so the allocation tracker can intern from
+	// inside it.  m_time of an interned
+	// stack is when it was first seen.  Stacks past
+	// CALLSTACK_TABLE_PAGE_SIZE * CALLSTACK_TABLE_MAX_PAGES get
+	// CALLSTACK_INVALID_ID.
+
+// Functions
+uint32_t CallstackIntern(uint8_t skip_frames);
+uint32_t CallstackInternFrames(void* const* frames, uint8_t frame_count);
+CallStack* CallstackGetInterned(uint32_t id);
+uint32_t CallstackGetInternedCount();
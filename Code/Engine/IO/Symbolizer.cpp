@@ -0,0 +1,239 @@
+#include "IO/Symbolizer.hpp"
+#include "IO/CallstackTable.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Futex.hpp"
+#include "Multithreading/Mutex.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct symbol_entry
+{
+	callstack_line_t m_line;
+	bool m_found;
+};
+
+// An empty slot has no address, nullptr is never looked up
+struct symbol_slot
+{
+	void* m_address;
+	symbol_entry* m_entry;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// Open addressed, a power of two in size and at most half full
+static symbol_slot* g_symbol_slots = nullptr;
+static uint32_t g_symbol_capacity = 0;
+static uint32_t g_symbol_count = 0;
+static Mutex g_symbolizer_lock;
+
+// Interned stacks below this were handed to a pass already
+static volatile uint32_t g_symbolizer_scanned = 0;
+static thread_handle g_symbolizer_thread = INVALID_THREAD_HANDLE;
+static volatile U32 g_symbolizer_running = 0;
+static volatile U32 g_symbolizer_wake = 0;
+static uint32_t g_symbolizer_interval_ms = SYMBOLIZER_INTERVAL_DEFAULT;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static inline uint32_t SymbolizerHash(void* address)
+{
+	uint64_t value = (uint64_t)(uintptr_t)address;
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDULL;
+	value ^= value >> 33;
+	return (uint32_t)value;
+}
+
+// The slot holding address, or the empty one it would go in
+static symbol_slot* SymbolizerFindSlot(symbol_slot* slots, uint32_t capacity, void* address)
+{
+	uint32_t mask = capacity - 1;
+	for (uint32_t index = SymbolizerHash(address) & mask;; index = (index + 1) & mask)
+	{
+		symbol_slot* slot = &slots[index];
+		if (address == slot->m_address || nullptr == slot->m_address)
+			return slot;
+	}
+}
+
+static void SymbolizerGrow()
+{
+	uint32_t capacity = (0 == g_symbol_capacity) ? SYMBOLIZER_INITIAL_CAPACITY : g_symbol_capacity * 2;
+	symbol_slot* slots = (symbol_slot*) ::calloc(capacity, sizeof(symbol_slot));
+
+	for (uint32_t index = 0; index < g_symbol_capacity; ++index)
+	{
+		if (nullptr != g_symbol_slots[index].m_address)
+			*SymbolizerFindSlot(slots, capacity, g_symbol_slots[index].m_address) = g_symbol_slots[index];
+	}
+
+	::free(g_symbol_slots);
+	g_symbol_slots = slots;
+	g_symbol_capacity = capacity;
+}
+
+// Taken under the lock, entries never move once made
+static symbol_entry* SymbolizerGetEntry(void* address)
+{
+	if ((g_symbol_count + 1) * 2 > g_symbol_capacity)
+		SymbolizerGrow();
+
+	symbol_slot* slot = SymbolizerFindSlot(g_symbol_slots, g_symbol_capacity, address);
+	if (nullptr != slot->m_address)
+		return slot->m_entry;
+
+	symbol_entry* entry = (symbol_entry*) ::calloc(1, sizeof(symbol_entry));
+	entry->m_found = CallstackResolveAddress(address, &entry->m_line);
+	slot->m_address = address;
+	slot->m_entry = entry;
+	++g_symbol_count;
+	return entry;
+}
+
+static int CompareAddresses(const void* a, const void* b)
+{
+	uintptr_t a_address = (uintptr_t)*(void* const*)a;
+	uintptr_t b_address = (uintptr_t)*(void* const*)b;
+	return (a_address < b_address) ? -1 : (a_address > b_address) ? 1 : 0;
+}
+
+static void SymbolizerThreadMain(void*)
+{
+	while (0 != AtomicLoad(&g_symbolizer_running, ATOMIC_ACQUIRE))
+	{
+		SymbolizerResolveInterned();
+		FutexWait(&g_symbolizer_wake, 0, g_symbolizer_interval_ms);
+	}
+}
+
+bool SymbolizerResolve(void* address, callstack_line_t* out_line)
+{
+	if (nullptr == address)
+		return false;
+
+	SCOPE_LOCK(&g_symbolizer_lock);
+	symbol_entry* entry = SymbolizerGetEntry(address);
+	if (!entry->m_found)
+		return false;
+
+	*out_line = entry->m_line;
+	return true;
+}
+
+// Sorted so each unique address is looked up once, and neighbours in the
+// same module one after another.  The lock is taken per address, so reports
+// on other threads are never held up for the whole batch.
+void SymbolizerResolveBatch(void* const* addresses, uint32_t address_count)
+{
+	if (0 == address_count)
+		return;
+
+	void** sorted = (void**) ::malloc(address_count * sizeof(void*));
+	memcpy(sorted, addresses, address_count * sizeof(void*));
+	::qsort(sorted, address_count, sizeof(void*), CompareAddresses);
+
+	for (uint32_t index = 0; index < address_count; ++index)
+	{
+		if ((0 < index && sorted[index] == sorted[index - 1]) || nullptr == sorted[index])
+			continue;
+
+		SCOPE_LOCK(&g_symbolizer_lock);
+		SymbolizerGetEntry(sorted[index]);
+	}
+
+	::free(sorted);
+}
+
+void SymbolizerResolveStacks(CallStack* const* stacks, uint32_t stack_count)
+{
+	uint32_t address_count = 0;
+	for (uint32_t index = 0; index < stack_count; ++index)
+	{
+		address_count += (nullptr != stacks[index]) ? stacks[index]->m_frame_count : 0;
+	}
+
+	void** addresses = (void**) ::malloc((address_count + 1) * sizeof(void*));
+	address_count = 0;
+	for (uint32_t index = 0; index < stack_count; ++index)
+	{
+		if (nullptr == stacks[index])
+			continue;
+
+		memcpy(&addresses[address_count], stacks[index]->m_frames, stacks[index]->m_frame_count * sizeof(void*));
+		address_count += stacks[index]->m_frame_count;
+	}
+
+	SymbolizerResolveBatch(addresses, address_count);
+	::free(addresses);
+}
+
+// Only the stacks interned since the last pass, whichever thread ran it
+void SymbolizerResolveInterned()
+{
+	uint32_t end = CallstackGetInternedCount();
+	uint32_t begin = AtomicLoad(&g_symbolizer_scanned, ATOMIC_RELAXED);
+	while (begin < end && !AtomicCompareExchange(&g_symbolizer_scanned, &begin, end, ATOMIC_RELAXED)) {}
+	if (begin >= end)
+		return;
+
+	CallStack** stacks = (CallStack**) ::malloc((end - begin) * sizeof(CallStack*));
+	for (uint32_t stack_id = begin; stack_id < end; ++stack_id)
+	{
+		stacks[stack_id - begin] = CallstackGetInterned(stack_id);
+	}
+
+	SymbolizerResolveStacks(stacks, end - begin);
+	::free(stacks);
+}
+
+bool SymbolizerStartThread(uint32_t interval_ms /*= SYMBOLIZER_INTERVAL_DEFAULT*/)
+{
+	if (INVALID_THREAD_HANDLE != g_symbolizer_thread)
+		return true;
+
+	g_symbolizer_interval_ms = interval_ms;
+	AtomicStore(&g_symbolizer_wake, 0U, ATOMIC_RELAXED);
+	AtomicStore(&g_symbolizer_running, 1U, ATOMIC_RELEASE);
+
+	thread_options options;
+	options.m_name = L"Symbolizer";
+	options.m_priority = THREAD_PRIO_LOWEST;
+	g_symbolizer_thread = ThreadCreate(SymbolizerThreadMain, nullptr, options);
+	return INVALID_THREAD_HANDLE != g_symbolizer_thread;
+}
+
+void SymbolizerStopThread()
+{
+	if (INVALID_THREAD_HANDLE == g_symbolizer_thread)
+		return;
+
+	AtomicStore(&g_symbolizer_running, 0U, ATOMIC_RELEASE);
+	AtomicStore(&g_symbolizer_wake, 1U, ATOMIC_RELEASE);
+	FutexWakeAll(&g_symbolizer_wake);
+	ThreadJoin(g_symbolizer_thread);
+	g_symbolizer_thread = INVALID_THREAD_HANDLE;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+uint32_t SymbolizerGetCachedCount()
+{
+	SCOPE_LOCK(&g_symbolizer_lock);
+	return g_symbol_count;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "IO/Callstack.hpp"
+
+// Defines
+#define SYMBOLIZER_INITIAL_CAPACITY (4096)
+#define SYMBOLIZER_INTERVAL_DEFAULT (250)
+
+	// Caches what CallstackResolveAddress says about each address, so a frame
+	// shared by thousands of stacks is only looked up once.  Addresses the
+	// platform can not name are cached as misses too.  CallstackGetLines goes
+	// through the cache, so reports get it without changes.
+	//
+	// A report can resolve every address it is about to print up front with
+	// SymbolizerResolveStacks or SymbolizerResolveInterned, which look each
+	// unique address up once, in address order.  The background thread does
+	// the same for stacks interned since its last pass, every interval, so most
+	// frames are already named when a report runs.  Start and stop it from one
+	// thread, and stop it before CallstackSystemDeinit.
+	//
+	// Every lookup takes one lock, which also keeps the platform backend, that
+	// is not thread safe on either platform, to one caller at a time.  Cached
+	// entries are never freed.
+
+// Functions
+bool SymbolizerResolve(void* address, callstack_line_t* out_line);
+void SymbolizerResolveBatch(void* const* addresses, uint32_t address_count);
+void SymbolizerResolveStacks(CallStack* const* stacks, uint32_t stack_count);
+void SymbolizerResolveInterned();
+bool SymbolizerStartThread(uint32_t interval_ms = SYMBOLIZER_INTERVAL_DEFAULT);
+void SymbolizerStopThread();
+uint32_t SymbolizerGetCachedCount();
@@ -0,0 +1,325 @@
+#include "Memory/AllocationTrace.hpp"
+#include "IO/CallstackTable.hpp"
+#include "IO/Symbolizer.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+// The lock is only ever contended by a flush from AllocTraceStop, or by the
+// threads sharing the last buffer
+struct alloc_trace_buffer
+{
+	Mutex m_lock;
+	uint8_t* m_data;
+	uint32_t m_used;
+	uint32_t m_thread;
+	uint64_t m_lastTicks;
+	volatile uint32_t m_claimed;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// Room for the largest event, five varints and the record byte
+const uint32_t ALLOC_TRACE_MAX_EVENT = 1 + 5 * 10;
+const uint32_t ALLOC_TRACE_MAX_STACK_RECORD = 1 + 2 * 10 + MAX_FRAMES_PER_CALLSTACK * 10;
+
+volatile uint32_t g_alloc_trace_active = 0;
+
+// Threads past the others share the last buffer through its lock
+static alloc_trace_buffer g_alloc_trace_buffers[ALLOC_TRACE_MAX_THREADS + 1];
+static alloc_trace_buffer* const g_alloc_trace_shared = &g_alloc_trace_buffers[ALLOC_TRACE_MAX_THREADS];
+static volatile uint32_t g_alloc_trace_thread_count = 0;
+
+// Taken after a buffer lock, never before one
+static Mutex g_alloc_trace_file_lock;
+static FILE* g_alloc_trace_file = nullptr;
+static uint64_t g_alloc_trace_start_ticks = 0;
+static uint32_t g_alloc_trace_stacks_written = 0;
+
+static thread_local alloc_trace_buffer* g_alloc_trace_buffer = nullptr;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static inline uint8_t* AllocTraceWriteVarint(uint8_t* out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
+
+static void AllocTraceWriteString(FILE* file, const char* text)
+{
+	uint8_t length[10];
+	size_t text_length = strlen(text);
+	fwrite(length, 1, AllocTraceWriteVarint(length, text_length) - length, file);
+	fwrite(text, 1, text_length, file);
+}
+
+// File lock held.  Stacks are interned in ID order, so everything up to the
+// current count covers any ID a chunk being written can use.
+static void AllocTraceWriteNewStacks()
+{
+	uint8_t record[ALLOC_TRACE_MAX_STACK_RECORD];
+	uint32_t stack_count = CallstackGetInternedCount();
+	for (uint32_t stack_id = g_alloc_trace_stacks_written; stack_id < stack_count; ++stack_id)
+	{
+		CallStack* stack = CallstackGetInterned(stack_id);
+
+		uint8_t* out = record;
+		*out++ = ALLOC_TRACE_STACK;
+		out = AllocTraceWriteVarint(out, stack_id);
+		out = AllocTraceWriteVarint(out, stack->m_frame_count);
+		for (uint8_t frame = 0; frame < stack->m_frame_count; ++frame)
+		{
+			out = AllocTraceWriteVarint(out, (uint64_t)(uintptr_t)stack->m_frames[frame]);
+		}
+
+		fwrite(record, 1, out - record, g_alloc_trace_file);
+	}
+
+	g_alloc_trace_stacks_written = stack_count;
+}
+
+// Buffer lock held
+static void AllocTraceFlush(alloc_trace_buffer* buffer)
+{
+	if (0 != buffer->m_used)
+	{
+		SCOPE_LOCK(&g_alloc_trace_file_lock);
+		if (nullptr != g_alloc_trace_file)
+		{
+			AllocTraceWriteNewStacks();
+
+			uint8_t header[9];
+			header[0] = ALLOC_TRACE_CHUNK;
+			memcpy(header + 1, &buffer->m_thread, sizeof(uint32_t));
+			memcpy(header + 5, &buffer->m_used, sizeof(uint32_t));
+			fwrite(header, 1, sizeof(header), g_alloc_trace_file);
+			fwrite(buffer->m_data, 1, buffer->m_used, g_alloc_trace_file);
+		}
+	}
+
+	buffer->m_used = 0;
+	buffer->m_lastTicks = g_alloc_trace_start_ticks;
+}
+
+static alloc_trace_buffer* AllocTraceClaimBuffer()
+{
+	for (uint32_t index = 0; index < ALLOC_TRACE_MAX_THREADS; ++index)
+	{
+		alloc_trace_buffer* buffer = &g_alloc_trace_buffers[index];
+		uint32_t expected = 0;
+		if (0 != AtomicLoad(&buffer->m_claimed, ATOMIC_RELAXED) || !AtomicCompareExchange(&buffer->m_claimed, &expected, 1U, ATOMIC_ACQUIRE))
+			continue;
+
+		uint32_t count = AtomicLoad(&g_alloc_trace_thread_count, ATOMIC_RELAXED);
+		while (count < index + 1 && !AtomicCompareExchange(&g_alloc_trace_thread_count, &count, index + 1, ATOMIC_RELEASE)) {}
+
+		// Kept by the slot once made, the next thread to claim it reuses it
+		if (nullptr == buffer->m_data)
+			buffer->m_data = (uint8_t*) ::malloc(ALLOC_TRACE_BUFFER_SIZE);
+		buffer->m_thread = index;
+		return buffer;
+	}
+
+	g_alloc_trace_shared->m_thread = ALLOC_TRACE_MAX_THREADS;
+	return g_alloc_trace_shared;
+}
+
+// Returns the buffer locked, with room for one more event; nullptr once the
+// trace has stopped
+static alloc_trace_buffer* AllocTraceBeginEvent()
+{
+	alloc_trace_buffer* buffer = g_alloc_trace_buffer;
+	if (nullptr == buffer)
+	{
+		buffer = AllocTraceClaimBuffer();
+		g_alloc_trace_buffer = buffer;
+	}
+
+	// Plain Lock, SCOPE_LOCK would send every event through the lock profiler
+	buffer->m_lock.Lock();
+
+	// Read under the lock, AllocTraceStop clears it before flushing buffers
+	if (0 == AtomicLoad(&g_alloc_trace_active, ATOMIC_ACQUIRE))
+	{
+		buffer->m_lock.Unlock();
+		return nullptr;
+	}
+
+	if (nullptr == buffer->m_data)
+		buffer->m_data = (uint8_t*) ::malloc(ALLOC_TRACE_BUFFER_SIZE);
+	if (buffer->m_used + ALLOC_TRACE_MAX_EVENT > ALLOC_TRACE_BUFFER_SIZE)
+		AllocTraceFlush(buffer);
+
+	return buffer;
+}
+
+static uint8_t* AllocTraceWriteTicks(alloc_trace_buffer* buffer, uint8_t* out)
+{
+	uint64_t ticks = TimeGetOpCount();
+	uint64_t delta = (ticks > buffer->m_lastTicks) ? ticks - buffer->m_lastTicks : 0;
+	buffer->m_lastTicks += delta;
+	return AllocTraceWriteVarint(out, delta);
+}
+
+void AllocTraceRecordAlloc(const void* address, uint64_t size, uint32_t stack_id)
+{
+	alloc_trace_buffer* buffer = AllocTraceBeginEvent();
+	if (nullptr == buffer)
+		return;
+
+	uint8_t* start = buffer->m_data + buffer->m_used;
+	uint8_t* out = start;
+	*out++ = ALLOC_TRACE_ALLOC;
+	out = AllocTraceWriteTicks(buffer, out);
+	out = AllocTraceWriteVarint(out, (uint64_t)(uintptr_t)address);
+	out = AllocTraceWriteVarint(out, size);
+	out = AllocTraceWriteVarint(out, (uint64_t)stack_id + 1);
+	buffer->m_used += (uint32_t)(out - start);
+
+	buffer->m_lock.Unlock();
+}
+
+void AllocTraceRecordFree(const void* address)
+{
+	alloc_trace_buffer* buffer = AllocTraceBeginEvent();
+	if (nullptr == buffer)
+		return;
+
+	uint8_t* start = buffer->m_data + buffer->m_used;
+	uint8_t* out = start;
+	*out++ = ALLOC_TRACE_FREE;
+	out = AllocTraceWriteTicks(buffer, out);
+	out = AllocTraceWriteVarint(out, (uint64_t)(uintptr_t)address);
+	buffer->m_used += (uint32_t)(out - start);
+
+	buffer->m_lock.Unlock();
+}
+
+// Called on thread exit by the allocation tracker
+void AllocTraceThreadRelease()
+{
+	alloc_trace_buffer* buffer = g_alloc_trace_buffer;
+	g_alloc_trace_buffer = g_alloc_trace_shared;
+	if (nullptr == buffer || g_alloc_trace_shared == buffer)
+		return;
+
+	buffer->m_lock.Lock();
+	AllocTraceFlush(buffer);
+	buffer->m_lock.Unlock();
+	AtomicStore(&buffer->m_claimed, 0U, ATOMIC_RELEASE);
+}
+
+bool AllocTraceStart(const char* file_path)
+{
+	SCOPE_LOCK(&g_alloc_trace_file_lock);
+	if (nullptr != g_alloc_trace_file)
+		return false;
+
+	FILE* file = fopen(file_path, "wb");
+	if (nullptr == file)
+		return false;
+
+	uint32_t version = ALLOC_TRACE_VERSION;
+	uint32_t pointer_size = (uint32_t)sizeof(void*);
+	uint64_t ticks_per_second = TimeOpCountFrom_ms(1000.0);
+	g_alloc_trace_start_ticks = TimeGetOpCount();
+	fwrite(ALLOC_TRACE_MAGIC, 1, 8, file);
+	fwrite(&version, sizeof(version), 1, file);
+	fwrite(&pointer_size, sizeof(pointer_size), 1, file);
+	fwrite(&ticks_per_second, sizeof(ticks_per_second), 1, file);
+	fwrite(&g_alloc_trace_start_ticks, sizeof(g_alloc_trace_start_ticks), 1, file);
+
+	// Buffers are empty since the last stop, only their time base is stale
+	for (uint32_t index = 0; index <= ALLOC_TRACE_MAX_THREADS; ++index)
+	{
+		g_alloc_trace_buffers[index].m_lastTicks = g_alloc_trace_start_ticks;
+	}
+
+	g_alloc_trace_file = file;
+	g_alloc_trace_stacks_written = 0;
+	AtomicStore(&g_alloc_trace_active, 1U, ATOMIC_RELEASE);
+	return true;
+}
+
+void AllocTraceStop()
+{
+	AtomicStore(&g_alloc_trace_active, 0U, ATOMIC_SEQ_CST);
+
+	// Anyone mid event finishes it before we get the lock
+	uint32_t thread_count = AtomicLoad(&g_alloc_trace_thread_count, ATOMIC_ACQUIRE);
+	for (uint32_t index = 0; index < thread_count; ++index)
+	{
+		alloc_trace_buffer* buffer = &g_alloc_trace_buffers[index];
+		buffer->m_lock.Lock();
+		AllocTraceFlush(buffer);
+		buffer->m_lock.Unlock();
+	}
+	g_alloc_trace_shared->m_lock.Lock();
+	AllocTraceFlush(g_alloc_trace_shared);
+	g_alloc_trace_shared->m_lock.Unlock();
+
+	SCOPE_LOCK(&g_alloc_trace_file_lock);
+	if (nullptr == g_alloc_trace_file)
+		return;
+
+	AllocTraceWriteNewStacks();
+
+	// Each stack is symbolized once here, however many events named it
+	SymbolizerResolveInterned();
+	callstack_line_t* lines = (callstack_line_t*) ::malloc(MAX_FRAMES_PER_CALLSTACK * sizeof(callstack_line_t));
+	for (uint32_t stack_id = 0; stack_id < g_alloc_trace_stacks_written; ++stack_id)
+	{
+		uint16_t line_count = CallstackGetLines(lines, MAX_FRAMES_PER_CALLSTACK, CallstackGetInterned(stack_id));
+
+		uint8_t record[21];
+		uint8_t* out = record;
+		*out++ = ALLOC_TRACE_SYMBOLS;
+		out = AllocTraceWriteVarint(out, stack_id);
+		out = AllocTraceWriteVarint(out, line_count);
+		fwrite(record, 1, out - record, g_alloc_trace_file);
+
+		for (uint16_t line = 0; line < line_count; ++line)
+		{
+			AllocTraceWriteString(g_alloc_trace_file, lines[line].function_name);
+			AllocTraceWriteString(g_alloc_trace_file, lines[line].file_name);
+			out = AllocTraceWriteVarint(record, lines[line].line);
+			fwrite(record, 1, out - record, g_alloc_trace_file);
+		}
+	}
+	::free(lines);
+
+	uint8_t end = ALLOC_TRACE_END;
+	fwrite(&end, 1, 1, g_alloc_trace_file);
+	fclose(g_alloc_trace_file);
+	g_alloc_trace_file = nullptr;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+bool AllocTraceIsRunning()
+{
+	return 0 != AtomicLoad(&g_alloc_trace_active, ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+// Defines
+#define ALLOC_TRACE_MAGIC        "SLVGALOC"
+#define ALLOC_TRACE_VERSION      (1)
+#define ALLOC_TRACE_BUFFER_SIZE  (64 * 1024)
+#define ALLOC_TRACE_MAX_THREADS  (256)
+
+	// Streams every allocation and free to a file while running, for the
+	// AllocTrace analyzer in Code/Tools to rebuild the heap over time.  Events
+	// are appended to a buffer owned by the thread and written out as one
+	// chunk when it fills, when the thread exits, and on stop, so the file is
+	// only touched once per ALLOC_TRACE_BUFFER_SIZE bytes of events.  Chunks
+	// from different threads interleave, the analyzer merges them by time.
+	// Allocations name their callstack by interned ID, and each stack's frames
+	// are written once, ahead of the first chunk that can refer to it.  On stop
+	// every stack is symbolized once and the names are appended.
+	//
+	// File layout, little endian, V is an unsigned LEB128 varint:
+	//   header  magic[8] version:u32 pointer_size:u32 ticks_per_second:u64 start_ticks:u64
+	//   stack   ALLOC_TRACE_STACK id:V frame_count:V frame:V...
+	//   chunk   ALLOC_TRACE_CHUNK thread:u32 byte_count:u32 event...
+	//   symbols ALLOC_TRACE_SYMBOLS id:V line_count:V (function:str file:str line:V)...
+	//   end     ALLOC_TRACE_END
+	// with str a V length then the bytes.  Inside a chunk
+	//   alloc   ALLOC_TRACE_ALLOC ticks:V address:V size:V stack_id + 1:V
+	//   free    ALLOC_TRACE_FREE ticks:V address:V
+	// where ticks are TimeGetOpCount ticks since the previous event of the
+	// chunk, or since start for the first, and stack 0 means none.
+
+// Datatypes
+// One byte ahead of every record
+enum alloc_trace_record
+{
+	ALLOC_TRACE_STACK = 1,
+	ALLOC_TRACE_CHUNK = 2,
+	ALLOC_TRACE_SYMBOLS = 3,
+	ALLOC_TRACE_END = 4,
+	ALLOC_TRACE_ALLOC = 5,
+	ALLOC_TRACE_FREE = 6
+};
+
+// Checked by operator new and delete before anything else is done
+extern volatile uint32_t g_alloc_trace_active;
+
+// Functions
+bool AllocTraceStart(const char* file_path);
+void AllocTraceStop();
+bool AllocTraceIsRunning();
+void AllocTraceRecordAlloc(const void* address, uint64_t size, uint32_t stack_id);
+void AllocTraceRecordFree(const void* address);
+void AllocTraceThreadRelease();
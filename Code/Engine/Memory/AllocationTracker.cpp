@@ -1,7 +1,17 @@
-#include "Memory\AllocationTracker.hpp"
-#include "IO\Callstack.hpp"
-#include "Time\Utils.hpp"
+#include "Memory/AllocationTracker.hpp"
+#include "Memory/AllocationTrace.hpp"
+#include "Memory/MemoryTag.hpp"
+#include "IO/CallstackTable.hpp"
+#include "IO/Symbolizer.hpp"
+#include "Time/Utils.hpp"
+#include "Multithreading/Atomic.hpp"
+#if defined(_WIN32)
+	#include <intrin.h>
+#endif
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 // #TODO Remove std::string
 
@@ -10,10 +20,10 @@
 //					  Macros						//
 //													//
 //////////////////////////////////////////////////////
-#define convertToKiB(size) size / 1024UL
-#define convertToMiB(size) size / (1024UL * 1024UL)
-#define convertToGiB(size) size / (1024UL * 1024UL * 1024UL)
-#define convertToReadableBytes(size) ((uint32_t)size > (2UL * 1024UL) && (uint32_t)size < (2UL * 1024UL * 1024UL)) ? (float)size * (float)convertToKiB(1) : ((uint32_t)size > (2UL * 1024UL * 1024UL) && (uint32_t)size < (2UL * 1024UL * 1024UL * 1024UL)) ? (float)size * (float)convertToMiB(1) : ((uint32_t)size > (2UL * 1024UL * 1024UL * 1024UL)) ? (float)size * (float)convertToGiB(1) : (float)size
+#define convertToKiB(size) ((double)(size) / 1024.0)
+#define convertToMiB(size) ((double)(size) / (1024.0 * 1024.0))
+#define convertToGiB(size) ((double)(size) / (1024.0 * 1024.0 * 1024.0))
+#define convertToReadableBytes(size) (float)(((uint64_t)(size) > (2ULL * 1024ULL) && (uint64_t)(size) < (2ULL * 1024ULL * 1024ULL)) ? convertToKiB(size) : ((uint64_t)(size) > (2ULL * 1024ULL * 1024ULL) && (uint64_t)(size) < (2ULL * 1024ULL * 1024ULL * 1024ULL)) ? convertToMiB(size) : ((uint64_t)(size) > (2ULL * 1024ULL * 1024ULL * 1024ULL)) ? convertToGiB(size) : (double)(size))
 
 
 //////////////////////////////////////////////////////
@@ -21,203 +31,597 @@
 //					Definitions						//
 //													//
 //////////////////////////////////////////////////////
-struct callstack_list // Treat as Linked List
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Counters for the threads that allocate, one shard per thread so operator new
+//	never writes memory another thread writes.  Each shard only counts up, and
+//	the getters sum every shard, so a free on another thread than the allocation
+//	simply lands in that thread's shard.  Live totals for the high water are
+//	handed to the globals in batches.  Threads past ALLOC_MAX_SHARDS share the
+//	last shard through atomic adds, and a shard is passed on to a new thread
+//	once its owner exits.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+struct alignas(64) alloc_shard
 {
-	CallStack* current_stack = nullptr;
-	uint16_t total_allocation = 0;
-	callstack_list* next = nullptr;
+	// Only written by the owner, relaxed stores keep them whole for readers
+	uint64_t m_allocs;
+	uint64_t m_frees;
+	uint64_t m_bytesAllocated;
+	uint64_t m_bytesFreed;
+	uint64_t m_largest;
+	// Not yet added to the global live totals
+	int64_t m_pendingCount;
+	int64_t m_pendingBytes;
+	// Per tag, not yet committed to the tag totals, bytes are read by
+	// MemoryTagGetLiveBytes so the owner stores them whole
+	int64_t m_tagPendingBytes[MEMORY_MAX_TAGS];
+	uint64_t m_tagPendingAllocated[MEMORY_MAX_TAGS];
+	// Counts per ALLOC_HISTOGRAM_BUCKETS bucket, owner written like the totals
+	uint64_t m_sizeHistogram[ALLOC_HISTOGRAM_BUCKETS];
+	uint64_t m_lifetimeHistogram[ALLOC_HISTOGRAM_BUCKETS];
+	volatile uint32_t m_claimed;
 };
 
-struct allocation_meta
+// Live totals for one interned callstack, indexed by its ID
+struct alloc_site
 {
-	uint16_t size;
+	volatile int64_t m_liveCount;
+	volatile int64_t m_liveBytes;
+	volatile uint64_t m_allocCount;
+	// SAMPLED estimates, count in 1/HEAP_SAMPLE_COUNT_ONE units
+	volatile int64_t m_sampleCount;
+	volatile int64_t m_sampleBytes;
+	volatile int64_t m_sampleObjects;
+};
+
+struct alloc_site_report
+{
+	CallStack* m_stack;
+	int64_t m_liveCount;
+	int64_t m_liveBytes;
+};
+
+struct alloc_thread_exit
+{
+	bool m_armed = false;
+	~alloc_thread_exit();
+};
+
+// A multiple of 16 bytes, so what operator new returns keeps malloc's
+// alignment; 16 in BASIC, 32 once a callstack is kept
+struct alignas(16) allocation_meta
+{
+	uint64_t size;
+	// TimeGetOpCount when allocated, for the lifetime histogram
+	uint64_t time : 56;
+	// Credited on free, whichever tag is current then
+	uint64_t tag : 8;
 	#if defined(TRACK_MEMORY)
 		#if (TRACK_MEMORY == TRACK_MEMORY_VERBOSE)
-			callstack_list callstack_node;
+			uint32_t stack_id;
+		#elif (TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+			// CALLSTACK_INVALID_ID unless the allocation was sampled
+			uint32_t stack_id;
+			// Bytes the sample stands for
+			uint32_t sample_weight;
 		#endif
 	#endif
 };
 
-static uint64_t g_alloc_count = 0;
-static uint64_t g_frame_allocs = 0;
-static uint64_t g_frame_frees = 0;
-static uint32_t g_allocated_byte_count = 0;
-static uint32_t g_max_allocated_byte_count = 0;
-static uint64_t g_alloc_hw = 0;
-static uint16_t g_byte_hw = 0;
+const uint32_t ALLOC_MAX_SHARDS = 128;
+const int64_t ALLOC_FLUSH_COUNT = 64;
+const int64_t ALLOC_FLUSH_BYTES = 64 * 1024;
+const int64_t HEAP_SAMPLE_COUNT_ONE = 256;
+
+// Everything here is constant initialized, operator new can run before main
+static alloc_shard g_alloc_shards[ALLOC_MAX_SHARDS + 1];
+static alloc_shard* const g_alloc_shared_shard = &g_alloc_shards[ALLOC_MAX_SHARDS];
+// Shards past this were never claimed
+static volatile uint32_t g_alloc_shard_count = 0;
+static volatile int64_t g_alloc_live_count = 0;
+static volatile int64_t g_alloc_live_bytes = 0;
+static volatile uint64_t g_alloc_hw = 0;
+static volatile uint64_t g_frame_alloc_base = 0;
+static volatile uint64_t g_frame_free_base = 0;
+static volatile uint64_t g_max_allocated_byte_count = 0;
+// Only added to by ResetFrameMemTrack, once a frame
+static volatile uint64_t g_frame_alloc_histogram[ALLOC_HISTOGRAM_BUCKETS];
 static bool g_was_report_run = false;
-static callstack_list* g_callstack_root = nullptr;
-static callstack_list* g_last_node = nullptr;
 
+// Pages of sites, added as the callstack table grows
+static alloc_site* volatile g_alloc_site_pages[CALLSTACK_TABLE_MAX_PAGES];
+static volatile uint64_t g_heap_sample_rate = HEAP_SAMPLE_RATE_DEFAULT;
 
-//////////////////////////////////////////////////////
-//													//
-//					 Getters						//
-//													//
-//////////////////////////////////////////////////////
-uint64_t GetCurrentAllocationCount() { return g_alloc_count; }
-uint64_t GetCurrentFrameAllocationCount() { return g_frame_allocs; }
-uint64_t GetCurrentFrameFreeCount() { return g_frame_frees; }
-uint64_t GetCurrentAllocationCountHighWater() { return g_alloc_hw; }
-uint32_t GetCurrentAllocationSizeInBytes() { return g_allocated_byte_count; }
-uint16_t GetCurrentAllocationSizeHighWaterInBytes() { return g_byte_hw; }
-uint32_t GetCurrentMaxAllocationSizeInBytes() { return g_max_allocated_byte_count; }
-uint64_t GetCurrentAllocationOverflowInBytes() { return g_alloc_hw - (uint64_t)g_max_allocated_byte_count; }
+static thread_local alloc_shard* g_alloc_shard = nullptr;
+static thread_local alloc_thread_exit g_alloc_thread_exit;
+#if (TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+	// Bytes left until the next sample, the only thing new touches when not sampling
+	static thread_local int64_t g_heap_sample_countdown = 0;
+	static thread_local uint64_t g_heap_sample_random = 0;
+	// The rate the countdown was drawn at, 0 when it was not drawn
+	static thread_local uint64_t g_heap_sample_drawn_rate = 0;
+#endif
 
 //////////////////////////////////////////////////////
 //													//
-//					 Setters						//
+//					Functions						//
 //													//
 //////////////////////////////////////////////////////
-void SetMaxMemoryInBytes(uint32_t bytes) { g_max_allocated_byte_count = bytes; }
-void SetMaxMemoryInKiB(uint32_t kib) { g_max_allocated_byte_count = (uint32_t)convertToKiB(kib); }
-void SetMaxMemoryInMiB(uint32_t mib) { g_max_allocated_byte_count = (uint32_t)convertToMiB(mib); }
-void SetMaxMemoryInGiB(uint32_t gib) { g_max_allocated_byte_count = (uint32_t)convertToGiB(gib); }
+static inline void ShardAdd(alloc_shard* shard, uint64_t* counter, uint64_t value)
+{
+	if (g_alloc_shared_shard == shard)
+		AtomicFetchAdd(counter, value, ATOMIC_RELAXED);
+	else
+		AtomicStore(counter, AtomicLoad(counter, ATOMIC_RELAXED) + value, ATOMIC_RELAXED);
+}
 
+// Bucket 0 holds 0, bucket N holds [2^(N-1), 2^N), the last one the rest
+static inline uint32_t AllocHistogramBucket(uint64_t value)
+{
+	if (0 == value)
+		return 0;
+
+	#if defined(_WIN32) && defined(_M_X64)
+		unsigned long top_bit;
+		_BitScanReverse64(&top_bit, value);
+		uint32_t bucket = (uint32_t)top_bit + 1;
+	#elif defined(_WIN32)
+		// No 64-bit scan on x86, take the high half if it has a bit set
+		unsigned long top_bit;
+		if (_BitScanReverse(&top_bit, (unsigned long)(value >> 32)))
+			top_bit += 32;
+		else
+			_BitScanReverse(&top_bit, (unsigned long)value);
+		uint32_t bucket = (uint32_t)top_bit + 1;
+	#else
+		uint32_t bucket = 64 - (uint32_t)__builtin_clzll(value);
+	#endif
+	return (bucket < ALLOC_HISTOGRAM_BUCKETS) ? bucket : ALLOC_HISTOGRAM_BUCKETS - 1;
+}
 
-//////////////////////////////////////////////////////
-//													//
-//					Functions						//
-//													//
-//////////////////////////////////////////////////////
-void ResetFrameMemTrack()
+static inline void ShardMax(uint64_t* counter, uint64_t value)
 {
-	g_frame_allocs = 0;
-	g_frame_frees = 0;
+	uint64_t current = AtomicLoad(counter, ATOMIC_RELAXED);
+	while (value > current && !AtomicCompareExchange(counter, &current, value, ATOMIC_RELAXED)) {}
 }
 
-void SplitList(callstack_list* head, callstack_list** out_front, callstack_list** out_back)
+static void AllocFlushLive(int64_t count, int64_t bytes)
 {
-	callstack_list* fast_walk = head->next;
-	callstack_list* slow_walk = head;
+	int64_t live = AtomicFetchAdd(&g_alloc_live_count, count, ATOMIC_RELAXED) + count;
+	int64_t live_bytes = AtomicFetchAdd(&g_alloc_live_bytes, bytes, ATOMIC_RELAXED) + bytes;
+
+	if (live > 0)
+		ShardMax((uint64_t*)&g_alloc_hw, (uint64_t)live);
+
+	#if DETECT_MEMORY_OVERRUN
+		uint64_t limit = AtomicLoad(&g_max_allocated_byte_count, ATOMIC_RELAXED);
+		if (0 != limit && live_bytes > 0)
+			MemoryTagCheckLimit((uint64_t)live_bytes, limit);
+	#else
+		(void)live_bytes;
+	#endif
+}
 
-	// Advance 'fast' two nodes, and advance 'slow' one node
-	while (nullptr != fast_walk)
+// The shared shard has no owner to batch for it
+static void ShardAddLive(alloc_shard* shard, int64_t count, int64_t bytes)
+{
+	if (g_alloc_shared_shard == shard)
 	{
-		fast_walk = fast_walk->next;
-		if (nullptr != fast_walk)
-		{
-			slow_walk = slow_walk->next;
-			fast_walk = fast_walk->next;
-		}
+		AllocFlushLive(count, bytes);
+		return;
+	}
+
+	shard->m_pendingCount += count;
+	shard->m_pendingBytes += bytes;
+	if (shard->m_pendingCount >= ALLOC_FLUSH_COUNT || shard->m_pendingCount <= -ALLOC_FLUSH_COUNT ||
+		shard->m_pendingBytes >= ALLOC_FLUSH_BYTES || shard->m_pendingBytes <= -ALLOC_FLUSH_BYTES)
+	{
+		AllocFlushLive(shard->m_pendingCount, shard->m_pendingBytes);
+		shard->m_pendingCount = 0;
+		shard->m_pendingBytes = 0;
 	}
+}
 
-	// 'slow' is before the midpoint in the list, so split it in two at that point.
-	*out_front = head;
-	*out_back = slow_walk->next;
-	slow_walk->next = nullptr;
+static void ShardFlushTag(alloc_shard* shard, memory_tag tag)
+{
+	MemoryTagCommit(tag, shard->m_tagPendingBytes[tag], shard->m_tagPendingAllocated[tag]);
+	AtomicStore(&shard->m_tagPendingBytes[tag], (int64_t)0, ATOMIC_RELAXED);
+	shard->m_tagPendingAllocated[tag] = 0;
 }
 
-void Merge(callstack_list* front, callstack_list* back, callstack_list** out_list)
+static void ShardAddTag(alloc_shard* shard, memory_tag tag, int64_t bytes)
 {
-	if (nullptr == front) 
+	uint64_t allocated = (bytes > 0) ? (uint64_t)bytes : 0;
+	if (g_alloc_shared_shard == shard)
 	{
-		*out_list = back;
+		MemoryTagCommit(tag, bytes, allocated);
 		return;
 	}
-	else if (nullptr == back) 
+
+	int64_t pending = shard->m_tagPendingBytes[tag] + bytes;
+	AtomicStore(&shard->m_tagPendingBytes[tag], pending, ATOMIC_RELAXED);
+	shard->m_tagPendingAllocated[tag] += allocated;
+	if (pending >= ALLOC_FLUSH_BYTES || pending <= -ALLOC_FLUSH_BYTES || shard->m_tagPendingAllocated[tag] >= (uint64_t)ALLOC_FLUSH_BYTES)
+		ShardFlushTag(shard, tag);
+}
+
+static alloc_shard* AllocClaimShard()
+{
+	for (uint32_t index = 0; index < ALLOC_MAX_SHARDS; ++index)
 	{
-		*out_list = front;
+		alloc_shard* shard = &g_alloc_shards[index];
+		uint32_t expected = 0;
+		if (0 != AtomicLoad(&shard->m_claimed, ATOMIC_RELAXED) || !AtomicCompareExchange(&shard->m_claimed, &expected, 1U, ATOMIC_ACQUIRE))
+			continue;
+
+		uint32_t count = AtomicLoad(&g_alloc_shard_count, ATOMIC_RELAXED);
+		while (count < index + 1 && !AtomicCompareExchange(&g_alloc_shard_count, &count, index + 1, ATOMIC_RELEASE)) {}
+		return shard;
+	}
+
+	return g_alloc_shared_shard;
+}
+
+static alloc_shard* AllocGetShard()
+{
+	alloc_shard* shard = g_alloc_shard;
+	if (nullptr != shard)
+		return shard;
+
+	// Set before arming the exit hook, which may allocate itself
+	shard = AllocClaimShard();
+	g_alloc_shard = shard;
+	g_alloc_thread_exit.m_armed = true;
+	return shard;
+}
+
+// Later allocations on this thread, from other thread_local destructors,
+// go to the shared shard
+alloc_thread_exit::~alloc_thread_exit()
+{
+	AllocTraceThreadRelease();
+
+	alloc_shard* shard = g_alloc_shard;
+	g_alloc_shard = g_alloc_shared_shard;
+	if (nullptr == shard || g_alloc_shared_shard == shard)
 		return;
+
+	AllocFlushLive(shard->m_pendingCount, shard->m_pendingBytes);
+	shard->m_pendingCount = 0;
+	shard->m_pendingBytes = 0;
+	for (uint32_t tag = 0; tag < MEMORY_MAX_TAGS; ++tag)
+	{
+		if (0 != shard->m_tagPendingBytes[tag] || 0 != shard->m_tagPendingAllocated[tag])
+			ShardFlushTag(shard, (memory_tag)tag);
 	}
+	AtomicStore(&shard->m_claimed, 0U, ATOMIC_RELEASE);
+}
 
-	callstack_list* merge_list = nullptr;
-	callstack_list** current_merge = &merge_list;
+// Calls visit on every shard that was ever used, the shared one last
+template <typename Visit>
+static void AllocForEachShard(Visit visit)
+{
+	uint32_t count = AtomicLoad(&g_alloc_shard_count, ATOMIC_ACQUIRE);
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		visit(&g_alloc_shards[index]);
+	}
+	visit(g_alloc_shared_shard);
+}
 
-	while(true) 
+static uint64_t AllocSumShards(uint64_t alloc_shard::* counter)
+{
+	uint64_t total = 0;
+	AllocForEachShard([&](alloc_shard* shard) { total += AtomicLoad(&(shard->*counter), ATOMIC_RELAXED); });
+	return total;
+}
+
+#if (TRACK_MEMORY == TRACK_MEMORY_VERBOSE || TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+static alloc_site* AllocGetSite(uint32_t stack_id)
+{
+	alloc_site* volatile* slot = &g_alloc_site_pages[stack_id / CALLSTACK_TABLE_PAGE_SIZE];
+	alloc_site* page = AtomicLoad(slot, ATOMIC_ACQUIRE);
+	if (nullptr == page)
 	{
-		if (back->total_allocation > front->total_allocation)
-		{  
-			// Back is Greater
-
-			*current_merge = back;
-			current_merge = &back->next;
-			back = *current_merge;
-			if (nullptr == back)
-			{
-				*current_merge = front;
-				break;
-			}
-		}
-		else 
-		{  
-			// Front is Greater
-
-			*current_merge = front;
-			current_merge = &front->next;
-			front = *current_merge;
-			if (nullptr == front) 
-			{
-				*current_merge = back;
-				break;
-			}
+		// Losing the race frees ours and takes the winner's
+		alloc_site* expected = nullptr;
+		page = (alloc_site*) ::calloc(CALLSTACK_TABLE_PAGE_SIZE, sizeof(alloc_site));
+		if (!AtomicCompareExchange(slot, &expected, page, ATOMIC_ACQ_REL))
+		{
+			::free(page);
+			page = expected;
 		}
 	}
-	
-	*out_list = merge_list;
+
+	return &page[stack_id % CALLSTACK_TABLE_PAGE_SIZE];
+}
+#endif
+
+#if (TRACK_MEMORY == TRACK_MEMORY_VERBOSE)
+static void AllocSiteAdd(uint32_t stack_id, int64_t count, int64_t bytes)
+{
+	if (CALLSTACK_INVALID_ID == stack_id)
+		return;
+
+	alloc_site* site = AllocGetSite(stack_id);
+	AtomicFetchAdd(&site->m_liveCount, count, ATOMIC_RELAXED);
+	AtomicFetchAdd(&site->m_liveBytes, bytes, ATOMIC_RELAXED);
+	if (count > 0)
+		AtomicFetchAdd(&site->m_allocCount, (uint64_t)count, ATOMIC_RELAXED);
+}
+#endif
+
+static int CompareSiteReports(const void* a, const void* b)
+{
+	int64_t a_bytes = ((const alloc_site_report*)a)->m_liveBytes;
+	int64_t b_bytes = ((const alloc_site_report*)b)->m_liveBytes;
+	return (a_bytes < b_bytes) ? 1 : (a_bytes > b_bytes) ? -1 : 0;
+}
+
+#if (TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+// xorshift64*, one stream per thread
+static uint64_t HeapSampleRandom()
+{
+	uint64_t state = g_heap_sample_random;
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	g_heap_sample_random = state;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+// Bytes to the next sample, exponentially distributed around the rate like
+// the gaps of a Poisson process, so every byte is equally likely to be picked.
+// While sampling is off the countdown stays bounded, so the slow path comes
+// back around to see a rate set later
+static int64_t HeapSampleNextInterval(uint64_t rate)
+{
+	if (0 == rate)
+		return HEAP_SAMPLE_RATE_DEFAULT;
+
+	// 53 random bits into (0, 1]
+	double uniform = ((double)(HeapSampleRandom() >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+	double interval = -log(uniform) * (double)rate;
+	return (interval >= 9.0e18) ? INT64_MAX : (int64_t)interval + 1;
 }
 
-void SortCallstack(callstack_list** list_to_sort)
+static void HeapSampleSiteAdd(uint32_t stack_id, int64_t sign, uint32_t weight, uint64_t size)
 {
-	callstack_list* head = *list_to_sort;
-	callstack_list* front = nullptr;
-	callstack_list* back = nullptr;
-	
-	// Base case -- length 0 or 1
-	if ((nullptr == head) || (nullptr == head->next))
+	alloc_site* site = AllocGetSite(stack_id);
+	int64_t objects = (int64_t)weight * HEAP_SAMPLE_COUNT_ONE / (int64_t)((0 == size) ? 1 : size);
+	AtomicFetchAdd(&site->m_sampleCount, sign, ATOMIC_RELAXED);
+	AtomicFetchAdd(&site->m_sampleBytes, sign * (int64_t)weight, ATOMIC_RELAXED);
+	AtomicFetchAdd(&site->m_sampleObjects, sign * objects, ATOMIC_RELAXED);
+}
+
+// The slow path of new, taken once the countdown runs out
+static void HeapSampleAllocation(allocation_meta* meta, uint64_t size)
+{
+	if (0 == g_heap_sample_random)
+		g_heap_sample_random = ((uint64_t)(uintptr_t)&g_heap_sample_random ^ TimeGetOpCount()) | 1;
+
+	// A thread's first countdown, and any run out while sampling was off,
+	// was never drawn, so it picks nothing
+	uint64_t drawn_rate = g_heap_sample_drawn_rate;
+	uint64_t rate = AtomicLoad(&g_heap_sample_rate, ATOMIC_RELAXED);
+	g_heap_sample_countdown = HeapSampleNextInterval(rate);
+	g_heap_sample_drawn_rate = rate;
+	if (0 == drawn_rate || 0 == rate)
 		return;
-	
-	// Split head into 'a' and 'b' sublists
-	SplitList(head, &front, &back);
-	
-	// Recursively sort the sublists
-	SortCallstack(&front);
-	SortCallstack(&back);
-	
-	// answer = merge the two sorted lists together
-	Merge(front, back, list_to_sort);
+
+	uint32_t stack_id = CallstackIntern(1);
+	if (CALLSTACK_INVALID_ID == stack_id)
+		return;
+
+	// Weighted by the chance a sample point fell inside the allocation, which
+	// keeps the estimate unbiased for small and large sizes alike
+	double probability = 1.0 - exp(-(double)size / (double)rate);
+	double weight = (0.0 < probability) ? (double)size / probability : (double)rate;
+	meta->stack_id = stack_id;
+	meta->sample_weight = (weight >= 4294967295.0) ? 0xFFFFFFFFu : (uint32_t)weight;
+	HeapSampleSiteAdd(stack_id, 1, meta->sample_weight, size);
+}
+
+static int CompareHeapSamples(const void* a, const void* b)
+{
+	uint64_t a_bytes = ((const heap_sample_site*)a)->m_liveBytes;
+	uint64_t b_bytes = ((const heap_sample_site*)b)->m_liveBytes;
+	return (a_bytes < b_bytes) ? 1 : (a_bytes > b_bytes) ? -1 : 0;
 }
+#endif
 
-void MakeCopyOfCallstackList(callstack_list** new_list)
+// Sorted by estimated live bytes, largest first
+static void HeapSampleWrite(FILE* file, uint32_t max_sites, bool print_frames)
 {
-	callstack_list* copy_head = nullptr;
-	callstack_list* current_copy = nullptr;
-	callstack_list* current_true = g_callstack_root;
+	uint32_t capacity = CallstackGetInternedCount();
+	heap_sample_site* sites = (heap_sample_site*) ::malloc((capacity + 1) * sizeof(heap_sample_site));
+	uint32_t count = GatherHeapSamples(sites, capacity);
+
+	uint64_t total_bytes = 0;
+	uint64_t total_count = 0;
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		total_bytes += sites[index].m_liveBytes;
+		total_count += sites[index].m_liveCount;
+	}
+
+	fprintf(file, "\nHeap samples: about %llu byte(s) live in %llu allocation(s) from %u site(s), sample rate %llu byte(s)\n",
+		(unsigned long long)total_bytes, (unsigned long long)total_count, count, (unsigned long long)GetHeapSampleRateInBytes());
+
+	if (max_sites < count)
+		count = max_sites;
 
-	while (nullptr != current_true)
+	CallStack** stacks = (CallStack**) ::malloc((count + 1) * sizeof(CallStack*));
+	for (uint32_t index = 0; index < count; ++index)
 	{
-		callstack_list* temp = (callstack_list*) ::calloc(1, sizeof(callstack_list));
+		stacks[index] = sites[index].m_stack;
+	}
+	SymbolizerResolveStacks(stacks, count);
+	::free(stacks);
+
+	callstack_line_t lines[MAX_FRAMES_PER_CALLSTACK];
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		const heap_sample_site& site = sites[index];
+		fprintf(file, "%2u. %llu byte(s) in %llu allocation(s), %llu sample(s)\n", index + 1,
+			(unsigned long long)site.m_liveBytes, (unsigned long long)site.m_liveCount, (unsigned long long)site.m_sampleCount);
 
-		if (nullptr == copy_head)
+		// Raw addresses as well, for symbolizing offline
+		if (print_frames)
 		{
-			copy_head = temp;
-			current_copy = copy_head;
+			for (uint8_t frame = 0; frame < site.m_stack->m_frame_count; ++frame)
+			{
+				fprintf(file, "     #%u %p\n", frame, site.m_stack->m_frames[frame]);
+			}
 		}
-		else
+
+		uint16_t line_count = CallstackGetLines(lines, MAX_FRAMES_PER_CALLSTACK, site.m_stack);
+		for (uint16_t line = 0; line < line_count; ++line)
 		{
-			current_copy->next = temp;
-			current_copy = current_copy->next;
+			fprintf(file, "     %s(%u): %s\n", lines[line].file_name, lines[line].line, lines[line].function_name);
 		}
+	}
 
-		current_copy->current_stack = current_true->current_stack;
-		current_copy->total_allocation = current_true->total_allocation;
-		current_copy->next = nullptr;
+	::free(sites);
+}
 
-		current_true = current_true->next;
+//////////////////////////////////////////////////////
+//													//
+//					 Getters						//
+//													//
+//////////////////////////////////////////////////////
+// Bytes of the tag not yet handed to MemoryTagCommit
+int64_t AllocGetPendingTagBytes(memory_tag tag)
+{
+	int64_t pending = 0;
+	AllocForEachShard([&](alloc_shard* shard) { pending += AtomicLoad(&shard->m_tagPendingBytes[tag], ATOMIC_RELAXED); });
+	return pending;
+}
+uint64_t GetCurrentAllocationCount() { return AllocSumShards(&alloc_shard::m_allocs) - AllocSumShards(&alloc_shard::m_frees); }
+uint64_t GetCurrentFrameAllocationCount() { return AllocSumShards(&alloc_shard::m_allocs) - AtomicLoad(&g_frame_alloc_base, ATOMIC_RELAXED); }
+uint64_t GetCurrentFrameFreeCount() { return AllocSumShards(&alloc_shard::m_frees) - AtomicLoad(&g_frame_free_base, ATOMIC_RELAXED); }
+// Batched, so it can trail the true peak by ALLOC_FLUSH_COUNT per thread
+uint64_t GetCurrentAllocationCountHighWater()
+{
+	uint64_t high_water = AtomicLoad(&g_alloc_hw, ATOMIC_RELAXED);
+	uint64_t current = GetCurrentAllocationCount();
+	return (current > high_water) ? current : high_water;
+}
+uint64_t GetCurrentAllocationSizeInBytes() { return AllocSumShards(&alloc_shard::m_bytesAllocated) - AllocSumShards(&alloc_shard::m_bytesFreed); }
+uint64_t GetCurrentAllocationSizeHighWaterInBytes()
+{
+	uint64_t largest = 0;
+	AllocForEachShard([&](alloc_shard* shard) { uint64_t value = AtomicLoad(&shard->m_largest, ATOMIC_RELAXED); largest = (value > largest) ? value : largest; });
+	return largest;
+}
+uint64_t GetCurrentMaxAllocationSizeInBytes() { return AtomicLoad(&g_max_allocated_byte_count, ATOMIC_RELAXED); }
+// Live bytes past the limit, 0 while under it or with no limit set
+uint64_t GetCurrentAllocationOverflowInBytes()
+{
+	uint64_t limit = GetCurrentMaxAllocationSizeInBytes();
+	uint64_t live = GetCurrentAllocationSizeInBytes();
+	return (0 != limit && live > limit) ? live - limit : 0;
+}
+// Bucket N counts values of N bits, see GatherAllocationHistogram
+uint64_t GetAllocationHistogramBucketMin(uint32_t bucket) { return (0 == bucket) ? 0 : (uint64_t)1 << (bucket - 1); }
+uint64_t GetHeapSampleRateInBytes() { return AtomicLoad(&g_heap_sample_rate, ATOMIC_RELAXED); }
+
+//////////////////////////////////////////////////////
+//													//
+//					 Setters						//
+//													//
+//////////////////////////////////////////////////////
+// 0 removes the limit
+void SetMaxMemoryInBytes(uint64_t bytes) { AtomicStore(&g_max_allocated_byte_count, bytes, ATOMIC_RELAXED); }
+void SetMaxMemoryInKiB(uint32_t kib) { SetMaxMemoryInBytes((uint64_t)kib * 1024ULL); }
+void SetMaxMemoryInMiB(uint32_t mib) { SetMaxMemoryInBytes((uint64_t)mib * 1024ULL * 1024ULL); }
+void SetMaxMemoryInGiB(uint32_t gib) { SetMaxMemoryInBytes((uint64_t)gib * 1024ULL * 1024ULL * 1024ULL); }
+// Threads pick the new rate up at their next sample, or within
+// HEAP_SAMPLE_RATE_DEFAULT bytes when sampling was off
+void SetHeapSampleRateInBytes(uint64_t bytes) { AtomicStore(&g_heap_sample_rate, bytes, ATOMIC_RELAXED); }
+
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Frame counts are measured from these totals, no shard is written
+void ResetFrameMemTrack()
+{
+	uint64_t allocs = AllocSumShards(&alloc_shard::m_allocs);
+	uint64_t frame_allocs = allocs - AtomicLoad(&g_frame_alloc_base, ATOMIC_RELAXED);
+	AtomicFetchAdd(&g_frame_alloc_histogram[AllocHistogramBucket(frame_allocs)], (uint64_t)1, ATOMIC_RELAXED);
+
+	AtomicStore(&g_frame_alloc_base, allocs, ATOMIC_RELAXED);
+	AtomicStore(&g_frame_free_base, AllocSumShards(&alloc_shard::m_frees), ATOMIC_RELAXED);
+	MemoryTagEndFrame();
+}
+
+// A snapshot summed over every thread, counts only grow so two snapshots
+// can be subtracted to see a stretch of time
+void GatherAllocationHistogram(alloc_histogram histogram, uint64_t* out_counts)
+{
+	memset(out_counts, 0, ALLOC_HISTOGRAM_BUCKETS * sizeof(uint64_t));
+	if (ALLOC_HISTOGRAM_FRAME_COUNT == histogram)
+	{
+		for (uint32_t bucket = 0; bucket < ALLOC_HISTOGRAM_BUCKETS; ++bucket)
+		{
+			out_counts[bucket] = AtomicLoad(&g_frame_alloc_histogram[bucket], ATOMIC_RELAXED);
+		}
+		return;
 	}
 
-	*new_list = copy_head;
+	uint64_t (alloc_shard::* counts)[ALLOC_HISTOGRAM_BUCKETS] = (ALLOC_HISTOGRAM_SIZE == histogram) ? &alloc_shard::m_sizeHistogram : &alloc_shard::m_lifetimeHistogram;
+	AllocForEachShard([&](alloc_shard* shard)
+	{
+		for (uint32_t bucket = 0; bucket < ALLOC_HISTOGRAM_BUCKETS; ++bucket)
+		{
+			out_counts[bucket] += AtomicLoad(&(shard->*counts)[bucket], ATOMIC_RELAXED);
+		}
+	});
 }
 
-void FreeCopyOfCallstackList(callstack_list** new_list)
+void ReportAllocationHistograms()
 {
-	callstack_list* current_copy = *new_list;
+	static const char* const names[3] = { "Allocation size (bytes)", "Allocation lifetime", "Allocations per frame" };
+	uint64_t counts[ALLOC_HISTOGRAM_BUCKETS];
 
-	while (nullptr != current_copy)
+	for (uint32_t histogram = 0; histogram < 3; ++histogram)
 	{
-		callstack_list* temp = current_copy->next;
-		::free(current_copy);
-		current_copy = temp;
+		GatherAllocationHistogram((alloc_histogram)histogram, counts);
+		uint64_t total = 0;
+		for (uint32_t bucket = 0; bucket < ALLOC_HISTOGRAM_BUCKETS; ++bucket)
+		{
+			total += counts[bucket];
+		}
+
+		printf("\n%s, %llu sample(s):\n", names[histogram], (unsigned long long)total);
+		if (0 == total)
+			continue;
+
+		uint64_t seen = 0;
+		for (uint32_t bucket = 0; bucket < ALLOC_HISTOGRAM_BUCKETS; ++bucket)
+		{
+			if (0 == counts[bucket])
+				continue;
+
+			seen += counts[bucket];
+			uint64_t low = GetAllocationHistogramBucketMin(bucket);
+			if (ALLOC_HISTOGRAM_LIFETIME == histogram)
+			{
+				char units[4];
+				double scaled = TimeOpCountToSeconds(low, units);
+				printf("  >= %10.3f %-3s", scaled, units);
+			}
+			else
+			{
+				printf("  >= %14llu", (unsigned long long)low);
+			}
+			printf(" %12llu %6.2f%% %6.2f%% cumulative\n", (unsigned long long)counts[bucket],
+				100.0 * (double)counts[bucket] / (double)total, 100.0 * (double)seen / (double)total);
+		}
 	}
 }
 
@@ -243,31 +647,63 @@ void ReportVerboseCallStacks(const char* start_time_str /*= ""*/, const char* en
 		endTime = std::stod(end_time_str);
 	}
 
-	callstack_list* sorted_list = nullptr;
-	MakeCopyOfCallstackList(&sorted_list);
+	const uint64_t alloc_count = GetCurrentAllocationCount();
+	const uint64_t allocated_byte_count = GetCurrentAllocationSizeInBytes();
+
+	// Sites still holding memory, read straight from the running totals
+	uint32_t stack_count = CallstackGetInternedCount();
+	alloc_site_report* reports = (alloc_site_report*) ::malloc((stack_count + 1) * sizeof(alloc_site_report));
+	uint32_t report_count = 0;
+	for (uint32_t stack_id = 0; stack_id < stack_count; ++stack_id)
+	{
+		alloc_site* page = AtomicLoad(&g_alloc_site_pages[stack_id / CALLSTACK_TABLE_PAGE_SIZE], ATOMIC_ACQUIRE);
+		if (nullptr == page)
+			continue;
+
+		alloc_site* site = &page[stack_id % CALLSTACK_TABLE_PAGE_SIZE];
+		int64_t live_count = AtomicLoad(&site->m_liveCount, ATOMIC_RELAXED);
+		if (live_count <= 0)
+			continue;
+
+		// Stacks are stamped when first seen
+		CallStack* stack = CallstackGetInterned(stack_id);
+		if (stack->m_time < startTime - 0.00001 || stack->m_time > endTime + 0.00001)
+			continue;
+
+		alloc_site_report& report = reports[report_count++];
+		report.m_stack = stack;
+		report.m_liveCount = live_count;
+		report.m_liveBytes = AtomicLoad(&site->m_liveBytes, ATOMIC_RELAXED);
+	}
 
-	SortCallstack(&sorted_list);
+	::qsort(reports, report_count, sizeof(alloc_site_report), CompareSiteReports);
 
-	uint totalSimiliarAllocs = 0;
-	uint32_t totalSimiliarSize = 0;
+	// Every frame about to be printed, each unique address looked up once
+	CallStack** report_stacks = (CallStack**) ::malloc((report_count + 1) * sizeof(CallStack*));
+	for (uint32_t index = 0; index < report_count; ++index)
+	{
+		report_stacks[index] = reports[index].m_stack;
+	}
+	SymbolizerResolveStacks(report_stacks, report_count);
+	::free(report_stacks);
 
-	float reportedTotalBytes = convertToReadableBytes(g_allocated_byte_count);
+	float reportedTotalBytes = convertToReadableBytes(allocated_byte_count);
 	char sizeTotal[4] = { 'B', 'y', 't', NULL };
 
-	if (g_allocated_byte_count > (2 * 1024) && g_allocated_byte_count < (2 * 1024 * 1024))
+	if (allocated_byte_count > (2ULL * 1024ULL) && allocated_byte_count < (2ULL * 1024ULL * 1024ULL))
 	{
 		sizeTotal[0] = 'K'; 
 		sizeTotal[1] = 'i'; 
 		sizeTotal[2] = 'B';
 	}
-	else if ((unsigned long)g_allocated_byte_count >(2UL * 1024UL * 1024UL) && (unsigned long)g_allocated_byte_count < (2UL * 1024UL * 1024UL * 1024UL))
+	else if (allocated_byte_count > (2ULL * 1024ULL * 1024ULL) && allocated_byte_count < (2ULL * 1024ULL * 1024ULL * 1024ULL))
 	{
 		//MB
 		sizeTotal[0] = 'M';
 		sizeTotal[1] = 'i';
 		sizeTotal[2] = 'B';
 	}
-	else if ((unsigned long)g_allocated_byte_count >(2UL * 1024UL * 1024UL * 1024UL))
+	else if (allocated_byte_count > (2ULL * 1024ULL * 1024ULL * 1024ULL))
 	{
 		//GB
 		sizeTotal[0] = 'G';
@@ -276,102 +712,130 @@ void ReportVerboseCallStacks(const char* start_time_str /*= ""*/, const char* en
 	}
 
 	char init_buffer[64];
-	sprintf_s(init_buffer, 64, "\n%llu leaked allocation(s).  Total: %0.3f %s\n", g_alloc_count, reportedTotalBytes, sizeTotal);
+	sprintf_s(init_buffer, 64, "\n%llu leaked allocation(s).  Total: %0.3f %s\n", (unsigned long long)alloc_count, reportedTotalBytes, sizeTotal);
 	//OutputDebugStringA(init_buffer);
 	printf(init_buffer);
 	//LogTaggedPrintf("leaks", init_buffer);
 
-	callstack_list* currentNode = sorted_list;
-
-	while(currentNode != nullptr && print_long_report)
+	for (uint32_t report_index = 0; report_index < report_count && print_long_report; ++report_index)
 	{
-		callstack_list* nextNode = currentNode->next;
+		const alloc_site_report& report = reports[report_index];
+		uint64_t totalSimiliarAllocs = (uint64_t)report.m_liveCount;
+		uint64_t totalSimiliarSize = (uint64_t)report.m_liveBytes;
 
-		uint32_t& currentHash = currentNode->current_stack->m_hash;
-		uint32_t nextHash;
-		if (nextNode == nullptr)
-			nextHash = currentHash + 1;
-		else
-			nextHash = nextNode->current_stack->m_hash;
+		//Print total allocs for type and total size
+		float reportedBytes = convertToReadableBytes(totalSimiliarSize);
+		char size[4] = { 'B', NULL, NULL, NULL };
 
-		if (nextHash == currentHash)
+		if (totalSimiliarSize > (2ULL * 1024ULL) && totalSimiliarSize < (2ULL * 1024ULL * 1024ULL))
+		{
+			size[0] = 'K';
+			size[1] = 'i';
+			size[2] = 'B';
+		}
+		else if (totalSimiliarSize > (2ULL * 1024ULL * 1024ULL) && totalSimiliarSize < (2ULL * 1024ULL * 1024ULL * 1024ULL))
 		{
-			totalSimiliarSize += currentNode->total_allocation;
-			totalSimiliarAllocs++;
+			//MB
+			size[0] = 'M';
+			size[1] = 'i';
+			size[2] = 'B';
+		}
+		else if (totalSimiliarSize > (2ULL * 1024ULL * 1024ULL * 1024ULL))
+		{
+			//GB
+			size[0] = 'G';
+			size[1] = 'i';
+			size[2] = 'B';
 		}
 
-		if (nextHash != currentHash)
+		char collection_buffer[128];
+		sprintf_s(collection_buffer, 128, "\nGroup contained %llu allocation(s), Total: %0.3f %s\n", (unsigned long long)totalSimiliarAllocs, reportedBytes, size);
+		//OutputDebugStringA(collection_buffer);
+		printf(collection_buffer);
+		//LogTaggedPrintf("allocs", collection_buffer);
+
+		// Printing a call stack, happens when making report
+		char line_buffer[512];
+		callstack_line_t lines[128];
+		uint line_count = CallstackGetLines(lines, 128, report.m_stack);
+		for (uint i = 0; i < line_count; ++i)
 		{
-			// Want to include the last node
-			totalSimiliarSize += currentNode->total_allocation;
-			totalSimiliarAllocs++;
+			// this specific format will make it double click-able in an output window 
+			// taking you to the offending line.
+			sprintf_s(line_buffer, 512, "     %s(%u): %s\n", lines[i].file_name, lines[i].line, lines[i].function_name);
+
+			// print to output and console
+			//OutputDebugStringA(line_buffer);
+			printf(line_buffer);
+			//LogTaggedPrintf("stack", line_buffer);
+		}
+	}
 
-			//Print total allocs for type and total size
-			float reportedBytes = convertToReadableBytes(totalSimiliarSize);
-			char size[4] = { 'B', NULL, NULL, NULL };
+	::free(reports);
+}
 
-			if (g_allocated_byte_count > (2 * 1024) && g_allocated_byte_count < (2 * 1024 * 1024))
-			{
-				size[0] = 'K';
-				size[1] = 'i';
-				size[2] = 'B';
-			}
-			else if ((unsigned long)g_allocated_byte_count >(2UL * 1024UL * 1024UL) && (unsigned long)g_allocated_byte_count < (2UL * 1024UL * 1024UL * 1024UL))
-			{
-				//MB
-				size[0] = 'M';
-				size[1] = 'i';
-				size[2] = 'B';
-			}
-			else if ((unsigned long)g_allocated_byte_count >(2UL * 1024UL * 1024UL * 1024UL))
-			{
-				//GB
-				size[0] = 'G';
-				size[1] = 'i';
-				size[2] = 'B';
-			}
+void ReportEntireVerboseCallStackList(bool print_long_report /*= false*/)
+{
+	ReportVerboseCallStacks("", "", print_long_report);
+}
 
-			char collection_buffer[128];
-			sprintf_s(collection_buffer, 128, "\nGroup contained %u allocation(s), Total: %0.3f %s\n", totalSimiliarAllocs, reportedBytes, size);
-			//OutputDebugStringA(collection_buffer);
-			printf(collection_buffer);
-			//LogTaggedPrintf("allocs", collection_buffer);
-
-			//Reset total allocs and size
-			totalSimiliarAllocs = 0;
-			totalSimiliarSize = 0;
-
-			// Printing a call stack, happens when making report
-			char line_buffer[512];
-			callstack_line_t lines[128];
-			uint line_count = CallstackGetLines(lines, 128, currentNode->current_stack);
-			for (uint i = 0; i < line_count; ++i)
-			{
-				// this specific format will make it double click-able in an output window 
-				// taking you to the offending line.
-
-				if ((currentNode->current_stack->m_time >= startTime - 0.00001 && currentNode->current_stack->m_time <= endTime + 0.00001))
-				{
-					//Print Line For Call Stack
-					sprintf_s(line_buffer, 512, "     %s(%u): %s\n", lines[i].file_name, lines[i].line, lines[i].function_name);
-				}
-
-				// print to output and console
-				//OutputDebugStringA(line_buffer);
-				printf(line_buffer);
-				//LogTaggedPrintf("stack", line_buffer);
-			}
-		}
+uint32_t GatherHeapSamples(heap_sample_site* out_sites, uint32_t capacity)
+{
+	uint32_t count = 0;
 
-		currentNode = currentNode->next;
+	#if (TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+	uint32_t stack_count = CallstackGetInternedCount();
+	heap_sample_site* sites = (heap_sample_site*) ::malloc((stack_count + 1) * sizeof(heap_sample_site));
+	for (uint32_t stack_id = 0; stack_id < stack_count; ++stack_id)
+	{
+		alloc_site* page = AtomicLoad(&g_alloc_site_pages[stack_id / CALLSTACK_TABLE_PAGE_SIZE], ATOMIC_ACQUIRE);
+		if (nullptr == page)
+			continue;
+
+		alloc_site* site = &page[stack_id % CALLSTACK_TABLE_PAGE_SIZE];
+		int64_t sample_count = AtomicLoad(&site->m_sampleCount, ATOMIC_RELAXED);
+		if (sample_count <= 0)
+			continue;
+
+		heap_sample_site& out = sites[count++];
+		out.m_stack = CallstackGetInterned(stack_id);
+		out.m_sampleCount = (uint64_t)sample_count;
+		int64_t bytes = AtomicLoad(&site->m_sampleBytes, ATOMIC_RELAXED);
+		int64_t objects = AtomicLoad(&site->m_sampleObjects, ATOMIC_RELAXED);
+		out.m_liveBytes = (bytes > 0) ? (uint64_t)bytes : 0;
+		out.m_liveCount = (objects > 0) ? (uint64_t)((objects + HEAP_SAMPLE_COUNT_ONE / 2) / HEAP_SAMPLE_COUNT_ONE) : 0;
 	}
 
-	FreeCopyOfCallstackList(&sorted_list);
+	::qsort(sites, count, sizeof(heap_sample_site), CompareHeapSamples);
+
+	if (count > capacity)
+		count = capacity;
+	memcpy(out_sites, sites, count * sizeof(heap_sample_site));
+	::free(sites);
+	#else
+	(void)out_sites;
+	(void)capacity;
+	#endif
+
+	return count;
 }
 
-void ReportEntireVerboseCallStackList(bool print_long_report /*= false*/)
+void ReportHeapSamples(uint32_t max_sites /*= 16*/)
 {
-	ReportVerboseCallStacks("", "", print_long_report);
+	HeapSampleWrite(stdout, max_sites, false);
+}
+
+// Every site with its raw frames, so a snapshot from a running process can be
+// symbolized elsewhere
+bool DumpHeapSamples(const char* file_path)
+{
+	FILE* file = fopen(file_path, "w");
+	if (nullptr == file)
+		return false;
+
+	HeapSampleWrite(file, 0xFFFFFFFFu, true);
+	fclose(file);
+	return true;
 }
 
 //////////////////////////////////////////////////////
@@ -381,41 +845,50 @@ void ReportEntireVerboseCallStackList(bool print_long_report /*= false*/)
 //////////////////////////////////////////////////////
 void* operator new(const size_t size)
 {
-	++g_alloc_count;
-	++g_frame_allocs;
-	g_allocated_byte_count += (uint32_t)size;
-
-	#if (g_allocated_byte_count > g_max_allocated_byte_count && DETECT_MEMORY_OVERRUN > g_allocated_byte_count)
-		#define DETECT_MEMORY_OVERRUN g_allocated_byte_count - g_max_allocated_byte_count;
+	alloc_shard* shard = AllocGetShard();
+	ShardAdd(shard, &shard->m_allocs, 1);
+	ShardAdd(shard, &shard->m_bytesAllocated, (uint64_t)size);
+	ShardAddLive(shard, 1, (int64_t)size);
+	memory_tag tag = MemoryTagGetCurrent();
+	ShardAddTag(shard, tag, (int64_t)size);
+
+	ShardAdd(shard, &shard->m_sizeHistogram[AllocHistogramBucket((uint64_t)size)], 1);
+
+	size_t alloc_size = size + sizeof(allocation_meta);
+	// Every meta field is written below, and new does not promise zeroed memory
+	allocation_meta *ptr = (allocation_meta*) ::malloc(alloc_size);
+	ptr->size = (uint64_t)size;
+	ptr->time = TimeGetOpCount();
+	ptr->tag = tag;
+
+	if (alloc_size > AtomicLoad(&shard->m_largest, ATOMIC_RELAXED))
+		ShardMax(&shard->m_largest, (uint64_t)alloc_size);
+
+	// Sampled Tracking
+	#if (TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+		ptr->stack_id = CALLSTACK_INVALID_ID;
+		g_heap_sample_countdown -= (int64_t)size;
+		if (g_heap_sample_countdown < 0)
+			HeapSampleAllocation(ptr, (uint64_t)size);
 	#endif
 
-	if (g_alloc_count > g_alloc_hw)
-		g_alloc_hw = g_alloc_count;
-
-	uint16_t alloc_size = (uint16_t)size + (uint16_t)sizeof(allocation_meta);
-	allocation_meta *ptr = (allocation_meta*) ::calloc(1, (size_t)alloc_size);
-	ptr->size = (uint16_t)size;
-
-	if (alloc_size > g_byte_hw)
-		g_byte_hw = alloc_size;
-
 	// Verbose Tracking
 	#if (TRACK_MEMORY == TRACK_MEMORY_VERBOSE)
-		ptr->callstack_node.current_stack = CreateCallstack(0);
-		ptr->callstack_node.total_allocation = (uint16_t)size;
-		ptr->callstack_node.next = nullptr;
-	
-		if(g_last_node)
-			g_last_node->next = &ptr->callstack_node;
-
-		g_last_node = &ptr->callstack_node;
-	
-		if (g_callstack_root == nullptr)
-		{
-			g_callstack_root = &ptr->callstack_node;
-		}
+		ptr->stack_id = CallstackIntern(0);
+		AllocSiteAdd(ptr->stack_id, 1, (int64_t)size);
 	#endif
 
+	// Streamed Tracking
+	if (0 != AtomicLoad(&g_alloc_trace_active, ATOMIC_RELAXED))
+	{
+		#if (TRACK_MEMORY == TRACK_MEMORY_VERBOSE)
+			uint32_t stack_id = ptr->stack_id;
+		#else
+			uint32_t stack_id = CallstackIntern(0);
+		#endif
+		AllocTraceRecordAlloc(ptr + 1, (uint64_t)size, stack_id);
+	}
+
 	return ptr + 1;
 }
 
@@ -424,45 +897,30 @@ void operator delete(void* ptr)
 	if (nullptr == ptr)
 		return;
 
-	--g_alloc_count;
-	++g_frame_frees;
-
 	allocation_meta *data = (allocation_meta*)ptr;
 	data--;
 
-	g_allocated_byte_count -= (uint32_t)data->size;
+	// Before the free, so a reuse of the address is always traced after it
+	if (0 != AtomicLoad(&g_alloc_trace_active, ATOMIC_RELAXED))
+		AllocTraceRecordFree(ptr);
+
+	// Counted against this thread, whichever thread made the allocation
+	alloc_shard* shard = AllocGetShard();
+	ShardAdd(shard, &shard->m_frees, 1);
+	ShardAdd(shard, &shard->m_bytesFreed, (uint64_t)data->size);
+	ShardAddLive(shard, -1, -(int64_t)data->size);
+	ShardAddTag(shard, (memory_tag)data->tag, -(int64_t)data->size);
+
+	// The tick count wraps at 56 bits, the mask keeps the difference right
+	uint64_t lifetime = (TimeGetOpCount() - data->time) & ((1ULL << 56) - 1);
+	ShardAdd(shard, &shard->m_lifetimeHistogram[AllocHistogramBucket(lifetime)], 1);
 
 	// Verbose Tracking
 	#if (TRACK_MEMORY == TRACK_MEMORY_VERBOSE)
-		if (data->callstack_node.current_stack != nullptr)
-			DestroyCallstack(data->callstack_node.current_stack);
-	
-		//Set pointer to current stack null
-		bool run = true;
-		callstack_list* currentNode = nullptr;
-		while (g_callstack_root != nullptr && run && &data->callstack_node != NULL)
-		{
-			if (currentNode == nullptr && g_callstack_root != &data->callstack_node)
-			{
-				currentNode = g_callstack_root;
-			}
-			else
-			{
-				g_callstack_root = nullptr;
-				run = false;
-				continue;
-			}
-	
-			if (currentNode->next != nullptr && currentNode->next != &data->callstack_node)
-			{
-				currentNode = currentNode->next;
-			}
-			else
-			{
-				currentNode->next = nullptr;
-				run = false;
-			}
-		}
+		AllocSiteAdd(data->stack_id, -1, -(int64_t)data->size);
+	#elif (TRACK_MEMORY == TRACK_MEMORY_SAMPLED)
+		if (CALLSTACK_INVALID_ID != data->stack_id)
+			HeapSampleSiteAdd(data->stack_id, -1, data->sample_weight, (uint64_t)data->size);
 	#endif
 
 	::free(data);
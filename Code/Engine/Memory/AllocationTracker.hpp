@@ -2,45 +2,88 @@
 #include <cstdint>
 
 // Defines
-#define DETECT_MEMORY_OVERRUN (0)
+#define DETECT_MEMORY_OVERRUN (1)
 #define TRACK_MEMORY_BASIC    (0)
 #define TRACK_MEMORY_VERBOSE  (1)
+#define TRACK_MEMORY_SAMPLED  (2)
+#define HEAP_SAMPLE_RATE_DEFAULT (512 * 1024)
+#define ALLOC_HISTOGRAM_BUCKETS  (64)
 
+	// DETECT_MEMORY_OVERRUN checks live bytes against SetMaxMemoryInBytes as
+	//   the tracker batches them, and reports going over through the memory
+	//   tag budget callback, see MemoryTag.hpp.  On by default, it costs a
+	//   load per batch until a limit is set
 	// If not defined, we will not track memory at all
 	// BASIC will track bytes used, and count
 	// VERBOSE will track individual call stacks
+	// SAMPLED will track bytes used, and count, plus the call stack of one
+	//   allocation every sample rate bytes on average; FINAL_BUILD gets it by
+	//   also defining SAMPLE_MEMORY
 #if defined(_DEBUG)
 	#define TRACK_MEMORY           TRACK_MEMORY_VERBOSE
 	#define PROFILED_BUILD
 #elif defined(FINAL_BUILD)
-	// undefined
+	#if defined(SAMPLE_MEMORY)
+		#define TRACK_MEMORY       TRACK_MEMORY_SAMPLED
+	#endif
 #else 
 	#define TRACK_MEMORY           TRACK_MEMORY_BASIC
 #endif
 
 // Datatypes
+class CallStack;
 
+// Log2 bucketed, bucket N counting values N bits wide: sizes in bytes,
+// lifetimes in TimeGetOpCount ticks from new to delete, and the allocations
+// made between two ResetFrameMemTrack calls
+enum alloc_histogram
+{
+	ALLOC_HISTOGRAM_SIZE = 0,
+	ALLOC_HISTOGRAM_LIFETIME = 1,
+	ALLOC_HISTOGRAM_FRAME_COUNT = 2
+};
+
+// Estimated from the samples, each standing for the allocations its size
+// and the sample rate make it likely to have been picked from
+struct heap_sample_site
+{
+	CallStack* m_stack;
+	uint64_t m_liveBytes;
+	uint64_t m_liveCount;
+	uint64_t m_sampleCount;
+};
 
 // Getters
 uint64_t GetCurrentAllocationCount();
 uint64_t GetCurrentFrameAllocationCount();
 uint64_t GetCurrentFrameFreeCount();
 uint64_t GetCurrentAllocationCountHighWater();
-uint32_t GetCurrentAllocationSizeInBytes();
-uint16_t GetCurrentAllocationSizeHighWaterInBytes();
-uint32_t GetCurrentMaxAllocationSizeInBytes();
+uint64_t GetCurrentAllocationSizeInBytes();
+uint64_t GetCurrentAllocationSizeHighWaterInBytes();
+uint64_t GetCurrentMaxAllocationSizeInBytes();
 uint64_t GetCurrentAllocationOverflowInBytes();
+uint64_t GetAllocationHistogramBucketMin(uint32_t bucket);
+uint64_t GetHeapSampleRateInBytes();
 
 //Setters
-void SetMaxMemoryInBytes(uint32_t bytes);
+void SetMaxMemoryInBytes(uint64_t bytes);
 void SetMaxMemoryInKiB(uint32_t kib);
 void SetMaxMemoryInMiB(uint32_t mib);
 void SetMaxMemoryInGiB(uint32_t gib);
+void SetHeapSampleRateInBytes(uint64_t bytes);
 
 // Functions
 void ResetFrameMemTrack();
 void ReportVerboseCallStacks(const char* start_time_str = "", const char* end_time_str = "", bool print_long_report = false);
 void ReportEntireVerboseCallStackList(bool print_long_report = false);
+// out_counts holds ALLOC_HISTOGRAM_BUCKETS entries
+void GatherAllocationHistogram(alloc_histogram histogram, uint64_t* out_counts);
+void ReportAllocationHistograms();
+// SAMPLED only, empty otherwise.  Safe from any thread at any time, a rate
+// of 0 stops taking new samples
+uint32_t GatherHeapSamples(heap_sample_site* out_sites, uint32_t capacity);
+void ReportHeapSamples(uint32_t max_sites = 16);
+bool DumpHeapSamples(const char* file_path);
 
 // Operators
 #ifndef TRACK_MEMORY
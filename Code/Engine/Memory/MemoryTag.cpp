@@ -0,0 +1,225 @@
+#include "Memory/MemoryTag.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Atomic.hpp"
+#include <stdio.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct alignas(64) memory_tag_info
+{
+	char m_name[32];
+	volatile int64_t m_liveBytes;
+	volatile uint64_t m_highWater;
+	// Bytes allocated since the last ResetFrameMemTrack
+	volatile uint64_t m_frameBytes;
+	volatile uint64_t m_budget;
+	volatile uint64_t m_frameBudget;
+	// Frame number + 1 the live budget was last reported in
+	volatile uint32_t m_reportedFrame;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+static void MemoryTagDefaultCallback(const memory_budget_event& event);
+
+// Constant initialized, operator new can run before main
+static memory_tag_info g_memory_tags[MEMORY_MAX_TAGS] = { { "Untagged", 0, 0, 0, 0, 0, 0 } };
+static volatile uint32_t g_memory_tag_count = 1;
+static volatile uint32_t g_memory_frame = 0;
+static volatile uint32_t g_memory_limit_reported = 0;
+static memory_budget_cb volatile g_memory_budget_callback = &MemoryTagDefaultCallback;
+// Only taken to register a tag
+static Mutex g_memory_tag_lock;
+
+static thread_local memory_tag g_memory_tag_current = MEMORY_TAG_UNTAGGED;
+// Set while this thread is in the callback
+static thread_local bool g_memory_budget_reporting = false;
+
+//////////////////////////////////////////////////////
+//													//
+//				   Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+ScopedMemoryTag::ScopedMemoryTag(memory_tag tag)
+	: m_previous(MemoryTagSetCurrent(tag))
+{
+}
+
+ScopedMemoryTag::~ScopedMemoryTag()
+{
+	MemoryTagSetCurrent(m_previous);
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static void MemoryTagDefaultCallback(const memory_budget_event& event)
+{
+	printf("Memory budget exceeded: %s at %llu byte(s) %s, budget %llu byte(s)\n", event.m_name,
+		(unsigned long long)event.m_bytes, event.m_perFrame ? "allocated last frame" : "live", (unsigned long long)event.m_budget);
+}
+
+static void MemoryTagNotify(memory_tag tag, const char* name, uint64_t bytes, uint64_t budget, bool per_frame)
+{
+	if (g_memory_budget_reporting)
+		return;
+
+	g_memory_budget_reporting = true;
+	memory_budget_event event = { tag, name, bytes, budget, per_frame };
+	AtomicLoad(&g_memory_budget_callback, ATOMIC_ACQUIRE)(event);
+	g_memory_budget_reporting = false;
+}
+
+// True for the first caller this frame, so each kind is reported once a frame
+static bool MemoryTagClaimReport(volatile uint32_t* reported_frame)
+{
+	uint32_t frame = AtomicLoad(&g_memory_frame, ATOMIC_RELAXED) + 1;
+	uint32_t seen = AtomicLoad(reported_frame, ATOMIC_RELAXED);
+	return seen != frame && AtomicCompareExchange(reported_frame, &seen, frame, ATOMIC_RELAXED);
+}
+
+memory_tag MemoryTagRegister(const char* name)
+{
+	SCOPE_LOCK(&g_memory_tag_lock);
+
+	uint32_t count = AtomicLoad(&g_memory_tag_count, ATOMIC_RELAXED);
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		if (0 == strncmp(g_memory_tags[index].m_name, name, sizeof(g_memory_tags[index].m_name) - 1))
+			return (memory_tag)index;
+	}
+
+	if (count >= MEMORY_MAX_TAGS)
+		return MEMORY_TAG_INVALID;
+
+	memory_tag_info& info = g_memory_tags[count];
+	strncpy(info.m_name, name, sizeof(info.m_name) - 1);
+	AtomicStore(&g_memory_tag_count, count + 1, ATOMIC_RELEASE);
+	return (memory_tag)count;
+}
+
+void MemoryTagCommit(memory_tag tag, int64_t live_bytes, uint64_t allocated_bytes)
+{
+	if (tag >= MEMORY_MAX_TAGS)
+		return;
+
+	memory_tag_info& info = g_memory_tags[tag];
+	int64_t live = AtomicFetchAdd(&info.m_liveBytes, live_bytes, ATOMIC_RELAXED) + live_bytes;
+	if (0 != allocated_bytes)
+		AtomicFetchAdd(&info.m_frameBytes, allocated_bytes, ATOMIC_RELAXED);
+
+	if (live <= 0)
+		return;
+
+	uint64_t high_water = AtomicLoad(&info.m_highWater, ATOMIC_RELAXED);
+	while ((uint64_t)live > high_water && !AtomicCompareExchange(&info.m_highWater, &high_water, (uint64_t)live, ATOMIC_RELAXED)) {}
+
+	uint64_t budget = AtomicLoad(&info.m_budget, ATOMIC_RELAXED);
+	if (0 != budget && (uint64_t)live > budget && MemoryTagClaimReport(&info.m_reportedFrame))
+		MemoryTagNotify(tag, info.m_name, (uint64_t)live, budget, false);
+}
+
+void MemoryTagAddBytes(memory_tag tag, int64_t bytes)
+{
+	MemoryTagCommit(tag, bytes, (bytes > 0) ? (uint64_t)bytes : 0);
+}
+
+void MemoryTagCheckLimit(uint64_t live_bytes, uint64_t limit)
+{
+	if (0 != limit && live_bytes > limit && MemoryTagClaimReport(&g_memory_limit_reported))
+		MemoryTagNotify(MEMORY_TAG_ALL, "All", live_bytes, limit, false);
+}
+
+// Checks the frame budgets, then starts the next frame
+void MemoryTagEndFrame()
+{
+	uint32_t count = AtomicLoad(&g_memory_tag_count, ATOMIC_ACQUIRE);
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		memory_tag_info& info = g_memory_tags[index];
+		uint64_t frame_bytes = AtomicExchange(&info.m_frameBytes, (uint64_t)0, ATOMIC_RELAXED);
+		uint64_t budget = AtomicLoad(&info.m_frameBudget, ATOMIC_RELAXED);
+		if (0 != budget && frame_bytes > budget)
+			MemoryTagNotify((memory_tag)index, info.m_name, frame_bytes, budget, true);
+	}
+
+	AtomicFetchAdd(&g_memory_frame, 1U, ATOMIC_RELAXED);
+}
+
+void MemoryTagReport()
+{
+	printf("\nMemory tags:\n");
+	uint32_t count = AtomicLoad(&g_memory_tag_count, ATOMIC_ACQUIRE);
+	for (uint32_t index = 0; index < count; ++index)
+	{
+		memory_tag tag = (memory_tag)index;
+		printf("%-31s %12llu live %12llu peak %12llu this frame", MemoryTagGetName(tag), (unsigned long long)MemoryTagGetLiveBytes(tag),
+			(unsigned long long)MemoryTagGetHighWaterBytes(tag), (unsigned long long)MemoryTagGetFrameBytes(tag));
+
+		if (0 != MemoryTagGetBudget(tag))
+			printf(", budget %llu", (unsigned long long)MemoryTagGetBudget(tag));
+		if (0 != MemoryTagGetFrameBudget(tag))
+			printf(", frame budget %llu", (unsigned long long)MemoryTagGetFrameBudget(tag));
+		printf("\n");
+	}
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					 Getters						//
+//													//
+//////////////////////////////////////////////////////
+memory_tag MemoryTagGetCurrent() { return g_memory_tag_current; }
+uint32_t MemoryTagGetCount() { return AtomicLoad(&g_memory_tag_count, ATOMIC_ACQUIRE); }
+const char* MemoryTagGetName(memory_tag tag)
+{
+	if (MEMORY_TAG_ALL == tag)
+		return "All";
+	return (tag < MemoryTagGetCount()) ? g_memory_tags[tag].m_name : "Invalid";
+}
+uint64_t MemoryTagGetLiveBytes(memory_tag tag)
+{
+	if (tag >= MEMORY_MAX_TAGS)
+		return 0;
+	int64_t live = AtomicLoad(&g_memory_tags[tag].m_liveBytes, ATOMIC_RELAXED) + AllocGetPendingTagBytes(tag);
+	return (live > 0) ? (uint64_t)live : 0;
+}
+uint64_t MemoryTagGetHighWaterBytes(memory_tag tag) { return (tag < MEMORY_MAX_TAGS) ? AtomicLoad(&g_memory_tags[tag].m_highWater, ATOMIC_RELAXED) : 0; }
+uint64_t MemoryTagGetFrameBytes(memory_tag tag) { return (tag < MEMORY_MAX_TAGS) ? AtomicLoad(&g_memory_tags[tag].m_frameBytes, ATOMIC_RELAXED) : 0; }
+uint64_t MemoryTagGetBudget(memory_tag tag) { return (tag < MEMORY_MAX_TAGS) ? AtomicLoad(&g_memory_tags[tag].m_budget, ATOMIC_RELAXED) : 0; }
+uint64_t MemoryTagGetFrameBudget(memory_tag tag) { return (tag < MEMORY_MAX_TAGS) ? AtomicLoad(&g_memory_tags[tag].m_frameBudget, ATOMIC_RELAXED) : 0; }
+
+//////////////////////////////////////////////////////
+//													//
+//					 Setters						//
+//													//
+//////////////////////////////////////////////////////
+memory_tag MemoryTagSetCurrent(memory_tag tag)
+{
+	memory_tag previous = g_memory_tag_current;
+	g_memory_tag_current = (tag < MEMORY_MAX_TAGS) ? tag : MEMORY_TAG_UNTAGGED;
+	return previous;
+}
+void MemoryTagSetBudget(memory_tag tag, uint64_t live_bytes)
+{
+	if (tag < MEMORY_MAX_TAGS)
+		AtomicStore(&g_memory_tags[tag].m_budget, live_bytes, ATOMIC_RELAXED);
+}
+void MemoryTagSetFrameBudget(memory_tag tag, uint64_t bytes_per_frame)
+{
+	if (tag < MEMORY_MAX_TAGS)
+		AtomicStore(&g_memory_tags[tag].m_frameBudget, bytes_per_frame, ATOMIC_RELAXED);
+}
+void MemoryTagSetBudgetCallback(memory_budget_cb callback)
+{
+	AtomicStore(&g_memory_budget_callback, (nullptr == callback) ? &MemoryTagDefaultCallback : callback, ATOMIC_RELEASE);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "Multithreading/ScopedLock.hpp"
+#include <cstdint>
+
+// Defines
+#define MEMORY_MAX_TAGS       (32)
+#define MEMORY_TAG_UNTAGGED   (0)
+// Names the global limit set with SetMaxMemoryInBytes in a budget event
+#define MEMORY_TAG_ALL        (0xFF)
+#define MEMORY_TAG_INVALID    (0xFE)
+
+	// Memory tags split the tracked heap by subsystem.  Every thread has a
+	// current tag, MEMORY_TAG_UNTAGGED until set, and operator new charges the
+	// allocation to it; the tag rides along in the allocation so the free is
+	// credited back to the same tag on any thread.  Allocators carry a tag of
+	// their own, see BaseAllocator.hpp.
+	//
+	// Each tag keeps live bytes, a live high water, and the bytes allocated
+	// since the last ResetFrameMemTrack.  A tag can be given a live budget,
+	// checked as allocations come in, and a per frame budget, checked when the
+	// frame is reset.  Going over either calls the budget callback, at most once
+	// per frame per tag and kind; the default one prints the event.  The
+	// tracker hands each thread's counts over in batches, so the checks and
+	// the high water can trail by up to 64 KiB per thread and tag; the live
+	// getter adds in what is still pending.
+	//
+	// The callback runs on the allocating thread, from inside operator new, so
+	// it should be short.  Allocations it makes are counted but never check a
+	// budget again.
+
+// Datatypes
+typedef uint8_t memory_tag;
+
+struct memory_budget_event
+{
+	memory_tag m_tag;
+	const char* m_name;
+	// Live bytes, or bytes allocated over the last frame
+	uint64_t m_bytes;
+	uint64_t m_budget;
+	bool m_perFrame;
+};
+
+typedef void(*memory_budget_cb)(const memory_budget_event& event);
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Charges the allocations of this thread to a tag until the scope ends, then
+//	puts the previous tag back.  Scopes nest.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class ScopedMemoryTag
+{
+public:
+	explicit ScopedMemoryTag(memory_tag tag);
+	~ScopedMemoryTag();
+
+	ScopedMemoryTag(const ScopedMemoryTag&) = delete;
+	ScopedMemoryTag& operator=(const ScopedMemoryTag&) = delete;
+
+private:
+	memory_tag m_previous;
+};
+
+#define SCOPE_MEMORY_TAG( tag ) ScopedMemoryTag COMBINE(__smt_,__LINE__)(tag)
+
+// Getters
+memory_tag MemoryTagGetCurrent();
+uint32_t MemoryTagGetCount();
+const char* MemoryTagGetName(memory_tag tag);
+uint64_t MemoryTagGetLiveBytes(memory_tag tag);
+uint64_t MemoryTagGetHighWaterBytes(memory_tag tag);
+uint64_t MemoryTagGetFrameBytes(memory_tag tag);
+uint64_t MemoryTagGetBudget(memory_tag tag);
+uint64_t MemoryTagGetFrameBudget(memory_tag tag);
+
+// Setters
+// Returns the tag that was current
+memory_tag MemoryTagSetCurrent(memory_tag tag);
+// 0 turns the budget off
+void MemoryTagSetBudget(memory_tag tag, uint64_t live_bytes);
+void MemoryTagSetFrameBudget(memory_tag tag, uint64_t bytes_per_frame);
+// nullptr puts the default back
+void MemoryTagSetBudgetCallback(memory_budget_cb callback);
+
+// Functions
+// The same name gives the same tag, MEMORY_TAG_INVALID once all are taken
+memory_tag MemoryTagRegister(const char* name);
+// Charges bytes the tracker does not see, like an allocator's own blocks
+void MemoryTagAddBytes(memory_tag tag, int64_t bytes);
+void MemoryTagReport();
+
+// Used by the allocation tracker
+void MemoryTagCommit(memory_tag tag, int64_t live_bytes, uint64_t allocated_bytes);
+void MemoryTagCheckLimit(uint64_t live_bytes, uint64_t limit);
+void MemoryTagEndFrame();
+// Provided by the allocation tracker
+int64_t AllocGetPendingTagBytes(memory_tag tag);
@@ -1,36 +1,406 @@
 #pragma  once
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
 #include "Core/NumberDef.hpp"
+#include <string.h>
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
 
+// Defines
+// 16 byte compare-exchange is only there on 64 bit targets
+#if (defined(_MSC_VER) && defined(_M_X64)) || (!defined(_MSC_VER) && defined(__SIZEOF_INT128__))
+	#define ATOMIC_DOUBLE_WIDTH
+#endif
+// ThreadSanitizer only sees the __atomic builtins, not inline assembly
+#if defined(__SANITIZE_THREAD__)
+	#define ATOMIC_THREAD_SANITIZER
+#elif defined(__has_feature)
+	#if __has_feature(thread_sanitizer)
+		#define ATOMIC_THREAD_SANITIZER
+	#endif
+#endif
 
-inline unsigned int AtomicAdd(volatile unsigned int* ptr, const unsigned int value)
+// Datatypes
+// Values match the GCC __ATOMIC_* constants so they pass straight through
+enum atomic_order
 {
-	return (unsigned int) ::InterlockedAddNoFence((volatile long*)ptr, (long)value);
+	ATOMIC_RELAXED = 0,
+	ATOMIC_ACQUIRE = 2,
+	ATOMIC_RELEASE = 3,
+	ATOMIC_ACQ_REL = 4,
+	ATOMIC_SEQ_CST = 5
+};
+
+#if defined(ATOMIC_DOUBLE_WIDTH)
+struct alignas(16) atomic128
+{
+	U64 m_low;
+	U64 m_high;
+};
+
+template <typename T>
+struct tagged_pointer
+{
+	T* m_pointer;
+	U64 m_tag;
+};
+#endif
+
+	// Every operation works on naturally aligned 4 or 8 byte values, plus the
+	// 16 byte atomic128 for double-width compare-exchange on 64 bit targets.
+	// MSVC builds target x86/x64, where interlocked operations are already
+	// full barriers, so the order only decides whether loads and stores need
+	// more than a compiler barrier.  32 bit x86 has no 8 byte move or 64 bit
+	// interlocked add, and a plain 8 byte access there is two 4 byte moves
+	// that can tear, so every 8 byte operation goes through cmpxchg8b.
+	// GCC/Clang builds hand the order to the __atomic builtins.
+	//
+	// Compare-exchange writes the value it found back into expected on failure,
+	// the same as std::atomic, so retry loops never need a separate reload.
+
+// Functions
+inline void AtomicThreadFence(atomic_order order)
+{
+	#if defined(_MSC_VER)
+		if (ATOMIC_SEQ_CST == order)
+			_mm_mfence();
+		else
+			_ReadWriteBarrier();
+	#else
+		__atomic_thread_fence(order);
+	#endif
+}
+
+inline void AtomicCompilerFence()
+{
+	#if defined(_MSC_VER)
+		_ReadWriteBarrier();
+	#else
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	#endif
+}
+
+#if defined(ATOMIC_DOUBLE_WIDTH)
+// Needs cmpxchg16b, present on every x64 CPU Windows 8.1 and later will boot on
+inline bool AtomicCompareExchange128(volatile atomic128* ptr, atomic128* expected, const atomic128& desired)
+{
+	#if defined(_MSC_VER)
+		return 0 != _InterlockedCompareExchange128((volatile long long*)ptr, (long long)desired.m_high, (long long)desired.m_low, (long long*)expected);
+	#elif defined(__x86_64__) && !defined(ATOMIC_THREAD_SANITIZER)
+		// Inline so we need neither -mcx16 nor libatomic
+		bool result;
+		__asm__ __volatile__(
+			"lock cmpxchg16b %1"
+			: "=@ccz"(result), "+m"(*ptr), "+a"(expected->m_low), "+d"(expected->m_high)
+			: "b"(desired.m_low), "c"(desired.m_high)
+			: "memory");
+		return result;
+	#else
+		return __atomic_compare_exchange((volatile unsigned __int128*)ptr, (unsigned __int128*)expected, (unsigned __int128*)&desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	#endif
+}
+
+// There is no plain 16 byte load, a compare-exchange that fails hands back the value
+inline atomic128 AtomicLoad128(volatile atomic128* ptr)
+{
+	atomic128 value = { 0, 0 };
+	AtomicCompareExchange128(ptr, &value, value);
+	return value;
+}
+#endif
+
+// Templates
+template <typename To, typename From>
+inline To AtomicBitCast(From value)
+{
+	static_assert(sizeof(To) == sizeof(From), "AtomicBitCast needs equal sizes");
+	To result;
+	memcpy(&result, &value, sizeof(To));
+	return result;
+}
+
+#if defined(_MSC_VER)
+
+template <size_t Size>
+struct atomic_ops;
+
+template <>
+struct atomic_ops<4>
+{
+	typedef long word;
+	static word Load(const volatile void* ptr) { return *(const volatile long*)ptr; }
+	static void Store(volatile void* ptr, word value) { *(volatile long*)ptr = value; }
+	static word Exchange(volatile void* ptr, word value) { return _InterlockedExchange((volatile long*)ptr, value); }
+	static word CompareExchange(volatile void* ptr, word comparand, word value) { return _InterlockedCompareExchange((volatile long*)ptr, value, comparand); }
+	static word FetchAdd(volatile void* ptr, word value) { return _InterlockedExchangeAdd((volatile long*)ptr, value); }
+	static word FetchOr(volatile void* ptr, word value) { return _InterlockedOr((volatile long*)ptr, value); }
+	static word FetchAnd(volatile void* ptr, word value) { return _InterlockedAnd((volatile long*)ptr, value); }
+};
+
+#if defined(_M_IX86)
+
+// Only _InterlockedCompareExchange64 exists here, the rest loop on it
+template <>
+struct atomic_ops<8>
+{
+	typedef long long word;
+	static word CompareExchange(volatile void* ptr, word comparand, word value) { return _InterlockedCompareExchange64((volatile long long*)ptr, value, comparand); }
+	// Swapping 0 for 0 leaves the value as it was and returns it whole
+	static word Load(const volatile void* ptr) { return CompareExchange((volatile void*)ptr, 0, 0); }
+	static void Store(volatile void* ptr, word value) { Exchange(ptr, value); }
+
+	static word Exchange(volatile void* ptr, word value)
+	{
+		word previous = Load(ptr);
+		for (word found; previous != (found = CompareExchange(ptr, previous, value)); previous = found) {}
+		return previous;
+	}
+
+	static word FetchAdd(volatile void* ptr, word value)
+	{
+		word previous = Load(ptr);
+		for (word found; previous != (found = CompareExchange(ptr, previous, previous + value)); previous = found) {}
+		return previous;
+	}
+
+	static word FetchOr(volatile void* ptr, word value)
+	{
+		word previous = Load(ptr);
+		for (word found; previous != (found = CompareExchange(ptr, previous, previous | value)); previous = found) {}
+		return previous;
+	}
+
+	static word FetchAnd(volatile void* ptr, word value)
+	{
+		word previous = Load(ptr);
+		for (word found; previous != (found = CompareExchange(ptr, previous, previous & value)); previous = found) {}
+		return previous;
+	}
+};
+
+#else
+
+template <>
+struct atomic_ops<8>
+{
+	typedef long long word;
+	static word Load(const volatile void* ptr) { return *(const volatile long long*)ptr; }
+	static void Store(volatile void* ptr, word value) { *(volatile long long*)ptr = value; }
+	static word Exchange(volatile void* ptr, word value) { return _InterlockedExchange64((volatile long long*)ptr, value); }
+	static word CompareExchange(volatile void* ptr, word comparand, word value) { return _InterlockedCompareExchange64((volatile long long*)ptr, value, comparand); }
+	static word FetchAdd(volatile void* ptr, word value) { return _InterlockedExchangeAdd64((volatile long long*)ptr, value); }
+	static word FetchOr(volatile void* ptr, word value) { return _InterlockedOr64((volatile long long*)ptr, value); }
+	static word FetchAnd(volatile void* ptr, word value) { return _InterlockedAnd64((volatile long long*)ptr, value); }
+};
+
+#endif
+
+#endif
+
+template <typename T>
+inline T AtomicLoad(const volatile T* ptr, atomic_order order = ATOMIC_SEQ_CST)
+{
+	#if defined(_MSC_VER)
+		// Aligned loads up to the word size are atomic on x86 and never move
+		// ahead of later accesses; 8 bytes on 32 bit x86 go through ops
+		#if defined(_M_IX86)
+			typedef atomic_ops<sizeof(T)> ops;
+			T value = AtomicBitCast<T>(ops::Load(ptr));
+		#else
+			T value = *ptr;
+		#endif
+		_ReadWriteBarrier();
+		(void)order;
+		return value;
+	#else
+		return __atomic_load_n(ptr, order);
+	#endif
+}
+
+template <typename T>
+inline void AtomicStore(volatile T* ptr, T value, atomic_order order = ATOMIC_SEQ_CST)
+{
+	#if defined(_MSC_VER)
+		if (ATOMIC_SEQ_CST == order)
+		{
+			typedef atomic_ops<sizeof(T)> ops;
+			ops::Exchange(ptr, AtomicBitCast<typename ops::word>(value));
+			return;
+		}
+		_ReadWriteBarrier();
+		#if defined(_M_IX86)
+			typedef atomic_ops<sizeof(T)> ops;
+			ops::Store(ptr, AtomicBitCast<typename ops::word>(value));
+		#else
+			*ptr = value;
+		#endif
+	#else
+		__atomic_store_n(ptr, value, order);
+	#endif
 }
 
-inline unsigned int AtomicIncrement(unsigned int* ptr)
+template <typename T>
+inline T AtomicExchange(volatile T* ptr, T value, atomic_order order = ATOMIC_SEQ_CST)
 {
-	return (unsigned int) ::InterlockedIncrementNoFence((volatile long*)ptr);
+	#if defined(_MSC_VER)
+		typedef atomic_ops<sizeof(T)> ops;
+		(void)order;
+		return AtomicBitCast<T>(ops::Exchange(ptr, AtomicBitCast<typename ops::word>(value)));
+	#else
+		return __atomic_exchange_n(ptr, value, order);
+	#endif
 }
 
-inline unsigned int AtomicDecrement(unsigned int* ptr)
+// The failure order is derived from order, as it may not include a release
+template <typename T>
+inline bool AtomicCompareExchange(volatile T* ptr, T* expected, T desired, atomic_order order = ATOMIC_SEQ_CST)
 {
-	return (unsigned int) ::InterlockedDecrementNoFence((volatile long*)ptr);
+	#if defined(_MSC_VER)
+		typedef atomic_ops<sizeof(T)> ops;
+		typename ops::word comparand = AtomicBitCast<typename ops::word>(*expected);
+		typename ops::word previous = ops::CompareExchange(ptr, comparand, AtomicBitCast<typename ops::word>(desired));
+		(void)order;
+		if (previous == comparand)
+			return true;
+		*expected = AtomicBitCast<T>(previous);
+		return false;
+	#else
+		int failure = __ATOMIC_RELAXED;
+		if (ATOMIC_SEQ_CST == order)
+			failure = __ATOMIC_SEQ_CST;
+		else if (ATOMIC_ACQUIRE == order || ATOMIC_ACQ_REL == order)
+			failure = __ATOMIC_ACQUIRE;
+		return __atomic_compare_exchange_n(ptr, expected, desired, false, order, failure);
+	#endif
 }
 
-inline unsigned int CompareAndSet(volatile unsigned int* ptr, const unsigned int comparand, const unsigned int value)
+template <typename T>
+inline T AtomicFetchAdd(volatile T* ptr, T value, atomic_order order = ATOMIC_SEQ_CST)
 {
-	return ::InterlockedCompareExchange(ptr, value, comparand);
+	#if defined(_MSC_VER)
+		typedef atomic_ops<sizeof(T)> ops;
+		(void)order;
+		return (T)ops::FetchAdd(ptr, (typename ops::word)value);
+	#else
+		return __atomic_fetch_add(ptr, value, order);
+	#endif
 }
 
-inline bool CompareAndSet64(volatile U64* data, const U64* comparand, const U64* value)
+template <typename T>
+inline T AtomicFetchSub(volatile T* ptr, T value, atomic_order order = ATOMIC_SEQ_CST)
 {
-	return 1 == ::InterlockedCompareExchange64((long long volatile*)data, *(long long*)value, *(long long*)comparand);
+	#if defined(_MSC_VER)
+		typedef atomic_ops<sizeof(T)> ops;
+		(void)order;
+		return (T)ops::FetchAdd(ptr, -(typename ops::word)value);
+	#else
+		return __atomic_fetch_sub(ptr, value, order);
+	#endif
 }
 
 template <typename T>
-inline T* CompareAndSetPointer(T* volatile *ptr, T* comparand, T* value)
+inline T AtomicFetchOr(volatile T* ptr, T value, atomic_order order = ATOMIC_SEQ_CST)
 {
-	return (T*)::InterlockedCompareExchangePointerNoFence((PVOID volatile*)ptr, (PVOID)value, (PVOID)comparand);
-}
\ No newline at end of file
+	#if defined(_MSC_VER)
+		typedef atomic_ops<sizeof(T)> ops;
+		(void)order;
+		return (T)ops::FetchOr(ptr, (typename ops::word)value);
+	#else
+		return __atomic_fetch_or(ptr, value, order);
+	#endif
+}
+
+template <typename T>
+inline T AtomicFetchAnd(volatile T* ptr, T value, atomic_order order = ATOMIC_SEQ_CST)
+{
+	#if defined(_MSC_VER)
+		typedef atomic_ops<sizeof(T)> ops;
+		(void)order;
+		return (T)ops::FetchAnd(ptr, (typename ops::word)value);
+	#else
+		return __atomic_fetch_and(ptr, value, order);
+	#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	A 4 or 8 byte integer or pointer that is only touched through atomic
+//	operations.  Each call names its memory order; relaxed is enough for
+//	statistics, acquire/release pair up to publish data between threads.
+//	Arithmetic and bit operations only make sense for integer types.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class Atomic
+{
+public:
+	Atomic() : m_value(T()) {};
+	explicit Atomic(T value) : m_value(value) {};
+
+	inline T Load(atomic_order order = ATOMIC_SEQ_CST) const { return AtomicLoad(&m_value, order); };
+	inline void Store(T value, atomic_order order = ATOMIC_SEQ_CST) { AtomicStore(&m_value, value, order); };
+	inline T Exchange(T value, atomic_order order = ATOMIC_SEQ_CST) { return AtomicExchange(&m_value, value, order); };
+	inline bool CompareExchange(T& expected, T desired, atomic_order order = ATOMIC_SEQ_CST) { return AtomicCompareExchange(&m_value, &expected, desired, order); };
+	inline T FetchAdd(T value, atomic_order order = ATOMIC_SEQ_CST) { return AtomicFetchAdd(&m_value, value, order); };
+	inline T FetchSub(T value, atomic_order order = ATOMIC_SEQ_CST) { return AtomicFetchSub(&m_value, value, order); };
+	inline T FetchOr(T value, atomic_order order = ATOMIC_SEQ_CST) { return AtomicFetchOr(&m_value, value, order); };
+	inline T FetchAnd(T value, atomic_order order = ATOMIC_SEQ_CST) { return AtomicFetchAnd(&m_value, value, order); };
+
+	// For waiting on the word through the futex layer
+	inline volatile T* GetAddress() { return &m_value; };
+
+private:
+	Atomic(const Atomic&) = delete;
+	Atomic& operator=(const Atomic&) = delete;
+
+private:
+	static_assert(4 == sizeof(T) || 8 == sizeof(T), "Atomic supports 4 and 8 byte types");
+	volatile T m_value;
+};
+
+#if defined(ATOMIC_DOUBLE_WIDTH)
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Pointer paired with a counter that every successful swap bumps, updated
+//	with one 16 byte compare-exchange.  A pointer that was popped and pushed
+//	back between our load and our swap no longer compares equal, which is
+//	what keeps lock-free stacks and free lists clear of the ABA problem.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+class AtomicTaggedPointer
+{
+public:
+	AtomicTaggedPointer() { m_value.m_low = 0; m_value.m_high = 0; };
+
+	inline tagged_pointer<T> Load() const
+	{
+		atomic128 value = AtomicLoad128((volatile atomic128*)&m_value);
+		tagged_pointer<T> result = { (T*)value.m_low, value.m_high };
+		return result;
+	};
+
+	// Only for set up, before other threads can see the pointer
+	inline void StoreUnsafe(T* pointer) { m_value.m_low = (U64)pointer; };
+
+	// On failure expected is refreshed with the current pointer and tag
+	inline bool CompareExchange(tagged_pointer<T>& expected, T* desired)
+	{
+		atomic128 comparand = { (U64)expected.m_pointer, expected.m_tag };
+		atomic128 value = { (U64)desired, expected.m_tag + 1 };
+
+		if (AtomicCompareExchange128(&m_value, &comparand, value))
+			return true;
+
+		expected.m_pointer = (T*)comparand.m_low;
+		expected.m_tag = comparand.m_high;
+		return false;
+	};
+
+private:
+	AtomicTaggedPointer(const AtomicTaggedPointer&) = delete;
+	AtomicTaggedPointer& operator=(const AtomicTaggedPointer&) = delete;
+
+private:
+	volatile atomic128 m_value;
+};
+#endif
@@ -1,14 +1,28 @@
 #include "Multithreading/CriticalSection.hpp"
+#if !defined(_WIN32)
+	#include <sched.h>
+	#include <time.h>
+	#include <errno.h>
+	#include <limits.h>
+	#include <unistd.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+#endif
 
 //////////////////////////////////////////////////////
 //													//
 //					  Datatypes						//
 //													//
 //////////////////////////////////////////////////////
+// Linux limits names to 15 characters, Windows is given the same
+#define THREAD_NAME_LENGTH (16)
+
 struct thread_pass_data
 {
 	thread_cb cb;
 	void *arg;
+	wchar_t name[THREAD_NAME_LENGTH];
+	thread_priority priority;
 };
 
 //////////////////////////////////////////////////////
@@ -18,33 +32,51 @@ struct thread_pass_data
 //////////////////////////////////////////////////////
 CriticalSection::CriticalSection()
 {
-	InitializeCriticalSection(&m_windowsCritical);
+	#if defined(_WIN32)
+		InitializeCriticalSection(&m_windowsCritical);
+	#else
+		pthread_mutexattr_t attributes;
+		pthread_mutexattr_init(&attributes);
+		pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutex_init(&m_posixMutex, &attributes);
+		pthread_mutexattr_destroy(&attributes);
+	#endif
 }
 
 CriticalSection::~CriticalSection()
 {
-	DeleteCriticalSection(&m_windowsCritical);
+	#if defined(_WIN32)
+		DeleteCriticalSection(&m_windowsCritical);
+	#else
+		pthread_mutex_destroy(&m_posixMutex);
+	#endif
 }
 
 void CriticalSection::Lock()
 {
-	EnterCriticalSection(&m_windowsCritical);
-}
-
-void CriticalSection::Unlock()
-{
-	LeaveCriticalSection(&m_windowsCritical);
+	#if defined(_WIN32)
+		EnterCriticalSection(&m_windowsCritical);
+	#else
+		pthread_mutex_lock(&m_posixMutex);
+	#endif
 }
 
-ScopedCriticalSection::ScopedCriticalSection(CriticalSection* cs)
+bool CriticalSection::TryLock()
 {
-	m_critical = cs;
-	m_critical->Lock();
+	#if defined(_WIN32)
+		return FALSE != TryEnterCriticalSection(&m_windowsCritical);
+	#else
+		return 0 == pthread_mutex_trylock(&m_posixMutex);
+	#endif
 }
 
-ScopedCriticalSection::~ScopedCriticalSection()
+void CriticalSection::Unlock()
 {
-	m_critical->Unlock();
+	#if defined(_WIN32)
+		LeaveCriticalSection(&m_windowsCritical);
+	#else
+		pthread_mutex_unlock(&m_posixMutex);
+	#endif
 }
 
 //////////////////////////////////////////////////////
@@ -52,10 +84,36 @@ ScopedCriticalSection::~ScopedCriticalSection()
 //					Functions						//
 //													//
 //////////////////////////////////////////////////////
+#if defined(_WIN32)
+static int ThreadWindowsPriority(thread_priority priority)
+{
+	const int priorities[] = { THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST };
+	return priorities[priority];
+}
+#else
+static void ThreadApplyStartOptions(thread_pass_data* pass_ptr)
+{
+	if (0 != pass_ptr->name[0])
+		ThreadSetCurrentName(pass_ptr->name);
+
+	if (THREAD_PRIO_NORMAL != pass_ptr->priority)
+		ThreadSetCurrentPriority(pass_ptr->priority);
+}
+#endif
+
+#if defined(_WIN32)
 static DWORD WINAPI ThreadEntryPointCommon(void* arg)
+#else
+static void* ThreadEntryPointCommon(void* arg)
+#endif
 {
 	thread_pass_data* pass_ptr = (thread_pass_data*)arg;
 
+	#if !defined(_WIN32)
+		// Windows threads are named and prioritized before they resume
+		ThreadApplyStartOptions(pass_ptr);
+	#endif
+
 	pass_ptr->cb(pass_ptr->arg);
 	delete pass_ptr;
 	return 0;
@@ -63,46 +121,212 @@ static DWORD WINAPI ThreadEntryPointCommon(void* arg)
 
 // Creates a thread with the entry point of cb, passed data
 thread_handle ThreadCreate(thread_cb cb, void* data, const wchar_t* thread_name)
+{
+	thread_options options;
+	options.m_name = thread_name;
+	return ThreadCreate(cb, data, options);
+}
+
+thread_handle ThreadCreate(thread_cb cb, void* data, const thread_options& options)
 {
 	// handle is like pointer, or reference to a thread
 	// thread_id is unique identifier
 	thread_pass_data* pass = new thread_pass_data();
 	pass->cb = cb;
 	pass->arg = data;
+	pass->priority = options.m_priority;
+
+	// Copied, the caller's string may not outlive the thread start
+	U32 length = 0;
+	if (nullptr != options.m_name)
+	{
+		for (; length < THREAD_NAME_LENGTH - 1 && 0 != options.m_name[length]; ++length)
+			pass->name[length] = options.m_name[length];
+	}
+	pass->name[length] = 0;
+
+	#if defined(_WIN32)
+		DWORD flags = CREATE_SUSPENDED;
+		if (0 != options.m_stackSize)
+			flags |= STACK_SIZE_PARAM_IS_A_RESERVATION;
+
+		DWORD thread_id;
+		thread_handle th = ::CreateThread(nullptr,   // SECURITY OPTIONS
+			(SIZE_T)options.m_stackSize,           // STACK SIZE, 0 is default
+			ThreadEntryPointCommon,    // "main" for this thread
+			pass,                     // data to pass to it
+			flags,                     // initial flags
+			&thread_id);              // thread_id
+
+		if (nullptr == th)
+		{
+			delete pass;
+			return INVALID_THREAD_HANDLE;
+		}
+
+		if (0 != options.m_affinityMask)
+			ThreadSetAffinity(th, options.m_affinityMask);
+		if (0 != pass->name[0])
+			::SetThreadDescription(th, pass->name);
+		if (THREAD_PRIO_NORMAL != options.m_priority)
+			::SetThreadPriority(th, ThreadWindowsPriority(options.m_priority));
+
+		::ResumeThread(th);
+		return th;
+	#else
+		pthread_attr_t attributes;
+		pthread_attr_init(&attributes);
 
-	DWORD thread_id;
-	thread_handle th = ::CreateThread(nullptr,   // SECURITY OPTIONS
-		0,                         // STACK SIZE, 0 is default
-		ThreadEntryPointCommon,    // "main" for this thread
-		pass,                     // data to pass to it
-		0,                         // initial flags
-		&thread_id);              // thread_id
+		if (0 != options.m_stackSize)
+		{
+			U64 stack_size = (options.m_stackSize < (U64)PTHREAD_STACK_MIN) ? (U64)PTHREAD_STACK_MIN : options.m_stackSize;
+			pthread_attr_setstacksize(&attributes, (size_t)stack_size);
+		}
 
-	#ifdef _DEBUG
-		SetThreadDescription(th, thread_name);
+		// Set before the start so the thread never runs anywhere else
+		if (0 != options.m_affinityMask)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			for (U32 cpu = 0; cpu < 64; ++cpu)
+			{
+				if (0 != (options.m_affinityMask & ((U64)1 << cpu)))
+					CPU_SET(cpu, &cpus);
+			}
+			pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus);
+		}
+
+		pthread_t thread;
+		int result = pthread_create(&thread, &attributes, ThreadEntryPointCommon, pass);
+		pthread_attr_destroy(&attributes);
+
+		if (0 != result)
+		{
+			delete pass;
+			return INVALID_THREAD_HANDLE;
+		}
+
+		return (thread_handle)thread;
+	#endif
+}
+
+bool ThreadSetAffinity(thread_handle th, U64 affinity_mask)
+{
+	#if defined(_WIN32)
+		return 0 != ::SetThreadAffinityMask(th, (DWORD_PTR)affinity_mask);
+	#else
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (U32 cpu = 0; cpu < 64; ++cpu)
+		{
+			if (0 != (affinity_mask & ((U64)1 << cpu)))
+				CPU_SET(cpu, &cpus);
+		}
+		return 0 == pthread_setaffinity_np((pthread_t)th, sizeof(cpus), &cpus);
+	#endif
+}
+
+bool ThreadSetCurrentAffinity(U64 affinity_mask)
+{
+	#if defined(_WIN32)
+		return ThreadSetAffinity(::GetCurrentThread(), affinity_mask);
+	#else
+		return ThreadSetAffinity((thread_handle)pthread_self(), affinity_mask);
+	#endif
+}
+
+// Raising priority above normal needs CAP_SYS_NICE on Linux, false if refused
+bool ThreadSetCurrentPriority(thread_priority priority)
+{
+	#if defined(_WIN32)
+		return FALSE != ::SetThreadPriority(::GetCurrentThread(), ThreadWindowsPriority(priority));
+	#else
+		// Nice values are per thread on Linux when given a thread id
+		const int nice_values[] = { 10, 5, 0, -5, -10 };
+		return 0 == setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice_values[priority]);
 	#endif
+}
+
+void ThreadSetCurrentName(const wchar_t* thread_name)
+{
+	#if defined(_WIN32)
+		::SetThreadDescription(::GetCurrentThread(), thread_name);
+	#else
+		// pthread names are narrow, anything outside ASCII becomes '?'
+		char name[THREAD_NAME_LENGTH];
+		U32 length = 0;
+		for (; length < THREAD_NAME_LENGTH - 1 && 0 != thread_name[length]; ++length)
+			name[length] = ((U32)thread_name[length] < 128) ? (char)thread_name[length] : '?';
+		name[length] = 0;
 
-	return th;
+		pthread_setname_np(pthread_self(), name);
+	#endif
 }
 
 void ThreadSleep(unsigned int ms)
 {
-	::Sleep(ms);
+	#if defined(_WIN32)
+		::Sleep(ms);
+	#else
+		struct timespec duration;
+		duration.tv_sec = ms / 1000;
+		duration.tv_nsec = (long)(ms % 1000) * 1000000L;
+		while (0 != nanosleep(&duration, &duration) && EINTR == errno) {}
+	#endif
 }
 
 void ThreadYield()
 {
-	::SwitchToThread();
+	#if defined(_WIN32)
+		::SwitchToThread();
+	#else
+		sched_yield();
+	#endif
+}
+
+unsigned int ThreadGetProcessorCount()
+{
+	// Only the processors this process may use
+	#if defined(_WIN32)
+		DWORD_PTR process_mask = 0;
+		DWORD_PTR system_mask = 0;
+		if (::GetProcessAffinityMask(::GetCurrentProcess(), &process_mask, &system_mask) && 0 != process_mask)
+		{
+			unsigned int count = 0;
+			for (; 0 != process_mask; process_mask &= process_mask - 1)
+			{
+				++count;
+			}
+			return count;
+		}
+
+		SYSTEM_INFO info;
+		::GetSystemInfo(&info);
+		return (unsigned int)info.dwNumberOfProcessors;
+	#else
+		cpu_set_t cpus;
+		if (0 == sched_getaffinity(0, sizeof(cpus), &cpus))
+			return (unsigned int)CPU_COUNT(&cpus);
+		return (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+	#endif
 }
 
 // Releases my hold on this thread.
 void ThreadDetach(thread_handle th)
 {
-	::CloseHandle(th);
+	#if defined(_WIN32)
+		::CloseHandle(th);
+	#else
+		pthread_detach((pthread_t)th);
+	#endif
 }
 
 void ThreadJoin(thread_handle th)
 {
-	::WaitForSingleObject(th, INFINITE);
-	::CloseHandle(th);
+	#if defined(_WIN32)
+		::WaitForSingleObject(th, INFINITE);
+		::CloseHandle(th);
+	#else
+		pthread_join((pthread_t)th, nullptr);
+	#endif
 }
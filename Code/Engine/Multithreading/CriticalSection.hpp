@@ -1,47 +1,75 @@
 #pragma once
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include "Core/NumberDef.hpp"
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <pthread.h>
+#endif
 // #TODO: Remove Tuple
 #include <tuple>
 // #TODO: Remove Utility
 #include <utility>
+#include "Multithreading/ScopedLock.hpp"
 
 // Datatypes
 typedef void* thread_handle;
 typedef void(*thread_cb)(void*);
 
+enum thread_priority
+{
+	THREAD_PRIO_LOWEST,
+	THREAD_PRIO_LOW,
+	THREAD_PRIO_NORMAL,
+	THREAD_PRIO_HIGH,
+	THREAD_PRIO_HIGHEST
+};
+
+struct thread_options
+{
+	const wchar_t* m_name = nullptr;
+	// One bit per OS processor number, 0 leaves placement to the OS
+	U64 m_affinityMask = 0;
+	// 0 keeps the platform default
+	U64 m_stackSize = 0;
+	thread_priority m_priority = THREAD_PRIO_NORMAL;
+};
+
+// Recursive, like the Windows critical section it wraps
 class CriticalSection
 {
 public:
 	CriticalSection();
 	~CriticalSection();
 	void Lock();
+	bool TryLock();
 	void Unlock();
 public:
-	CRITICAL_SECTION m_windowsCritical;
+	#if defined(_WIN32)
+		CRITICAL_SECTION m_windowsCritical;
+	#else
+		pthread_mutex_t m_posixMutex;
+	#endif
 };
 
-class ScopedCriticalSection
-{
-public:
-	ScopedCriticalSection(CriticalSection* cs);
-	~ScopedCriticalSection();
-public:
-	CriticalSection* m_critical;
-};
+// Older call sites name the guard directly
+typedef ScopedLock ScopedCriticalSection;
 
 // Defines
 #define INVALID_THREAD_HANDLE 0
-#define COMBINE_1(X,Y) X##Y
-#define COMBINE(X,Y) COMBINE_1(X,Y)
-#define SCOPE_LOCK( csp ) ScopedCriticalSection COMBINE(__scs_,__LINE__)(csp)
 
 // Functions
 thread_handle ThreadCreate(thread_cb cb, void *data, const wchar_t* thread_name);
+thread_handle ThreadCreate(thread_cb cb, void *data, const thread_options& options);
+bool ThreadSetAffinity(thread_handle th, U64 affinity_mask);
+bool ThreadSetCurrentAffinity(U64 affinity_mask);
+bool ThreadSetCurrentPriority(thread_priority priority);
+void ThreadSetCurrentName(const wchar_t* thread_name);
 void ThreadSleep(unsigned int ms);
 void ThreadDetach(thread_handle th);
 void ThreadJoin(thread_handle th);
 void ThreadYield();
+unsigned int ThreadGetProcessorCount();
 
 // Templates
 template <typename CB, typename ...ARGS>
@@ -0,0 +1,307 @@
+#include "Multithreading/Epoch.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Futex.hpp"
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <linux/membarrier.h>
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct epoch_retired
+{
+	void* m_pointer;
+	epoch_free_cb m_free;
+	void* m_context;
+	U64 m_epoch;
+};
+
+// Retired in epoch order, so whatever can be freed is always a prefix
+struct epoch_retire_list
+{
+	epoch_retired* m_entries;
+	U32 m_count;
+	U32 m_capacity;
+};
+
+// A cache line each, readers store to m_state on every section
+struct alignas(64) epoch_thread
+{
+	// Epoch seen shifted up one, low bit set while inside a section
+	volatile U64 m_state;
+	volatile U32 m_claimed;
+	epoch_retire_list m_retired;
+};
+
+struct epoch_thread_exit
+{
+	bool m_armed = false;
+	~epoch_thread_exit() { EpochThreadRelease(); }
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// Two advances, after which no section that saw a retired node is left
+const U64 EPOCH_GRACE = 2;
+const U32 EPOCH_FLUSH_SPIN = 64;
+
+volatile U64 g_epoch = 0;
+static epoch_thread g_epoch_threads[EPOCH_MAX_THREADS];
+// Records past this were never claimed, scans stop here
+static volatile U32 g_epoch_thread_count = 0;
+// Threads that found no free record, any of them in a section stalls advances
+static volatile U32 g_epoch_overflow_active = 0;
+static epoch_retire_list g_epoch_orphans = {};
+static Mutex g_epoch_orphan_lock;
+
+static bool EpochRegisterBarrier();
+// Readers only need a compiler fence when writers can fence every thread
+extern const bool g_epoch_asymmetric = EpochRegisterBarrier();
+
+thread_local epoch_reader g_epoch_reader = {};
+static thread_local epoch_thread* g_epoch_thread = nullptr;
+static thread_local epoch_thread_exit g_epoch_thread_exit;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static bool EpochRegisterBarrier()
+{
+	#if defined(_WIN32)
+		return true;
+	#else
+		return 0 == syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0);
+	#endif
+}
+
+// A full fence on every processor running one of our threads, which pairs
+// with the plain store and compiler fence on the read side
+static void EpochHeavyBarrier()
+{
+	#if defined(_WIN32)
+		::FlushProcessWriteBuffers();
+	#else
+		syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+	#endif
+}
+
+static void EpochListPush(epoch_retire_list* list, const epoch_retired& retired)
+{
+	if (list->m_count == list->m_capacity)
+	{
+		U32 capacity = (0 == list->m_capacity) ? EPOCH_RETIRE_BATCH * 2 : list->m_capacity * 2;
+		list->m_entries = (epoch_retired*) ::realloc(list->m_entries, capacity * sizeof(epoch_retired));
+		list->m_capacity = capacity;
+	}
+
+	list->m_entries[list->m_count++] = retired;
+}
+
+// Frees everything retired at least two epochs before current
+static void EpochListReclaim(epoch_retire_list* list, U64 current)
+{
+	U32 freed = 0;
+	while (freed < list->m_count && list->m_entries[freed].m_epoch + EPOCH_GRACE <= current)
+	{
+		const epoch_retired& retired = list->m_entries[freed];
+		retired.m_free(retired.m_pointer, retired.m_context);
+		++freed;
+	}
+
+	if (0 == freed)
+		return;
+
+	list->m_count -= freed;
+	memmove(list->m_entries, list->m_entries + freed, list->m_count * sizeof(epoch_retired));
+}
+
+static epoch_thread* EpochClaimThread()
+{
+	for (U32 index = 0; index < EPOCH_MAX_THREADS; ++index)
+	{
+		epoch_thread& thread = g_epoch_threads[index];
+		U32 expected = 0;
+		if (0 != AtomicLoad(&thread.m_claimed, ATOMIC_RELAXED) || !AtomicCompareExchange(&thread.m_claimed, &expected, 1U, ATOMIC_ACQUIRE))
+			continue;
+
+		// Raise the scan limit, a record is only ever claimed once below it
+		U32 count = AtomicLoad(&g_epoch_thread_count, ATOMIC_RELAXED);
+		while (count < index + 1 && !AtomicCompareExchange(&g_epoch_thread_count, &count, index + 1, ATOMIC_RELEASE)) {}
+
+		g_epoch_thread_exit.m_armed = true;
+		return &thread;
+	}
+
+	return nullptr;
+}
+
+static epoch_thread* EpochGetThread()
+{
+	if (nullptr == g_epoch_thread)
+		g_epoch_thread = EpochClaimThread();
+	return g_epoch_thread;
+}
+
+// First section on this thread, or every outermost one when no record was
+// free; the reader's nesting already counts this section
+void EpochEnterSlow()
+{
+	epoch_thread* thread = EpochGetThread();
+	if (nullptr == thread)
+	{
+		AtomicFetchAdd(&g_epoch_overflow_active, 1U, ATOMIC_SEQ_CST);
+		return;
+	}
+
+	// Only set on an outermost entry, so a record claimed by EpochRetire
+	// inside an overflow section cannot unbalance its exit
+	g_epoch_reader.m_state = &thread->m_state;
+	--g_epoch_reader.m_nesting;
+	EpochEnter();
+}
+
+void EpochExitSlow()
+{
+	AtomicFetchSub(&g_epoch_overflow_active, 1U, ATOMIC_RELEASE);
+}
+
+// Advances once every thread in a section has seen the current epoch
+static U64 EpochTryAdvance()
+{
+	U64 epoch = AtomicLoad(&g_epoch, ATOMIC_SEQ_CST);
+
+	if (0 != AtomicLoad(&g_epoch_overflow_active, ATOMIC_SEQ_CST))
+		return epoch;
+
+	if (g_epoch_asymmetric)
+		EpochHeavyBarrier();
+
+	U32 count = AtomicLoad(&g_epoch_thread_count, ATOMIC_ACQUIRE);
+	for (U32 index = 0; index < count; ++index)
+	{
+		U64 state = AtomicLoad(&g_epoch_threads[index].m_state, ATOMIC_SEQ_CST);
+		if (0 != (state & EPOCH_ACTIVE) && (state >> 1) != epoch)
+			return epoch;
+	}
+
+	// Losing the race means someone else advanced, just as good
+	AtomicCompareExchange(&g_epoch, &epoch, epoch + 1, ATOMIC_SEQ_CST);
+	return AtomicLoad(&g_epoch, ATOMIC_SEQ_CST);
+}
+
+// The pointer must already be unreachable for new readers
+void EpochRetire(void* pointer, epoch_free_cb free_cb, void* context /*= nullptr*/)
+{
+	epoch_retired retired;
+	retired.m_pointer = pointer;
+	retired.m_free = free_cb;
+	retired.m_context = context;
+	retired.m_epoch = AtomicLoad(&g_epoch, ATOMIC_SEQ_CST);
+
+	epoch_thread* thread = EpochGetThread();
+	if (nullptr == thread)
+	{
+		SCOPE_LOCK(&g_epoch_orphan_lock);
+		EpochListPush(&g_epoch_orphans, retired);
+		return;
+	}
+
+	EpochListPush(&thread->m_retired, retired);
+	if (0 == thread->m_retired.m_count % EPOCH_RETIRE_BATCH)
+		EpochCollect();
+}
+
+// Returns true when anything is still waiting on this thread's list
+bool EpochCollect()
+{
+	U64 epoch = EpochTryAdvance();
+
+	// Whoever gets the lock adopts what exited threads left behind
+	if (g_epoch_orphan_lock.TryLock())
+	{
+		EpochListReclaim(&g_epoch_orphans, epoch);
+		g_epoch_orphan_lock.Unlock();
+	}
+
+	epoch_thread* thread = g_epoch_thread;
+	if (nullptr == thread)
+		return false;
+
+	EpochListReclaim(&thread->m_retired, epoch);
+	return 0 != thread->m_retired.m_count;
+}
+
+// Frees all this thread has retired, waiting out the other threads' sections.
+// Must not be called from inside a section, the epoch could never advance.
+void EpochFlush()
+{
+	U32 spin = 0;
+	while (EpochCollect())
+	{
+		if (++spin < EPOCH_FLUSH_SPIN)
+			CpuPause();
+		else
+			ThreadYield();
+	}
+}
+
+// Runs on thread exit, anything still pending is left to other threads
+void EpochThreadRelease()
+{
+	epoch_thread* thread = g_epoch_thread;
+	if (nullptr == thread)
+		return;
+
+	AtomicStore(&thread->m_state, (U64)0, ATOMIC_RELEASE);
+	g_epoch_reader = epoch_reader();
+	EpochListReclaim(&thread->m_retired, EpochTryAdvance());
+
+	// Orphans from several threads are not in epoch order, so reclaiming them
+	// stops at the first entry that is too new; later ones are merely late
+	if (0 != thread->m_retired.m_count)
+	{
+		SCOPE_LOCK(&g_epoch_orphan_lock);
+		for (U32 index = 0; index < thread->m_retired.m_count; ++index)
+		{
+			EpochListPush(&g_epoch_orphans, thread->m_retired.m_entries[index]);
+		}
+	}
+
+	::free(thread->m_retired.m_entries);
+	thread->m_retired = epoch_retire_list();
+
+	g_epoch_thread = nullptr;
+	AtomicStore(&thread->m_claimed, 0U, ATOMIC_RELEASE);
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+U64 EpochGetCurrent()
+{
+	return AtomicLoad(&g_epoch, ATOMIC_ACQUIRE);
+}
+
+U32 EpochGetPendingCount()
+{
+	epoch_thread* thread = g_epoch_thread;
+	return (nullptr == thread) ? 0 : thread->m_retired.m_count;
+}
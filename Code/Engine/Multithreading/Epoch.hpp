@@ -0,0 +1,123 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/ScopedLock.hpp"
+
+// Datatypes
+typedef void(*epoch_free_cb)(void* pointer, void* context);
+
+// Read side of a thread's record, kept apart so sections never leave the header
+struct epoch_reader
+{
+	// Null until the first section claims a record, or when none was free
+	volatile U64* m_state;
+	U32 m_nesting;
+};
+
+// Defines
+#define EPOCH_MAX_THREADS  (128)
+#define EPOCH_RETIRE_BATCH (64)
+// Low bit of a record's state, set while inside a section
+#define EPOCH_ACTIVE       (1ULL)
+
+	// Epoch based reclamation for lock-free structures.  Readers wrap every
+	// access to shared nodes in EpochEnter/EpochExit (or SCOPE_EPOCH), which
+	// publishes the global epoch they saw.  Sections nest and are inline: a
+	// thread local counter bump and, for the outermost one, a plain store, with
+	// only the first section on a thread calling out to claim a record.  The
+	// thread advancing the epoch pays for the fence instead, through
+	// FlushProcessWriteBuffers or membarrier, and readers fall back to a full
+	// fence where membarrier is missing.  A writer that unlinks a node
+	// hands it to EpochRetire instead of freeing it.  It goes on a list private
+	// to the writer's thread, stamped with the global epoch, and every
+	// EPOCH_RETIRE_BATCH retirements the thread tries to advance the epoch,
+	// which only happens once every thread inside a section has seen the current
+	// one.  A node is freed two advances after it was retired, when no section
+	// that could have seen it is left.  A section must not span JobWait, since
+	// the fiber may resume on another thread.  Threads give their record back
+	// when they exit, and whatever they had retired is adopted by the next
+	// collection.  Threads beyond EPOCH_MAX_THREADS still work, but hold the
+	// epoch back while in a section.
+
+// Globals, only for the inline sections below
+extern volatile U64 g_epoch;
+extern const bool g_epoch_asymmetric;
+extern thread_local epoch_reader g_epoch_reader;
+
+// Functions
+void EpochEnterSlow();
+void EpochExitSlow();
+void EpochRetire(void* pointer, epoch_free_cb free_cb, void* context = nullptr);
+bool EpochCollect();
+void EpochFlush();
+void EpochThreadRelease();
+U64 EpochGetCurrent();
+U32 EpochGetPendingCount();
+
+inline void EpochEnter()
+{
+	epoch_reader& reader = g_epoch_reader;
+	if (0 != reader.m_nesting++)
+		return;
+
+	if (nullptr == reader.m_state)
+	{
+		EpochEnterSlow();
+		return;
+	}
+
+	// The state has to be visible before any shared read; with the heavy
+	// barrier on the advancing side a compiler fence is enough here
+	U64 epoch = AtomicLoad(&g_epoch, ATOMIC_RELAXED);
+	if (g_epoch_asymmetric)
+	{
+		AtomicStore(reader.m_state, (epoch << 1) | EPOCH_ACTIVE, ATOMIC_RELAXED);
+		AtomicCompilerFence();
+	}
+	else
+	{
+		AtomicExchange(reader.m_state, (epoch << 1) | EPOCH_ACTIVE, ATOMIC_SEQ_CST);
+	}
+}
+
+inline void EpochExit()
+{
+	epoch_reader& reader = g_epoch_reader;
+	if (0 != --reader.m_nesting)
+		return;
+
+	if (nullptr == reader.m_state)
+	{
+		EpochExitSlow();
+		return;
+	}
+
+	AtomicStore(reader.m_state, (U64)0, ATOMIC_RELEASE);
+}
+
+class ScopedEpoch
+{
+public:
+	ScopedEpoch() { EpochEnter(); };
+	~ScopedEpoch() { EpochExit(); };
+private:
+	ScopedEpoch(const ScopedEpoch&) = delete;
+	ScopedEpoch& operator=(const ScopedEpoch&) = delete;
+};
+
+// Defines
+#define SCOPE_EPOCH() ScopedEpoch COMBINE(__sep_,__LINE__)
+
+// Templates
+template <typename Object>
+void EpochDeleteRetired(void* pointer, void*)
+{
+	delete (Object*)pointer;
+}
+
+// For nodes made with new, allocator nodes go through BaseAllocator::Retire
+template <typename Object>
+void EpochRetireDelete(Object* obj)
+{
+	EpochRetire(obj, &EpochDeleteRetired<Object>);
+}
@@ -0,0 +1,228 @@
+#include "Multithreading/Fiber.hpp"
+#include <stdlib.h>
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#if !defined(__x86_64__)
+		#include <ucontext.h>
+	#endif
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct Fiber
+{
+	// Windows: fiber handle. x86-64: saved stack pointer.
+	void* m_context;
+	void* m_stack;
+	U64 m_stackSize;
+	fiber_cb m_entry;
+	void* m_data;
+	#if !defined(_WIN32) && !defined(__x86_64__)
+		ucontext_t m_ucontext;
+	#endif
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+#if !defined(_WIN32) && defined(__x86_64__)
+
+// Saves the System V callee-saved registers plus the SSE and x87 control
+// words on the current stack, stores the stack pointer through rdi, then
+// loads the stack in rsi and unwinds the same frame from it.
+extern "C" void FiberSwapContext(void** out_stack_pointer, void* stack_pointer);
+extern "C" void FiberTrampoline();
+
+asm(R"(
+	.text
+	.globl FiberSwapContext
+	.type FiberSwapContext, @function
+FiberSwapContext:
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	subq $8, %rsp
+	stmxcsr (%rsp)
+	fnstcw 4(%rsp)
+	movq %rsp, (%rdi)
+	movq %rsi, %rsp
+	ldmxcsr (%rsp)
+	fldcw 4(%rsp)
+	addq $8, %rsp
+	popq %r15
+	popq %r14
+	popq %r13
+	popq %r12
+	popq %rbx
+	popq %rbp
+	ret
+	.size FiberSwapContext, .-FiberSwapContext
+
+	.globl FiberTrampoline
+	.type FiberTrampoline, @function
+FiberTrampoline:
+	movq %r12, %rdi
+	callq *%r13
+	ud2
+	.size FiberTrampoline, .-FiberTrampoline
+)");
+
+const U64 FIBER_INITIAL_FRAME_WORDS = 8;
+const U32 FIBER_DEFAULT_MXCSR = 0x1F80;
+const U16 FIBER_DEFAULT_FPU_CONTROL = 0x037F;
+
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static void FiberStart(Fiber* fiber)
+{
+	fiber->m_entry(fiber->m_data);
+
+	// Returning would unwind into nothing, fibers have to switch away for good
+	abort();
+}
+
+#if defined(_WIN32)
+static VOID WINAPI FiberStartWindows(LPVOID param)
+{
+	FiberStart((Fiber*)param);
+}
+#elif !defined(__x86_64__)
+static void FiberStartUContext(int high_bits, int low_bits)
+{
+	U64 address = ((U64)(unsigned int)high_bits << 32) | (U64)(unsigned int)low_bits;
+	FiberStart((Fiber*)address);
+}
+#endif
+
+#if !defined(_WIN32)
+static void* FiberAllocateStack(U64 size, U64* out_mapped_size)
+{
+	// One PROT_NONE guard page under the stack turns an overflow into a fault
+	U64 page_size = (U64)sysconf(_SC_PAGESIZE);
+	U64 mapped_size = ((size + page_size - 1) / page_size) * page_size + page_size;
+
+	void* memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == memory)
+		return nullptr;
+
+	mprotect(memory, page_size, PROT_NONE);
+	*out_mapped_size = mapped_size;
+	return memory;
+}
+#endif
+
+Fiber* FiberConvertThread()
+{
+	Fiber* fiber = (Fiber*) ::calloc(1, sizeof(Fiber));
+
+	#if defined(_WIN32)
+		fiber->m_context = ::ConvertThreadToFiber(nullptr);
+	#endif
+
+	return fiber;
+}
+
+void FiberRevertThread(Fiber* thread_fiber)
+{
+	#if defined(_WIN32)
+		::ConvertFiberToThread();
+	#endif
+
+	::free(thread_fiber);
+}
+
+Fiber* FiberCreate(fiber_cb entry_point, void* data, U64 stack_size /*= FIBER_DEFAULT_STACK_SIZE*/)
+{
+	Fiber* fiber = (Fiber*) ::calloc(1, sizeof(Fiber));
+	fiber->m_entry = entry_point;
+	fiber->m_data = data;
+
+	#if defined(_WIN32)
+		fiber->m_context = ::CreateFiber((SIZE_T)stack_size, FiberStartWindows, fiber);
+		if (nullptr == fiber->m_context)
+		{
+			::free(fiber);
+			return nullptr;
+		}
+	#else
+		fiber->m_stack = FiberAllocateStack(stack_size, &fiber->m_stackSize);
+		if (nullptr == fiber->m_stack)
+		{
+			::free(fiber);
+			return nullptr;
+		}
+
+		#if defined(__x86_64__)
+			// Lay out the frame FiberSwapContext pops: control words, r15..rbp,
+			// then the return into the trampoline, which calls FiberStart(r12)
+			// through r13 from a 16 byte aligned stack.
+			U64* stack_top = (U64*)((char*)fiber->m_stack + fiber->m_stackSize);
+			U64* frame = stack_top - FIBER_INITIAL_FRAME_WORDS;
+
+			frame[0] = (U64)FIBER_DEFAULT_MXCSR | ((U64)FIBER_DEFAULT_FPU_CONTROL << 32);
+			frame[1] = 0;						// r15
+			frame[2] = 0;						// r14
+			frame[3] = (U64)&FiberStart;		// r13
+			frame[4] = (U64)fiber;				// r12
+			frame[5] = 0;						// rbx
+			frame[6] = 0;						// rbp
+			frame[7] = (U64)&FiberTrampoline;	// return address
+
+			fiber->m_context = frame;
+		#else
+			U64 page_size = (U64)sysconf(_SC_PAGESIZE);
+			getcontext(&fiber->m_ucontext);
+			fiber->m_ucontext.uc_stack.ss_sp = (char*)fiber->m_stack + page_size;
+			fiber->m_ucontext.uc_stack.ss_size = fiber->m_stackSize - page_size;
+			fiber->m_ucontext.uc_link = nullptr;
+
+			U64 address = (U64)fiber;
+			makecontext(&fiber->m_ucontext, (void(*)())FiberStartUContext, 2, (int)(address >> 32), (int)(address & 0xFFFFFFFF));
+		#endif
+	#endif
+
+	return fiber;
+}
+
+void FiberDestroy(Fiber* fiber)
+{
+	if (nullptr == fiber)
+		return;
+
+	#if defined(_WIN32)
+		::DeleteFiber(fiber->m_context);
+	#else
+		munmap(fiber->m_stack, fiber->m_stackSize);
+	#endif
+
+	::free(fiber);
+}
+
+void FiberSwitch(Fiber* from, Fiber* to)
+{
+	#if defined(_WIN32)
+		(void)from;
+		::SwitchToFiber(to->m_context);
+	#elif defined(__x86_64__)
+		FiberSwapContext(&from->m_context, to->m_context);
+	#else
+		swapcontext(&from->m_ucontext, &to->m_ucontext);
+	#endif
+}
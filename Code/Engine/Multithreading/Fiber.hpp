@@ -0,0 +1,24 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+
+// Datatypes
+typedef void(*fiber_cb)(void*);
+struct Fiber;
+
+// Defines
+#define FIBER_DEFAULT_STACK_SIZE (64 * 1024)
+
+	// Windows builds use the OS fiber API.  Linux x86-64 switches with a
+	// hand-written routine that only saves the callee-saved registers, and
+	// other Linux targets fall back to ucontext.
+	//
+	// Fibers move between threads, so anything thread_local must be re-read
+	// after FiberSwitch returns.  MSVC needs /GT so TLS addresses are not
+	// cached across the switch; every engine and tool configuration sets it.
+
+// Functions
+Fiber* FiberConvertThread();
+void FiberRevertThread(Fiber* thread_fiber);
+Fiber* FiberCreate(fiber_cb entry_point, void* data, U64 stack_size = FIBER_DEFAULT_STACK_SIZE);
+void FiberDestroy(Fiber* fiber);
+void FiberSwitch(Fiber* from, Fiber* to);
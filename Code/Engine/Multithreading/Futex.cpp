@@ -0,0 +1,57 @@
+#include "Multithreading/Futex.hpp"
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+	#pragma comment(lib, "Synchronization.lib")
+#else
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+	#include <time.h>
+	#include <errno.h>
+	#include <limits.h>
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+bool FutexWait(volatile U32* address, U32 expected, U32 timeout_ms /*= FUTEX_WAIT_INFINITE*/)
+{
+	#if defined(_WIN32)
+		DWORD wait_ms = (FUTEX_WAIT_INFINITE == timeout_ms) ? INFINITE : (DWORD)timeout_ms;
+		return FALSE != ::WaitOnAddress(address, &expected, sizeof(U32), wait_ms);
+	#else
+		struct timespec timeout;
+		struct timespec* timeout_ptr = nullptr;
+
+		if (FUTEX_WAIT_INFINITE != timeout_ms)
+		{
+			timeout.tv_sec = timeout_ms / 1000;
+			timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+			timeout_ptr = &timeout;
+		}
+
+		long result = syscall(SYS_futex, (U32*)address, FUTEX_WAIT_PRIVATE, expected, timeout_ptr, nullptr, 0);
+		return !(-1 == result && ETIMEDOUT == errno);
+	#endif
+}
+
+void FutexWakeOne(volatile U32* address)
+{
+	#if defined(_WIN32)
+		::WakeByAddressSingle((PVOID)address);
+	#else
+		syscall(SYS_futex, (U32*)address, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+	#endif
+}
+
+void FutexWakeAll(volatile U32* address)
+{
+	#if defined(_WIN32)
+		::WakeByAddressAll((PVOID)address);
+	#else
+		syscall(SYS_futex, (U32*)address, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+	#endif
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+// Defines
+#define FUTEX_WAIT_INFINITE (0xFFFFFFFFU)
+
+	// Thin wrappers over WaitOnAddress/WakeByAddress on Windows and the
+	// futex syscall on Linux.  FutexWait sleeps only while *address still
+	// equals expected, and may return spuriously, so callers re-check.
+
+// Functions
+bool FutexWait(volatile U32* address, U32 expected, U32 timeout_ms = FUTEX_WAIT_INFINITE);
+void FutexWakeOne(volatile U32* address);
+void FutexWakeAll(volatile U32* address);
+
+inline void CpuPause()
+{
+	#if defined(_MSC_VER)
+		_mm_pause();
+	#elif defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+	#elif defined(__aarch64__)
+		__asm__ __volatile__("yield");
+	#endif
+}
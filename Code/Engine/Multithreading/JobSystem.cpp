@@ -0,0 +1,625 @@
+#include "Multithreading/JobSystem.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Fiber.hpp"
+#include "Multithreading/Topology.hpp"
+#include "Allocation/PoolAllocator.hpp"
+#include "Time/Profiler.hpp"
+#include "Time/Utils.hpp"
+#include <assert.h>
+#include <wchar.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct Job
+{
+	job_cb m_entry;
+	void* m_data;
+	JobCounter* m_counter;
+	PoolAllocator<Job>* m_pool;
+};
+
+class JobDeque
+{
+public:
+	JobDeque();
+	~JobDeque();
+	bool PushBottom(Job* job);
+	Job* PopBottom();
+	Job* StealTop();
+private:
+	Job* m_jobs[JOB_QUEUE_CAPACITY];
+	Mutex m_lock;
+	U64 m_top;
+	U64 m_bottom;
+};
+
+struct job_waiter
+{
+	Fiber* m_fiber = nullptr;
+	JobCounter* m_counter = nullptr;
+	// Thread fibers can only resume on their own thread, pooled ones anywhere
+	I32 m_pinnedWorker = -1;
+};
+
+struct job_worker
+{
+	JobDeque m_deque;
+	PoolAllocator<Job>* m_pool = nullptr;
+	thread_handle m_thread = INVALID_THREAD_HANDLE;
+	Fiber* m_threadFiber = nullptr;
+	Fiber* m_currentFiber = nullptr;
+	// Left by the fiber that switched away, picked up by the one that runs next
+	Fiber* m_releaseFiber = nullptr;
+	job_waiter m_parking;
+	// Other slots nearest in the cache hierarchy first, injection slot last
+	U32* m_stealOrder = nullptr;
+	// Index into the topology, -1 when not placed
+	I32 m_logical = -1;
+	U32 m_index = 0;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+const U32 JOB_IDLE_YIELD_COUNT = 64;
+static job_worker* g_workers = nullptr;
+static U32 g_worker_count = 0;
+static volatile U32 g_job_system_running = 0;
+// Threads outside the system share the slot after the last worker
+static thread_local I32 g_worker_index = -1;
+static Fiber** g_all_fibers = nullptr;
+static Fiber** g_free_fibers = nullptr;
+static U32 g_free_fiber_count = 0;
+static Mutex g_fiber_lock;
+static job_waiter* g_waiters = nullptr;
+static U32 g_waiter_count = 0;
+static Atomic<U32> g_waiter_pending;
+static Mutex g_waiter_lock;
+
+#if defined(_MSC_VER)
+	#define JOB_NO_INLINE __declspec(noinline)
+#else
+	#define JOB_NO_INLINE __attribute__((noinline))
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//				Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+JobDeque::JobDeque()
+	: m_top(0)
+	, m_bottom(0)
+{
+}
+
+JobDeque::~JobDeque()
+{
+}
+
+bool JobDeque::PushBottom(Job* job)
+{
+	SCOPE_LOCK(&m_lock);
+
+	if (m_bottom - m_top >= JOB_QUEUE_CAPACITY)
+		return false;
+
+	m_jobs[m_bottom % JOB_QUEUE_CAPACITY] = job;
+	++m_bottom;
+	return true;
+}
+
+Job* JobDeque::PopBottom()
+{
+	SCOPE_LOCK(&m_lock);
+
+	if (m_bottom == m_top)
+		return nullptr;
+
+	--m_bottom;
+	return m_jobs[m_bottom % JOB_QUEUE_CAPACITY];
+}
+
+Job* JobDeque::StealTop()
+{
+	SCOPE_LOCK(&m_lock);
+
+	if (m_bottom == m_top)
+		return nullptr;
+
+	Job* job = m_jobs[m_top % JOB_QUEUE_CAPACITY];
+	++m_top;
+	return job;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Never inlined, so the thread_local is re-read after a fiber migrates
+static JOB_NO_INLINE I32 GetCurrentWorkerIndex()
+{
+	return g_worker_index;
+}
+
+static job_worker* GetCurrentWorker()
+{
+	assert(nullptr != g_workers && "JobSystemInit has not been called");
+	I32 worker_index = GetCurrentWorkerIndex();
+	if (worker_index < 0)
+		return &g_workers[g_worker_count];
+
+	return &g_workers[worker_index];
+}
+
+static void ExecuteJob(Job* job)
+{
+	job_cb entry = job->m_entry;
+	void* data = job->m_data;
+	JobCounter* counter = job->m_counter;
+
+	// Return the slot before running, so the job can schedule more work
+	job->m_pool->Destroy(job);
+	#if defined(PROFILE_ZONES)
+		// A job that waits may finish on another worker, it is recorded there
+		U64 start_ticks = TimeGetOpCount();
+		entry(data);
+		ProfilerRecordJob((const void*)entry, start_ticks, TimeGetOpCount() - start_ticks);
+	#else
+		entry(data);
+	#endif
+
+	if (nullptr != counter)
+		counter->m_value.FetchSub(1, ATOMIC_RELEASE);
+}
+
+static Job* FindJob()
+{
+	Job* job = nullptr;
+	I32 worker_index = GetCurrentWorkerIndex();
+
+	if (worker_index >= 0)
+	{
+		job = g_workers[worker_index].m_deque.PopBottom();
+		if (nullptr != job)
+			return job;
+	}
+
+	// Workers steal from whoever shares the most cache with them first
+	if (worker_index >= 0)
+	{
+		const U32* steal_order = g_workers[worker_index].m_stealOrder;
+		for (U32 offset = 0; offset < g_worker_count; ++offset)
+		{
+			job = g_workers[steal_order[offset]].m_deque.StealTop();
+			if (nullptr != job)
+				return job;
+		}
+
+		return nullptr;
+	}
+
+	// Outside threads have no placement, they go round robin over every slot
+	U32 slot_count = g_worker_count + 1;
+	for (U32 victim = 0; victim < slot_count; ++victim)
+	{
+		job = g_workers[victim].m_deque.StealTop();
+		if (nullptr != job)
+			return job;
+	}
+
+	return nullptr;
+}
+
+static Fiber* AcquireFiber()
+{
+	SCOPE_LOCK(&g_fiber_lock);
+
+	if (0 == g_free_fiber_count)
+		return nullptr;
+
+	return g_free_fibers[--g_free_fiber_count];
+}
+
+static void ReleaseFiber(Fiber* fiber)
+{
+	SCOPE_LOCK(&g_fiber_lock);
+	g_free_fibers[g_free_fiber_count++] = fiber;
+}
+
+// Runs first thing on whichever fiber was just switched to, when the
+// fiber we came from is guaranteed to be off its stack.
+static void FiberPostSwitch()
+{
+	job_worker* worker = GetCurrentWorker();
+
+	if (nullptr != worker->m_releaseFiber)
+	{
+		ReleaseFiber(worker->m_releaseFiber);
+		worker->m_releaseFiber = nullptr;
+	}
+
+	if (nullptr != worker->m_parking.m_fiber)
+	{
+		SCOPE_LOCK(&g_waiter_lock);
+		g_waiters[g_waiter_count++] = worker->m_parking;
+		g_waiter_pending.FetchAdd(1, ATOMIC_RELAXED);
+		worker->m_parking = job_waiter();
+	}
+}
+
+static void SwitchWorkerFiber(job_worker* worker, Fiber* to)
+{
+	Fiber* from = worker->m_currentFiber;
+	worker->m_currentFiber = to;
+	FiberSwitch(from, to);
+
+	// Possibly resumed on another thread, worker must not be used past here
+	FiberPostSwitch();
+}
+
+static Fiber* TakeReadyWaiter(job_worker* worker)
+{
+	if (0 == g_waiter_pending.Load(ATOMIC_RELAXED))
+		return nullptr;
+
+	SCOPE_LOCK(&g_waiter_lock);
+
+	for (U32 index = 0; index < g_waiter_count; ++index)
+	{
+		job_waiter& waiter = g_waiters[index];
+		if (0 != waiter.m_counter->m_value.Load(ATOMIC_ACQUIRE))
+			continue;
+
+		if (waiter.m_pinnedWorker >= 0 && waiter.m_pinnedWorker != (I32)worker->m_index)
+			continue;
+
+		Fiber* fiber = waiter.m_fiber;
+		g_waiters[index] = g_waiters[--g_waiter_count];
+		g_waiter_pending.FetchSub(1, ATOMIC_RELAXED);
+		return fiber;
+	}
+
+	return nullptr;
+}
+
+static void JobIdle(U32* idle_count)
+{
+	// Back off from yielding to sleeping once the system goes quiet,
+	// unless someone is parked and waiting to be resumed.
+	if (++(*idle_count) < JOB_IDLE_YIELD_COUNT || 0 != g_waiter_pending.Load(ATOMIC_RELAXED))
+		ThreadYield();
+	else
+		ThreadSleep(1);
+}
+
+static void JobFiberMain(void*)
+{
+	FiberPostSwitch();
+
+	U32 idle_count = 0;
+	for (;;)
+	{
+		job_worker* worker = GetCurrentWorker();
+
+		Fiber* ready = TakeReadyWaiter(worker);
+		if (nullptr != ready)
+		{
+			worker->m_releaseFiber = worker->m_currentFiber;
+			SwitchWorkerFiber(worker, ready);
+			idle_count = 0;
+			continue;
+		}
+
+		if (JobRunPending())
+		{
+			idle_count = 0;
+			continue;
+		}
+
+		// Hand the thread back to its own stack so the worker can exit, once
+		// no parked fiber is left to finish.  Should this fiber be reused
+		// later it simply resumes the loop.
+		if (0 == AtomicLoad(&g_job_system_running, ATOMIC_ACQUIRE) && 0 == g_waiter_pending.Load(ATOMIC_ACQUIRE))
+		{
+			worker->m_releaseFiber = worker->m_currentFiber;
+			SwitchWorkerFiber(worker, worker->m_threadFiber);
+			continue;
+		}
+
+		JobIdle(&idle_count);
+	}
+}
+
+static void JobWorkerMain(void* data)
+{
+	job_worker* worker = (job_worker*)data;
+	g_worker_index = (I32)worker->m_index;
+
+	worker->m_threadFiber = FiberConvertThread();
+	worker->m_currentFiber = worker->m_threadFiber;
+
+	Fiber* fiber = AcquireFiber();
+	if (nullptr != fiber)
+	{
+		// Only comes back once the system shuts down
+		SwitchWorkerFiber(worker, fiber);
+	}
+	else
+	{
+		U32 idle_count = 0;
+		while (0 != AtomicLoad(&g_job_system_running, ATOMIC_ACQUIRE) || 0 != g_waiter_pending.Load(ATOMIC_ACQUIRE))
+		{
+			if (JobRunPending())
+				idle_count = 0;
+			else
+				JobIdle(&idle_count);
+		}
+	}
+
+	FiberRevertThread(worker->m_threadFiber);
+	worker->m_threadFiber = nullptr;
+	worker->m_currentFiber = nullptr;
+	g_worker_index = -1;
+}
+
+// 0 for SMT siblings, then shared cache, then same package, 4 for unplaced
+static U32 JobWorkerDistance(const cpu_topology* topology, const job_worker& a, const job_worker& b)
+{
+	if (a.m_logical < 0 || b.m_logical < 0)
+		return 4;
+
+	const cpu_logical& first = topology->m_logical[a.m_logical];
+	const cpu_logical& second = topology->m_logical[b.m_logical];
+
+	if (first.m_core == second.m_core)
+		return 0;
+	if (first.m_cacheGroup == second.m_cacheGroup)
+		return 1;
+	if (first.m_package == second.m_package)
+		return 2;
+	return 3;
+}
+
+// Spreads workers over cores before doubling up on SMT siblings, keeping
+// neighbouring workers on the same cache, and orders each worker's steal
+// victims by distance.  Equal distances go round robin from the worker
+// after us, so thieves do not all hit the same victim first.
+static void JobPlaceWorkers()
+{
+	const cpu_topology* topology = TopologyGet();
+	U32 placement[TOPOLOGY_MAX_LOGICAL];
+	U32 placement_count = TopologyGetPlacementOrder(placement, TOPOLOGY_MAX_LOGICAL);
+
+	for (U32 index = 0; index < g_worker_count; ++index)
+	{
+		if (0 != placement_count)
+			g_workers[index].m_logical = (I32)placement[index % placement_count];
+	}
+
+	for (U32 index = 0; index < g_worker_count; ++index)
+	{
+		job_worker& worker = g_workers[index];
+		worker.m_stealOrder = new U32[g_worker_count];
+
+		U32 count = 0;
+		for (U32 offset = 1; offset < g_worker_count; ++offset)
+		{
+			U32 victim = (index + offset) % g_worker_count;
+			U32 distance = JobWorkerDistance(topology, worker, g_workers[victim]);
+
+			// Insertion sort keeps the round robin order among equals
+			U32 position = count++;
+			while (position > 0 && JobWorkerDistance(topology, worker, g_workers[worker.m_stealOrder[position - 1]]) > distance)
+			{
+				worker.m_stealOrder[position] = worker.m_stealOrder[position - 1];
+				--position;
+			}
+			worker.m_stealOrder[position] = victim;
+		}
+
+		worker.m_stealOrder[count] = g_worker_count;
+	}
+}
+
+bool JobSystemInit(U32 worker_count /*= 0*/)
+{
+	if (nullptr != g_workers)
+		return false;
+
+	if (0 == worker_count)
+		worker_count = Max(ThreadGetProcessorCount(), 1U);
+
+	g_worker_count = worker_count;
+	g_workers = new job_worker[worker_count + 1];
+
+	g_all_fibers = new Fiber*[JOB_FIBER_COUNT];
+	g_free_fibers = new Fiber*[JOB_FIBER_COUNT];
+	g_waiters = new job_waiter[JOB_FIBER_COUNT + worker_count];
+	g_waiter_count = 0;
+	g_free_fiber_count = 0;
+
+	for (U32 index = 0; index < JOB_FIBER_COUNT; ++index)
+	{
+		g_all_fibers[index] = FiberCreate(JobFiberMain, nullptr, JOB_FIBER_STACK_SIZE);
+		if (nullptr != g_all_fibers[index])
+			g_free_fibers[g_free_fiber_count++] = g_all_fibers[index];
+	}
+
+	for (U32 index = 0; index <= worker_count; ++index)
+	{
+		g_workers[index].m_index = index;
+		g_workers[index].m_pool = new PoolAllocator<Job>(JOB_POOL_CAPACITY);
+	}
+
+	JobPlaceWorkers();
+
+	// The initializing thread is worker 0, its own stack parks in JobWait
+	// like any other fiber but only ever resumes on this thread.
+	g_worker_index = 0;
+	g_workers[0].m_threadFiber = FiberConvertThread();
+	g_workers[0].m_currentFiber = g_workers[0].m_threadFiber;
+	AtomicStore(&g_job_system_running, (U32)1, ATOMIC_RELEASE);
+
+	// Pinned only when every worker gets a processor of its own, the calling
+	// thread is left where it is and simply takes the first slot.
+	const cpu_topology* topology = TopologyGet();
+	bool pin_workers = worker_count <= topology->m_logicalCount;
+
+	for (U32 index = 1; index < worker_count; ++index)
+	{
+		wchar_t name[16];
+		swprintf(name, 16, L"Job Worker %u", index);
+
+		thread_options options;
+		options.m_name = name;
+		if (pin_workers && g_workers[index].m_logical >= 0)
+			options.m_affinityMask = (U64)1 << topology->m_logical[g_workers[index].m_logical].m_id;
+
+		g_workers[index].m_thread = ThreadCreate(JobWorkerMain, &g_workers[index], options);
+	}
+
+	return true;
+}
+
+void JobSystemDeinit()
+{
+	if (nullptr == g_workers)
+		return;
+
+	job_worker* worker = GetCurrentWorker();
+	assert(0 == worker->m_index && worker->m_currentFiber == worker->m_threadFiber && "JobSystemDeinit must run on the thread that called JobSystemInit, outside any job");
+	AtomicStore(&g_job_system_running, (U32)0, ATOMIC_RELEASE);
+
+	// Workers stay until nothing is queued or parked
+	for (U32 index = 1; index < g_worker_count; ++index)
+	{
+		ThreadJoin(g_workers[index].m_thread);
+	}
+
+	// Finish anything still queued or parked before the fibers and pools go
+	// away.  A resumed fiber runs the scheduler loop here, which hands the
+	// thread back once the same holds.  Waiters whose counters never drain
+	// keep this waiting.
+	while (JobRunPending() || 0 != g_waiter_pending.Load(ATOMIC_ACQUIRE))
+	{
+		Fiber* ready = TakeReadyWaiter(worker);
+		if (nullptr != ready)
+			SwitchWorkerFiber(worker, ready);
+		else
+			ThreadYield();
+	}
+
+	for (U32 index = 0; index <= g_worker_count; ++index)
+	{
+		delete g_workers[index].m_pool;
+		delete[] g_workers[index].m_stealOrder;
+	}
+
+	for (U32 index = 0; index < JOB_FIBER_COUNT; ++index)
+	{
+		FiberDestroy(g_all_fibers[index]);
+	}
+
+	FiberRevertThread(g_workers[0].m_threadFiber);
+
+	delete[] g_waiters;
+	delete[] g_free_fibers;
+	delete[] g_all_fibers;
+	g_waiters = nullptr;
+	g_free_fibers = nullptr;
+	g_all_fibers = nullptr;
+
+	delete[] g_workers;
+	g_workers = nullptr;
+	g_worker_count = 0;
+	g_worker_index = -1;
+}
+
+void JobRun(job_cb cb, void* data, JobCounter* counter /*= nullptr*/)
+{
+	job_worker* worker = GetCurrentWorker();
+
+	// An exhausted pool runs the job in place instead of going to the heap
+	Job* job = worker->m_pool->Create<Job>();
+	if (nullptr == job)
+	{
+		cb(data);
+		return;
+	}
+
+	job->m_entry = cb;
+	job->m_data = data;
+	job->m_counter = counter;
+	job->m_pool = worker->m_pool;
+
+	if (nullptr != counter)
+		counter->m_value.FetchAdd(1, ATOMIC_RELAXED);
+
+	if (!worker->m_deque.PushBottom(job))
+		ExecuteJob(job);
+}
+
+void JobWait(JobCounter* counter)
+{
+	if (0 == counter->m_value.Load(ATOMIC_ACQUIRE))
+		return;
+
+	// Park the current fiber and keep this thread busy on a fresh one,
+	// the scheduler loop resumes us once the counter drains.
+	if (GetCurrentWorkerIndex() >= 0)
+	{
+		job_worker* worker = GetCurrentWorker();
+		Fiber* next = AcquireFiber();
+		if (nullptr != next)
+		{
+			Fiber* current = worker->m_currentFiber;
+			worker->m_parking.m_fiber = current;
+			worker->m_parking.m_counter = counter;
+			worker->m_parking.m_pinnedWorker = (current == worker->m_threadFiber) ? (I32)worker->m_index : -1;
+
+			SwitchWorkerFiber(worker, next);
+			return;
+		}
+	}
+
+	// Outside the system, or out of fibers, help instead of parking
+	while (0 != counter->m_value.Load(ATOMIC_ACQUIRE))
+	{
+		if (!JobRunPending())
+			ThreadYield();
+	}
+}
+
+bool JobRunPending()
+{
+	Job* job = FindJob();
+	if (nullptr == job)
+		return false;
+
+	ExecuteJob(job);
+	return true;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+U32 JobSystemGetWorkerCount()
+{
+	return g_worker_count;
+}
+
+I32 JobSystemGetWorkerIndex()
+{
+	return GetCurrentWorkerIndex();
+}
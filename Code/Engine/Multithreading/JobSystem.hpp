@@ -0,0 +1,45 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Multithreading/Atomic.hpp"
+
+// Datatypes
+typedef void(*job_cb)(void*);
+
+struct JobCounter
+{
+	Atomic<U32> m_value;
+};
+
+// Defines
+#define JOB_QUEUE_CAPACITY (4096)
+#define JOB_POOL_CAPACITY  (4096)
+#define JOB_FIBER_COUNT    (128)
+#define JOB_FIBER_STACK_SIZE (64 * 1024)
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	One worker per core, where worker 0 is the thread that called JobSystemInit
+//	and the rest are created with ThreadCreate.  Every worker owns a deque and
+//	a job pool: it pushes and pops its own jobs LIFO at the bottom, and idle
+//	workers steal FIFO from the top of the others.  Jobs run on pooled fibers,
+//	so JobWait parks the waiting fiber and the thread moves on to other work;
+//	the fiber is resumed on whichever worker first sees the counter at zero.
+//	Threads outside the system, or a system out of fibers, fall back to
+//	executing jobs until the counter drains.  Jobs scheduled from outside the
+//	system go through a shared injection queue instead of a worker deque.
+//	Workers are placed with the CPU topology: one per core before any SMT
+//	sibling is used, neighbours on a shared cache, and each steals from the
+//	workers closest to it first.  They are pinned when there are no more
+//	workers than processors.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Functions
+bool JobSystemInit(U32 worker_count = 0);
+void JobSystemDeinit();
+void JobRun(job_cb cb, void* data, JobCounter* counter = nullptr);
+void JobWait(JobCounter* counter);
+bool JobRunPending();
+U32 JobSystemGetWorkerCount();
+I32 JobSystemGetWorkerIndex();
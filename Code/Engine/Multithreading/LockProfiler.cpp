@@ -0,0 +1,265 @@
+#include "Multithreading/LockProfiler.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Time/Utils.hpp"
+#include "Time/Profiler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+// Only ever written by the thread that owns it
+struct lock_site_stats
+{
+	U64 m_acquireCount;
+	U64 m_contendedCount;
+	U64 m_waitTicks;
+	U64 m_holdTicks;
+	U64 m_maxWaitTicks;
+	U64 m_maxHoldTicks;
+	lock_histogram m_waitHistogram;
+	lock_histogram m_holdHistogram;
+};
+
+struct lock_thread_stats
+{
+	lock_site_stats* volatile m_sites[LOCK_PROFILER_MAX_SITES];
+	lock_thread_stats* m_next;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// Taken with Lock/Unlock, a SCOPE_LOCK in here would profile itself
+static Mutex g_lock_profiler_lock;
+static lock_site* g_lock_sites[LOCK_PROFILER_MAX_SITES];
+static volatile U32 g_lock_site_count = 0;
+// Tables outlive their threads, so exited threads still show in the report
+static lock_thread_stats* g_lock_threads = nullptr;
+static thread_local lock_thread_stats* g_lock_thread = nullptr;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Written by one thread, read by the report; a relaxed store keeps it untorn
+static inline void LockStatAdd(U64* counter, U64 value)
+{
+	AtomicStore(counter, AtomicLoad(counter, ATOMIC_RELAXED) + value, ATOMIC_RELAXED);
+}
+
+static inline void LockStatMax(U64* counter, U64 value)
+{
+	if (value > AtomicLoad(counter, ATOMIC_RELAXED))
+		AtomicStore(counter, value, ATOMIC_RELAXED);
+}
+
+// Returns 0 once every slot is taken
+static U32 LockProfilerRegisterSite(lock_site* site)
+{
+	U32 id = AtomicLoad(&site->m_id, ATOMIC_ACQUIRE);
+	if (0 != id)
+		return id;
+
+	g_lock_profiler_lock.Lock();
+	id = site->m_id;
+	if (0 == id && g_lock_site_count < LOCK_PROFILER_MAX_SITES)
+	{
+		g_lock_sites[g_lock_site_count] = site;
+		id = g_lock_site_count + 1;
+		AtomicStore(&g_lock_site_count, id, ATOMIC_RELEASE);
+		AtomicStore(&site->m_id, id, ATOMIC_RELEASE);
+	}
+	g_lock_profiler_lock.Unlock();
+
+	return id;
+}
+
+// Looked up on every record, a fiber may release its guard on another thread
+static lock_thread_stats* LockProfilerGetThread()
+{
+	lock_thread_stats* thread = g_lock_thread;
+	if (nullptr != thread)
+		return thread;
+
+	thread = (lock_thread_stats*) ::calloc(1, sizeof(lock_thread_stats));
+	g_lock_profiler_lock.Lock();
+	thread->m_next = g_lock_threads;
+	g_lock_threads = thread;
+	g_lock_profiler_lock.Unlock();
+
+	g_lock_thread = thread;
+	return thread;
+}
+
+U64 LockProfilerGetTicks()
+{
+	return TimeGetOpCount();
+}
+
+void LockProfilerRecord(lock_site* site, bool contended, U64 start_ticks, U64 wait_ticks, U64 hold_ticks)
+{
+	if (contended)
+		ProfilerRecordLockWait(site, start_ticks, wait_ticks);
+
+	U32 id = LockProfilerRegisterSite(site);
+	if (0 == id)
+		return;
+
+	lock_thread_stats* thread = LockProfilerGetThread();
+	lock_site_stats* stats = thread->m_sites[id - 1];
+	if (nullptr == stats)
+	{
+		stats = (lock_site_stats*) ::calloc(1, sizeof(lock_site_stats));
+		AtomicStore(&thread->m_sites[id - 1], stats, ATOMIC_RELEASE);
+	}
+
+	LockStatAdd(&stats->m_acquireCount, 1);
+	if (contended)
+		LockStatAdd(&stats->m_contendedCount, 1);
+	LockStatAdd(&stats->m_waitTicks, wait_ticks);
+	LockStatAdd(&stats->m_holdTicks, hold_ticks);
+	LockStatMax(&stats->m_maxWaitTicks, wait_ticks);
+	LockStatMax(&stats->m_maxHoldTicks, hold_ticks);
+	stats->m_waitHistogram.Record(wait_ticks);
+	stats->m_holdHistogram.Record(hold_ticks);
+}
+
+U32 LockProfilerGetSiteCount()
+{
+	return AtomicLoad(&g_lock_site_count, ATOMIC_ACQUIRE);
+}
+
+static bool LockReportBefore(const lock_site_report& a, const lock_site_report& b)
+{
+	if (a.m_contendedCount != b.m_contendedCount)
+		return a.m_contendedCount > b.m_contendedCount;
+	return a.m_waitTicks > b.m_waitTicks;
+}
+
+// Sums every thread's counters into out_reports, most contended first.
+// Threads keep counting meanwhile, so the totals are a close snapshot.
+U32 LockProfilerGather(lock_site_report* out_reports, U32 capacity)
+{
+	g_lock_profiler_lock.Lock();
+
+	U32 site_count = g_lock_site_count;
+	lock_site_report* reports = (lock_site_report*) ::calloc(site_count + 1, sizeof(lock_site_report));
+	for (U32 index = 0; index < site_count; ++index)
+	{
+		reports[index].m_file = g_lock_sites[index]->m_file;
+		reports[index].m_line = g_lock_sites[index]->m_line;
+	}
+
+	for (lock_thread_stats* thread = g_lock_threads; nullptr != thread; thread = thread->m_next)
+	{
+		for (U32 index = 0; index < site_count; ++index)
+		{
+			lock_site_stats* stats = AtomicLoad(&thread->m_sites[index], ATOMIC_ACQUIRE);
+			if (nullptr == stats)
+				continue;
+
+			lock_site_report& report = reports[index];
+			report.m_acquireCount += AtomicLoad(&stats->m_acquireCount, ATOMIC_RELAXED);
+			report.m_contendedCount += AtomicLoad(&stats->m_contendedCount, ATOMIC_RELAXED);
+			report.m_waitTicks += AtomicLoad(&stats->m_waitTicks, ATOMIC_RELAXED);
+			report.m_holdTicks += AtomicLoad(&stats->m_holdTicks, ATOMIC_RELAXED);
+			U64 max_wait = AtomicLoad(&stats->m_maxWaitTicks, ATOMIC_RELAXED);
+			U64 max_hold = AtomicLoad(&stats->m_maxHoldTicks, ATOMIC_RELAXED);
+			if (max_wait > report.m_maxWaitTicks)
+				report.m_maxWaitTicks = max_wait;
+			if (max_hold > report.m_maxHoldTicks)
+				report.m_maxHoldTicks = max_hold;
+			report.m_waitHistogram.Add(stats->m_waitHistogram);
+			report.m_holdHistogram.Add(stats->m_holdHistogram);
+		}
+	}
+
+	g_lock_profiler_lock.Unlock();
+
+	// Insertion sort, reports are only asked for now and then
+	for (U32 index = 1; index < site_count; ++index)
+	{
+		lock_site_report moving = reports[index];
+		U32 position = index;
+		while (position > 0 && LockReportBefore(moving, reports[position - 1]))
+		{
+			reports[position] = reports[position - 1];
+			--position;
+		}
+		reports[position] = moving;
+	}
+
+	U32 count = (site_count < capacity) ? site_count : capacity;
+	memcpy(out_reports, reports, count * sizeof(lock_site_report));
+	::free(reports);
+	return count;
+}
+
+void LockProfilerReport(U32 max_sites /*= 16*/)
+{
+	U32 capacity = LockProfilerGetSiteCount();
+	if (0 == capacity)
+	{
+		printf("\nNo lock sites recorded.\n");
+		return;
+	}
+
+	if (max_sites < capacity)
+		capacity = max_sites;
+
+	lock_site_report* reports = (lock_site_report*) ::malloc(capacity * sizeof(lock_site_report));
+	U32 count = LockProfilerGather(reports, capacity);
+
+	printf("\nTop %u contended lock site(s)\n", count);
+	for (U32 index = 0; index < count; ++index)
+	{
+		const lock_site_report& report = reports[index];
+		char total_wait[128];
+		char average_hold[128];
+		char p99_wait[128];
+		char max_wait[128];
+		TimeOpCountToString(report.m_waitTicks, total_wait);
+		TimeOpCountToString((0 == report.m_acquireCount) ? 0 : report.m_holdTicks / report.m_acquireCount, average_hold);
+		TimeOpCountToString(report.m_waitHistogram.GetValueAtPercentile(0.99), p99_wait);
+		TimeOpCountToString(report.m_maxWaitTicks, max_wait);
+
+		double contended_percent = (0 == report.m_acquireCount) ? 0.0 : 100.0 * (double)report.m_contendedCount / (double)report.m_acquireCount;
+		printf("%2u. %s(%u)\n", index + 1, report.m_file, report.m_line);
+		printf("     %llu acquire(s), %llu contended (%.1f%%)\n", (unsigned long long)report.m_acquireCount, (unsigned long long)report.m_contendedCount, contended_percent);
+		printf("     wait total %s, p99 %s, max %s; hold average %s\n", total_wait, p99_wait, max_wait, average_hold);
+	}
+
+	::free(reports);
+}
+
+// Records racing the reset may survive it
+void LockProfilerReset()
+{
+	g_lock_profiler_lock.Lock();
+
+	for (lock_thread_stats* thread = g_lock_threads; nullptr != thread; thread = thread->m_next)
+	{
+		for (U32 index = 0; index < LOCK_PROFILER_MAX_SITES; ++index)
+		{
+			lock_site_stats* stats = AtomicLoad(&thread->m_sites[index], ATOMIC_ACQUIRE);
+			if (nullptr == stats)
+				continue;
+
+			U64* counters = (U64*)stats;
+			for (U32 counter = 0; counter < sizeof(lock_site_stats) / sizeof(U64); ++counter)
+			{
+				AtomicStore(&counters[counter], (U64)0, ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	g_lock_profiler_lock.Unlock();
+}
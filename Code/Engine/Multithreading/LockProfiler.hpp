@@ -0,0 +1,106 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+// Build flags, PROFILED_BUILD comes from here
+#include "Memory/AllocationTracker.hpp"
+#include "Time/HdrHistogram.hpp"
+
+// Defines
+#if defined(PROFILED_BUILD)
+	#define PROFILE_LOCKS
+#endif
+#define LOCK_PROFILER_MAX_SITES (1024)
+// 12.5% resolution up to 2^40 ticks, minutes at any clock rate
+#define LOCK_PROFILER_SUB_BUCKET_BITS (4)
+#define LOCK_PROFILER_VALUE_BITS      (40)
+
+	// With PROFILE_LOCKS every SCOPE_LOCK becomes a lock site named by its
+	// __FILE__ and __LINE__.  Each acquire first tries the lock, and counts as
+	// contended when that fails; wait time runs from the attempt until the lock
+	// is held, hold time from then until release, both in TimeGetOpCount ticks.
+	// Both go to HDR histograms, so percentiles hold to 12.5% at any scale.
+	// Counters live in a table per thread and are only summed when gathered,
+	// so an acquire never touches memory another thread writes.  Two sites
+	// taking the same lock are reported apart, which is what shows where the
+	// contention comes from.  Sites past LOCK_PROFILER_MAX_SITES are not counted.
+	// Contended waits also go to the profiler's timeline, see Profiler.hpp.
+
+// Datatypes
+typedef HdrHistogram<LOCK_PROFILER_SUB_BUCKET_BITS, LOCK_PROFILER_VALUE_BITS> lock_histogram;
+
+struct lock_site
+{
+	const char* m_file;
+	U32 m_line;
+	// 0 until the first acquire registers the site
+	volatile U32 m_id;
+};
+
+struct lock_site_report
+{
+	const char* m_file;
+	U32 m_line;
+	U64 m_acquireCount;
+	U64 m_contendedCount;
+	U64 m_waitTicks;
+	U64 m_holdTicks;
+	U64 m_maxWaitTicks;
+	U64 m_maxHoldTicks;
+	lock_histogram m_waitHistogram;
+	lock_histogram m_holdHistogram;
+};
+
+// Functions
+U64 LockProfilerGetTicks();
+void LockProfilerRecord(lock_site* site, bool contended, U64 start_ticks, U64 wait_ticks, U64 hold_ticks);
+U32 LockProfilerGetSiteCount();
+U32 LockProfilerGather(lock_site_report* out_reports, U32 capacity);
+void LockProfilerReport(U32 max_sites = 16);
+void LockProfilerReset();
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	The SCOPE_LOCK guard in profiled builds.  Same as ScopedLock, but acquires
+//	through TryLock first so contention is seen, and times the wait and hold.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class ProfiledScopedLock
+{
+public:
+	template <typename LockType>
+	ProfiledScopedLock(LockType* lock, lock_site* site)
+		: m_lock(lock)
+		, m_unlock(&UnlockLock<LockType>)
+		, m_site(site)
+	{
+		m_start = LockProfilerGetTicks();
+		m_contended = !lock->TryLock();
+		if (m_contended)
+			lock->Lock();
+		m_acquired = LockProfilerGetTicks();
+	}
+
+	~ProfiledScopedLock()
+	{
+		U64 released = LockProfilerGetTicks();
+		m_unlock(m_lock);
+		LockProfilerRecord(m_site, m_contended, m_start, m_acquired - m_start, released - m_acquired);
+	}
+
+private:
+	template <typename LockType>
+	static void UnlockLock(void* lock)
+	{
+		((LockType*)lock)->Unlock();
+	}
+
+	ProfiledScopedLock(const ProfiledScopedLock&) = delete;
+	ProfiledScopedLock& operator=(const ProfiledScopedLock&) = delete;
+
+private:
+	void* m_lock;
+	void(*m_unlock)(void*);
+	lock_site* m_site;
+	U64 m_start;
+	U64 m_acquired;
+	bool m_contended;
+};
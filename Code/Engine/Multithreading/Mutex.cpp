@@ -0,0 +1,173 @@
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Futex.hpp"
+#include "Multithreading/Atomic.hpp"
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+const U32 MUTEX_UNLOCKED = 0;
+const U32 MUTEX_LOCKED = 1;
+const U32 MUTEX_SLEEPERS = 2;
+
+const U32 RWLOCK_READER_MASK = 0x0FFFFFFF;
+const U32 RWLOCK_SLEEPERS = 0x20000000;
+const U32 RWLOCK_WRITER_PENDING = 0x40000000;
+const U32 RWLOCK_WRITER = 0x80000000;
+
+//////////////////////////////////////////////////////
+//													//
+//				Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+void Mutex::Lock()
+{
+	U32 expected = MUTEX_UNLOCKED;
+	if (AtomicCompareExchange(&m_state, &expected, MUTEX_LOCKED, ATOMIC_ACQUIRE))
+		return;
+
+	LockContended();
+}
+
+bool Mutex::TryLock()
+{
+	U32 expected = MUTEX_UNLOCKED;
+	return AtomicCompareExchange(&m_state, &expected, MUTEX_LOCKED, ATOMIC_ACQUIRE);
+}
+
+void Mutex::LockContended()
+{
+	// Most hold times are short, so spin on a plain read for a while first
+	for (U32 spin = 0; spin < MUTEX_SPIN_COUNT; ++spin)
+	{
+		U32 state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+		if (MUTEX_UNLOCKED == state && AtomicCompareExchange(&m_state, &state, MUTEX_LOCKED, ATOMIC_ACQUIRE))
+			return;
+		if (MUTEX_SLEEPERS == state)
+			break;
+		CpuPause();
+	}
+
+	// Once we may sleep the word has to say so, so we take it as state 2 even
+	// when it turns out nobody else is waiting; that costs one spare wake
+	while (MUTEX_UNLOCKED != AtomicExchange(&m_state, MUTEX_SLEEPERS, ATOMIC_ACQUIRE))
+		FutexWait(&m_state, MUTEX_SLEEPERS);
+}
+
+void Mutex::Unlock()
+{
+	if (MUTEX_LOCKED == AtomicExchange(&m_state, MUTEX_UNLOCKED, ATOMIC_RELEASE))
+		return;
+
+	FutexWakeOne(&m_state);
+}
+
+bool RWLock::TryLockShared()
+{
+	U32 state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+	if (0 != (state & (RWLOCK_WRITER | RWLOCK_WRITER_PENDING)))
+		return false;
+	return AtomicCompareExchange(&m_state, &state, state + 1, ATOMIC_ACQUIRE);
+}
+
+void RWLock::LockShared()
+{
+	U32 spin = 0;
+	U32 state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+	for (;;)
+	{
+		if (0 == (state & (RWLOCK_WRITER | RWLOCK_WRITER_PENDING)))
+		{
+			if (AtomicCompareExchange(&m_state, &state, state + 1, ATOMIC_ACQUIRE))
+				return;
+			continue;
+		}
+
+		if (spin < RWLOCK_SPIN_COUNT)
+		{
+			++spin;
+			CpuPause();
+			state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+			continue;
+		}
+
+		// Flag ourselves as a sleeper before waiting so the next unlock wakes us
+		U32 sleeping = state | RWLOCK_SLEEPERS;
+		if (sleeping != state && !AtomicCompareExchange(&m_state, &state, sleeping, ATOMIC_RELAXED))
+			continue;
+
+		FutexWait(&m_state, sleeping);
+		state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+	}
+}
+
+void RWLock::UnlockShared()
+{
+	U32 state = AtomicFetchSub(&m_state, 1U, ATOMIC_RELEASE) - 1;
+
+	// Last reader out with a writer waiting hands the word over
+	if (0 == (state & RWLOCK_READER_MASK) && 0 != (state & RWLOCK_SLEEPERS))
+	{
+		if (AtomicCompareExchange(&m_state, &state, state & ~RWLOCK_SLEEPERS, ATOMIC_RELAXED))
+			FutexWakeAll(&m_state);
+	}
+}
+
+bool RWLock::TryLock()
+{
+	U32 state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+	if (0 != (state & (RWLOCK_WRITER | RWLOCK_READER_MASK)))
+		return false;
+	return AtomicCompareExchange(&m_state, &state, (state & ~RWLOCK_WRITER_PENDING) | RWLOCK_WRITER, ATOMIC_ACQUIRE);
+}
+
+void RWLock::Lock()
+{
+	U32 state = 0;
+	if (AtomicCompareExchange(&m_state, &state, RWLOCK_WRITER, ATOMIC_ACQUIRE))
+		return;
+
+	U32 spin = 0;
+	for (;;)
+	{
+		if (0 == (state & (RWLOCK_WRITER | RWLOCK_READER_MASK)))
+		{
+			// Keep the sleeper bit, other writers or readers may still be parked;
+			// pending is cleared and re-raised by any writer still waiting
+			U32 locked = (state & RWLOCK_SLEEPERS) | RWLOCK_WRITER;
+			if (AtomicCompareExchange(&m_state, &state, locked, ATOMIC_ACQUIRE))
+				return;
+			continue;
+		}
+
+		U32 wanted = state | RWLOCK_WRITER_PENDING;
+		if (spin >= RWLOCK_SPIN_COUNT)
+			wanted |= RWLOCK_SLEEPERS;
+
+		if (wanted != state)
+		{
+			if (!AtomicCompareExchange(&m_state, &state, wanted, ATOMIC_RELAXED))
+				continue;
+			state = wanted;
+		}
+
+		if (spin < RWLOCK_SPIN_COUNT)
+		{
+			++spin;
+			CpuPause();
+		}
+		else
+		{
+			FutexWait(&m_state, state);
+		}
+		state = AtomicLoad(&m_state, ATOMIC_RELAXED);
+	}
+}
+
+void RWLock::Unlock()
+{
+	U32 state = AtomicExchange(&m_state, 0U, ATOMIC_RELEASE);
+	if (0 != (state & RWLOCK_SLEEPERS))
+		FutexWakeAll(&m_state);
+}
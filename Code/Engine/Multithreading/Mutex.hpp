@@ -0,0 +1,74 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Multithreading/ScopedLock.hpp"
+
+// Defines
+#define MUTEX_SPIN_COUNT  (128)
+#define RWLOCK_SPIN_COUNT (128)
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	A single 32 bit word: 0 unlocked, 1 locked, 2 locked with possible sleepers.
+//	Lock is one compare-exchange and Unlock one exchange when nobody contends;
+//	otherwise the locker spins briefly before sleeping on the word through the
+//	futex layer, and only an unlock that sees state 2 pays for a wake.
+//	Not recursive, and needs no heap memory or OS object.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class Mutex
+{
+public:
+	Mutex() : m_state(0) {};
+	~Mutex() {};
+	void Lock();
+	bool TryLock();
+	void Unlock();
+private:
+	void LockContended();
+	Mutex(const Mutex&) = delete;
+	Mutex& operator=(const Mutex&) = delete;
+private:
+	volatile U32 m_state;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Reader/writer lock in one 32 bit word.  The low bits count readers, and the
+//	top bits flag a writer holding the lock, a writer waiting for it, and
+//	threads asleep on the word.  A pending writer stops new readers from
+//	getting in, so a stream of readers cannot starve it.  The uncontended
+//	paths are a single compare-exchange or add each.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class RWLock
+{
+public:
+	RWLock() : m_state(0) {};
+	~RWLock() {};
+	void LockShared();
+	bool TryLockShared();
+	void UnlockShared();
+	void Lock();
+	bool TryLock();
+	void Unlock();
+private:
+	RWLock(const RWLock&) = delete;
+	RWLock& operator=(const RWLock&) = delete;
+private:
+	volatile U32 m_state;
+};
+
+class ScopedReadLock
+{
+public:
+	ScopedReadLock(RWLock* lock) : m_lock(lock) { m_lock->LockShared(); };
+	~ScopedReadLock() { m_lock->UnlockShared(); };
+private:
+	ScopedReadLock(const ScopedReadLock&) = delete;
+	ScopedReadLock& operator=(const ScopedReadLock&) = delete;
+private:
+	RWLock* m_lock;
+};
+
+// Defines
+#define SCOPE_READ_LOCK( rwp ) ScopedReadLock COMBINE(__srl_,__LINE__)(rwp)
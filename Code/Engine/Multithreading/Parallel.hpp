@@ -0,0 +1,496 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Math/Utils.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/JobSystem.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+// Defines
+#define PARALLEL_MAX_JOBS            (64)
+#define PARALLEL_MAX_BLOCKS          (256)
+#define PARALLEL_GRAIN_DIVISOR       (32)
+#define PARALLEL_SORT_MIN_BLOCK      (4096)
+#define PARALLEL_SORT_INSERTION_RUN  (32)
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Data parallel algorithms on the job system's workers.  The calling thread
+//	takes one share of the work itself, and everything runs sequentially when
+//	the job system is not initialized.
+//
+//	ParallelFor hands out chunks with guided self-scheduling: each claim takes
+//	half of the remaining range divided by the job count, never less than the
+//	grain, so early chunks are large and the tail is balanced by small ones.
+//	The body is called as body(chunk_begin, chunk_end).
+//
+//	ParallelReduce requires an associative and commutative combine, since
+//	chunks are claimed in no particular order.  ParallelScan is an inclusive
+//	scan and only needs associativity.  The sorts work on trivially copyable
+//	types and use a scratch buffer the size of the input.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Functions
+inline U32 ParallelGetJobCount(U64 work_items, U64 grain)
+{
+	U64 workers = (U64)Max(JobSystemGetWorkerCount(), (U32)1);
+	U64 useful = (work_items + grain - 1) / Max(grain, (U64)1);
+	return (U32)ClampWithin(Min(workers, useful), (U64)PARALLEL_MAX_JOBS, (U64)1);
+}
+
+template <typename Context>
+void ParallelJobEntry(void* data)
+{
+	((Context*)data)->Execute();
+}
+
+template <typename Context>
+void ParallelDispatch(Context* context, U32 job_count)
+{
+	JobCounter counter;
+
+	for (U32 index = 1; index < job_count; ++index)
+	{
+		JobRun(ParallelJobEntry<Context>, context, &counter);
+	}
+
+	context->Execute();
+	JobWait(&counter);
+}
+
+// Templates
+template <typename Body>
+struct parallel_for_context
+{
+	Body* m_body;
+	Atomic<U64> m_cursor;
+	U64 m_end;
+	U64 m_grain;
+	U64 m_jobCount;
+
+	void Execute()
+	{
+		for (;;)
+		{
+			U64 current = m_cursor.Load(ATOMIC_RELAXED);
+			if (current >= m_end)
+				return;
+
+			U64 remaining = m_end - current;
+			U64 size = Min(Max(remaining / (2 * m_jobCount), m_grain), remaining);
+			U64 next = current + size;
+
+			if (m_cursor.CompareExchange(current, next, ATOMIC_RELAXED))
+				(*m_body)(current, next);
+		}
+	}
+};
+
+template <typename Body>
+void ParallelFor(U64 begin, U64 end, Body body, U64 min_grain = 0)
+{
+	if (begin >= end)
+		return;
+
+	U64 count = end - begin;
+	U64 workers = (U64)Max(JobSystemGetWorkerCount(), (U32)1);
+	U64 grain = (0 != min_grain) ? min_grain : Max(count / (workers * PARALLEL_GRAIN_DIVISOR), (U64)1);
+	U32 job_count = ParallelGetJobCount(count, grain);
+
+	if (1 == job_count)
+	{
+		body(begin, end);
+		return;
+	}
+
+	parallel_for_context<Body> context;
+	context.m_body = &body;
+	context.m_cursor.Store(begin, ATOMIC_RELAXED);
+	context.m_end = end;
+	context.m_grain = grain;
+	context.m_jobCount = job_count;
+
+	ParallelDispatch(&context, job_count);
+}
+
+template <typename Value, typename Map, typename Combine>
+struct parallel_reduce_context
+{
+	Map* m_map;
+	Combine* m_combine;
+	const Value* m_identity;
+	Value m_partials[PARALLEL_MAX_JOBS];
+	Atomic<U32> m_nextSlot;
+	Atomic<U64> m_cursor;
+	U64 m_end;
+	U64 m_grain;
+	U64 m_jobCount;
+
+	void Execute()
+	{
+		U32 slot = m_nextSlot.FetchAdd(1, ATOMIC_RELAXED);
+		Value accumulated = *m_identity;
+
+		for (;;)
+		{
+			U64 current = m_cursor.Load(ATOMIC_RELAXED);
+			if (current >= m_end)
+				break;
+
+			U64 remaining = m_end - current;
+			U64 size = Min(Max(remaining / (2 * m_jobCount), m_grain), remaining);
+			U64 next = current + size;
+
+			if (m_cursor.CompareExchange(current, next, ATOMIC_RELAXED))
+				accumulated = (*m_combine)(accumulated, (*m_map)(current, next));
+		}
+
+		m_partials[slot] = accumulated;
+	}
+};
+
+// map(chunk_begin, chunk_end) returns the reduction of one chunk
+template <typename Value, typename Map, typename Combine>
+Value ParallelReduce(U64 begin, U64 end, const Value& identity, Map map, Combine combine, U64 min_grain = 0)
+{
+	if (begin >= end)
+		return identity;
+
+	U64 count = end - begin;
+	U64 workers = (U64)Max(JobSystemGetWorkerCount(), (U32)1);
+	U64 grain = (0 != min_grain) ? min_grain : Max(count / (workers * PARALLEL_GRAIN_DIVISOR), (U64)1);
+	U32 job_count = ParallelGetJobCount(count, grain);
+
+	if (1 == job_count)
+		return combine(identity, map(begin, end));
+
+	parallel_reduce_context<Value, Map, Combine> context;
+	context.m_map = &map;
+	context.m_combine = &combine;
+	context.m_identity = &identity;
+	context.m_cursor.Store(begin, ATOMIC_RELAXED);
+	context.m_end = end;
+	context.m_grain = grain;
+	context.m_jobCount = job_count;
+
+	ParallelDispatch(&context, job_count);
+
+	Value result = identity;
+	for (U32 slot = 0; slot < job_count; ++slot)
+	{
+		result = combine(result, context.m_partials[slot]);
+	}
+
+	return result;
+}
+
+// Inclusive scan: output[i] = combine(input[0], ..., input[i])
+template <typename Object, typename Combine>
+void ParallelScan(const Object* input, Object* output, U64 count, const Object& identity, Combine combine)
+{
+	if (0 == count)
+		return;
+
+	U64 block_count = Min((U64)ParallelGetJobCount(count, PARALLEL_SORT_MIN_BLOCK) * 4, Min(count, (U64)PARALLEL_MAX_BLOCKS));
+	Object block_sums[PARALLEL_MAX_BLOCKS];
+
+	// Reduce every block, scan the block totals, then scan each block
+	// again starting from the total of everything before it.
+	ParallelFor(0, block_count, [&](U64 first_block, U64 last_block)
+	{
+		for (U64 block = first_block; block < last_block; ++block)
+		{
+			U64 lo = count * block / block_count;
+			U64 hi = count * (block + 1) / block_count;
+
+			Object sum = identity;
+			for (U64 index = lo; index < hi; ++index)
+			{
+				sum = combine(sum, input[index]);
+			}
+
+			block_sums[block] = sum;
+		}
+	}, 1);
+
+	Object running = identity;
+	for (U64 block = 0; block < block_count; ++block)
+	{
+		Object total = block_sums[block];
+		block_sums[block] = running;
+		running = combine(running, total);
+	}
+
+	ParallelFor(0, block_count, [&](U64 first_block, U64 last_block)
+	{
+		for (U64 block = first_block; block < last_block; ++block)
+		{
+			U64 lo = count * block / block_count;
+			U64 hi = count * (block + 1) / block_count;
+
+			Object sum = block_sums[block];
+			for (U64 index = lo; index < hi; ++index)
+			{
+				sum = combine(sum, input[index]);
+				output[index] = sum;
+			}
+		}
+	}, 1);
+}
+
+// Stable merge of a[0, a_count) and b[0, b_count), ties favour a
+template <typename Object, typename Less>
+void MergeSequential(const Object* a, U64 a_count, const Object* b, U64 b_count, Object* out, Less& less)
+{
+	U64 i = 0;
+	U64 j = 0;
+
+	while (i < a_count && j < b_count)
+	{
+		if (less(b[j], a[i]))
+			*out++ = b[j++];
+		else
+			*out++ = a[i++];
+	}
+
+	while (i < a_count)
+		*out++ = a[i++];
+
+	while (j < b_count)
+		*out++ = b[j++];
+}
+
+// How many elements of a land in the first k outputs of MergeSequential
+template <typename Object, typename Less>
+U64 MergeCoRank(U64 k, const Object* a, U64 a_count, const Object* b, U64 b_count, Less& less)
+{
+	U64 lo = (k > b_count) ? k - b_count : 0;
+	U64 hi = Min(k, a_count);
+
+	while (lo < hi)
+	{
+		U64 i = lo + (hi - lo) / 2;
+		U64 j = k - i;
+
+		if (j > 0 && !less(b[j - 1], a[i]))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	return lo;
+}
+
+template <typename Object, typename Less>
+void MergeSortSequential(Object* data, Object* scratch, U64 count, Less& less)
+{
+	// Insertion sort short runs, then merge them bottom up
+	for (U64 run = 0; run < count; run += PARALLEL_SORT_INSERTION_RUN)
+	{
+		U64 run_end = Min(run + PARALLEL_SORT_INSERTION_RUN, count);
+		for (U64 index = run + 1; index < run_end; ++index)
+		{
+			Object value = data[index];
+			U64 hole = index;
+
+			while (hole > run && less(value, data[hole - 1]))
+			{
+				data[hole] = data[hole - 1];
+				--hole;
+			}
+
+			data[hole] = value;
+		}
+	}
+
+	Object* source = data;
+	Object* destination = scratch;
+
+	for (U64 width = PARALLEL_SORT_INSERTION_RUN; width < count; width *= 2)
+	{
+		for (U64 lo = 0; lo < count; lo += 2 * width)
+		{
+			U64 mid = Min(lo + width, count);
+			U64 hi = Min(lo + 2 * width, count);
+			MergeSequential(source + lo, mid - lo, source + mid, hi - mid, destination + lo, less);
+		}
+
+		Object* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	if (source != data)
+		memcpy(data, source, sizeof(Object) * count);
+}
+
+// Parallel merge sort.  Blocks are sorted independently, then merged in
+// rounds where every merge is split across jobs along its merge path.
+template <typename Object, typename Less>
+void ParallelSort(Object* data, U64 count, Less less)
+{
+	if (count < 2)
+		return;
+
+	U32 job_count = ParallelGetJobCount(count, PARALLEL_SORT_MIN_BLOCK);
+	Object* scratch = (Object*) ::malloc(sizeof(Object) * count);
+
+	if (1 == job_count)
+	{
+		MergeSortSequential(data, scratch, count, less);
+		::free(scratch);
+		return;
+	}
+
+	U64 block_count = UpperPowerOfTwo((U64)job_count);
+
+	ParallelFor(0, block_count, [&](U64 first_block, U64 last_block)
+	{
+		for (U64 block = first_block; block < last_block; ++block)
+		{
+			U64 lo = count * block / block_count;
+			U64 hi = count * (block + 1) / block_count;
+			MergeSortSequential(data + lo, scratch + lo, hi - lo, less);
+		}
+	}, 1);
+
+	Object* source = data;
+	Object* destination = scratch;
+
+	for (U64 span = 1; span < block_count; span *= 2)
+	{
+		U64 pair_count = block_count / (2 * span);
+		U64 pieces = Max((U64)(2 * job_count) / pair_count, (U64)1);
+
+		ParallelFor(0, pair_count * pieces, [&](U64 first_task, U64 last_task)
+		{
+			for (U64 task = first_task; task < last_task; ++task)
+			{
+				U64 pair = task / pieces;
+				U64 piece = task % pieces;
+
+				U64 lo = count * (2 * pair * span) / block_count;
+				U64 mid = count * ((2 * pair + 1) * span) / block_count;
+				U64 hi = count * ((2 * pair + 2) * span) / block_count;
+
+				const Object* a = source + lo;
+				const Object* b = source + mid;
+				U64 a_count = mid - lo;
+				U64 b_count = hi - mid;
+
+				U64 k_begin = (hi - lo) * piece / pieces;
+				U64 k_end = (hi - lo) * (piece + 1) / pieces;
+				U64 i_begin = MergeCoRank(k_begin, a, a_count, b, b_count, less);
+				U64 i_end = MergeCoRank(k_end, a, a_count, b, b_count, less);
+
+				MergeSequential(a + i_begin, i_end - i_begin, b + (k_begin - i_begin), (k_end - i_end) - (k_begin - i_begin), destination + lo + k_begin, less);
+			}
+		}, 1);
+
+		Object* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	if (source != data)
+	{
+		ParallelFor(0, count, [&](U64 lo, U64 hi)
+		{
+			memcpy(data + lo, source + lo, sizeof(Object) * (hi - lo));
+		});
+	}
+
+	::free(scratch);
+}
+
+// LSD radix sort of unsigned integer keys, one byte per pass.  Every block
+// histograms and scatters its own slice, so each pass stays stable.
+template <typename Key>
+void ParallelRadixSort(Key* keys, U64 count)
+{
+	if (count < 2)
+		return;
+
+	const U32 RADIX = 256;
+	U64 block_count = ParallelGetJobCount(count, PARALLEL_SORT_MIN_BLOCK);
+
+	Key* scratch = (Key*) ::malloc(sizeof(Key) * count);
+	U64* offsets = (U64*) ::malloc(sizeof(U64) * RADIX * block_count);
+
+	Key* source = keys;
+	Key* destination = scratch;
+
+	for (U32 shift = 0; shift < sizeof(Key) * 8; shift += 8)
+	{
+		ParallelFor(0, block_count, [&](U64 first_block, U64 last_block)
+		{
+			for (U64 block = first_block; block < last_block; ++block)
+			{
+				U64* histogram = offsets + block * RADIX;
+				memset(histogram, 0, sizeof(U64) * RADIX);
+
+				U64 lo = count * block / block_count;
+				U64 hi = count * (block + 1) / block_count;
+				for (U64 index = lo; index < hi; ++index)
+				{
+					++histogram[(source[index] >> shift) & (RADIX - 1)];
+				}
+			}
+		}, 1);
+
+		// Skip the pass when every key shares this digit
+		bool single_digit = false;
+		for (U32 digit = 0; digit < RADIX && !single_digit; ++digit)
+		{
+			U64 total = 0;
+			for (U64 block = 0; block < block_count; ++block)
+			{
+				total += offsets[block * RADIX + digit];
+			}
+
+			single_digit = (total == count);
+		}
+
+		if (single_digit)
+			continue;
+
+		U64 running = 0;
+		for (U32 digit = 0; digit < RADIX; ++digit)
+		{
+			for (U64 block = 0; block < block_count; ++block)
+			{
+				U64 bucket = offsets[block * RADIX + digit];
+				offsets[block * RADIX + digit] = running;
+				running += bucket;
+			}
+		}
+
+		ParallelFor(0, block_count, [&](U64 first_block, U64 last_block)
+		{
+			for (U64 block = first_block; block < last_block; ++block)
+			{
+				U64* cursor = offsets + block * RADIX;
+
+				U64 lo = count * block / block_count;
+				U64 hi = count * (block + 1) / block_count;
+				for (U64 index = lo; index < hi; ++index)
+				{
+					Key key = source[index];
+					destination[cursor[(key >> shift) & (RADIX - 1)]++] = key;
+				}
+			}
+		}, 1);
+
+		Key* swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	if (source != keys)
+		memcpy(keys, source, sizeof(Key) * count);
+
+	::free(offsets);
+	::free(scratch);
+}
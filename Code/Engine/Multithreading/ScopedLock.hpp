@@ -0,0 +1,51 @@
+#pragma once
+#include "Multithreading/LockProfiler.hpp"
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Holds any lock with Lock/Unlock for the length of a scope.  The constructor
+//	deduces the lock type and remembers a matching unlock, so SCOPE_LOCK takes a
+//	CriticalSection*, Mutex* or RWLock* alike.  Profiled builds swap in
+//	ProfiledScopedLock, which also needs the lock to have TryLock.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class ScopedLock
+{
+public:
+	template <typename LockType>
+	ScopedLock(LockType* lock)
+		: m_lock(lock)
+		, m_unlock(&UnlockLock<LockType>)
+	{
+		lock->Lock();
+	}
+
+	~ScopedLock()
+	{
+		m_unlock(m_lock);
+	}
+
+private:
+	template <typename LockType>
+	static void UnlockLock(void* lock)
+	{
+		((LockType*)lock)->Unlock();
+	}
+
+	ScopedLock(const ScopedLock&) = delete;
+	ScopedLock& operator=(const ScopedLock&) = delete;
+
+private:
+	void* m_lock;
+	void(*m_unlock)(void*);
+};
+
+// Defines
+#define COMBINE_1(X,Y) X##Y
+#define COMBINE(X,Y) COMBINE_1(X,Y)
+#if defined(PROFILE_LOCKS)
+	// The site is constant initialized, so it costs no guard on each entry
+	#define SCOPE_LOCK( csp ) static lock_site COMBINE(__lks_,__LINE__) = { __FILE__, __LINE__, 0 }; ProfiledScopedLock COMBINE(__scs_,__LINE__)(csp, &COMBINE(__lks_,__LINE__))
+#else
+	#define SCOPE_LOCK( csp ) ScopedLock COMBINE(__scs_,__LINE__)(csp)
+#endif
@@ -0,0 +1,280 @@
+#include "Multithreading/Synchronization.hpp"
+#include "Multithreading/Atomic.hpp"
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <time.h>
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+const U32 EVENT_SET = 1;
+const U64 SYNC_NO_DEADLINE = 0xFFFFFFFFFFFFFFFFULL;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static U64 SyncGetMilliseconds()
+{
+	#if defined(_WIN32)
+		return (U64)::GetTickCount64();
+	#else
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (U64)now.tv_sec * 1000 + (U64)now.tv_nsec / 1000000;
+	#endif
+}
+
+static U64 SyncGetDeadline(U32 timeout_ms)
+{
+	if (FUTEX_WAIT_INFINITE == timeout_ms)
+		return SYNC_NO_DEADLINE;
+	return SyncGetMilliseconds() + timeout_ms;
+}
+
+// Sleeps while *address equals expected, false once the deadline has passed
+static bool SyncSleep(volatile U32* address, U32 expected, U64 deadline_ms)
+{
+	if (SYNC_NO_DEADLINE == deadline_ms)
+	{
+		FutexWait(address, expected);
+		return true;
+	}
+
+	U64 now = SyncGetMilliseconds();
+	if (now >= deadline_ms)
+		return false;
+
+	FutexWait(address, expected, (U32)(deadline_ms - now));
+	return true;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//				Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+Event::Event(bool manual_reset /*= false*/, bool initially_set /*= false*/)
+	: m_state(initially_set ? EVENT_SET : 0)
+	, m_waiters(0)
+	, m_manualReset(manual_reset)
+{
+}
+
+void Event::Set()
+{
+	// Sequentially consistent on both sides like the semaphore, so either
+	// the waiter sees the flag or we see the waiter
+	U32 state = 0;
+	if (!AtomicCompareExchange(&m_state, &state, EVENT_SET, ATOMIC_SEQ_CST))
+		return;
+
+	if (0 == AtomicLoad(&m_waiters, ATOMIC_SEQ_CST))
+		return;
+
+	if (m_manualReset)
+		FutexWakeAll(&m_state);
+	else
+		FutexWakeOne(&m_state);
+}
+
+void Event::Reset()
+{
+	AtomicStore(&m_state, 0U, ATOMIC_RELAXED);
+}
+
+bool Event::TryWait()
+{
+	U32 state = AtomicLoad(&m_state, ATOMIC_ACQUIRE);
+	if (0 == state)
+		return false;
+
+	if (m_manualReset)
+		return true;
+
+	// Auto reset, whoever clears the flag is the one let through
+	return AtomicCompareExchange(&m_state, &state, 0U, ATOMIC_ACQUIRE);
+}
+
+bool Event::Wait(U32 timeout_ms /*= FUTEX_WAIT_INFINITE*/)
+{
+	for (U32 spin = 0; spin < SYNC_SPIN_COUNT; ++spin)
+	{
+		if (TryWait())
+			return true;
+		CpuPause();
+	}
+
+	U64 deadline = SyncGetDeadline(timeout_ms);
+	AtomicFetchAdd(&m_waiters, 1U, ATOMIC_SEQ_CST);
+
+	// An auto reset Set wakes one sleeper, which may lose the flag to a
+	// thread that never slept and then just goes back to sleep
+	bool signalled = false;
+	for (;;)
+	{
+		if (TryWait())
+		{
+			signalled = true;
+			break;
+		}
+
+		if (!SyncSleep(&m_state, 0, deadline))
+		{
+			signalled = TryWait();
+			break;
+		}
+	}
+
+	AtomicFetchSub(&m_waiters, 1U, ATOMIC_RELAXED);
+	return signalled;
+}
+
+bool Event::IsSet()
+{
+	return 0 != (AtomicLoad(&m_state, ATOMIC_ACQUIRE) & EVENT_SET);
+}
+
+Semaphore::Semaphore(U32 initial_count /*= 0*/)
+	: m_count(initial_count)
+	, m_waiters(0)
+{
+}
+
+void Semaphore::Release(U32 count /*= 1*/)
+{
+	// Sequentially consistent on both sides, so either the waiter sees the
+	// count or we see the waiter
+	AtomicFetchAdd(&m_count, count, ATOMIC_SEQ_CST);
+	if (0 == AtomicLoad(&m_waiters, ATOMIC_SEQ_CST))
+		return;
+
+	if (1 == count)
+		FutexWakeOne(&m_count);
+	else
+		FutexWakeAll(&m_count);
+}
+
+bool Semaphore::TryAcquire()
+{
+	U32 count = AtomicLoad(&m_count, ATOMIC_RELAXED);
+	while (0 != count)
+	{
+		if (AtomicCompareExchange(&m_count, &count, count - 1, ATOMIC_ACQUIRE))
+			return true;
+	}
+
+	return false;
+}
+
+bool Semaphore::Acquire(U32 timeout_ms /*= FUTEX_WAIT_INFINITE*/)
+{
+	for (U32 spin = 0; spin < SYNC_SPIN_COUNT; ++spin)
+	{
+		if (TryAcquire())
+			return true;
+		CpuPause();
+	}
+
+	U64 deadline = SyncGetDeadline(timeout_ms);
+	AtomicFetchAdd(&m_waiters, 1U, ATOMIC_SEQ_CST);
+
+	bool acquired = false;
+	for (;;)
+	{
+		if (TryAcquire())
+		{
+			acquired = true;
+			break;
+		}
+
+		if (!SyncSleep(&m_count, 0, deadline))
+		{
+			acquired = TryAcquire();
+			break;
+		}
+	}
+
+	AtomicFetchSub(&m_waiters, 1U, ATOMIC_RELAXED);
+	return acquired;
+}
+
+Latch::Latch(U32 count)
+	: m_count(count)
+{
+}
+
+void Latch::CountDown(U32 count /*= 1*/)
+{
+	if (count == AtomicFetchSub(&m_count, count, ATOMIC_RELEASE))
+		FutexWakeAll(&m_count);
+}
+
+bool Latch::IsReady()
+{
+	return 0 == AtomicLoad(&m_count, ATOMIC_ACQUIRE);
+}
+
+bool Latch::Wait(U32 timeout_ms /*= FUTEX_WAIT_INFINITE*/)
+{
+	for (U32 spin = 0; spin < SYNC_SPIN_COUNT; ++spin)
+	{
+		if (IsReady())
+			return true;
+		CpuPause();
+	}
+
+	U64 deadline = SyncGetDeadline(timeout_ms);
+	for (;;)
+	{
+		U32 count = AtomicLoad(&m_count, ATOMIC_ACQUIRE);
+		if (0 == count)
+			return true;
+
+		if (!SyncSleep(&m_count, count, deadline))
+			return IsReady();
+	}
+}
+
+Barrier::Barrier(U32 thread_count)
+	: m_remaining(thread_count)
+	, m_generation(0)
+	, m_threadCount(thread_count)
+{
+}
+
+bool Barrier::ArriveAndWait()
+{
+	// Read before arriving, the last arrival moves it on
+	U32 generation = AtomicLoad(&m_generation, ATOMIC_ACQUIRE);
+
+	if (1 == AtomicFetchSub(&m_remaining, 1U, ATOMIC_ACQ_REL))
+	{
+		// Reset before the new generation shows, early arrivals of the next
+		// phase must find the full count
+		AtomicStore(&m_remaining, m_threadCount, ATOMIC_RELAXED);
+		AtomicFetchAdd(&m_generation, 1U, ATOMIC_RELEASE);
+		FutexWakeAll(&m_generation);
+		return true;
+	}
+
+	for (U32 spin = 0; spin < SYNC_SPIN_COUNT; ++spin)
+	{
+		if (generation != AtomicLoad(&m_generation, ATOMIC_ACQUIRE))
+			return false;
+		CpuPause();
+	}
+
+	while (generation == AtomicLoad(&m_generation, ATOMIC_ACQUIRE))
+	{
+		FutexWait(&m_generation, generation);
+	}
+
+	return false;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Multithreading/Futex.hpp"
+
+// Defines
+#define SYNC_SPIN_COUNT (128)
+
+	// Waiting primitives on a 32 bit word each.  A waiter spins on the word
+	// for SYNC_SPIN_COUNT rounds, then sleeps on it through the futex layer,
+	// and the signalling side only makes a wake call when someone may be
+	// asleep.  Timeouts are in milliseconds, FUTEX_WAIT_INFINITE waits for
+	// good, and a timed wait returns false when it gave up.  They block the
+	// thread, so a job that has to wait on other jobs should use JobWait.
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Set releases waiters.  An auto reset event lets exactly one waiter through
+//	per Set and clears itself as it does; a manual reset event lets everyone
+//	through until Reset.  Setting an event that is already set does nothing.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class Event
+{
+public:
+	explicit Event(bool manual_reset = false, bool initially_set = false);
+	~Event() {};
+	void Set();
+	void Reset();
+	bool Wait(U32 timeout_ms = FUTEX_WAIT_INFINITE);
+	bool TryWait();
+	bool IsSet();
+private:
+	Event(const Event&) = delete;
+	Event& operator=(const Event&) = delete;
+private:
+	volatile U32 m_state;
+	// Threads in the sleeping half of Wait, Set only wakes when there are any
+	volatile U32 m_waiters;
+	bool m_manualReset;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Counting semaphore.  Release adds to the count and wakes as many sleepers
+//	as it added, Acquire takes one from it or waits until it can.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class Semaphore
+{
+public:
+	explicit Semaphore(U32 initial_count = 0);
+	~Semaphore() {};
+	void Release(U32 count = 1);
+	bool Acquire(U32 timeout_ms = FUTEX_WAIT_INFINITE);
+	bool TryAcquire();
+	inline U32 GetCount() { return m_count; };
+private:
+	Semaphore(const Semaphore&) = delete;
+	Semaphore& operator=(const Semaphore&) = delete;
+private:
+	volatile U32 m_count;
+	volatile U32 m_waiters;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Single use countdown.  Waiters are released once CountDown has taken the
+//	count to zero, and every later Wait returns at once.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class Latch
+{
+public:
+	explicit Latch(U32 count);
+	~Latch() {};
+	void CountDown(U32 count = 1);
+	bool Wait(U32 timeout_ms = FUTEX_WAIT_INFINITE);
+	bool IsReady();
+private:
+	Latch(const Latch&) = delete;
+	Latch& operator=(const Latch&) = delete;
+private:
+	volatile U32 m_count;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Reusable barrier for a fixed number of threads.  Each phase ends when the
+//	last thread arrives, which resets the count for the next phase and is the
+//	one ArriveAndWait returns true for, so it can do any serial work.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class Barrier
+{
+public:
+	explicit Barrier(U32 thread_count);
+	~Barrier() {};
+	bool ArriveAndWait();
+	inline U32 GetThreadCount() { return m_threadCount; };
+private:
+	Barrier(const Barrier&) = delete;
+	Barrier& operator=(const Barrier&) = delete;
+private:
+	volatile U32 m_remaining;
+	volatile U32 m_generation;
+	U32 m_threadCount;
+};
@@ -0,0 +1,470 @@
+#include "Multithreading/TaskGraph.hpp"
+#include "Math/Utils.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// The previous frame's run and the kick, on top of the predecessors
+const U32 TASK_GRAPH_EXTRA_TOKENS = 2;
+
+//////////////////////////////////////////////////////
+//													//
+//				Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+TaskGraph::TaskGraph(U32 frames_in_flight /*= 2*/)
+	: m_nodeCount(0)
+	, m_edgeCount(0)
+	, m_links(nullptr)
+	, m_order(nullptr)
+	, m_framesInFlight(ClampWithin(frames_in_flight, (U32)TASK_GRAPH_MAX_FRAMES, 1U))
+	, m_nextFrame(0)
+	, m_compiled(false)
+	, m_completedCount(0)
+	, m_lastFrame(0)
+	, m_lastFrameTicks(0)
+	, m_lastCriticalPathTicks(0)
+	, m_lastCriticalPath(nullptr)
+	, m_lastCriticalPathLength(0)
+{
+	// A node finishing frame N releases its run in N + 1, so that frame's
+	// counters must be set before N starts; one slot more than in flight.
+	m_frameSlots = m_framesInFlight + 1;
+
+	for (U32 index = 0; index < m_frameSlots; ++index)
+	{
+		task_frame& frame = m_frames[index];
+		frame.m_graph = this;
+		frame.m_frame = 0;
+		frame.m_kickTicks = 0;
+		frame.m_pending = nullptr;
+		frame.m_instances = nullptr;
+		frame.m_startTicks = nullptr;
+		frame.m_endTicks = nullptr;
+		frame.m_pathTicks = nullptr;
+		frame.m_pathFrom = nullptr;
+	}
+}
+
+TaskGraph::~TaskGraph()
+{
+	WaitAll();
+
+	for (U32 index = 0; index < m_frameSlots; ++index)
+	{
+		task_frame& frame = m_frames[index];
+		delete[] frame.m_pending;
+		delete[] frame.m_instances;
+		delete[] frame.m_startTicks;
+		delete[] frame.m_endTicks;
+		delete[] frame.m_pathTicks;
+		delete[] frame.m_pathFrom;
+	}
+
+	delete[] m_links;
+	delete[] m_order;
+	delete[] m_lastCriticalPath;
+}
+
+U32 TaskGraph::AddNode(const char* name, task_cb entry, void* data)
+{
+	if (m_compiled || m_nodeCount >= TASK_GRAPH_MAX_NODES)
+		return TASK_GRAPH_INVALID_NODE;
+
+	task_node& node = m_nodes[m_nodeCount];
+	node.m_name = name;
+	node.m_entry = entry;
+	node.m_data = data;
+	node.m_firstSuccessor = 0;
+	node.m_successorCount = 0;
+	node.m_firstPredecessor = 0;
+	node.m_predecessorCount = 0;
+	node.m_totalTicks = 0;
+	node.m_runCount = 0;
+	return m_nodeCount++;
+}
+
+// before runs to completion ahead of after, within the same frame
+bool TaskGraph::AddEdge(U32 before, U32 after)
+{
+	if (m_compiled || m_edgeCount >= TASK_GRAPH_MAX_EDGES)
+		return false;
+	if (before >= m_nodeCount || after >= m_nodeCount || before == after)
+		return false;
+
+	m_edgeFrom[m_edgeCount] = before;
+	m_edgeTo[m_edgeCount] = after;
+	++m_edgeCount;
+	return true;
+}
+
+// Only before Compile, or after it failed.  Edge order does not matter, so
+// the last one takes the removed one's place
+bool TaskGraph::RemoveEdge(U32 before, U32 after)
+{
+	if (m_compiled)
+		return false;
+
+	for (U32 edge = 0; edge < m_edgeCount; ++edge)
+	{
+		if (before != m_edgeFrom[edge] || after != m_edgeTo[edge])
+			continue;
+
+		--m_edgeCount;
+		m_edgeFrom[edge] = m_edgeFrom[m_edgeCount];
+		m_edgeTo[edge] = m_edgeTo[m_edgeCount];
+		return true;
+	}
+
+	return false;
+}
+
+// Fails on an empty graph or a cycle.  Nothing is kept from a failed call,
+// so nodes can be added or the edge closing the cycle removed and Compile
+// called again
+bool TaskGraph::Compile()
+{
+	if (m_compiled || 0 == m_nodeCount)
+		return false;
+
+	for (U32 edge = 0; edge < m_edgeCount; ++edge)
+	{
+		++m_nodes[m_edgeFrom[edge]].m_successorCount;
+		++m_nodes[m_edgeTo[edge]].m_predecessorCount;
+	}
+
+	// Successor lists first, predecessor lists after, one block per node
+	m_links = new U32[m_edgeCount * 2];
+	U32 offset = 0;
+	for (U32 index = 0; index < m_nodeCount; ++index)
+	{
+		m_nodes[index].m_firstSuccessor = offset;
+		offset += m_nodes[index].m_successorCount;
+	}
+	for (U32 index = 0; index < m_nodeCount; ++index)
+	{
+		m_nodes[index].m_firstPredecessor = offset;
+		offset += m_nodes[index].m_predecessorCount;
+	}
+
+	U32* successor_fill = new U32[m_nodeCount];
+	U32* predecessor_fill = new U32[m_nodeCount];
+	for (U32 index = 0; index < m_nodeCount; ++index)
+	{
+		successor_fill[index] = 0;
+		predecessor_fill[index] = 0;
+	}
+
+	for (U32 edge = 0; edge < m_edgeCount; ++edge)
+	{
+		task_node& from = m_nodes[m_edgeFrom[edge]];
+		task_node& to = m_nodes[m_edgeTo[edge]];
+		m_links[from.m_firstSuccessor + successor_fill[m_edgeFrom[edge]]++] = m_edgeTo[edge];
+		m_links[to.m_firstPredecessor + predecessor_fill[m_edgeTo[edge]]++] = m_edgeFrom[edge];
+	}
+
+	// Kahn's algorithm, anything left over sits on a cycle
+	m_order = new U32[m_nodeCount];
+	U32 order_count = 0;
+	for (U32 index = 0; index < m_nodeCount; ++index)
+	{
+		predecessor_fill[index] = m_nodes[index].m_predecessorCount;
+		if (0 == predecessor_fill[index])
+			m_order[order_count++] = index;
+	}
+
+	for (U32 position = 0; position < order_count; ++position)
+	{
+		const task_node& node = m_nodes[m_order[position]];
+		for (U32 link = 0; link < node.m_successorCount; ++link)
+		{
+			U32 successor = m_links[node.m_firstSuccessor + link];
+			if (0 == --predecessor_fill[successor])
+				m_order[order_count++] = successor;
+		}
+	}
+
+	delete[] successor_fill;
+	delete[] predecessor_fill;
+
+	if (order_count != m_nodeCount)
+	{
+		for (U32 index = 0; index < m_nodeCount; ++index)
+		{
+			m_nodes[index].m_successorCount = 0;
+			m_nodes[index].m_predecessorCount = 0;
+		}
+
+		delete[] m_links;
+		delete[] m_order;
+		m_links = nullptr;
+		m_order = nullptr;
+		return false;
+	}
+
+	for (U32 index = 0; index < m_frameSlots; ++index)
+	{
+		task_frame& frame = m_frames[index];
+		frame.m_pending = new Atomic<U32>[m_nodeCount];
+		frame.m_instances = new task_instance[m_nodeCount];
+		frame.m_startTicks = new U64[m_nodeCount];
+		frame.m_endTicks = new U64[m_nodeCount];
+		frame.m_pathTicks = new U64[m_nodeCount];
+		frame.m_pathFrom = new U32[m_nodeCount];
+
+		for (U32 node = 0; node < m_nodeCount; ++node)
+		{
+			frame.m_instances[node].m_frame = &frame;
+			frame.m_instances[node].m_node = node;
+		}
+
+		// Frame 0 has no previous runs to wait for
+		ArmFrame(&frame, 0 == index);
+	}
+
+	m_lastCriticalPath = new U32[m_nodeCount];
+	m_compiled = true;
+	return true;
+}
+
+void TaskGraph::ArmFrame(task_frame* frame, bool first)
+{
+	U32 extra = first ? TASK_GRAPH_EXTRA_TOKENS - 1 : TASK_GRAPH_EXTRA_TOKENS;
+	for (U32 node = 0; node < m_nodeCount; ++node)
+	{
+		frame->m_pending[node].Store(m_nodes[node].m_predecessorCount + extra, ATOMIC_RELAXED);
+	}
+}
+
+// Returns the frame index passed to every node of the frame
+U64 TaskGraph::Kick()
+{
+	if (!m_compiled)
+		return 0;
+
+	// Waiting on the slot's last user too, its finisher may still be re-arming
+	U64 frame_index = m_nextFrame;
+	if (frame_index >= m_frameSlots)
+		Wait(frame_index - m_frameSlots);
+	if (frame_index >= m_framesInFlight)
+		Wait(frame_index - m_framesInFlight);
+
+	task_frame* frame = &m_frames[frame_index % m_frameSlots];
+	frame->m_frame = frame_index;
+	frame->m_kickTicks = TimeGetOpCount();
+	frame->m_remaining.Store(m_nodeCount, ATOMIC_RELAXED);
+	frame->m_done.m_value.Store(1, ATOMIC_RELAXED);
+	++m_nextFrame;
+
+	for (U32 node = 0; node < m_nodeCount; ++node)
+	{
+		Release(frame, node);
+	}
+
+	return frame_index;
+}
+
+void TaskGraph::Wait(U64 frame_index)
+{
+	if (frame_index >= m_nextFrame)
+		return;
+
+	// A reused slot means the frame finished long ago
+	task_frame* frame = &m_frames[frame_index % m_frameSlots];
+	if (frame->m_frame != frame_index)
+		return;
+
+	JobWait(&frame->m_done);
+}
+
+void TaskGraph::WaitAll()
+{
+	// Frames finish in order, node runs never overtake the previous frame's
+	if (0 != m_nextFrame)
+		Wait(m_nextFrame - 1);
+
+	// The last finisher may still be tidying an earlier frame
+	for (U32 index = 0; index < m_frameSlots; ++index)
+	{
+		JobWait(&m_frames[index].m_done);
+	}
+}
+
+void TaskGraph::NodeEntry(void* data)
+{
+	task_instance* instance = (task_instance*)data;
+	task_frame* frame = instance->m_frame;
+	frame->m_graph->RunNode(frame, instance->m_node);
+}
+
+void TaskGraph::Schedule(task_instance* instance)
+{
+	if (0 == JobSystemGetWorkerCount())
+		NodeEntry(instance);
+	else
+		JobRun(NodeEntry, instance);
+}
+
+void TaskGraph::Release(task_frame* frame, U32 node)
+{
+	if (1 == frame->m_pending[node].FetchSub(1, ATOMIC_ACQ_REL))
+		Schedule(&frame->m_instances[node]);
+}
+
+void TaskGraph::RunNode(task_frame* frame, U32 node_index)
+{
+	const task_node& node = m_nodes[node_index];
+
+	frame->m_startTicks[node_index] = TimeGetOpCount();
+	node.m_entry(node.m_data, frame->m_frame);
+	frame->m_endTicks[node_index] = TimeGetOpCount();
+
+	for (U32 link = 0; link < node.m_successorCount; ++link)
+	{
+		Release(frame, m_links[node.m_firstSuccessor + link]);
+	}
+
+	// Our run in the next frame, armed since this frame was kicked
+	Release(&m_frames[(frame->m_frame + 1) % m_frameSlots], node_index);
+
+	if (1 == frame->m_remaining.FetchSub(1, ATOMIC_ACQ_REL))
+		FinishFrame(frame);
+}
+
+// Runs on whichever worker finished the frame's last node
+void TaskGraph::FinishFrame(task_frame* frame)
+{
+	U64 frame_end = frame->m_kickTicks;
+	U32 path_end = m_order[0];
+
+	// Longest chain of node times, in topological order
+	for (U32 position = 0; position < m_nodeCount; ++position)
+	{
+		U32 node_index = m_order[position];
+		const task_node& node = m_nodes[node_index];
+
+		U64 longest = 0;
+		U32 from = TASK_GRAPH_INVALID_NODE;
+		for (U32 link = 0; link < node.m_predecessorCount; ++link)
+		{
+			U32 predecessor = m_links[node.m_firstPredecessor + link];
+			if (TASK_GRAPH_INVALID_NODE == from || frame->m_pathTicks[predecessor] > longest)
+			{
+				longest = frame->m_pathTicks[predecessor];
+				from = predecessor;
+			}
+		}
+
+		frame->m_pathTicks[node_index] = longest + (frame->m_endTicks[node_index] - frame->m_startTicks[node_index]);
+		frame->m_pathFrom[node_index] = from;
+
+		if (frame->m_pathTicks[node_index] > frame->m_pathTicks[path_end])
+			path_end = node_index;
+		frame_end = Max(frame_end, frame->m_endTicks[node_index]);
+	}
+
+	{
+		SCOPE_LOCK(&m_statsLock);
+
+		for (U32 node = 0; node < m_nodeCount; ++node)
+		{
+			m_nodes[node].m_totalTicks += frame->m_endTicks[node] - frame->m_startTicks[node];
+			++m_nodes[node].m_runCount;
+		}
+
+		// Two frames can finish close together, only the newest is kept
+		if (0 == m_completedCount || frame->m_frame > m_lastFrame)
+		{
+			m_lastFrame = frame->m_frame;
+			m_lastFrameTicks = frame_end - frame->m_kickTicks;
+			m_lastCriticalPathTicks = frame->m_pathTicks[path_end];
+
+			// Walked back from the end, stored front to back
+			U32 length = 0;
+			for (U32 node = path_end; TASK_GRAPH_INVALID_NODE != node; node = frame->m_pathFrom[node])
+			{
+				++length;
+			}
+
+			U32 position = length;
+			for (U32 node = path_end; TASK_GRAPH_INVALID_NODE != node; node = frame->m_pathFrom[node])
+			{
+				m_lastCriticalPath[--position] = node;
+			}
+			m_lastCriticalPathLength = length;
+		}
+
+		++m_completedCount;
+	}
+
+	// The slot's next user is frame + slots, its runs wait on the previous frame
+	ArmFrame(frame, false);
+	frame->m_done.m_value.FetchSub(1, ATOMIC_RELEASE);
+}
+
+void TaskGraph::Report()
+{
+	SCOPE_LOCK(&m_statsLock);
+
+	if (0 == m_completedCount)
+	{
+		printf("\nTask graph has not completed a frame.\n");
+		return;
+	}
+
+	char frame_time[128];
+	char path_time[128];
+	TimeOpCountToString(m_lastFrameTicks, frame_time);
+	TimeOpCountToString(m_lastCriticalPathTicks, path_time);
+	printf("\nTask graph frame %llu: %s, critical path %s over %u node(s)\n", (unsigned long long)m_lastFrame, frame_time, path_time, m_lastCriticalPathLength);
+
+	for (U32 position = 0; position < m_lastCriticalPathLength; ++position)
+	{
+		const task_node& node = m_nodes[m_lastCriticalPath[position]];
+		char average[128];
+		TimeOpCountToString(node.m_totalTicks / Max(node.m_runCount, (U64)1), average);
+		printf("     %s (average %s)\n", (nullptr != node.m_name) ? node.m_name : "<unnamed>", average);
+	}
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+U64 TaskGraph::GetLastFrameTicks()
+{
+	SCOPE_LOCK(&m_statsLock);
+	return m_lastFrameTicks;
+}
+
+U64 TaskGraph::GetLastCriticalPathTicks()
+{
+	SCOPE_LOCK(&m_statsLock);
+	return m_lastCriticalPathTicks;
+}
+
+U32 TaskGraph::GetLastCriticalPath(U32* out_nodes, U32 capacity)
+{
+	SCOPE_LOCK(&m_statsLock);
+
+	U32 count = Min(m_lastCriticalPathLength, capacity);
+	for (U32 position = 0; position < count; ++position)
+	{
+		out_nodes[position] = m_lastCriticalPath[position];
+	}
+	return count;
+}
+
+U64 TaskGraph::GetNodeAverageTicks(U32 node)
+{
+	SCOPE_LOCK(&m_statsLock);
+
+	if (node >= m_nodeCount || 0 == m_nodes[node].m_runCount)
+		return 0;
+	return m_nodes[node].m_totalTicks / m_nodes[node].m_runCount;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/JobSystem.hpp"
+#include "Multithreading/Mutex.hpp"
+
+// Datatypes
+// frame is the index Kick returned, for picking per frame buffers
+typedef void(*task_cb)(void* data, U64 frame);
+
+class TaskGraph;
+
+struct task_node
+{
+	const char* m_name;
+	task_cb m_entry;
+	void* m_data;
+	U32 m_firstSuccessor;
+	U32 m_successorCount;
+	U32 m_firstPredecessor;
+	U32 m_predecessorCount;
+	// Summed over completed frames, guarded by the graph's stats lock
+	U64 m_totalTicks;
+	U64 m_runCount;
+};
+
+struct task_frame;
+
+struct task_instance
+{
+	task_frame* m_frame;
+	U32 m_node;
+};
+
+// One per frame in flight plus one, reused round robin
+struct task_frame
+{
+	TaskGraph* m_graph;
+	U64 m_frame;
+	U64 m_kickTicks;
+	// 1 while the frame runs, so JobWait can park on it
+	JobCounter m_done;
+	Atomic<U32> m_remaining;
+	// Predecessors this frame, the node's previous frame, and the kick
+	Atomic<U32>* m_pending;
+	task_instance* m_instances;
+	U64* m_startTicks;
+	U64* m_endTicks;
+	// Scratch for the critical path, used by whoever finishes the frame
+	U64* m_pathTicks;
+	U32* m_pathFrom;
+};
+
+// Defines
+#define TASK_GRAPH_MAX_NODES   (256)
+#define TASK_GRAPH_MAX_EDGES   (1024)
+#define TASK_GRAPH_MAX_FRAMES  (4)
+#define TASK_GRAPH_INVALID_NODE (0xFFFFFFFF)
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	A dependency graph declared once and run every frame on the job system.
+//	Nodes and edges are added up front, then Compile checks for cycles and
+//	lays the edges out per node; if it finds a cycle, edges can be removed
+//	and it can be called again.  Each Kick starts a frame: every node has an
+//	atomic counter of what it still waits for, and the node that takes a
+//	counter to zero schedules that successor as a job.
+//
+//	Besides its predecessors, a node waits for its own run in the previous
+//	frame, so a node never overlaps itself, but up to frames_in_flight frames
+//	run at once: early nodes of the next frame start as soon as their last
+//	run is done, while late nodes of the current frame are still going.  Kick
+//	blocks while that many frames are already in flight.
+//
+//	Every run is timed with TimeGetOpCount.  When a frame completes, the
+//	longest chain of node times through the graph is worked out, which is
+//	the frame's critical path: the shortest the frame could take on any
+//	number of workers.  Without an initialized job system, nodes run inline.
+//	Kick and Wait are meant to be called from a single thread.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class TaskGraph
+{
+public:
+	TaskGraph(U32 frames_in_flight = 2);
+	~TaskGraph();
+	U32 AddNode(const char* name, task_cb entry, void* data);
+	bool AddEdge(U32 before, U32 after);
+	bool RemoveEdge(U32 before, U32 after);
+	bool Compile();
+	U64 Kick();
+	void Wait(U64 frame);
+	void WaitAll();
+	void Report();
+
+	// Of the last completed frame
+	U64 GetLastFrameTicks();
+	U64 GetLastCriticalPathTicks();
+	U32 GetLastCriticalPath(U32* out_nodes, U32 capacity);
+	U64 GetNodeAverageTicks(U32 node);
+
+	inline U32 GetNodeCount() { return m_nodeCount; };
+	inline U32 GetFramesInFlight() { return m_framesInFlight; };
+	inline bool IsCompiled() { return m_compiled; };
+private:
+	static void NodeEntry(void* data);
+	void Schedule(task_instance* instance);
+	void Release(task_frame* frame, U32 node);
+	void RunNode(task_frame* frame, U32 node);
+	void FinishFrame(task_frame* frame);
+	void ArmFrame(task_frame* frame, bool first);
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+private:
+	task_node m_nodes[TASK_GRAPH_MAX_NODES];
+	U32 m_edgeFrom[TASK_GRAPH_MAX_EDGES];
+	U32 m_edgeTo[TASK_GRAPH_MAX_EDGES];
+	U32 m_nodeCount;
+	U32 m_edgeCount;
+	// Successor then predecessor indices, filled by Compile
+	U32* m_links;
+	// Compile's topological order, walked for the critical path
+	U32* m_order;
+	task_frame m_frames[TASK_GRAPH_MAX_FRAMES + 1];
+	U32 m_framesInFlight;
+	U32 m_frameSlots;
+	U64 m_nextFrame;
+	bool m_compiled;
+
+	Mutex m_statsLock;
+	U64 m_completedCount;
+	U64 m_lastFrame;
+	U64 m_lastFrameTicks;
+	U64 m_lastCriticalPathTicks;
+	U32* m_lastCriticalPath;
+	U32 m_lastCriticalPathLength;
+};
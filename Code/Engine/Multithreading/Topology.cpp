@@ -0,0 +1,343 @@
+#include "Multithreading/Topology.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include "Math/Utils.hpp"
+#include <stdlib.h>
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <sched.h>
+	#include <stdio.h>
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+const U32 TOPOLOGY_INVALID = 0xFFFFFFFF;
+static cpu_topology g_topology = {};
+static cpu_logical g_logical[TOPOLOGY_MAX_LOGICAL];
+static bool g_topology_ready = false;
+static Mutex g_topology_lock;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Maps an OS specific key (a mask, a first sibling id) to a dense id
+static U32 TopologyRenumber(U64* keys, U32* key_count, U64 key)
+{
+	for (U32 index = 0; index < *key_count; ++index)
+	{
+		if (keys[index] == key)
+			return index;
+	}
+
+	keys[*key_count] = key;
+	return (*key_count)++;
+}
+
+#if !defined(_WIN32)
+static bool TopologyReadU32(const char* path, U32* out_value)
+{
+	FILE* file = fopen(path, "r");
+	if (nullptr == file)
+		return false;
+
+	unsigned int value = 0;
+	bool read = (1 == fscanf(file, "%u", &value));
+	fclose(file);
+
+	*out_value = (U32)value;
+	return read;
+}
+
+// Finds the deepest cache above L1 for cpu, the first id of its shared_cpu_list
+// names the group, since every member of the group reports the same list.
+static bool TopologyReadLastCache(U32 cpu, U32* out_level, U32* out_first_sibling)
+{
+	char path[128];
+	bool found = false;
+
+	for (U32 index = 0; ; ++index)
+	{
+		U32 level = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/level", cpu, index);
+		if (!TopologyReadU32(path, &level))
+			break;
+
+		if (found && level <= *out_level)
+			continue;
+
+		U32 first_sibling = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list", cpu, index);
+		if (!TopologyReadU32(path, &first_sibling))
+			continue;
+
+		*out_level = level;
+		*out_first_sibling = first_sibling;
+		found = true;
+	}
+
+	return found;
+}
+
+static void TopologyDiscover()
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (0 != sched_getaffinity(0, sizeof(allowed), &allowed))
+		return;
+
+	U64 core_keys[TOPOLOGY_MAX_LOGICAL];
+	U64 package_keys[TOPOLOGY_MAX_LOGICAL];
+	U64 cache_keys[TOPOLOGY_MAX_LOGICAL];
+	U32 core_count = 0;
+	U32 package_count = 0;
+	U32 cache_count = 0;
+	U32 cache_level = 0;
+	char path[128];
+
+	for (U32 cpu = 0; cpu < TOPOLOGY_MAX_LOGICAL; ++cpu)
+	{
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+
+		U32 package = 0;
+		U32 core = cpu;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+		TopologyReadU32(path, &package);
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+		TopologyReadU32(path, &core);
+
+		// No cache information groups the processor with its package
+		U32 level = 0;
+		U32 first_sibling = 0;
+		U64 cache_key = ((U64)1 << 32) | package;
+		if (TopologyReadLastCache(cpu, &level, &first_sibling))
+		{
+			cache_key = first_sibling;
+			cache_level = Max(cache_level, level);
+		}
+
+		cpu_logical& logical = g_logical[g_topology.m_logicalCount++];
+		logical.m_id = cpu;
+		// core_id is only unique within a package
+		logical.m_core = TopologyRenumber(core_keys, &core_count, ((U64)package << 32) | core);
+		logical.m_package = TopologyRenumber(package_keys, &package_count, package);
+		logical.m_cacheGroup = TopologyRenumber(cache_keys, &cache_count, cache_key);
+	}
+
+	g_topology.m_coreCount = core_count;
+	g_topology.m_packageCount = package_count;
+	g_topology.m_cacheGroupCount = cache_count;
+	g_topology.m_cacheLevel = cache_level;
+}
+#else
+static U32 TopologyFindMask(U64* masks, U32 mask_count, U32 cpu)
+{
+	for (U32 index = 0; index < mask_count; ++index)
+	{
+		if (0 != (masks[index] & ((U64)1 << cpu)))
+			return index;
+	}
+
+	return TOPOLOGY_INVALID;
+}
+
+static void TopologyDiscover()
+{
+	DWORD_PTR process_mask = 0;
+	DWORD_PTR system_mask = 0;
+	if (!::GetProcessAffinityMask(::GetCurrentProcess(), &process_mask, &system_mask))
+		return;
+
+	DWORD length = 0;
+	::GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+	if (ERROR_INSUFFICIENT_BUFFER != ::GetLastError())
+		return;
+
+	char* buffer = (char*) ::malloc(length);
+	if (!::GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer, &length))
+	{
+		::free(buffer);
+		return;
+	}
+
+	// Processor group 0 only, which is all a 64 bit mask can address
+	U64 core_masks[TOPOLOGY_MAX_LOGICAL];
+	U64 package_masks[TOPOLOGY_MAX_LOGICAL];
+	U64 cache_masks[TOPOLOGY_MAX_LOGICAL];
+	U32 core_count = 0;
+	U32 package_count = 0;
+	U32 cache_count = 0;
+	U32 cache_level = 0;
+
+	for (DWORD offset = 0; offset < length; )
+	{
+		PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer + offset);
+		offset += info->Size;
+
+		if (RelationProcessorCore == info->Relationship && 0 == info->Processor.GroupMask[0].Group)
+		{
+			if (core_count < TOPOLOGY_MAX_LOGICAL)
+				core_masks[core_count++] = (U64)info->Processor.GroupMask[0].Mask;
+		}
+		else if (RelationProcessorPackage == info->Relationship)
+		{
+			for (WORD group = 0; group < info->Processor.GroupCount; ++group)
+			{
+				if (0 == info->Processor.GroupMask[group].Group && package_count < TOPOLOGY_MAX_LOGICAL)
+					package_masks[package_count++] = (U64)info->Processor.GroupMask[group].Mask;
+			}
+		}
+		else if (RelationCache == info->Relationship && 0 == info->Cache.GroupMask.Group && info->Cache.Level > 1)
+		{
+			// Only the deepest level counts, a deeper one restarts the list
+			if (info->Cache.Level > cache_level)
+			{
+				cache_level = info->Cache.Level;
+				cache_count = 0;
+			}
+
+			if (info->Cache.Level == cache_level && cache_count < TOPOLOGY_MAX_LOGICAL)
+				cache_masks[cache_count++] = (U64)info->Cache.GroupMask.Mask;
+		}
+	}
+
+	::free(buffer);
+
+	for (U32 cpu = 0; cpu < TOPOLOGY_MAX_LOGICAL; ++cpu)
+	{
+		if (0 == ((U64)process_mask & ((U64)1 << cpu)))
+			continue;
+
+		U32 core = TopologyFindMask(core_masks, core_count, cpu);
+		U32 package = TopologyFindMask(package_masks, package_count, cpu);
+		U32 cache = TopologyFindMask(cache_masks, cache_count, cpu);
+
+		cpu_logical& logical = g_logical[g_topology.m_logicalCount++];
+		logical.m_id = cpu;
+		// Fallbacks are offset so they cannot collide with a real mask index
+		logical.m_core = (TOPOLOGY_INVALID == core) ? TOPOLOGY_MAX_LOGICAL + cpu : core;
+		logical.m_package = (TOPOLOGY_INVALID == package) ? 0 : package;
+		logical.m_cacheGroup = (TOPOLOGY_INVALID == cache) ? TOPOLOGY_MAX_LOGICAL + logical.m_package : cache;
+	}
+
+	// Renumber densely, a restricted affinity mask can leave gaps
+	U64 core_keys[TOPOLOGY_MAX_LOGICAL];
+	U64 package_keys[TOPOLOGY_MAX_LOGICAL];
+	U64 cache_keys[TOPOLOGY_MAX_LOGICAL];
+	core_count = 0;
+	package_count = 0;
+	cache_count = 0;
+
+	for (U32 index = 0; index < g_topology.m_logicalCount; ++index)
+	{
+		cpu_logical& logical = g_logical[index];
+		logical.m_core = TopologyRenumber(core_keys, &core_count, logical.m_core);
+		logical.m_package = TopologyRenumber(package_keys, &package_count, logical.m_package);
+		logical.m_cacheGroup = TopologyRenumber(cache_keys, &cache_count, logical.m_cacheGroup);
+	}
+
+	g_topology.m_coreCount = core_count;
+	g_topology.m_packageCount = package_count;
+	g_topology.m_cacheGroupCount = cache_count;
+	g_topology.m_cacheLevel = cache_level;
+}
+#endif
+
+static void TopologyBuild()
+{
+	g_topology.m_logical = g_logical;
+	g_topology.m_logicalCount = 0;
+
+	TopologyDiscover();
+
+	// Nothing usable, treat every processor as a core of its own
+	if (0 == g_topology.m_logicalCount)
+	{
+		U32 count = Min(ThreadGetProcessorCount(), (U32)TOPOLOGY_MAX_LOGICAL);
+		for (U32 index = 0; index < count; ++index)
+		{
+			g_logical[index].m_id = index;
+			g_logical[index].m_core = index;
+			g_logical[index].m_package = 0;
+			g_logical[index].m_cacheGroup = 0;
+		}
+
+		g_topology.m_logicalCount = count;
+		g_topology.m_coreCount = count;
+		g_topology.m_packageCount = 1;
+		g_topology.m_cacheGroupCount = 1;
+		g_topology.m_cacheLevel = 0;
+	}
+
+	// Siblings are numbered in processor order within their core
+	for (U32 index = 0; index < g_topology.m_logicalCount; ++index)
+	{
+		g_logical[index].m_smtIndex = 0;
+		for (U32 other = 0; other < index; ++other)
+		{
+			if (g_logical[other].m_core == g_logical[index].m_core)
+				++g_logical[index].m_smtIndex;
+		}
+	}
+}
+
+const cpu_topology* TopologyGet()
+{
+	SCOPE_LOCK(&g_topology_lock);
+
+	if (!g_topology_ready)
+	{
+		TopologyBuild();
+		g_topology_ready = true;
+	}
+
+	return &g_topology;
+}
+
+static bool TopologyPlaceBefore(const cpu_logical& a, const cpu_logical& b)
+{
+	if (a.m_smtIndex != b.m_smtIndex)
+		return a.m_smtIndex < b.m_smtIndex;
+	if (a.m_package != b.m_package)
+		return a.m_package < b.m_package;
+	if (a.m_cacheGroup != b.m_cacheGroup)
+		return a.m_cacheGroup < b.m_cacheGroup;
+	return a.m_core < b.m_core;
+}
+
+// Fills out_logical with indices into m_logical: first one hardware thread of
+// every core, then the second threads, and so on.  Within each pass processors
+// are grouped by package and then by cache, so neighbouring entries share as
+// much cache as possible and SMT siblings are only doubled up when needed.
+U32 TopologyGetPlacementOrder(U32* out_logical, U32 capacity)
+{
+	const cpu_topology* topology = TopologyGet();
+	U32 order[TOPOLOGY_MAX_LOGICAL];
+
+	// Insertion sort, there are at most 64 entries
+	for (U32 index = 0; index < topology->m_logicalCount; ++index)
+	{
+		U32 position = index;
+		while (position > 0 && TopologyPlaceBefore(topology->m_logical[index], topology->m_logical[order[position - 1]]))
+		{
+			order[position] = order[position - 1];
+			--position;
+		}
+		order[position] = index;
+	}
+
+	U32 count = Min(topology->m_logicalCount, capacity);
+	for (U32 index = 0; index < count; ++index)
+	{
+		out_logical[index] = order[index];
+	}
+
+	return count;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+
+// Datatypes
+struct cpu_logical
+{
+	U32 m_id;			// OS processor number, the bit used in affinity masks
+	U32 m_core;			// physical core, shared by SMT siblings
+	U32 m_package;		// socket
+	U32 m_cacheGroup;	// processors behind the same last level cache
+	U32 m_smtIndex;		// 0 for the first hardware thread of a core
+};
+
+struct cpu_topology
+{
+	cpu_logical* m_logical;
+	U32 m_logicalCount;
+	U32 m_coreCount;
+	U32 m_packageCount;
+	U32 m_cacheGroupCount;
+	U32 m_cacheLevel;
+};
+
+// Defines
+#define TOPOLOGY_MAX_LOGICAL (64)
+
+	// Read once from /sys/devices/system/cpu on Linux and from
+	// GetLogicalProcessorInformationEx on Windows.  Only processors the process
+	// may run on are listed, and only the first 64 of them, since affinity
+	// masks are a U64.  Ids for cores, packages and cache groups are renumbered
+	// from 0 in discovery order.  Without usable information every processor
+	// becomes its own core in one package and one cache group.
+
+// Functions
+const cpu_topology* TopologyGet();
+U32 TopologyGetPlacementOrder(U32* out_logical, U32 capacity);
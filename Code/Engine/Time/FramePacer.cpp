@@ -0,0 +1,225 @@
+#include "Time/FramePacer.hpp"
+#include "Time/Utils.hpp"
+#include "Time/Profiler.hpp"
+#include "Multithreading/Futex.hpp"
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+	// Windows 10 1803 and up, older ones fall back to a normal timer
+	#if !defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+		#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION (0x00000002)
+	#endif
+#else
+	#include <errno.h>
+	#include <time.h>
+#endif
+#include <math.h>
+#include <stdio.h>
+
+//////////////////////////////////////////////////////
+//													//
+//				Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+FramePacer::FramePacer(double target_fps /*= FRAME_PACER_TARGET_FPS_DEFAULT*/, double min_fps /*= FRAME_PACER_MIN_FPS_DEFAULT*/)
+	: m_timer(nullptr)
+	, m_oversleepTicks(0)
+	, m_lastFrameTicks(0)
+	, m_deadlineTicks(0)
+{
+	#if defined(_WIN32)
+		m_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (nullptr == m_timer)
+			m_timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	#endif
+
+	SetTargetFrameRate(target_fps);
+	SetMinFrameRate(min_fps);
+	SetSpinMicroseconds(FRAME_PACER_SPIN_US_DEFAULT);
+	ResetStats();
+}
+
+FramePacer::~FramePacer()
+{
+	#if defined(_WIN32)
+		if (nullptr != m_timer)
+			CloseHandle((HANDLE)m_timer);
+	#endif
+}
+
+double FramePacer::WaitForNextFrame()
+{
+	U64 now = TimeGetOpCount();
+	if (0 == m_lastFrameTicks)
+	{
+		m_lastFrameTicks = now;
+		m_deadlineTicks = now;
+		return 0.0;
+	}
+
+	U64 spin_ticks = 0;
+	if (0 == m_periodTicks)
+	{
+		m_deadlineTicks = now;
+	}
+	else
+	{
+		PROFILE_SCOPE("Frame wait");
+		U64 deadline = m_deadlineTicks + m_periodTicks;
+		if (now >= deadline)
+		{
+			// A whole period behind, catching up would only rush the next frames
+			++m_missedCount;
+			m_deadlineTicks = (now - deadline >= m_periodTicks) ? now : deadline;
+		}
+		else
+		{
+			// Never more than half the period, so one late wake can not keep
+			// every later frame spinning
+			U64 margin = (2 * m_oversleepTicks > m_spinTicks) ? 2 * m_oversleepTicks : m_spinTicks;
+			if (margin > m_periodTicks / 2)
+				margin = m_periodTicks / 2;
+
+			if (deadline - now > margin)
+			{
+				U64 wake = deadline - margin;
+				SleepFor(wake - now);
+				now = TimeGetOpCount();
+
+				// Clamped, a stall like a break point or a suspend says nothing
+				// about how late the next wake will be
+				U64 oversleep = (now > wake) ? now - wake : 0;
+				U64 sample = (oversleep > m_periodTicks / 4) ? m_periodTicks / 4 : oversleep;
+				m_oversleepTicks = m_oversleepTicks - m_oversleepTicks / 8 + sample / 8;
+				m_oversleepSumTicks += oversleep;
+				++m_sleepCount;
+			}
+			else
+			{
+				// Decays while only spinning, so the pacer gets back to sleeping
+				m_oversleepTicks -= m_oversleepTicks / 8;
+			}
+
+			U64 spin_start = now;
+			while (now < deadline)
+			{
+				CpuPause();
+				now = TimeGetOpCount();
+			}
+			spin_ticks = now - spin_start;
+			m_deadlineTicks = deadline;
+		}
+	}
+
+	U64 frame_ticks = now - m_lastFrameTicks;
+	m_lastFrameTicks = now;
+	RecordFrame(frame_ticks, spin_ticks);
+
+	if (frame_ticks > m_maxFrameTicks)
+		frame_ticks = m_maxFrameTicks;
+	return (double)TimeOpCountTo_ns(frame_ticks) / 1.0e9;
+}
+
+void FramePacer::GetStats(frame_pacer_stats* out_stats) const
+{
+	out_stats->m_frameCount = m_frameCount;
+	out_stats->m_missedCount = m_missedCount;
+	out_stats->m_targetMs = (0 == m_periodTicks) ? 0.0 : 1000.0 / m_targetFps;
+	out_stats->m_meanMs = m_meanMs;
+	out_stats->m_jitterMs = (m_frameCount > 1) ? sqrt(m_squaredMs / (double)(m_frameCount - 1)) : 0.0;
+	out_stats->m_minMs = (0 == m_frameCount) ? 0.0 : m_minMs;
+	out_stats->m_maxMs = m_maxMs;
+	out_stats->m_meanErrorMs = (0 == m_frameCount) ? 0.0 : m_errorSumMs / (double)m_frameCount;
+	out_stats->m_maxErrorMs = m_maxErrorMs;
+	out_stats->m_meanSpinUs = (0 == m_frameCount) ? 0.0 : (double)TimeOpCountTo_ns(m_spinSumTicks) / 1000.0 / (double)m_frameCount;
+	out_stats->m_meanOversleepUs = (0 == m_sleepCount) ? 0.0 : (double)TimeOpCountTo_ns(m_oversleepSumTicks) / 1000.0 / (double)m_sleepCount;
+}
+
+void FramePacer::ResetStats()
+{
+	m_frameCount = 0;
+	m_missedCount = 0;
+	m_meanMs = 0.0;
+	m_squaredMs = 0.0;
+	m_minMs = 1.0e300;
+	m_maxMs = 0.0;
+	m_errorSumMs = 0.0;
+	m_maxErrorMs = 0.0;
+	m_spinSumTicks = 0;
+	m_oversleepSumTicks = 0;
+	m_sleepCount = 0;
+	m_oversleepTicks = 0;
+}
+
+void FramePacer::Report() const
+{
+	frame_pacer_stats stats;
+	GetStats(&stats);
+
+	printf("\nFrame pacing over %llu frame(s), target %.3f ms\n", (unsigned long long)stats.m_frameCount, stats.m_targetMs);
+	printf("  mean %.3f ms, jitter %.3f ms, min %.3f ms, max %.3f ms\n", stats.m_meanMs, stats.m_jitterMs, stats.m_minMs, stats.m_maxMs);
+	printf("  off target by %.3f ms on average, %.3f ms at most; %llu missed deadline(s)\n", stats.m_meanErrorMs, stats.m_maxErrorMs,
+		(unsigned long long)stats.m_missedCount);
+	printf("  spun %.1f us per frame, sleeps woke %.1f us late on average\n", stats.m_meanSpinUs, stats.m_meanOversleepUs);
+}
+
+// 0 or less runs uncapped
+void FramePacer::SetTargetFrameRate(double fps)
+{
+	m_targetFps = (fps > 0.0) ? fps : 0.0;
+	m_periodTicks = (fps > 0.0) ? (U64)((double)TimeGetOpsPerSecond() / fps) : 0;
+	m_oversleepTicks = 0;
+}
+
+// 0 or less never clamps
+void FramePacer::SetMinFrameRate(double fps)
+{
+	m_minFps = (fps > 0.0) ? fps : 0.0;
+	m_maxFrameTicks = (fps > 0.0) ? (U64)((double)TimeGetOpsPerSecond() / fps) : ~(U64)0;
+}
+
+void FramePacer::SetSpinMicroseconds(U32 spin_us)
+{
+	m_spinTicks = TimeOpCountFrom_ms((double)spin_us / 1000.0);
+	m_oversleepTicks = 0;
+}
+
+void FramePacer::SleepFor(U64 ticks)
+{
+	U64 ns = TimeOpCountTo_ns(ticks);
+	#if defined(_WIN32)
+		// Relative, in 100 ns units
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)(ns / 100);
+		if (nullptr != m_timer && SetWaitableTimer((HANDLE)m_timer, &due, 0, nullptr, nullptr, FALSE))
+			WaitForSingleObject((HANDLE)m_timer, INFINITE);
+		else
+			::Sleep((DWORD)(ns / 1000000));
+	#else
+		timespec duration = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+		while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, 0, &duration, &duration)) {}
+	#endif
+}
+
+void FramePacer::RecordFrame(U64 frame_ticks, U64 spin_ticks)
+{
+	double ms = (double)TimeOpCountTo_ns(frame_ticks) / 1.0e6;
+	++m_frameCount;
+	double delta = ms - m_meanMs;
+	m_meanMs += delta / (double)m_frameCount;
+	m_squaredMs += delta * (ms - m_meanMs);
+	if (ms < m_minMs)
+		m_minMs = ms;
+	if (ms > m_maxMs)
+		m_maxMs = ms;
+
+	if (0 != m_periodTicks)
+	{
+		double error = fabs(ms - 1000.0 / m_targetFps);
+		m_errorSumMs += error;
+		if (error > m_maxErrorMs)
+			m_maxErrorMs = error;
+	}
+
+	m_spinSumTicks += spin_ticks;
+}
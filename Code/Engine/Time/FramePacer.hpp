@@ -0,0 +1,100 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+
+// Defines
+#define FRAME_PACER_TARGET_FPS_DEFAULT (60.0)
+#define FRAME_PACER_MIN_FPS_DEFAULT    (10.0)
+#define FRAME_PACER_SPIN_US_DEFAULT    (300)
+
+// Datatypes
+struct frame_pacer_stats
+{
+	U64 m_frameCount;
+	// Frames whose work ran past their deadline, so there was nothing to wait
+	U64 m_missedCount;
+	double m_targetMs;
+	double m_meanMs;
+	// Standard deviation of the frame time
+	double m_jitterMs;
+	double m_minMs;
+	double m_maxMs;
+	// How far frames land from the target, 0 when uncapped
+	double m_meanErrorMs;
+	double m_maxErrorMs;
+	// CPU burnt spinning per frame, and how late the OS wakes the sleep
+	double m_meanSpinUs;
+	double m_meanOversleepUs;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Caps the frame rate without burning a core.  Frames are paced on absolute
+//	deadlines one period apart, so a frame that runs a little long is made up
+//	by the next instead of pushing every later frame back; one that overruns
+//	by more than a whole period starts the deadlines over.  The wait sleeps
+//	with clock_nanosleep, or a high resolution waitable timer on Windows, up
+//	to the spin margin before the deadline, then spins the rest on the clock.
+//	The margin is the configured spin time or twice how late the OS has been
+//	waking the sleep lately, whichever is more, so a coarse scheduler costs a
+//	longer spin rather than late frames.  It never passes half the period:
+//	each late wake counts for at most a quarter period, and the estimate
+//	decays on frames that only spin.  A target of 0 does not wait at all.
+//
+//	WaitForNextFrame returns the seconds since the last call, clamped to the
+//	min frame rate so a long stall, like a break point, is not simulated as
+//	one huge step.  Call it from one thread.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class FramePacer
+{
+public:
+	explicit FramePacer(double target_fps = FRAME_PACER_TARGET_FPS_DEFAULT, double min_fps = FRAME_PACER_MIN_FPS_DEFAULT);
+	~FramePacer();
+
+	double WaitForNextFrame();
+	void GetStats(frame_pacer_stats* out_stats) const;
+	void ResetStats();
+	void Report() const;
+
+	void SetTargetFrameRate(double fps);
+	void SetMinFrameRate(double fps);
+	void SetSpinMicroseconds(U32 spin_us);
+
+	inline double GetTargetFrameRate() const { return m_targetFps; };
+	inline double GetMinFrameRate() const { return m_minFps; };
+
+private:
+	void SleepFor(U64 ticks);
+	void RecordFrame(U64 frame_ticks, U64 spin_ticks);
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+private:
+	// The waitable timer on Windows, unused elsewhere
+	void* m_timer;
+	double m_targetFps;
+	double m_minFps;
+	U64 m_periodTicks;
+	U64 m_maxFrameTicks;
+	U64 m_spinTicks;
+	// Exponential average, an eighth per sample; reset with the stats
+	U64 m_oversleepTicks;
+	// 0 before the first frame
+	U64 m_lastFrameTicks;
+	U64 m_deadlineTicks;
+
+	// Welford's running mean and variance, in milliseconds
+	U64 m_frameCount;
+	U64 m_missedCount;
+	double m_meanMs;
+	double m_squaredMs;
+	double m_minMs;
+	double m_maxMs;
+	double m_errorSumMs;
+	double m_maxErrorMs;
+	U64 m_spinSumTicks;
+	U64 m_oversleepSumTicks;
+	U64 m_sleepCount;
+};
@@ -0,0 +1,215 @@
+#include "Time/HdrHistogram.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Buckets under 2^SubBucketBits hold one value each, every later run of
+// 2^(SubBucketBits - 1) buckets covers the next power of two
+U64 HdrGetBucketLowest(U32 index, U32 sub_bucket_bits)
+{
+	U32 half_count = 1U << (sub_bucket_bits - 1);
+	if (index < 2 * half_count)
+		return index;
+
+	U32 shift = index / half_count - 1;
+	return (U64)(index - shift * half_count) << shift;
+}
+
+U64 HdrGetBucketHighest(U32 index, U32 sub_bucket_bits)
+{
+	U32 half_count = 1U << (sub_bucket_bits - 1);
+	if (index < 2 * half_count)
+		return index;
+
+	U32 shift = index / half_count - 1;
+	return HdrGetBucketLowest(index, sub_bucket_bits) + ((U64)1 << shift) - 1;
+}
+
+// The highest value of the bucket holding the percentile's sample, percentile in [0, 1]
+U64 HdrGetValueAtPercentile(const U64* counts, U32 bucket_count, U32 sub_bucket_bits, double percentile)
+{
+	U64 total = 0;
+	for (U32 index = 0; index < bucket_count; ++index)
+	{
+		total += AtomicLoad(&counts[index], ATOMIC_RELAXED);
+	}
+
+	if (0 == total)
+		return 0;
+
+	double rank = percentile * (double)total;
+	U64 wanted = (U64)rank;
+	if ((double)wanted < rank)
+		++wanted;
+	wanted = (wanted < 1) ? 1 : (wanted > total) ? total : wanted;
+
+	U64 seen = 0;
+	for (U32 index = 0; index < bucket_count; ++index)
+	{
+		seen += AtomicLoad(&counts[index], ATOMIC_RELAXED);
+		if (seen >= wanted)
+			return HdrGetBucketHighest(index, sub_bucket_bits);
+	}
+
+	return HdrGetBucketHighest(bucket_count - 1, sub_bucket_bits);
+}
+
+static inline U8* HdrWriteVarint(U8* out, U64 value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (U8)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (U8)value;
+	return out;
+}
+
+// nullptr once it would read past the end
+static inline const U8* HdrReadVarint(const U8* data, const U8* end, U64* out_value)
+{
+	U64 value = 0;
+	for (U32 shift = 0; data < end && shift < 64; shift += 7)
+	{
+		U8 byte = *data++;
+		value |= (U64)(byte & 0x7F) << shift;
+		if (0 == (byte & 0x80))
+		{
+			*out_value = value;
+			return data;
+		}
+	}
+	return nullptr;
+}
+
+// Magic, sub-bucket bits, value bits, the summary, then each count as a
+// varint of count << 1, or of (empty run length << 1) | 1.  Trailing empty
+// buckets are left off.  The counts are read once and encoded past room for
+// the largest head, which is then written and the counts moved up behind it,
+// so the total always matches the counts even while the writer records.
+U32 HdrSerialize(const U64* counts, U32 bucket_count, U32 sub_bucket_bits, U32 value_bits, const U64* summary, U8* out_data, U32 capacity)
+{
+	U8 head[HDR_SERIAL_HEAD_MAX];
+	if (capacity < HDR_SERIAL_HEAD_MAX)
+		return 0;
+
+	U8* begin = out_data + HDR_SERIAL_HEAD_MAX;
+	U8* out = begin;
+	U8* end = out_data + capacity;
+	U8 buffer[20];
+	U64 total = 0;
+	U32 run = 0;
+	for (U32 index = 0; index < bucket_count; ++index)
+	{
+		U64 count = AtomicLoad(&counts[index], ATOMIC_RELAXED);
+		if (0 == count)
+		{
+			++run;
+			continue;
+		}
+
+		U8* token = buffer;
+		if (0 != run)
+			token = HdrWriteVarint(token, ((U64)run << 1) | 1);
+		token = HdrWriteVarint(token, count << 1);
+		run = 0;
+		total += count;
+
+		U32 length = (U32)(token - buffer);
+		if (length > (U32)(end - out))
+			return 0;
+		memcpy(out, buffer, length);
+		out += length;
+	}
+
+	U32 magic = HDR_SERIAL_MAGIC;
+	memcpy(head, &magic, sizeof(magic));
+	head[4] = (U8)sub_bucket_bits;
+	head[5] = (U8)value_bits;
+	U8* head_end = HdrWriteVarint(head + 6, total);
+	for (U32 index = HDR_SUM; index < HDR_SUMMARY_COUNT; ++index)
+	{
+		head_end = HdrWriteVarint(head_end, AtomicLoad(&summary[index], ATOMIC_RELAXED));
+	}
+
+	U32 head_size = (U32)(head_end - head);
+	U32 counts_size = (U32)(out - begin);
+	memmove(out_data + head_size, begin, counts_size);
+	memcpy(out_data, head, head_size);
+	return head_size + counts_size;
+}
+
+bool HdrDeserialize(const U8* data, U32 size, U64* out_counts, U32 bucket_count, U32 sub_bucket_bits, U32 value_bits, U64* out_summary)
+{
+	memset(out_counts, 0, bucket_count * sizeof(U64));
+	memset(out_summary, 0, HDR_SUMMARY_COUNT * sizeof(U64));
+
+	U32 magic = 0;
+	if (size < 6)
+		return false;
+	memcpy(&magic, data, sizeof(magic));
+	if (HDR_SERIAL_MAGIC != magic || sub_bucket_bits != data[4] || value_bits != data[5])
+		return false;
+
+	const U8* end = data + size;
+	data += 6;
+
+	U64 summary[HDR_SUMMARY_COUNT];
+	for (U32 index = 0; index < HDR_SUMMARY_COUNT; ++index)
+	{
+		data = HdrReadVarint(data, end, &summary[index]);
+		if (nullptr == data)
+			return false;
+	}
+
+	U32 index = 0;
+	while (data < end)
+	{
+		U64 token;
+		data = HdrReadVarint(data, end, &token);
+		if (nullptr == data)
+			break;
+
+		U64 run = (0 != (token & 1)) ? token >> 1 : 1;
+		if (run > bucket_count - index)
+			break;
+
+		if (0 == (token & 1))
+			out_counts[index] = token >> 1;
+		index += (U32)run;
+	}
+
+	U64 total = 0;
+	for (U32 bucket = 0; bucket < bucket_count; ++bucket)
+	{
+		total += out_counts[bucket];
+	}
+
+	// Anything cut short or left over shows as a total that does not add up
+	if (data != end || total != summary[HDR_TOTAL])
+	{
+		memset(out_counts, 0, bucket_count * sizeof(U64));
+		return false;
+	}
+
+	memcpy(out_summary, summary, sizeof(summary));
+	return true;
+}
+
+void HdrReportTicks(const char* name, U64 count, U64 mean, U64 min, U64 p50, U64 p90, U64 p99, U64 p999, U64 max)
+{
+	char text[7][128];
+	U64 values[7] = { mean, min, p50, p90, p99, p999, max };
+	for (U32 index = 0; index < 7; ++index)
+	{
+		TimeOpCountToString(values[index], text[index]);
+	}
+
+	printf("%s: %llu sample(s), mean %s, min %s, p50 %s, p90 %s, p99 %s, p99.9 %s, max %s\n", name, (unsigned long long)count,
+		text[0], text[1], text[2], text[3], text[4], text[5], text[6]);
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Multithreading/Atomic.hpp"
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+// Defines
+#define HDR_SUB_BUCKET_BITS_DEFAULT (5)
+#define HDR_VALUE_BITS_DEFAULT      (48)
+// "HDR1", leads the serialized form
+#define HDR_SERIAL_MAGIC            (0x31524448U)
+// The magic, the layout and the summary at their longest
+#define HDR_SERIAL_HEAD_MAX         (6 + 10 * 4)
+
+	// A high dynamic range histogram: every power of two is split into the
+	// same number of linear sub-buckets, so any value is kept to within a fixed
+	// relative error, 2^-(SubBucketBits - 1), across the whole range.  Values
+	// under 2^SubBucketBits are exact, values over 2^ValueBits - 1 are counted
+	// as that.  The defaults keep 6.25% from one tick to 2^48 ticks, days of
+	// TSC ticks, in 720 buckets.
+	//
+	// Recording is a bit scan, a shift and an add.  Each histogram takes one
+	// writer; its counts are stored relaxed and untorn, so any thread can read
+	// or merge it meanwhile and get a close snapshot.  Keep one per thread and
+	// Add them together to report.  All zero is a valid empty histogram, so a
+	// calloc'd or memset one is ready to record into.
+	//
+	// Values are whatever the caller records; the reports read them as
+	// TimeGetOpCount ticks.  The serialized form is the layout, the summary,
+	// and the counts as varints with runs of empty buckets folded into one.
+
+// Datatypes
+// The fields kept beside the counts; min is kept inverted so all zero reads as empty
+enum hdr_summary
+{
+	HDR_TOTAL = 0,
+	HDR_SUM = 1,
+	HDR_MIN_INVERTED = 2,
+	HDR_MAX = 3,
+	HDR_SUMMARY_COUNT = 4
+};
+
+// Functions
+// Which bucket a value falls in, and the range of values a bucket holds
+inline U32 HdrGetBucketIndex(U64 value, U32 sub_bucket_bits)
+{
+	#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long msb;
+		_BitScanReverse64(&msb, value | 1);
+	#elif defined(_MSC_VER)
+		// No 64-bit scan on x86, take the high half if it has a bit set
+		unsigned long msb;
+		if (_BitScanReverse(&msb, (unsigned long)(value >> 32)))
+			msb += 32;
+		else
+			_BitScanReverse(&msb, (unsigned long)value | 1);
+	#else
+		U32 msb = 63 - (U32)__builtin_clzll(value | 1);
+	#endif
+	U32 shift = (msb >= sub_bucket_bits) ? (U32)msb - sub_bucket_bits + 1 : 0;
+	return (shift << (sub_bucket_bits - 1)) + (U32)(value >> shift);
+}
+U64 HdrGetBucketLowest(U32 index, U32 sub_bucket_bits);
+U64 HdrGetBucketHighest(U32 index, U32 sub_bucket_bits);
+U64 HdrGetValueAtPercentile(const U64* counts, U32 bucket_count, U32 sub_bucket_bits, double percentile);
+U32 HdrSerialize(const U64* counts, U32 bucket_count, U32 sub_bucket_bits, U32 value_bits, const U64* summary, U8* out_data, U32 capacity);
+bool HdrDeserialize(const U8* data, U32 size, U64* out_counts, U32 bucket_count, U32 sub_bucket_bits, U32 value_bits, U64* out_summary);
+void HdrReportTicks(const char* name, U64 count, U64 mean, U64 min, U64 p50, U64 p90, U64 p99, U64 p999, U64 max);
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	Fixed size, so it can sit inside per thread stats and be copied into
+//	reports.  Percentiles are the highest value of the bucket they fall in,
+//	capped at the largest value recorded, and are taken in [0, 1].
+//
+//////////////////////////////////////////////////////////////////////////////////////
+template <U32 SubBucketBits = HDR_SUB_BUCKET_BITS_DEFAULT, U32 ValueBits = HDR_VALUE_BITS_DEFAULT>
+class HdrHistogram
+{
+public:
+	static const U32 BUCKET_COUNT = (ValueBits - SubBucketBits + 2) << (SubBucketBits - 1);
+	static const U64 MAX_VALUE = (ValueBits >= 64) ? ~(U64)0 : (((U64)1 << (ValueBits & 63)) - 1);
+	// Worst case, every count a 10 byte varint
+	static const U32 MAX_SERIAL_SIZE = HDR_SERIAL_HEAD_MAX + 10 * BUCKET_COUNT;
+
+	inline void Record(U64 value, U64 count = 1)
+	{
+		if (value > MAX_VALUE)
+			value = MAX_VALUE;
+
+		U64* bucket = &m_counts[HdrGetBucketIndex(value, SubBucketBits)];
+		AtomicStore(bucket, AtomicLoad(bucket, ATOMIC_RELAXED) + count, ATOMIC_RELAXED);
+		AtomicStore(&m_summary[HDR_TOTAL], AtomicLoad(&m_summary[HDR_TOTAL], ATOMIC_RELAXED) + count, ATOMIC_RELAXED);
+		AtomicStore(&m_summary[HDR_SUM], AtomicLoad(&m_summary[HDR_SUM], ATOMIC_RELAXED) + value * count, ATOMIC_RELAXED);
+		if (~value > AtomicLoad(&m_summary[HDR_MIN_INVERTED], ATOMIC_RELAXED))
+			AtomicStore(&m_summary[HDR_MIN_INVERTED], ~value, ATOMIC_RELAXED);
+		if (value > AtomicLoad(&m_summary[HDR_MAX], ATOMIC_RELAXED))
+			AtomicStore(&m_summary[HDR_MAX], value, ATOMIC_RELAXED);
+	}
+
+	// Only this histogram's writer may call it
+	void Add(const HdrHistogram& other)
+	{
+		for (U32 index = 0; index < BUCKET_COUNT; ++index)
+		{
+			U64 count = AtomicLoad(&other.m_counts[index], ATOMIC_RELAXED);
+			if (0 != count)
+				AtomicStore(&m_counts[index], AtomicLoad(&m_counts[index], ATOMIC_RELAXED) + count, ATOMIC_RELAXED);
+		}
+
+		for (U32 index = HDR_TOTAL; index <= HDR_SUM; ++index)
+		{
+			U64 value = AtomicLoad(&other.m_summary[index], ATOMIC_RELAXED);
+			AtomicStore(&m_summary[index], AtomicLoad(&m_summary[index], ATOMIC_RELAXED) + value, ATOMIC_RELAXED);
+		}
+		for (U32 index = HDR_MIN_INVERTED; index <= HDR_MAX; ++index)
+		{
+			U64 value = AtomicLoad(&other.m_summary[index], ATOMIC_RELAXED);
+			if (value > AtomicLoad(&m_summary[index], ATOMIC_RELAXED))
+				AtomicStore(&m_summary[index], value, ATOMIC_RELAXED);
+		}
+	}
+
+	void Reset()
+	{
+		for (U32 index = 0; index < BUCKET_COUNT; ++index)
+		{
+			AtomicStore(&m_counts[index], (U64)0, ATOMIC_RELAXED);
+		}
+		for (U32 index = 0; index < HDR_SUMMARY_COUNT; ++index)
+		{
+			AtomicStore(&m_summary[index], (U64)0, ATOMIC_RELAXED);
+		}
+	}
+
+	// 0 when the buffer is too small, MAX_SERIAL_SIZE always fits
+	inline U32 Serialize(U8* out_data, U32 capacity) const { return HdrSerialize(m_counts, BUCKET_COUNT, SubBucketBits, ValueBits, m_summary, out_data, capacity); }
+	// Replaces the contents; false, leaving it empty, unless the layout matches
+	inline bool Deserialize(const U8* data, U32 size) { return HdrDeserialize(data, size, m_counts, BUCKET_COUNT, SubBucketBits, ValueBits, m_summary); }
+
+	inline void Report(const char* name) const
+	{
+		HdrReportTicks(name, GetTotalCount(), GetMean(), GetMin(), GetValueAtPercentile(0.5), GetValueAtPercentile(0.9),
+			GetValueAtPercentile(0.99), GetValueAtPercentile(0.999), GetMax());
+	}
+
+	inline U64 GetTotalCount() const { return AtomicLoad(&m_summary[HDR_TOTAL], ATOMIC_RELAXED); };
+	inline U64 GetMin() const { return (0 == GetTotalCount()) ? 0 : ~AtomicLoad(&m_summary[HDR_MIN_INVERTED], ATOMIC_RELAXED); };
+	inline U64 GetMax() const { return AtomicLoad(&m_summary[HDR_MAX], ATOMIC_RELAXED); };
+	inline U64 GetMean() const { return (0 == GetTotalCount()) ? 0 : AtomicLoad(&m_summary[HDR_SUM], ATOMIC_RELAXED) / GetTotalCount(); };
+	inline U64 GetValueAtPercentile(double percentile) const
+	{
+		U64 value = HdrGetValueAtPercentile(m_counts, BUCKET_COUNT, SubBucketBits, percentile);
+		if (value > GetMax())
+			return GetMax();
+		return (value < GetMin()) ? GetMin() : value;
+	}
+
+private:
+	U64 m_summary[HDR_SUMMARY_COUNT];
+	U64 m_counts[BUCKET_COUNT];
+};
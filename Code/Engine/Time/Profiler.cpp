@@ -0,0 +1,684 @@
+#include "Time/Profiler.hpp"
+#include "Time/Utils.hpp"
+#include "Memory/AllocationTracker.hpp"
+#include "Memory/MemoryTag.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Atomic.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+#define PROFILE_NODE_NONE  (0xFFFFFFFFU)
+// Events copied out of a ring per check that the writer has not lapped them
+#define PROFILER_COPY_BATCH (256)
+
+// Node 0 is the root of a thread's tree and has no zone
+struct profile_node
+{
+	const profile_zone* m_zone;
+	U32 m_parent;
+	U32 m_firstChild;
+	U32 m_nextSibling;
+	U32 m_frameCalls;
+	U64 m_frameInclusive;
+	U64 m_frameChildren;
+	U32 m_lastCalls;
+	U64 m_lastInclusive;
+	U64 m_lastExclusive;
+	U64 m_totalCalls;
+	U64 m_totalInclusive;
+	U64 m_totalExclusive;
+	U64 m_maxInclusive;
+	// Every call's inclusive ticks since the reset
+	profile_histogram m_callHistogram;
+};
+
+struct profile_open_zone
+{
+	U32 m_node;
+	U64 m_beginTicks;
+};
+
+struct profile_thread
+{
+	// The only field the owning thread writes besides the events
+	alignas(64) volatile U64 m_head;
+	// Set when the thread exits, a new thread takes the record over once read
+	volatile U32 m_retired;
+
+	// Only touched under the lock
+	alignas(64) U64 m_tail;
+	U64 m_dropped;
+	profile_node* m_nodes;
+	U32 m_nodeCount;
+	U32 m_nodeCapacity;
+	// Zones past PROFILER_MAX_DEPTH are not pushed, their ends find no match
+	profile_open_zone m_open[PROFILER_MAX_DEPTH];
+	U32 m_openCount;
+	U32 m_index;
+	char m_name[32];
+	profile_thread* m_next;
+
+	profile_event m_events[PROFILER_RING_EVENTS];
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+static Mutex g_profiler_lock;
+// Records outlive their threads, so exited threads still show in the report
+static profile_thread* g_profile_threads = nullptr;
+static profile_thread* g_profile_threads_last = nullptr;
+static volatile U32 g_profile_thread_count = 0;
+static thread_local profile_thread* g_profile_thread = nullptr;
+
+// Only touched when a thread first records, so the hot path never pays for
+// the destructor
+struct profile_thread_owner
+{
+	~profile_thread_owner()
+	{
+		if (nullptr != g_profile_thread)
+			AtomicStore(&g_profile_thread->m_retired, 1U, ATOMIC_RELEASE);
+	}
+};
+static thread_local profile_thread_owner g_profile_thread_owner;
+
+// 0 until the first frame mark, which only starts the count
+static U64 g_profiler_last_mark = 0;
+static U64 g_profiler_frame_ticks = 0;
+static U64 g_profiler_total_frame_ticks = 0;
+static U64 g_profiler_frames = 0;
+static profile_frame_cb volatile g_profiler_frame_callbacks[PROFILER_MAX_FRAME_CALLBACKS] = {};
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// A record another thread left behind keeps its tree, so short lived threads
+// doing the same work add up in one place instead of costing a ring each
+static profile_thread* ProfilerGetThread()
+{
+	profile_thread* thread = g_profile_thread;
+	if (nullptr != thread)
+		return thread;
+
+	g_profiler_lock.Lock();
+	for (thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+	{
+		if (0 != AtomicLoad(&thread->m_retired, ATOMIC_ACQUIRE) && thread->m_tail == thread->m_head)
+			break;
+	}
+
+	if (nullptr == thread)
+	{
+		thread = (profile_thread*) ::calloc(1, sizeof(profile_thread));
+		thread->m_nodeCapacity = 64;
+		thread->m_nodes = (profile_node*) ::calloc(thread->m_nodeCapacity, sizeof(profile_node));
+		thread->m_nodes[0].m_parent = PROFILE_NODE_NONE;
+		thread->m_nodes[0].m_firstChild = PROFILE_NODE_NONE;
+		thread->m_nodes[0].m_nextSibling = PROFILE_NODE_NONE;
+		thread->m_nodeCount = 1;
+		thread->m_index = g_profile_thread_count;
+		snprintf(thread->m_name, sizeof(thread->m_name), "Thread %u", thread->m_index);
+
+		if (nullptr == g_profile_threads_last)
+			g_profile_threads = thread;
+		else
+			g_profile_threads_last->m_next = thread;
+		g_profile_threads_last = thread;
+		AtomicStore(&g_profile_thread_count, thread->m_index + 1, ATOMIC_RELEASE);
+	}
+
+	// Zones the old owner left open never end
+	thread->m_openCount = 0;
+	AtomicStore(&thread->m_retired, 0U, ATOMIC_RELAXED);
+	g_profiler_lock.Unlock();
+
+	g_profile_thread = thread;
+	(void)&g_profile_thread_owner;
+	return thread;
+}
+
+// Never waits for the reader, the oldest event is overwritten instead
+static inline void ProfilerPush(profile_thread* thread, profile_event_kind kind, const void* data, U64 ticks, U64 value)
+{
+	U64 head = thread->m_head;
+	// Keeps the last head store ahead of the overwrite, see ProfilerCopyEvents
+	AtomicThreadFence(ATOMIC_RELEASE);
+
+	profile_event& event = thread->m_events[head & (PROFILER_RING_EVENTS - 1)];
+	event.m_ticks = ticks;
+	event.m_data = data;
+	event.m_value = value;
+	event.m_kind = kind;
+	AtomicStore(&thread->m_head, head + 1, ATOMIC_RELEASE);
+}
+
+// Copies [begin, end) out while the owner keeps writing, and returns the
+// first of them that was not overwritten as it was copied.  Slot i is only
+// rewritten once head reaches i + PROFILER_RING_EVENTS.
+static U64 ProfilerCopyEvents(const profile_thread* thread, U64 begin, U64 end, profile_event* out_events)
+{
+	for (U64 index = begin; index != end; ++index)
+	{
+		out_events[index - begin] = thread->m_events[index & (PROFILER_RING_EVENTS - 1)];
+	}
+
+	AtomicThreadFence(ATOMIC_ACQUIRE);
+	U64 head = AtomicLoad(&thread->m_head, ATOMIC_RELAXED);
+	U64 first_intact = (head >= PROFILER_RING_EVENTS) ? head - PROFILER_RING_EVENTS + 1 : 0;
+	return (first_intact > begin) ? first_intact : begin;
+}
+
+void ProfilerBegin(const profile_zone* zone)
+{
+	ProfilerPush(ProfilerGetThread(), PROFILE_EVENT_BEGIN, zone, TimeGetOpCount(), 0);
+}
+
+void ProfilerEnd(const profile_zone* zone)
+{
+	U64 ticks = TimeGetOpCount();
+	ProfilerPush(ProfilerGetThread(), PROFILE_EVENT_END, zone, ticks, 0);
+}
+
+void ProfilerRecordLockWait(const lock_site* site, U64 start_ticks, U64 wait_ticks)
+{
+	ProfilerPush(ProfilerGetThread(), PROFILE_EVENT_LOCK_WAIT, site, start_ticks, wait_ticks);
+}
+
+void ProfilerRecordJob(const void* entry, U64 start_ticks, U64 run_ticks)
+{
+	ProfilerPush(ProfilerGetThread(), PROFILE_EVENT_JOB, entry, start_ticks, run_ticks);
+}
+
+void ProfilerRecordCounter(const char* name, U64 value)
+{
+	ProfilerPush(ProfilerGetThread(), PROFILE_EVENT_COUNTER, name, TimeGetOpCount(), value);
+}
+
+// The child of parent for zone, added after its siblings if new
+static U32 ProfilerGetChild(profile_thread* thread, U32 parent, const profile_zone* zone)
+{
+	U32 last = PROFILE_NODE_NONE;
+	for (U32 child = thread->m_nodes[parent].m_firstChild; PROFILE_NODE_NONE != child; child = thread->m_nodes[child].m_nextSibling)
+	{
+		if (zone == thread->m_nodes[child].m_zone)
+			return child;
+		last = child;
+	}
+
+	if (thread->m_nodeCount == thread->m_nodeCapacity)
+	{
+		thread->m_nodeCapacity *= 2;
+		thread->m_nodes = (profile_node*) ::realloc(thread->m_nodes, thread->m_nodeCapacity * sizeof(profile_node));
+	}
+
+	U32 index = thread->m_nodeCount++;
+	profile_node& node = thread->m_nodes[index];
+	memset(&node, 0, sizeof(profile_node));
+	node.m_zone = zone;
+	node.m_parent = parent;
+	node.m_firstChild = PROFILE_NODE_NONE;
+	node.m_nextSibling = PROFILE_NODE_NONE;
+
+	if (PROFILE_NODE_NONE == last)
+		thread->m_nodes[parent].m_firstChild = index;
+	else
+		thread->m_nodes[last].m_nextSibling = index;
+	return index;
+}
+
+static void ProfilerApplyEvent(profile_thread* thread, const profile_event& event)
+{
+	const profile_zone* zone = (const profile_zone*)event.m_data;
+	if (PROFILE_EVENT_BEGIN == event.m_kind)
+	{
+		if (thread->m_openCount < PROFILER_MAX_DEPTH)
+		{
+			U32 parent = (0 == thread->m_openCount) ? 0 : thread->m_open[thread->m_openCount - 1].m_node;
+			profile_open_zone& open = thread->m_open[thread->m_openCount++];
+			open.m_node = ProfilerGetChild(thread, parent, zone);
+			open.m_beginTicks = event.m_ticks;
+		}
+		return;
+	}
+	if (PROFILE_EVENT_END != event.m_kind)
+		return;
+
+	// The innermost open zone that matches; any left above it lost their end
+	U32 depth = thread->m_openCount;
+	while (0 < depth && zone != thread->m_nodes[thread->m_open[depth - 1].m_node].m_zone)
+	{
+		--depth;
+	}
+	if (0 == depth)
+		return;
+
+	const profile_open_zone& open = thread->m_open[depth - 1];
+	U64 inclusive = event.m_ticks - open.m_beginTicks;
+	profile_node& node = thread->m_nodes[open.m_node];
+	node.m_frameInclusive += inclusive;
+	++node.m_frameCalls;
+	node.m_callHistogram.Record(inclusive);
+	thread->m_nodes[node.m_parent].m_frameChildren += inclusive;
+	thread->m_openCount = depth - 1;
+}
+
+// Moves this frame's counts into the last frame and the totals
+static void ProfilerEndNodeFrame(profile_node& node)
+{
+	U64 exclusive = (node.m_frameInclusive > node.m_frameChildren) ? node.m_frameInclusive - node.m_frameChildren : 0;
+	node.m_lastCalls = node.m_frameCalls;
+	node.m_lastInclusive = node.m_frameInclusive;
+	node.m_lastExclusive = exclusive;
+	node.m_totalCalls += node.m_frameCalls;
+	node.m_totalInclusive += node.m_frameInclusive;
+	node.m_totalExclusive += exclusive;
+	if (node.m_frameInclusive > node.m_maxInclusive)
+		node.m_maxInclusive = node.m_frameInclusive;
+
+	node.m_frameCalls = 0;
+	node.m_frameInclusive = 0;
+	node.m_frameChildren = 0;
+}
+
+static void ProfilerResetTotals()
+{
+	for (profile_thread* thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+	{
+		for (U32 index = 0; index < thread->m_nodeCount; ++index)
+		{
+			profile_node& node = thread->m_nodes[index];
+			node.m_totalCalls = 0;
+			node.m_totalInclusive = 0;
+			node.m_totalExclusive = 0;
+			node.m_maxInclusive = 0;
+			node.m_callHistogram.Reset();
+		}
+	}
+
+	g_profiler_total_frame_ticks = 0;
+	g_profiler_frames = 0;
+}
+
+// Reads the ring from where the last frame mark stopped, counting what it lapped
+static void ProfilerReadThread(profile_thread* thread)
+{
+	profile_event batch[PROFILER_COPY_BATCH];
+	U64 head = AtomicLoad(&thread->m_head, ATOMIC_ACQUIRE);
+	U64 tail = thread->m_tail;
+	if (head - tail > PROFILER_RING_EVENTS)
+	{
+		thread->m_dropped += head - tail - PROFILER_RING_EVENTS;
+		tail = head - PROFILER_RING_EVENTS;
+		// Their ends may be among the lost, so nothing after would nest right
+		thread->m_openCount = 0;
+	}
+
+	while (tail != head)
+	{
+		U64 end = (head - tail > PROFILER_COPY_BATCH) ? tail + PROFILER_COPY_BATCH : head;
+		U64 intact = ProfilerCopyEvents(thread, tail, end, batch);
+		if (intact > tail)
+		{
+			intact = (intact < head) ? intact : head;
+			thread->m_dropped += intact - tail;
+			thread->m_openCount = 0;
+		}
+		if (intact >= end)
+		{
+			tail = intact;
+			continue;
+		}
+
+		for (U64 index = intact; index != end; ++index)
+		{
+			ProfilerApplyEvent(thread, batch[index - tail]);
+		}
+		tail = end;
+	}
+
+	thread->m_tail = tail;
+}
+
+// Ends the frame on every thread.  Events recorded while it runs go to the next one.
+void ProfilerFrameMark()
+{
+	U64 now = TimeGetOpCount();
+
+	// Recorded before the lock, a thread's first event can take it
+	profile_thread* current = ProfilerGetThread();
+	ProfilerPush(current, PROFILE_EVENT_FRAME, nullptr, now, 0);
+	ProfilerPush(current, PROFILE_EVENT_COUNTER, "Heap bytes", now, GetCurrentAllocationSizeInBytes());
+	ProfilerPush(current, PROFILE_EVENT_COUNTER, "Heap allocations", now, GetCurrentAllocationCount());
+	for (U32 tag = 0; tag < MemoryTagGetCount(); ++tag)
+	{
+		ProfilerPush(current, PROFILE_EVENT_MEMORY_TAG, MemoryTagGetName((memory_tag)tag), now, MemoryTagGetLiveBytes((memory_tag)tag));
+	}
+
+	U64 frame_ticks = 0;
+	{
+		SCOPE_LOCK(&g_profiler_lock);
+		for (profile_thread* thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+		{
+			ProfilerReadThread(thread);
+			for (U32 index = 1; index < thread->m_nodeCount; ++index)
+			{
+				ProfilerEndNodeFrame(thread->m_nodes[index]);
+			}
+		}
+
+		if (0 == g_profiler_last_mark)
+		{
+			ProfilerResetTotals();
+		}
+		else
+		{
+			frame_ticks = now - g_profiler_last_mark;
+			g_profiler_frame_ticks = frame_ticks;
+			g_profiler_total_frame_ticks += frame_ticks;
+			++g_profiler_frames;
+		}
+		g_profiler_last_mark = now;
+	}
+
+	if (0 == frame_ticks)
+		return;
+
+	for (U32 index = 0; index < PROFILER_MAX_FRAME_CALLBACKS; ++index)
+	{
+		profile_frame_cb callback = AtomicLoad(&g_profiler_frame_callbacks[index], ATOMIC_ACQUIRE);
+		if (nullptr != callback)
+			callback(frame_ticks);
+	}
+}
+
+// The node after index in depth first order, tracking its depth
+static U32 ProfilerNextNode(const profile_thread* thread, U32 index, U32* depth)
+{
+	const profile_node* nodes = thread->m_nodes;
+	if (PROFILE_NODE_NONE != nodes[index].m_firstChild)
+	{
+		++*depth;
+		return nodes[index].m_firstChild;
+	}
+
+	while (0 != index)
+	{
+		if (PROFILE_NODE_NONE != nodes[index].m_nextSibling)
+			return nodes[index].m_nextSibling;
+		index = nodes[index].m_parent;
+		--*depth;
+	}
+	return PROFILE_NODE_NONE;
+}
+
+// Every zone seen since the last reset, thread by thread, each tree depth first
+U32 ProfilerGather(profile_node_report* out_reports, U32 capacity)
+{
+	SCOPE_LOCK(&g_profiler_lock);
+
+	U32 count = 0;
+	U64 frames = g_profiler_frames;
+	for (profile_thread* thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+	{
+		U32 depth = 0;
+		for (U32 index = ProfilerNextNode(thread, 0, &depth); PROFILE_NODE_NONE != index && count < capacity; index = ProfilerNextNode(thread, index, &depth))
+		{
+			const profile_node& node = thread->m_nodes[index];
+			if (0 == node.m_totalCalls && 0 == node.m_lastCalls)
+				continue;
+
+			profile_node_report& report = out_reports[count++];
+			report.m_name = node.m_zone->m_name;
+			report.m_file = node.m_zone->m_file;
+			report.m_line = node.m_zone->m_line;
+			report.m_thread = thread->m_index;
+			report.m_depth = depth - 1;
+			report.m_inclusiveTicks = node.m_lastInclusive;
+			report.m_exclusiveTicks = node.m_lastExclusive;
+			report.m_calls = node.m_lastCalls;
+			report.m_averageInclusiveTicks = (0 == frames) ? 0 : node.m_totalInclusive / frames;
+			report.m_averageExclusiveTicks = (0 == frames) ? 0 : node.m_totalExclusive / frames;
+			report.m_averageCalls = (0 == frames) ? 0.0 : (double)node.m_totalCalls / (double)frames;
+			report.m_maxInclusiveTicks = node.m_maxInclusive;
+			report.m_p50CallTicks = node.m_callHistogram.GetValueAtPercentile(0.5);
+			report.m_p99CallTicks = node.m_callHistogram.GetValueAtPercentile(0.99);
+			report.m_p999CallTicks = node.m_callHistogram.GetValueAtPercentile(0.999);
+		}
+	}
+
+	return count;
+}
+
+void ProfilerReport()
+{
+	U32 capacity = ProfilerGetNodeCount();
+	if (0 == capacity)
+	{
+		printf("\nNo profile zones recorded.\n");
+		return;
+	}
+
+	profile_node_report* reports = (profile_node_report*) ::malloc(capacity * sizeof(profile_node_report));
+	U32 count = ProfilerGather(reports, capacity);
+
+	char frame[128];
+	char average_frame[128];
+	TimeOpCountToString(ProfilerGetFrameTicks(), frame);
+	TimeOpCountToString(ProfilerGetAverageFrameTicks(), average_frame);
+	printf("\nProfile of frame %llu: %s, average %s, %llu event(s) dropped\n", (unsigned long long)ProfilerGetFrameCount(), frame, average_frame,
+		(unsigned long long)ProfilerGetDroppedCount());
+	printf("%-40s %12s %12s %6s | %12s %12s %8s %12s | %12s %12s\n", "Zone", "Inclusive", "Exclusive", "Calls", "Avg incl", "Avg excl", "Avg calls", "Max incl",
+		"p50 call", "p99 call");
+
+	U32 thread = PROFILE_NODE_NONE;
+	for (U32 index = 0; index < count; ++index)
+	{
+		const profile_node_report& report = reports[index];
+		if (thread != report.m_thread)
+		{
+			thread = report.m_thread;
+			printf("%s\n", ProfilerGetThreadName(thread));
+		}
+
+		char inclusive[128];
+		char exclusive[128];
+		char average_inclusive[128];
+		char average_exclusive[128];
+		char max_inclusive[128];
+		char p50_call[128];
+		char p99_call[128];
+		TimeOpCountToString(report.m_inclusiveTicks, inclusive);
+		TimeOpCountToString(report.m_exclusiveTicks, exclusive);
+		TimeOpCountToString(report.m_averageInclusiveTicks, average_inclusive);
+		TimeOpCountToString(report.m_averageExclusiveTicks, average_exclusive);
+		TimeOpCountToString(report.m_maxInclusiveTicks, max_inclusive);
+		TimeOpCountToString(report.m_p50CallTicks, p50_call);
+		TimeOpCountToString(report.m_p99CallTicks, p99_call);
+
+		int indent = 2 + 2 * (int)report.m_depth;
+		printf("%*s%-*s %12s %12s %6u | %12s %12s %8.1f %12s | %12s %12s\n", indent, "", (40 > indent) ? 40 - indent : 0, report.m_name,
+			inclusive, exclusive, report.m_calls, average_inclusive, average_exclusive, report.m_averageCalls, max_inclusive, p50_call, p99_call);
+	}
+
+	::free(reports);
+}
+
+// Starts the averages over, the last frame is kept
+void ProfilerReset()
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	ProfilerResetTotals();
+}
+
+// Ended events are recorded at their end, so they are kept when they end
+// inside the window even if they started before it
+static bool ProfilerInWindow(const profile_event& event, U64 since)
+{
+	U64 end = event.m_ticks;
+	if (PROFILE_EVENT_LOCK_WAIT == event.m_kind || PROFILE_EVENT_JOB == event.m_kind)
+		end += event.m_value;
+	return end >= since;
+}
+
+// Copies while every thread keeps recording; each ring gives what it still holds
+bool ProfilerCapture(double seconds, profile_capture* out_capture)
+{
+	U64 now = TimeGetOpCount();
+	U64 span = (U64)(seconds * (double)TimeGetOpsPerSecond());
+	U64 since = (span < now) ? now - span : 0;
+
+	SCOPE_LOCK(&g_profiler_lock);
+	U32 thread_count = AtomicLoad(&g_profile_thread_count, ATOMIC_ACQUIRE);
+	if (0 == thread_count)
+		return false;
+
+	out_capture->m_beginTicks = since;
+	out_capture->m_endTicks = now;
+	out_capture->m_threadCount = thread_count;
+	out_capture->m_threads = (profile_capture_thread*) ::calloc(thread_count, sizeof(profile_capture_thread));
+
+	for (profile_thread* thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+	{
+		profile_capture_thread& captured = out_capture->m_threads[thread->m_index];
+		memcpy(captured.m_name, thread->m_name, sizeof(captured.m_name));
+		captured.m_index = thread->m_index;
+
+		U64 head = AtomicLoad(&thread->m_head, ATOMIC_ACQUIRE);
+		U64 begin = (head > PROFILER_RING_EVENTS) ? head - PROFILER_RING_EVENTS : 0;
+		captured.m_events = (profile_event*) ::malloc((size_t)(head - begin + 1) * sizeof(profile_event));
+		U64 intact = ProfilerCopyEvents(thread, begin, head, captured.m_events);
+
+		U32 count = 0;
+		for (U64 index = intact; index < head; ++index)
+		{
+			const profile_event& event = captured.m_events[index - begin];
+			if (event.m_ticks <= now && ProfilerInWindow(event, since))
+				captured.m_events[count++] = event;
+		}
+		captured.m_eventCount = count;
+	}
+
+	return true;
+}
+
+void ProfilerFreeCapture(profile_capture* capture)
+{
+	for (U32 index = 0; index < capture->m_threadCount; ++index)
+	{
+		::free(capture->m_threads[index].m_events);
+	}
+	::free(capture->m_threads);
+	capture->m_threads = nullptr;
+	capture->m_threadCount = 0;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Getters							//
+//													//
+//////////////////////////////////////////////////////
+U32 ProfilerGetThreadCount() { return AtomicLoad(&g_profile_thread_count, ATOMIC_ACQUIRE); }
+
+const char* ProfilerGetThreadName(U32 thread)
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	for (profile_thread* entry = g_profile_threads; nullptr != entry; entry = entry->m_next)
+	{
+		if (thread == entry->m_index)
+			return entry->m_name;
+	}
+	return "Invalid";
+}
+
+U32 ProfilerGetNodeCount()
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	U32 count = 0;
+	for (profile_thread* thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+	{
+		count += thread->m_nodeCount - 1;
+	}
+	return count;
+}
+
+U64 ProfilerGetFrameCount()
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	return g_profiler_frames;
+}
+
+U64 ProfilerGetFrameTicks()
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	return g_profiler_frame_ticks;
+}
+
+U64 ProfilerGetAverageFrameTicks()
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	return (0 == g_profiler_frames) ? 0 : g_profiler_total_frame_ticks / g_profiler_frames;
+}
+
+U64 ProfilerGetDroppedCount()
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	U64 dropped = 0;
+	for (profile_thread* thread = g_profile_threads; nullptr != thread; thread = thread->m_next)
+	{
+		dropped += thread->m_dropped;
+	}
+	return dropped;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Setters							//
+//													//
+//////////////////////////////////////////////////////
+void ProfilerSetThreadName(const char* name)
+{
+	profile_thread* thread = ProfilerGetThread();
+	SCOPE_LOCK(&g_profiler_lock);
+	snprintf(thread->m_name, sizeof(thread->m_name), "%s", name);
+}
+
+bool ProfilerAddFrameCallback(profile_frame_cb callback)
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	U32 free_slot = PROFILER_MAX_FRAME_CALLBACKS;
+	for (U32 index = 0; index < PROFILER_MAX_FRAME_CALLBACKS; ++index)
+	{
+		profile_frame_cb current = AtomicLoad(&g_profiler_frame_callbacks[index], ATOMIC_RELAXED);
+		if (callback == current)
+			return true;
+		if (nullptr == current && PROFILER_MAX_FRAME_CALLBACKS == free_slot)
+			free_slot = index;
+	}
+
+	if (PROFILER_MAX_FRAME_CALLBACKS == free_slot)
+		return false;
+
+	AtomicStore(&g_profiler_frame_callbacks[free_slot], callback, ATOMIC_RELEASE);
+	return true;
+}
+
+void ProfilerRemoveFrameCallback(profile_frame_cb callback)
+{
+	SCOPE_LOCK(&g_profiler_lock);
+	for (U32 index = 0; index < PROFILER_MAX_FRAME_CALLBACKS; ++index)
+	{
+		if (callback == AtomicLoad(&g_profiler_frame_callbacks[index], ATOMIC_RELAXED))
+			AtomicStore(&g_profiler_frame_callbacks[index], (profile_frame_cb)nullptr, ATOMIC_RELEASE);
+	}
+}
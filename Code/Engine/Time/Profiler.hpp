@@ -0,0 +1,182 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+// COMBINE and lock_site, and PROFILED_BUILD by way of the lock profiler
+#include "Multithreading/ScopedLock.hpp"
+#include "Time/HdrHistogram.hpp"
+
+// Defines
+#if defined(PROFILED_BUILD)
+	#define PROFILE_ZONES
+#endif
+// Per thread, a power of two
+#define PROFILER_RING_EVENTS (64 * 1024)
+#define PROFILER_MAX_DEPTH   (64)
+#define PROFILER_MAX_FRAME_CALLBACKS (4)
+// Per zone and call path, 12.5% resolution up to 2^40 ticks
+#define PROFILER_HISTOGRAM_SUB_BUCKET_BITS (4)
+#define PROFILER_HISTOGRAM_VALUE_BITS      (40)
+
+	// With PROFILE_ZONES every PROFILE_SCOPE("name") records a begin and an end
+	// event, each a TimeGetOpCount tick and the zone, into a ring owned by the
+	// calling thread.  Contended lock waits, job executions, and the heap and
+	// memory tag counters sampled at every frame mark go in the same rings.
+	// Only the owning thread writes a ring, so recording takes no lock and no
+	// shared write.  Without PROFILE_ZONES the macro is empty.
+	//
+	// ProfilerFrameMark, which CalculateDeltaSeconds calls, reads every ring
+	// up to where it got to last time and folds the zones into a call tree per
+	// thread: one node per zone and call path, with the inclusive and exclusive
+	// ticks and the calls of the frame just ended, and averages over the frames
+	// since ProfilerReset.  A zone is counted in the frame it ends in.  Every
+	// call also goes to an HDR histogram on its node, which gives the tail of
+	// the per call times since the reset.
+	//
+	// The rings never wait for a reader, they overwrite their oldest events,
+	// so they always hold the most recent PROFILER_RING_EVENTS per thread.
+	// ProfilerCapture copies out the ones from the last N seconds while the
+	// threads keep recording, see TraceExport.hpp.  Events a ring laps before
+	// the frame mark reads them are counted as dropped, and the tree skips any
+	// end whose begin was lost.
+	//
+	// A zone has to begin and end on the same thread, so it must not span a
+	// fiber switch.  Names must outlive the profiler, string literals are best.
+
+// Datatypes
+struct profile_zone
+{
+	const char* m_name;
+	const char* m_file;
+	U32 m_line;
+};
+
+enum profile_event_kind
+{
+	// m_data is the profile_zone
+	PROFILE_EVENT_BEGIN = 0,
+	PROFILE_EVENT_END = 1,
+	// Recorded when they end, m_ticks is the start and m_value the duration.
+	// m_data is the lock_site, or the job entry point.
+	PROFILE_EVENT_LOCK_WAIT = 2,
+	PROFILE_EVENT_JOB = 3,
+	// m_data names the counter, or the memory tag, m_value is the value
+	PROFILE_EVENT_COUNTER = 4,
+	PROFILE_EVENT_MEMORY_TAG = 5,
+	PROFILE_EVENT_FRAME = 6
+};
+
+struct profile_event
+{
+	U64 m_ticks;
+	const void* m_data;
+	U64 m_value : 56;
+	U64 m_kind : 8;
+};
+
+struct profile_capture_thread
+{
+	char m_name[32];
+	U32 m_index;
+	U32 m_eventCount;
+	// In the order recorded; zones in tick order, ended events at their end
+	profile_event* m_events;
+};
+
+struct profile_capture
+{
+	U64 m_beginTicks;
+	U64 m_endTicks;
+	U32 m_threadCount;
+	profile_capture_thread* m_threads;
+};
+
+typedef void(*profile_frame_cb)(U64 frame_ticks);
+typedef HdrHistogram<PROFILER_HISTOGRAM_SUB_BUCKET_BITS, PROFILER_HISTOGRAM_VALUE_BITS> profile_histogram;
+
+// Depth first, a node's children follow it one level deeper
+struct profile_node_report
+{
+	const char* m_name;
+	const char* m_file;
+	U32 m_line;
+	U32 m_thread;
+	U32 m_depth;
+	// The last frame
+	U64 m_inclusiveTicks;
+	U64 m_exclusiveTicks;
+	U32 m_calls;
+	// Per frame, over the frames since ProfilerReset
+	U64 m_averageInclusiveTicks;
+	U64 m_averageExclusiveTicks;
+	double m_averageCalls;
+	U64 m_maxInclusiveTicks;
+	// Per call, over the calls since ProfilerReset
+	U64 m_p50CallTicks;
+	U64 m_p99CallTicks;
+	U64 m_p999CallTicks;
+};
+
+// Functions
+void ProfilerBegin(const profile_zone* zone);
+void ProfilerEnd(const profile_zone* zone);
+void ProfilerRecordLockWait(const lock_site* site, U64 start_ticks, U64 wait_ticks);
+void ProfilerRecordJob(const void* entry, U64 start_ticks, U64 run_ticks);
+void ProfilerRecordCounter(const char* name, U64 value);
+void ProfilerFrameMark();
+U32 ProfilerGather(profile_node_report* out_reports, U32 capacity);
+void ProfilerReport();
+void ProfilerReset();
+// Events from the last seconds on every thread, free with ProfilerFreeCapture
+bool ProfilerCapture(double seconds, profile_capture* out_capture);
+void ProfilerFreeCapture(profile_capture* capture);
+
+// Getters
+U32 ProfilerGetThreadCount();
+const char* ProfilerGetThreadName(U32 thread);
+U32 ProfilerGetNodeCount();
+U64 ProfilerGetFrameCount();
+U64 ProfilerGetFrameTicks();
+U64 ProfilerGetAverageFrameTicks();
+U64 ProfilerGetDroppedCount();
+
+// Setters
+// Names the calling thread in reports, copied
+void ProfilerSetThreadName(const char* name);
+// Each is called after every frame mark with the frame's length, on the
+// thread that marked it; adding one twice keeps one, false when full
+bool ProfilerAddFrameCallback(profile_frame_cb callback);
+void ProfilerRemoveFrameCallback(profile_frame_cb callback);
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	The PROFILE_SCOPE guard.  Records the begin of its zone when made and the
+//	end when the scope closes.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const profile_zone* zone)
+		: m_zone(zone)
+	{
+		ProfilerBegin(zone);
+	}
+
+	~ProfileScope()
+	{
+		ProfilerEnd(m_zone);
+	}
+
+private:
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const profile_zone* m_zone;
+};
+
+#if defined(PROFILE_ZONES)
+	// The zone is constant initialized, so it costs no guard on each entry
+	#define PROFILE_SCOPE( name ) static const profile_zone COMBINE(__pzn_,__LINE__) = { name, __FILE__, __LINE__ }; ProfileScope COMBINE(__psc_,__LINE__)(&COMBINE(__pzn_,__LINE__))
+#else
+	#define PROFILE_SCOPE( name )
+#endif
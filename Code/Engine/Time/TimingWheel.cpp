@@ -0,0 +1,251 @@
+#include "Time/TimingWheel.hpp"
+#include "Time/Utils.hpp"
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+const U64 TIMING_WHEEL_MAX_DELTA = ((U64)1 << (TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOT_BITS)) - 1;
+
+//////////////////////////////////////////////////////
+//													//
+//				Class Structures					//
+//													//
+//////////////////////////////////////////////////////
+TimingWheel::TimingWheel(U64 max_timers, double tick_ms /*= 1.0*/)
+	: m_currentTick(0)
+	, m_nextId(1)
+	, m_pendingCount(0)
+{
+	for (U32 level = 0; level < TIMING_WHEEL_LEVELS; ++level)
+	{
+		for (U32 slot = 0; slot < TIMING_WHEEL_SLOTS; ++slot)
+		{
+			// Every slot is the sentinel of its own circular list
+			TimerNode* head = &m_slots[level][slot];
+			head->m_prev = head;
+			head->m_next = head;
+			head->m_id = 0;
+		}
+
+		m_levelCount[level] = 0;
+	}
+
+	m_opsPerTick = Max(TimeOpCountFrom_ms(tick_ms), (uint64_t)1);
+	m_nodePool = new PoolAllocator<TimerNode>(max_timers);
+	m_startOps = TimeGetOpCount();
+}
+
+TimingWheel::~TimingWheel()
+{
+	delete m_nodePool;
+}
+
+timer_id TimingWheel::Schedule(double delay_ms, timer_cb cb, void* data)
+{
+	U64 delay_ticks = (TimeOpCountFrom_ms(delay_ms) + m_opsPerTick - 1) / m_opsPerTick;
+	return ScheduleTicks(delay_ticks, cb, data);
+}
+
+timer_id TimingWheel::ScheduleTicks(U64 delay_ticks, timer_cb cb, void* data)
+{
+	timer_id timer;
+
+	SCOPE_LOCK(&m_lock);
+
+	TimerNode* node = m_nodePool->Create<TimerNode>();
+	if (nullptr == node)
+		return timer;
+
+	// A timer never fires on the tick it was scheduled in
+	node->m_id = m_nextId++;
+	node->m_expireTick = m_currentTick + Max(delay_ticks, (U64)1);
+	node->m_callback = cb;
+	node->m_data = data;
+	InsertNode(node);
+	++m_pendingCount;
+
+	timer.node = node;
+	timer.id = node->m_id;
+	return timer;
+}
+
+bool TimingWheel::Cancel(timer_id& timer)
+{
+	if (nullptr == timer.node)
+		return false;
+
+	TimerNode* node = (TimerNode*)timer.node;
+
+	{
+		SCOPE_LOCK(&m_lock);
+
+		// Pool memory outlives every node, so a stale id only ever reads
+		// a cleared or reused node and is rejected here.
+		if (node->m_id != timer.id)
+		{
+			timer = timer_id();
+			return false;
+		}
+
+		UnlinkNode(node);
+		--m_levelCount[node->m_level];
+		node->m_id = 0;
+		--m_pendingCount;
+		m_nodePool->Destroy(node);
+	}
+
+	timer = timer_id();
+	return true;
+}
+
+U32 TimingWheel::Update()
+{
+	U64 target_tick = (TimeGetOpCount() - m_startOps) / m_opsPerTick;
+	TimerNode* expired = nullptr;
+
+	{
+		SCOPE_LOCK(&m_lock);
+
+		while (m_currentTick < target_tick)
+		{
+			// With the lower levels empty nothing can fire before the next
+			// boundary that cascades into them, so jump to just before it.
+			U32 empty_levels = 0;
+			while (empty_levels < TIMING_WHEEL_LEVELS && 0 == m_levelCount[empty_levels])
+			{
+				++empty_levels;
+			}
+
+			if (empty_levels == TIMING_WHEEL_LEVELS)
+			{
+				m_currentTick = target_tick;
+				break;
+			}
+
+			if (empty_levels > 0)
+			{
+				U64 span_mask = ((U64)1 << (empty_levels * TIMING_WHEEL_SLOT_BITS)) - 1;
+				U64 boundary = (m_currentTick | span_mask) + 1;
+				if (boundary > target_tick)
+				{
+					m_currentTick = target_tick;
+					break;
+				}
+
+				m_currentTick = boundary - 1;
+			}
+
+			++m_currentTick;
+
+			// Cascade from the highest level whose lower bits just wrapped
+			U32 top_level = 0;
+			while (top_level + 1 < TIMING_WHEEL_LEVELS
+				&& 0 == (m_currentTick & (((U64)1 << ((top_level + 1) * TIMING_WHEEL_SLOT_BITS)) - 1)))
+			{
+				++top_level;
+			}
+
+			for (U32 level = top_level; level > 0; --level)
+			{
+				Cascade(level);
+			}
+
+			// Move the whole level 0 slot onto the expired list
+			TimerNode* head = &m_slots[0][m_currentTick & TIMING_WHEEL_SLOT_MASK];
+			while (head->m_next != head)
+			{
+				TimerNode* node = head->m_next;
+				UnlinkNode(node);
+				--m_levelCount[0];
+				node->m_id = 0;
+				node->m_next = expired;
+				expired = node;
+				--m_pendingCount;
+			}
+		}
+	}
+
+	// Fire outside the lock so callbacks are free to schedule again
+	U32 fired = 0;
+	while (nullptr != expired)
+	{
+		TimerNode* next = expired->m_next;
+		timer_cb cb = expired->m_callback;
+		void* data = expired->m_data;
+
+		m_nodePool->Destroy(expired);
+		cb(data);
+
+		expired = next;
+		++fired;
+	}
+
+	return fired;
+}
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+void TimingWheel::InsertNode(TimerNode* node)
+{
+	U64 delta = (node->m_expireTick > m_currentTick) ? node->m_expireTick - m_currentTick : 0;
+
+	// Anything past the wheel's range parks on the top level and is
+	// re-placed each time that slot cascades.
+	U64 place_tick = node->m_expireTick;
+	if (delta > TIMING_WHEEL_MAX_DELTA)
+	{
+		delta = TIMING_WHEEL_MAX_DELTA;
+		place_tick = m_currentTick + TIMING_WHEEL_MAX_DELTA;
+	}
+
+	U32 level = 0;
+	while (level + 1 < TIMING_WHEEL_LEVELS && delta >= ((U64)1 << ((level + 1) * TIMING_WHEEL_SLOT_BITS)))
+	{
+		++level;
+	}
+
+	U32 slot = (U32)((place_tick >> (level * TIMING_WHEEL_SLOT_BITS)) & TIMING_WHEEL_SLOT_MASK);
+	TimerNode* head = &m_slots[level][slot];
+
+	node->m_level = level;
+	++m_levelCount[level];
+	node->m_prev = head->m_prev;
+	node->m_next = head;
+	head->m_prev->m_next = node;
+	head->m_prev = node;
+}
+
+void TimingWheel::Cascade(U32 level)
+{
+	U32 slot = (U32)((m_currentTick >> (level * TIMING_WHEEL_SLOT_BITS)) & TIMING_WHEEL_SLOT_MASK);
+	TimerNode* head = &m_slots[level][slot];
+	if (head->m_next == head)
+		return;
+
+	// Detach the list first, re-insertion may land back on this level
+	TimerNode* node = head->m_next;
+	head->m_prev->m_next = nullptr;
+	head->m_prev = head;
+	head->m_next = head;
+
+	while (nullptr != node)
+	{
+		TimerNode* next = node->m_next;
+		--m_levelCount[level];
+		InsertNode(node);
+		node = next;
+	}
+}
+
+void TimingWheel::UnlinkNode(TimerNode* node)
+{
+	node->m_prev->m_next = node->m_next;
+	node->m_next->m_prev = node->m_prev;
+	node->m_prev = nullptr;
+	node->m_next = nullptr;
+}
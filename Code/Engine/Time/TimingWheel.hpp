@@ -0,0 +1,76 @@
+#pragma once
+#include "Core/NumberDef.hpp"
+#include "Allocation/PoolAllocator.hpp"
+#include "Multithreading/Mutex.hpp"
+
+// Datatypes
+typedef void(*timer_cb)(void*);
+
+const U32 TIMING_WHEEL_LEVELS = 4;
+const U32 TIMING_WHEEL_SLOT_BITS = 8;
+const U32 TIMING_WHEEL_SLOTS = 1U << TIMING_WHEEL_SLOT_BITS;
+const U32 TIMING_WHEEL_SLOT_MASK = TIMING_WHEEL_SLOTS - 1;
+
+struct timer_id
+{
+	void* node = nullptr;
+	U64 id = 0;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//
+//	A hierarchical timing wheel driven by TimeGetOpCount.  Each level holds 256
+//	slots, and every slot on a level covers 256 slots of the level below it, so
+//	four levels cover 2^32 ticks.  Timers live in an intrusive doubly linked list
+//	in their slot, which makes Schedule and Cancel O(1).  Update only touches the
+//	slots of the ticks that elapsed, cascading higher levels down as the lower
+//	level wraps, so pending timers are never scanned, and runs of ticks with empty
+//	lower levels are skipped outright.  Timer nodes come from a PoolAllocator
+//	sized by the max_timers given to the constructor.
+//
+//////////////////////////////////////////////////////////////////////////////////////
+class TimingWheel
+{
+public:
+	explicit TimingWheel(U64 max_timers, double tick_ms = 1.0);
+	~TimingWheel();
+
+	timer_id Schedule(double delay_ms, timer_cb cb, void* data);
+	timer_id ScheduleTicks(U64 delay_ticks, timer_cb cb, void* data);
+	bool Cancel(timer_id& timer);
+	U32 Update();
+
+	inline U64 GetPendingCount() const { return m_pendingCount; };
+	inline U64 GetCurrentTick() const { return m_currentTick; };
+	inline U64 GetOpsPerTick() const { return m_opsPerTick; };
+
+private:
+	struct TimerNode
+	{
+		// The pool writes its free list link over the first member,
+		// so the id has to sit behind it to survive a Free.
+		TimerNode* m_prev;
+		TimerNode* m_next;
+		U64 m_id;
+		U64 m_expireTick;
+		timer_cb m_callback;
+		void* m_data;
+		U32 m_level;
+	};
+
+	void InsertNode(TimerNode* node);
+	void Cascade(U32 level);
+	void UnlinkNode(TimerNode* node);
+
+private:
+	TimerNode m_slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+	U64 m_levelCount[TIMING_WHEEL_LEVELS];
+	PoolAllocator<TimerNode>* m_nodePool;
+	Mutex m_lock;
+	U64 m_startOps;
+	U64 m_opsPerTick;
+	U64 m_currentTick;
+	U64 m_nextId;
+	U64 m_pendingCount;
+};
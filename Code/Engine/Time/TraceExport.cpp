@@ -0,0 +1,280 @@
+#include "Time/TraceExport.hpp"
+#include "Time/Utils.hpp"
+#include "IO/Symbolizer.hpp"
+#include "Multithreading/Mutex.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include <stdio.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+// Handed from the frame that ran long to the thread writing it out
+struct trace_spike_write
+{
+	profile_capture m_capture;
+	double m_seconds;
+	char m_path[260];
+	char m_frame[128];
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+// 0 while disarmed
+static volatile U64 g_trace_trigger_ticks = 0;
+static double g_trace_trigger_seconds = TRACE_CAPTURE_SECONDS_DEFAULT;
+static char g_trace_trigger_path[260];
+static Mutex g_trace_trigger_lock;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static void TraceWriteString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (; '\0' != *text; ++text)
+	{
+		unsigned char character = (unsigned char)*text;
+		if ('"' == character || '\\' == character)
+		{
+			fputc('\\', file);
+			fputc(character, file);
+		}
+		else if (character < 0x20)
+		{
+			fprintf(file, "\\u%04x", character);
+		}
+		else
+		{
+			fputc(character, file);
+		}
+	}
+	fputc('"', file);
+}
+
+// Microseconds into the capture, anything earlier is clipped to its start
+static double TraceMicroseconds(const profile_capture& capture, U64 ticks)
+{
+	if (ticks <= capture.m_beginTicks)
+		return 0.0;
+	return (double)TimeOpCountTo_ns(ticks - capture.m_beginTicks) / 1000.0;
+}
+
+static void TraceWriteHead(FILE* file, bool* first, const char* phase, U32 thread, double microseconds)
+{
+	fprintf(file, "%s\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", *first ? "" : ",", phase, thread, microseconds);
+	*first = false;
+}
+
+static void TraceWriteComplete(FILE* file, bool* first, const profile_capture& capture, U32 thread, const profile_event& event,
+	const char* category, const char* name, const char* detail_key, const char* detail)
+{
+	double begin = TraceMicroseconds(capture, event.m_ticks);
+	double end = TraceMicroseconds(capture, event.m_ticks + event.m_value);
+	TraceWriteHead(file, first, "X", thread, begin);
+	fprintf(file, ",\"dur\":%.3f,\"cat\":\"%s\",\"name\":", end - begin, category);
+	TraceWriteString(file, name);
+	fprintf(file, ",\"args\":{\"%s\":", detail_key);
+	TraceWriteString(file, detail);
+	fprintf(file, "}}");
+}
+
+// Pairs the zones up again: an end without its begin in the capture is
+// skipped, and zones still open when it ends are closed at its end
+static void TraceWriteThread(FILE* file, bool* first, const profile_capture& capture, const profile_capture_thread& thread)
+{
+	const void* open[PROFILER_MAX_DEPTH];
+	U32 depth = 0;
+	char text[512];
+
+	for (U32 index = 0; index < thread.m_eventCount; ++index)
+	{
+		const profile_event& event = thread.m_events[index];
+		double microseconds = TraceMicroseconds(capture, event.m_ticks);
+		switch (event.m_kind)
+		{
+		case PROFILE_EVENT_BEGIN:
+		{
+			if (depth >= PROFILER_MAX_DEPTH)
+				break;
+
+			const profile_zone* zone = (const profile_zone*)event.m_data;
+			open[depth++] = zone;
+			TraceWriteHead(file, first, "B", thread.m_index, microseconds);
+			fprintf(file, ",\"cat\":\"zone\",\"name\":");
+			TraceWriteString(file, zone->m_name);
+			fprintf(file, ",\"args\":{\"file\":");
+			TraceWriteString(file, zone->m_file);
+			fprintf(file, ",\"line\":%u}}", zone->m_line);
+			break;
+		}
+		case PROFILE_EVENT_END:
+		{
+			U32 match = depth;
+			while (0 < match && event.m_data != open[match - 1])
+			{
+				--match;
+			}
+			for (; 0 < match && depth >= match; --depth)
+			{
+				TraceWriteHead(file, first, "E", thread.m_index, microseconds);
+				fprintf(file, "}");
+			}
+			break;
+		}
+		case PROFILE_EVENT_LOCK_WAIT:
+		{
+			const lock_site* site = (const lock_site*)event.m_data;
+			snprintf(text, sizeof(text), "%s(%u)", site->m_file, site->m_line);
+			TraceWriteComplete(file, first, capture, thread.m_index, event, "lock", "Lock wait", "site", text);
+			break;
+		}
+		case PROFILE_EVENT_JOB:
+		{
+			// The symbolizer looks up return addresses one byte back
+			char address[32];
+			snprintf(address, sizeof(address), "%p", event.m_data);
+			callstack_line_t line;
+			const char* name = SymbolizerResolve((char*)event.m_data + 1, &line) ? line.function_name : "Job";
+			TraceWriteComplete(file, first, capture, thread.m_index, event, "job", name, "entry", address);
+			break;
+		}
+		case PROFILE_EVENT_COUNTER:
+		case PROFILE_EVENT_MEMORY_TAG:
+		{
+			const char* format = (PROFILE_EVENT_MEMORY_TAG == event.m_kind) ? "Memory tag %s" : "%s";
+			snprintf(text, sizeof(text), format, (const char*)event.m_data);
+			TraceWriteHead(file, first, "C", thread.m_index, microseconds);
+			fprintf(file, ",\"cat\":\"counter\",\"name\":");
+			TraceWriteString(file, text);
+			fprintf(file, ",\"args\":{\"value\":%llu}}", (unsigned long long)event.m_value);
+			break;
+		}
+		case PROFILE_EVENT_FRAME:
+		{
+			TraceWriteHead(file, first, "i", thread.m_index, microseconds);
+			fprintf(file, ",\"s\":\"g\",\"cat\":\"frame\",\"name\":\"Frame\"}");
+			break;
+		}
+		}
+	}
+
+	double end = TraceMicroseconds(capture, capture.m_endTicks);
+	for (; 0 < depth; --depth)
+	{
+		TraceWriteHead(file, first, "E", thread.m_index, end);
+		fprintf(file, "}");
+	}
+}
+
+bool TraceWriteChromeJson(const profile_capture& capture, const char* file_path)
+{
+	FILE* file = fopen(file_path, "w");
+	if (nullptr == file)
+		return false;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	for (U32 index = 0; index < capture.m_threadCount; ++index)
+	{
+		const profile_capture_thread& thread = capture.m_threads[index];
+		fprintf(file, "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",", thread.m_index);
+		TraceWriteString(file, thread.m_name);
+		fprintf(file, "}}");
+		first = false;
+	}
+
+	for (U32 index = 0; index < capture.m_threadCount; ++index)
+	{
+		TraceWriteThread(file, &first, capture, capture.m_threads[index]);
+	}
+
+	fprintf(file, "\n]}\n");
+	bool written = (0 == ferror(file));
+	fclose(file);
+	return written;
+}
+
+bool TraceCaptureLastSeconds(double seconds, const char* file_path)
+{
+	profile_capture capture;
+	if (!ProfilerCapture(seconds, &capture))
+		return false;
+
+	bool written = TraceWriteChromeJson(capture, file_path);
+	ProfilerFreeCapture(&capture);
+	return written;
+}
+
+static void TraceSpikeWriterMain(void* data)
+{
+	trace_spike_write* write = (trace_spike_write*)data;
+	if (TraceWriteChromeJson(write->m_capture, write->m_path))
+		printf("Frame took %s, trace of the last %.1f s written to %s\n", write->m_frame, write->m_seconds, write->m_path);
+	ProfilerFreeCapture(&write->m_capture);
+	delete write;
+}
+
+// Disarms before capturing, so a slow capture can not trigger the next one.
+// The rings are copied here, before they lap, but the JSON is written on a
+// thread of its own so the frame only pays for the copy; a write still in
+// flight when the program exits is lost
+static void TraceSpikeFrameCallback(U64 frame_ticks)
+{
+	U64 threshold = AtomicLoad(&g_trace_trigger_ticks, ATOMIC_ACQUIRE);
+	if (0 == threshold || frame_ticks <= threshold)
+		return;
+
+	trace_spike_write* write = new trace_spike_write;
+	{
+		SCOPE_LOCK(&g_trace_trigger_lock);
+		if (!AtomicCompareExchange(&g_trace_trigger_ticks, &threshold, (U64)0, ATOMIC_ACQ_REL))
+		{
+			delete write;
+			return;
+		}
+		memcpy(write->m_path, g_trace_trigger_path, sizeof(write->m_path));
+		write->m_seconds = g_trace_trigger_seconds;
+	}
+
+	TimeOpCountToString(frame_ticks, write->m_frame);
+	if (!ProfilerCapture(write->m_seconds, &write->m_capture))
+	{
+		delete write;
+		return;
+	}
+
+	thread_options options;
+	options.m_name = L"Trace Writer";
+	options.m_priority = THREAD_PRIO_LOWEST;
+	thread_handle writer = ThreadCreate(TraceSpikeWriterMain, write, options);
+	if (INVALID_THREAD_HANDLE == writer)
+		TraceSpikeWriterMain(write);
+	else
+		ThreadDetach(writer);
+}
+
+void TraceSetSpikeTrigger(double frame_ms, const char* file_path, double seconds /*= TRACE_CAPTURE_SECONDS_DEFAULT*/)
+{
+	SCOPE_LOCK(&g_trace_trigger_lock);
+	if (frame_ms <= 0.0 || nullptr == file_path)
+	{
+		AtomicStore(&g_trace_trigger_ticks, (U64)0, ATOMIC_RELEASE);
+		ProfilerRemoveFrameCallback(&TraceSpikeFrameCallback);
+		return;
+	}
+
+	snprintf(g_trace_trigger_path, sizeof(g_trace_trigger_path), "%s", file_path);
+	g_trace_trigger_seconds = seconds;
+	U64 threshold = TimeOpCountFrom_ms(frame_ms);
+	AtomicStore(&g_trace_trigger_ticks, (0 == threshold) ? (U64)1 : threshold, ATOMIC_RELEASE);
+	ProfilerAddFrameCallback(&TraceSpikeFrameCallback);
+}
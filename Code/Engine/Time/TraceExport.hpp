@@ -0,0 +1,26 @@
+#pragma once
+#include "Time/Profiler.hpp"
+
+// Defines
+#define TRACE_CAPTURE_SECONDS_DEFAULT (5.0)
+
+	// Writes what the profiler rings hold as Chrome Trace Event JSON, which
+	// chrome://tracing and ui.perfetto.dev both open.  Zones become begin and
+	// end slices on their thread, lock waits and jobs complete slices, the
+	// heap and memory tag counters counter tracks, and frame marks instant
+	// events across all threads.  Jobs are named by their symbolized entry
+	// point, lock waits by the file and line of the SCOPE_LOCK.
+	//
+	// Nothing has to be started ahead of time: the rings always hold the most
+	// recent events, so TraceCaptureLastSeconds can be called after the fact,
+	// and the spike trigger does so by itself the first frame that runs long.
+	// The trigger adds itself beside any other frame callbacks, copies the
+	// rings on the frame thread and writes the JSON on a thread of its own.
+	// How far back a capture reaches depends on how fast each thread records;
+	// a busy thread's ring may cover less than the seconds asked for.
+
+// Functions
+bool TraceWriteChromeJson(const profile_capture& capture, const char* file_path);
+bool TraceCaptureLastSeconds(double seconds, const char* file_path);
+// Captures once when a frame takes longer than frame_ms, 0 disarms
+void TraceSetSpikeTrigger(double frame_ms, const char* file_path, double seconds = TRACE_CAPTURE_SECONDS_DEFAULT);
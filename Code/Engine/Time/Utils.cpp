@@ -1,6 +1,23 @@
 #include "Time/Utils.hpp"
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include "Time/Profiler.hpp"
+#include "Time/FramePacer.hpp"
+#include "Multithreading/Atomic.hpp"
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+	#include <intrin.h>
+#else
+	#include <time.h>
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define TIME_HAS_TSC (1)
+	#if !defined(_WIN32)
+		#include <cpuid.h>
+		#include <x86intrin.h>
+	#endif
+#else
+	#define TIME_HAS_TSC (0)
+#endif
 #include <stdio.h>
 #include <cstring>
 
@@ -10,47 +27,168 @@
 //													//
 //////////////////////////////////////////////////////
 static InternalTimeSystem g_time;
-const float MIN_FRAMES_PER_SECOND = 10.0f;
-const float MAX_FRAMES_PER_SECOND = 60.0f;
-const float MIN_SECONDS_PER_FRAME = (1.0f / MAX_FRAMES_PER_SECOND);
-const float MAX_SECONDS_PER_FRAME = (1.0f / MIN_FRAMES_PER_SECOND);
 
 //////////////////////////////////////////////////////
 //													//
 //					Functions						//
 //													//
 //////////////////////////////////////////////////////
-double InitializeTime(LARGE_INTEGER& out_initial_time)
+// The OS monotonic clock, in its own counts
+static uint64_t TimeReadClock()
 {
-	LARGE_INTEGER counts_per_second;
-	QueryPerformanceFrequency(&counts_per_second);
-	QueryPerformanceCounter(&out_initial_time);
-	return(1.0 / static_cast< double >(counts_per_second.QuadPart));
+	#if defined(_WIN32)
+		LARGE_INTEGER count;
+		::QueryPerformanceCounter(&count);
+		return (uint64_t)count.QuadPart;
+	#else
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+	#endif
+}
+
+static uint64_t TimeGetClockFrequency()
+{
+	#if defined(_WIN32)
+		LARGE_INTEGER frequency;
+		::QueryPerformanceFrequency(&frequency);
+		return (uint64_t)frequency.QuadPart;
+	#else
+		return 1000000000ULL;
+	#endif
+}
+
+#if TIME_HAS_TSC
+static inline uint64_t TimeReadTsc()
+{
+	return __rdtsc();
+}
+
+// CPUID 0x80000007, EDX bit 8
+static bool TimeHasInvariantTsc()
+{
+	#if defined(_WIN32)
+		int registers[4];
+		__cpuid(registers, 0x80000000);
+		if ((unsigned int)registers[0] < 0x80000007u)
+			return false;
+		__cpuid(registers, 0x80000007);
+		return 0 != (registers[3] & (1 << 8));
+	#else
+		unsigned int eax, ebx, ecx, edx;
+		if (0 == __get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007u)
+			return false;
+		__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+		return 0 != (edx & (1u << 8));
+	#endif
+}
+
+// TSC ticks per second, from how far both clocks move over the same spin
+static uint64_t TimeCalibrateTsc()
+{
+	uint64_t clock_frequency = TimeGetClockFrequency();
+	uint64_t clock_span = (uint64_t)((double)clock_frequency * (double)TIME_CALIBRATION_NS / 1.0e9);
+	uint64_t clock_start = TimeReadClock();
+	uint64_t tsc_start = TimeReadTsc();
+
+	uint64_t clock_end;
+	do
+	{
+		clock_end = TimeReadClock();
+	} while (clock_end - clock_start < clock_span);
+	uint64_t tsc_end = TimeReadTsc();
+
+	double seconds = (double)(clock_end - clock_start) / (double)clock_frequency;
+	return (uint64_t)((double)(tsc_end - tsc_start) / seconds + 0.5);
+}
+#endif
+
+// Run once by whichever thread reads the clock first, the rest wait for it
+static void TimeSystemInit()
+{
+	uint32_t expected = TIME_SOURCE_NONE;
+	if (!AtomicCompareExchange(&g_time.source, &expected, (uint32_t)TIME_SOURCE_CALIBRATING, ATOMIC_ACQUIRE))
+	{
+		while (TIME_SOURCE_CALIBRATING == AtomicLoad(&g_time.source, ATOMIC_ACQUIRE)) {}
+		return;
+	}
+
+	time_source source = TIME_SOURCE_CLOCK;
+	uint64_t ops_per_second = TimeGetClockFrequency();
+	#if TIME_HAS_TSC
+		if (TimeHasInvariantTsc())
+		{
+			source = TIME_SOURCE_TSC;
+			ops_per_second = TimeCalibrateTsc();
+		}
+	#endif
+
+	g_time.ops_per_second = ops_per_second;
+	g_time.seconds_per_op = 1.0 / (double)ops_per_second;
+	g_time.ns_per_op_fixed = (uint64_t)(1.0e9 * 4294967296.0 / (double)ops_per_second + 0.5);
+	#if TIME_HAS_TSC
+		g_time.start_ops = (TIME_SOURCE_TSC == source) ? TimeReadTsc() : TimeReadClock();
+	#else
+		g_time.start_ops = TimeReadClock();
+	#endif
+	AtomicStore(&g_time.source, (uint32_t)source, ATOMIC_RELEASE);
+}
+
+static inline const InternalTimeSystem& TimeSystem()
+{
+	if (AtomicLoad(&g_time.source, ATOMIC_ACQUIRE) < TIME_SOURCE_CLOCK)
+		TimeSystemInit();
+	return g_time;
 }
 
 void SleepSeconds(float seconds_to_sleep)
 {
-	int ms_to_sleep = (int)(1000.f * seconds_to_sleep);
-	Sleep(ms_to_sleep);
+	#if defined(_WIN32)
+		int ms_to_sleep = (int)(1000.f * seconds_to_sleep);
+		Sleep(ms_to_sleep);
+	#else
+		uint64_t ns_to_sleep = (uint64_t)(1.0e9 * (double)seconds_to_sleep);
+		timespec duration = { (time_t)(ns_to_sleep / 1000000000ULL), (long)(ns_to_sleep % 1000000000ULL) };
+		nanosleep(&duration, nullptr);
+	#endif
+}
+
+// 64 x 32.32 bits, keeping the whole product so no count overflows
+uint64_t TimeOpCountTo_ns(uint64_t op_count)
+{
+	uint64_t ns_per_op = TimeSystem().ns_per_op_fixed;
+	#if defined(_MSC_VER) && defined(_M_X64)
+		uint64_t high;
+		uint64_t low = _umul128(op_count, ns_per_op, &high);
+		return (high << 32) | (low >> 32);
+	#elif defined(_MSC_VER) || !defined(__SIZEOF_INT128__)
+		// No 64 x 64 multiply on x86, sum the 32-bit partial products; the
+		// bits above 96 wrap off, as they do in the shift above
+		uint64_t op_high = op_count >> 32;
+		uint64_t op_low = (uint32_t)op_count;
+		uint64_t ns_high = ns_per_op >> 32;
+		uint64_t ns_low = (uint32_t)ns_per_op;
+		return ((op_high * ns_high) << 32) + op_high * ns_low + op_low * ns_high + ((op_low * ns_low) >> 32);
+	#else
+		return (uint64_t)(((unsigned __int128)op_count * ns_per_op) >> 32);
+	#endif
 }
 
 uint64_t TimeOpCountTo_us(uint64_t op_count)
 {
-	op_count *= (1000U * 1000U);
-	const uint64_t micro = (uint64_t)(op_count * g_time.seconds_per_op);
-	return micro;
+	return TimeOpCountTo_ns(op_count) / 1000U;
 }
 
 double TimeOpCountTo_ms(uint64_t op_count)
 {
-	double seconds = op_count * g_time.seconds_per_op;
+	double seconds = op_count * TimeSystem().seconds_per_op;
 	return seconds * 1000.0;
 }
 
 uint64_t TimeOpCountFrom_ms(double micro_seconds)
 {
 	double seconds = micro_seconds / 1000.0;
-	const uint64_t ops = (uint64_t)(seconds * g_time.ops_per_second);
+	const uint64_t ops = (uint64_t)(seconds * TimeSystem().ops_per_second);
 	return ops;
 }
 
@@ -59,83 +197,65 @@ void TimeOpCountToString(uint64_t op_count, char* out_time_len_128)
 	char buffer[128];
 	uint64_t micro = TimeOpCountTo_us(op_count);
 
-	if (micro < 1500) 
+	if (micro < 1500)
 	{
-		sprintf_s(buffer, 128, "%llu us", micro);
+		snprintf(buffer, 128, "%llu us", (unsigned long long)micro);
 	}
-	else if (micro < 1500000) 
+	else if (micro < 1500000)
 	{
 		double milli = (double)micro / (double)1000.0;
-		sprintf_s(buffer, 128, "%.4f ms", milli);
+		snprintf(buffer, 128, "%.4f ms", milli);
 	}
-	else 
+	else
 	{
 		double seconds = (double)micro / (double)(1000000.0);
-		sprintf_s(buffer, 128, "%.4f s", seconds);
+		snprintf(buffer, 128, "%.4f s", seconds);
 	}
 
 	strcpy(out_time_len_128, buffer);
 }
 
+// Scaled to us, ms or seconds, whichever reads best, units optional
 double TimeOpCountToSeconds(uint64_t op_count, char* out_units_len_4 /*= nullptr*/)
 {
-	uint64_t micro = TimeOpCountTo_us(op_count);
+	char units[4] = { 0 };
+	double scaled;
+	double micro = (double)TimeOpCountTo_ns(op_count) / 1000.0;
 
-	if (micro < 1500) 
+	if (micro < 1500.0)
 	{
-		out_units_len_4[0] = 'u';
-		out_units_len_4[1] = 's';
-		out_units_len_4[2] = NULL;
-		out_units_len_4[3] = NULL;
-		return (double)micro;
+		units[0] = 'u';
+		units[1] = 's';
+		scaled = micro;
 	}
-	else if (micro < 1500000) 
+	else if (micro < 1500000.0)
 	{
-		out_units_len_4[0] = 'm';
-		out_units_len_4[1] = 's';
-		out_units_len_4[2] = NULL;
-		out_units_len_4[3] = NULL;
-		return (double)micro / (double)1000.0;
+		units[0] = 'm';
+		units[1] = 's';
+		scaled = micro / 1000.0;
 	}
-	else 
+	else
 	{
-		out_units_len_4[0] = 's';
-		out_units_len_4[1] = 'e';
-		out_units_len_4[2] = 'c';
-		out_units_len_4[3] = NULL;
-		return (double)micro / (double)(1000000.0);
+		units[0] = 's';
+		units[1] = 'e';
+		units[2] = 'c';
+		scaled = micro / 1000000.0;
 	}
-}
-
-InternalTimeSystem::InternalTimeSystem()
-{
-	::QueryPerformanceFrequency((LARGE_INTEGER*)&ops_per_second);
-	seconds_per_op = 1.0 / (double)ops_per_second;
 
-	::QueryPerformanceCounter((LARGE_INTEGER*)&start_ops);
+	if (nullptr != out_units_len_4)
+		memcpy(out_units_len_4, units, sizeof(units));
+	return scaled;
 }
 
+// Paced by the default frame pacer, see TimeGetFramePacer
 float CalculateDeltaSeconds()
 {
-	double time_now = GetCurrentTimeSeconds();
-	static double last_frame_time = time_now;
-	double delta_seconds = time_now - last_frame_time;
-
-	// Wait until [nearly] the minimum frame time has elapsed (limit framerate to within the max)
-	while (delta_seconds < MIN_SECONDS_PER_FRAME * .999f)
-	{
-		time_now = GetCurrentTimeSeconds();
-		delta_seconds = time_now - last_frame_time;
-	}
-	last_frame_time = time_now;
-
-	// Clamp deltaSeconds to be within the max time allowed (e.g. sitting at a debug break point)
-	if (delta_seconds > MAX_SECONDS_PER_FRAME)
-	{
-		delta_seconds = MAX_SECONDS_PER_FRAME;
-	}
+	float delta_seconds = (float)TimeGetFramePacer().WaitForNextFrame();
 
-	return (float)delta_seconds;
+	#if defined(PROFILE_ZONES)
+		ProfilerFrameMark();
+	#endif
+	return delta_seconds;
 }
 
 //////////////////////////////////////////////////////
@@ -143,41 +263,62 @@ float CalculateDeltaSeconds()
 //					Getters							//
 //													//
 //////////////////////////////////////////////////////
+// Seconds since the time system started
 double GetCurrentTimeSeconds()
 {
-	static LARGE_INTEGER initial_time;
-	static double seconds_per_count = InitializeTime(initial_time);
-	LARGE_INTEGER current_count;
-	QueryPerformanceCounter(&current_count);
-	LONGLONG elapsed_counts_since_init_time = current_count.QuadPart - current_count.QuadPart;
-
-	double current_seconds = static_cast< double >(elapsed_counts_since_init_time) * seconds_per_count;
-	return current_seconds;
+	return TimeGetSeconds();
 }
 
 uint64_t __fastcall TimeGetOpCount()
 {
-	uint64_t count;
-	QueryPerformanceCounter((LARGE_INTEGER*)&count);
-	return count;
+	#if TIME_HAS_TSC
+		if (TIME_SOURCE_TSC == g_time.source)
+			return TimeReadTsc();
+	#endif
+
+	if (TIME_SOURCE_CLOCK != g_time.source)
+	{
+		TimeSystemInit();
+		return TimeGetOpCount();
+	}
+	return TimeReadClock();
 }
 
+// The clock is read first, the first call is what sets start_ops
 uint __fastcall TimeGet_ms()
 {
-	uint64_t count = TimeGetOpCount() - g_time.start_ops;
-	count = (count * 1000U) / g_time.ops_per_second;
-	return (uint)count;
+	uint64_t now = TimeGetOpCount();
+	uint64_t count = now - g_time.start_ops;
+	return (uint)(TimeOpCountTo_ns(count) / 1000000U);
 }
 
 uint __fastcall TimeGet_us()
 {
-	uint64_t count = TimeGetOpCount() - g_time.start_ops;;
-	count = (count * 1000U * 1000U) / g_time.ops_per_second;
-	return (uint)count;
+	uint64_t now = TimeGetOpCount();
+	uint64_t count = now - g_time.start_ops;
+	return (uint)(TimeOpCountTo_ns(count) / 1000U);
+}
+
+uint64_t __fastcall TimeGet_ns()
+{
+	uint64_t now = TimeGetOpCount();
+	uint64_t count = now - g_time.start_ops;
+	return TimeOpCountTo_ns(count);
 }
 
 double __fastcall TimeGetSeconds()
 {
-	uint64_t count = TimeGetOpCount() - g_time.start_ops;
+	uint64_t now = TimeGetOpCount();
+	uint64_t count = now - g_time.start_ops;
 	return (double)count * g_time.seconds_per_op;
 }
+
+// Made on first use, so the time system is up before it reads the clock
+FramePacer& TimeGetFramePacer()
+{
+	static FramePacer frame_pacer;
+	return frame_pacer;
+}
+
+uint64_t TimeGetOpsPerSecond() { return TimeSystem().ops_per_second; }
+time_source TimeGetSource() { return (time_source)TimeSystem().source; }
@@ -1,26 +1,60 @@
 #pragma once
 #include <stdint.h>
 
+// Defines
+#if !defined(_WIN32)
+	#define __fastcall
+#endif
+// Spent spinning against the OS clock to measure the TSC rate
+#define TIME_CALIBRATION_NS (10 * 1000 * 1000)
+
+	// Op counts are TSC ticks read with rdtsc when the processor reports an
+	// invariant TSC, one that runs at a fixed rate through power states and
+	// is kept in step across cores.  The rate is measured once against
+	// CLOCK_MONOTONIC, or QueryPerformanceCounter on Windows, by the first
+	// call to anything here, which can be operator new before main.  Without
+	// an invariant TSC, or off x86, op counts come from that OS clock
+	// instead.  TimeGetOpCount is then one predictable branch and an rdtsc,
+	// cheap enough to call millions of times a second, and op counts turn
+	// into nanoseconds with one 32.32 fixed point multiply.
+
 // Datatypes
 typedef unsigned int uint;
+class FramePacer;
+
+enum time_source
+{
+	TIME_SOURCE_NONE = 0,
+	TIME_SOURCE_CALIBRATING = 1,
+	TIME_SOURCE_CLOCK = 2,
+	TIME_SOURCE_TSC = 3
+};
 
+// Constant initialized, filled in by the first clock read
 class InternalTimeSystem
 {
 public:
-	InternalTimeSystem();
-
-	uint64_t start_ops;
-	uint64_t ops_per_second;
+	uint64_t start_ops = 0;
+	uint64_t ops_per_second = 0;
+	// Nanoseconds per op, 32.32 fixed point
+	uint64_t ns_per_op_fixed = 0;
 
-	double seconds_per_op;
+	double seconds_per_op = 0.0;
+	// Written last, once everything above is set
+	volatile uint32_t source = TIME_SOURCE_NONE;
 };
 
 // Getters
 double GetCurrentTimeSeconds();
 uint __fastcall TimeGet_us();
 uint __fastcall TimeGet_ms();
+uint64_t __fastcall TimeGet_ns();
 uint64_t __fastcall TimeGetOpCount();
 double __fastcall TimeGetSeconds();
+uint64_t TimeGetOpsPerSecond();
+time_source TimeGetSource();
+// The pacer CalculateDeltaSeconds waits on, 60 fps and clamped at 10 fps until set
+FramePacer& TimeGetFramePacer();
 
 // Functions
 float CalculateDeltaSeconds();
@@ -29,4 +63,5 @@ void TimeOpCountToString(uint64_t op_count, char* out_time_len_128);
 uint64_t TimeOpCountFrom_ms(double micro_seconds);
 double TimeOpCountTo_ms(uint64_t op_count);
 uint64_t TimeOpCountTo_us(uint64_t op_count);
-double TimeOpCountToSeconds(uint64_t op_count, char* out_units_len_4 = nullptr);
\ No newline at end of file
+uint64_t TimeOpCountTo_ns(uint64_t op_count);
+double TimeOpCountToSeconds(uint64_t op_count, char* out_units_len_4 = nullptr);
@@ -0,0 +1,527 @@
+// Reads an allocation trace written by AllocTraceStart / AllocTraceStop and
+// prints the heap over time, what the heap held at its peak, the sites making
+// the most short-lived allocations, and the sites still holding memory when
+// the trace ended.  Built as a console program with Code/Engine on the
+// include path; it only needs the format in Memory/AllocationTrace.hpp.
+//
+//	AllocTraceAnalyzer <trace> [-top N] [-short_us N] [-buckets N] [-frames N]
+#include "Memory/AllocationTrace.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct trace_event
+{
+	uint64_t m_ticks;
+	uint64_t m_address;
+	uint64_t m_size;
+	uint32_t m_stack;
+	uint32_t m_thread;
+	bool m_alloc;
+};
+
+struct trace_line
+{
+	std::string m_function;
+	std::string m_file;
+	uint32_t m_line;
+};
+
+struct trace_stack
+{
+	std::vector<uint64_t> m_frames;
+	std::vector<trace_line> m_lines;
+};
+
+struct trace_live
+{
+	uint64_t m_size;
+	uint64_t m_ticks;
+	uint32_t m_stack;
+};
+
+struct site_total
+{
+	uint32_t m_stack;
+	uint64_t m_count;
+	uint64_t m_bytes;
+	uint64_t m_oldestTicks;
+};
+
+struct trace_options
+{
+	const char* m_path = nullptr;
+	uint32_t m_top = 10;
+	uint32_t m_buckets = 40;
+	uint32_t m_frames = 6;
+	double m_shortSeconds = 0.001;
+};
+
+// Stack 0 in the file means none, kept as this here
+const uint32_t NO_STACK = 0xFFFFFFFFu;
+
+//////////////////////////////////////////////////////
+//													//
+//					Class Structures				//
+//													//
+//////////////////////////////////////////////////////
+class TraceReader
+{
+public:
+	TraceReader(const uint8_t* data, size_t size) : m_data(data), m_end(data + size) {};
+	bool IsDone() const { return m_data >= m_end; };
+	size_t GetRemaining() const { return (size_t)(m_end - m_data); };
+	const uint8_t* GetPosition() const { return m_data; };
+	void Skip(size_t bytes) { m_data += bytes; };
+
+	bool ReadByte(uint8_t* out)
+	{
+		if (IsDone())
+			return false;
+		*out = *m_data++;
+		return true;
+	}
+
+	bool ReadFixed(void* out, size_t bytes)
+	{
+		if (GetRemaining() < bytes)
+			return false;
+		memcpy(out, m_data, bytes);
+		m_data += bytes;
+		return true;
+	}
+
+	bool ReadVarint(uint64_t* out)
+	{
+		uint64_t value = 0;
+		for (uint32_t shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte;
+			if (!ReadByte(&byte))
+				return false;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if (0 == (byte & 0x80))
+			{
+				*out = value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ReadString(std::string* out)
+	{
+		uint64_t length;
+		if (!ReadVarint(&length) || GetRemaining() < length)
+			return false;
+		out->assign((const char*)m_data, (size_t)length);
+		m_data += length;
+		return true;
+	}
+
+private:
+	const uint8_t* m_data;
+	const uint8_t* m_end;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static bool ReadTraceFile(const char* path, std::vector<uint8_t>* out_data)
+{
+	FILE* file = fopen(path, "rb");
+	if (nullptr == file)
+		return false;
+
+	// Read in blocks rather than sizing with ftell, whose long is 32 bits on
+	// Windows and cannot measure traces past 2 GiB
+	const size_t block_size = 16 * 1024 * 1024;
+	out_data->clear();
+	for (;;)
+	{
+		size_t offset = out_data->size();
+		out_data->resize(offset + block_size);
+		size_t read = fread(out_data->data() + offset, 1, block_size, file);
+		out_data->resize(offset + read);
+		if (read < block_size)
+			break;
+	}
+
+	bool failed = (0 != ferror(file));
+	fclose(file);
+	return !failed;
+}
+
+static bool ParseChunk(TraceReader* reader, uint32_t thread, uint32_t byte_count, std::vector<trace_event>* events)
+{
+	TraceReader chunk(reader->GetPosition(), byte_count);
+	reader->Skip(byte_count);
+
+	// From the start of the trace
+	uint64_t ticks = 0;
+	while (!chunk.IsDone())
+	{
+		uint8_t kind;
+		uint64_t delta;
+		trace_event event = {};
+		if (!chunk.ReadByte(&kind) || !chunk.ReadVarint(&delta) || !chunk.ReadVarint(&event.m_address))
+			return false;
+
+		ticks += delta;
+		event.m_ticks = ticks;
+		event.m_thread = thread;
+		event.m_stack = NO_STACK;
+		event.m_alloc = (ALLOC_TRACE_ALLOC == kind);
+
+		if (event.m_alloc)
+		{
+			uint64_t stack;
+			if (!chunk.ReadVarint(&event.m_size) || !chunk.ReadVarint(&stack))
+				return false;
+			event.m_stack = (0 == stack) ? NO_STACK : (uint32_t)(stack - 1);
+		}
+		else if (ALLOC_TRACE_FREE != kind)
+		{
+			return false;
+		}
+
+		events->push_back(event);
+	}
+
+	return true;
+}
+
+static bool ParseTrace(const std::vector<uint8_t>& data, uint64_t* out_ticks_per_second, std::vector<trace_event>* events, std::unordered_map<uint32_t, trace_stack>* stacks)
+{
+	TraceReader reader(data.data(), data.size());
+
+	char magic[8];
+	uint32_t version;
+	uint32_t pointer_size;
+	uint64_t start_ticks;
+	if (!reader.ReadFixed(magic, 8) || 0 != memcmp(magic, ALLOC_TRACE_MAGIC, 8))
+	{
+		printf("Not an allocation trace.\n");
+		return false;
+	}
+	if (!reader.ReadFixed(&version, 4) || ALLOC_TRACE_VERSION != version)
+	{
+		printf("Unsupported trace version.\n");
+		return false;
+	}
+	if (!reader.ReadFixed(&pointer_size, 4) || !reader.ReadFixed(out_ticks_per_second, 8) || !reader.ReadFixed(&start_ticks, 8))
+		return false;
+
+	// A trace cut short by a crash still has everything up to its last chunk
+	while (!reader.IsDone())
+	{
+		uint8_t record;
+		reader.ReadByte(&record);
+
+		if (ALLOC_TRACE_END == record)
+			return true;
+
+		if (ALLOC_TRACE_CHUNK == record)
+		{
+			uint32_t thread;
+			uint32_t byte_count;
+			if (!reader.ReadFixed(&thread, 4) || !reader.ReadFixed(&byte_count, 4) || reader.GetRemaining() < byte_count)
+				break;
+			if (!ParseChunk(&reader, thread, byte_count, events))
+				break;
+		}
+		else if (ALLOC_TRACE_STACK == record)
+		{
+			uint64_t id;
+			uint64_t frame_count;
+			if (!reader.ReadVarint(&id) || !reader.ReadVarint(&frame_count))
+				break;
+			trace_stack& stack = (*stacks)[(uint32_t)id];
+			stack.m_frames.resize((size_t)frame_count);
+			for (uint64_t frame = 0; frame < frame_count; ++frame)
+			{
+				reader.ReadVarint(&stack.m_frames[(size_t)frame]);
+			}
+		}
+		else if (ALLOC_TRACE_SYMBOLS == record)
+		{
+			uint64_t id;
+			uint64_t line_count;
+			if (!reader.ReadVarint(&id) || !reader.ReadVarint(&line_count))
+				break;
+			trace_stack& stack = (*stacks)[(uint32_t)id];
+			stack.m_lines.resize((size_t)line_count);
+			for (trace_line& line : stack.m_lines)
+			{
+				uint64_t number = 0;
+				if (!reader.ReadString(&line.m_function) || !reader.ReadString(&line.m_file) || !reader.ReadVarint(&number))
+					return true;
+				line.m_line = (uint32_t)number;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	printf("Trace ends early, it was not stopped cleanly; reading what is there.\n");
+	return true;
+}
+
+static void PrintStack(const std::unordered_map<uint32_t, trace_stack>& stacks, uint32_t stack_id, uint32_t max_frames)
+{
+	auto found = stacks.find(stack_id);
+	if (NO_STACK == stack_id || stacks.end() == found)
+	{
+		printf("     (no callstack)\n");
+		return;
+	}
+
+	const trace_stack& stack = found->second;
+	if (!stack.m_lines.empty())
+	{
+		for (size_t index = 0; index < stack.m_lines.size() && index < max_frames; ++index)
+		{
+			const trace_line& line = stack.m_lines[index];
+			printf("     %s(%u): %s\n", line.m_file.c_str(), line.m_line, line.m_function.c_str());
+		}
+		return;
+	}
+
+	for (size_t index = 0; index < stack.m_frames.size() && index < max_frames; ++index)
+	{
+		printf("     #%u 0x%llx\n", (uint32_t)index, (unsigned long long)stack.m_frames[index]);
+	}
+}
+
+static void SortSites(std::vector<site_total>* sites, bool by_count)
+{
+	std::sort(sites->begin(), sites->end(), [by_count](const site_total& a, const site_total& b)
+	{
+		return by_count ? (a.m_count > b.m_count) : (a.m_bytes > b.m_bytes);
+	});
+}
+
+static void PrintSites(const char* title, std::vector<site_total>& sites, bool by_count, const trace_options& options, const std::unordered_map<uint32_t, trace_stack>& stacks, double seconds_per_tick)
+{
+	SortSites(&sites, by_count);
+
+	printf("\n%s\n", title);
+	for (size_t index = 0; index < sites.size() && index < options.m_top; ++index)
+	{
+		const site_total& site = sites[index];
+		printf("%2u. %llu byte(s) in %llu allocation(s)", (uint32_t)index + 1, (unsigned long long)site.m_bytes, (unsigned long long)site.m_count);
+		if (0 != site.m_oldestTicks)
+			printf(", oldest from %.3f s", (double)site.m_oldestTicks * seconds_per_tick);
+		printf("\n");
+		PrintStack(stacks, site.m_stack, options.m_frames);
+	}
+}
+
+static std::vector<site_total> CollectSites(const std::unordered_map<uint32_t, site_total>& totals)
+{
+	std::vector<site_total> sites;
+	sites.reserve(totals.size());
+	for (const auto& entry : totals)
+	{
+		sites.push_back(entry.second);
+	}
+	return sites;
+}
+
+static void Analyze(std::vector<trace_event>& events, const std::unordered_map<uint32_t, trace_stack>& stacks, uint64_t ticks_per_second, const trace_options& options)
+{
+	if (events.empty())
+	{
+		printf("No events in the trace.\n");
+		return;
+	}
+
+	// Chunks from different threads overlap in time
+	std::stable_sort(events.begin(), events.end(), [](const trace_event& a, const trace_event& b) { return a.m_ticks < b.m_ticks; });
+
+	double seconds_per_tick = 1.0 / (double)ticks_per_second;
+	uint64_t end_ticks = events.back().m_ticks;
+	uint64_t short_ticks = (uint64_t)(options.m_shortSeconds * (double)ticks_per_second);
+	uint32_t bucket_count = (0 == options.m_buckets) ? 1 : options.m_buckets;
+	std::vector<uint64_t> bucket_peak(bucket_count, 0);
+	std::vector<uint64_t> bucket_last(bucket_count, 0);
+	std::vector<bool> bucket_used(bucket_count, false);
+
+	// First pass, heap over time, the peak, and lifetimes
+	std::unordered_map<uint64_t, trace_live> live;
+	std::unordered_map<uint32_t, site_total> short_lived;
+	uint64_t live_bytes = 0;
+	uint64_t peak_bytes = 0;
+	size_t peak_index = 0;
+	uint64_t alloc_count = 0;
+	uint64_t unmatched_frees = 0;
+	for (size_t index = 0; index < events.size(); ++index)
+	{
+		const trace_event& event = events[index];
+		if (event.m_alloc)
+		{
+			++alloc_count;
+			live_bytes += event.m_size;
+			live[event.m_address] = { event.m_size, event.m_ticks, event.m_stack };
+		}
+		else
+		{
+			auto found = live.find(event.m_address);
+			if (live.end() == found)
+			{
+				// Allocated before the trace started
+				++unmatched_frees;
+				continue;
+			}
+
+			live_bytes -= found->second.m_size;
+			if (event.m_ticks - found->second.m_ticks <= short_ticks)
+			{
+				site_total& site = short_lived[found->second.m_stack];
+				site.m_stack = found->second.m_stack;
+				site.m_count += 1;
+				site.m_bytes += found->second.m_size;
+			}
+			live.erase(found);
+		}
+
+		if (live_bytes > peak_bytes)
+		{
+			peak_bytes = live_bytes;
+			peak_index = index;
+		}
+
+		uint32_t bucket = (uint32_t)((double)event.m_ticks / (double)(end_ticks + 1) * bucket_count);
+		bucket_peak[bucket] = std::max(bucket_peak[bucket], live_bytes);
+		bucket_last[bucket] = live_bytes;
+		bucket_used[bucket] = true;
+	}
+
+	// A slice without events holds what the one before it ended with
+	for (uint32_t bucket = 1; bucket < bucket_count; ++bucket)
+	{
+		if (bucket_used[bucket])
+			continue;
+		bucket_peak[bucket] = bucket_last[bucket - 1];
+		bucket_last[bucket] = bucket_last[bucket - 1];
+	}
+
+	printf("%llu allocation(s) and %llu free(s) over %.3f s, %llu free(s) of memory from before the trace\n",
+		(unsigned long long)alloc_count, (unsigned long long)(events.size() - alloc_count), (double)end_ticks * seconds_per_tick, (unsigned long long)unmatched_frees);
+
+	printf("\nHeap over time, highest traced bytes live in each slice\n");
+	for (uint32_t bucket = 0; bucket < bucket_count; ++bucket)
+	{
+		char bar[51];
+		uint32_t width = (0 == peak_bytes) ? 0 : (uint32_t)(bucket_peak[bucket] * 50 / peak_bytes);
+		memset(bar, '#', width);
+		bar[width] = '\0';
+		printf("%9.3f s %14llu %s\n", (double)end_ticks * bucket / bucket_count * seconds_per_tick, (unsigned long long)bucket_peak[bucket], bar);
+	}
+
+	// Second pass up to the peak, what the heap held at that point
+	std::unordered_map<uint64_t, trace_live> peak_live;
+	for (size_t index = 0; index <= peak_index; ++index)
+	{
+		const trace_event& event = events[index];
+		if (event.m_alloc)
+			peak_live[event.m_address] = { event.m_size, event.m_ticks, event.m_stack };
+		else
+			peak_live.erase(event.m_address);
+	}
+
+	std::unordered_map<uint32_t, site_total> peak_sites;
+	for (const auto& entry : peak_live)
+	{
+		site_total& site = peak_sites[entry.second.m_stack];
+		site.m_stack = entry.second.m_stack;
+		site.m_count += 1;
+		site.m_bytes += entry.second.m_size;
+	}
+
+	std::unordered_map<uint32_t, site_total> leak_sites;
+	for (const auto& entry : live)
+	{
+		site_total& site = leak_sites[entry.second.m_stack];
+		site.m_stack = entry.second.m_stack;
+		site.m_count += 1;
+		site.m_bytes += entry.second.m_size;
+		if (0 == site.m_oldestTicks || entry.second.m_ticks < site.m_oldestTicks)
+			site.m_oldestTicks = entry.second.m_ticks;
+	}
+
+	char title[128];
+	snprintf(title, sizeof(title), "Peak of %llu byte(s) at %.3f s, largest sites", (unsigned long long)peak_bytes, (double)events[peak_index].m_ticks * seconds_per_tick);
+	std::vector<site_total> sites = CollectSites(peak_sites);
+	PrintSites(title, sites, false, options, stacks, seconds_per_tick);
+
+	snprintf(title, sizeof(title), "Short lived hotspots, freed within %.3f ms", options.m_shortSeconds * 1000.0);
+	sites = CollectSites(short_lived);
+	PrintSites(title, sites, true, options, stacks, seconds_per_tick);
+
+	snprintf(title, sizeof(title), "Leak candidates, %llu allocation(s) still live at the end", (unsigned long long)live.size());
+	sites = CollectSites(leak_sites);
+	PrintSites(title, sites, false, options, stacks, seconds_per_tick);
+}
+
+static bool ParseOptions(int argc, char** argv, trace_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-top") && has_value)
+			options->m_top = (uint32_t)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-short_us") && has_value)
+			options->m_shortSeconds = atof(argv[++index]) / 1000000.0;
+		else if (0 == strcmp(argument, "-buckets") && has_value)
+			options->m_buckets = (uint32_t)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-frames") && has_value)
+			options->m_frames = (uint32_t)atoi(argv[++index]);
+		else if ('-' != argument[0] && nullptr == options->m_path)
+			options->m_path = argument;
+		else
+			return false;
+	}
+
+	return nullptr != options->m_path;
+}
+
+int main(int argc, char** argv)
+{
+	trace_options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		printf("usage: AllocTraceAnalyzer <trace> [-top N] [-short_us N] [-buckets N] [-frames N]\n");
+		return 1;
+	}
+
+	std::vector<uint8_t> data;
+	if (!ReadTraceFile(options.m_path, &data))
+	{
+		printf("Could not read %s\n", options.m_path);
+		return 1;
+	}
+
+	uint64_t ticks_per_second = 1;
+	std::vector<trace_event> events;
+	std::unordered_map<uint32_t, trace_stack> stacks;
+	if (!ParseTrace(data, &ticks_per_second, &events, &stacks))
+		return 1;
+
+	Analyze(events, stacks, (0 == ticks_per_second) ? 1 : ticks_per_second, options);
+	return 0;
+}
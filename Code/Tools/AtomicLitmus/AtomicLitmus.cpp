@@ -0,0 +1,433 @@
+// Litmus tests for Multithreading/Atomic.hpp, meant to run under
+// ThreadSanitizer.  Each test shares plain data between threads only through
+// the ordering an atomic operation promises, so if a wrapper drops or
+// weakens the order it was given, TSan reports the data race; the outcomes
+// forbidden by that order are counted as well, which also catches a wrong
+// result where TSan is not available, as with MSVC.  -relaxed runs message
+// passing with relaxed orders instead, which TSan must report, to show the
+// tests can fail.  Returns non-zero when any test fails.  Built as a console
+// program linked against the engine; on Linux:
+//
+//	g++ -std=c++17 -O1 -g -fsanitize=thread -ICode/Engine Code/Tools/AtomicLitmus/AtomicLitmus.cpp
+//		Code/Engine/Multithreading/CriticalSection.cpp -lpthread
+//
+//	AtomicLitmus [-rounds N] [-threads N] [-relaxed]
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct litmus_options
+{
+	U32 m_rounds = 20000;
+	U32 m_threads = 4;
+	bool m_relaxed = false;
+};
+
+// Plain fields, only ever handed over through an atomic
+struct litmus_payload
+{
+	U64 m_first;
+	U64 m_second;
+	U32 m_round;
+};
+
+struct litmus_thread
+{
+	U32 m_index;
+	U32 m_rounds;
+	U32 m_threadCount;
+	U32 m_failures;
+};
+
+struct litmus_node
+{
+	litmus_node* volatile m_next;
+	// Written by whoever popped the node last
+	U32 m_owner;
+	U32 m_uses;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+static litmus_options g_options;
+
+static litmus_payload g_payload;
+static volatile U32 g_published = 0;
+static volatile U32 g_acknowledged = 0;
+
+static volatile U32 g_round = 0;
+static volatile U32 g_finished = 0;
+static volatile U32 g_x = 0;
+static volatile U32 g_y = 0;
+static U32 g_seen_x = 0;
+static U32 g_seen_y = 0;
+
+static volatile U64 g_counter = 0;
+static volatile U32 g_lock = 0;
+static U64 g_locked_counter = 0;
+static volatile U64 g_bits = 0;
+
+static litmus_payload* volatile g_slot = nullptr;
+static volatile U32 g_slot_taken = 0;
+
+#if defined(ATOMIC_DOUBLE_WIDTH)
+	#define LITMUS_NODE_COUNT (64)
+	static AtomicTaggedPointer<litmus_node> g_stack;
+	static litmus_node g_nodes[LITMUS_NODE_COUNT];
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static void RunThreads(thread_cb cb, litmus_thread* threads, U32 count)
+{
+	thread_handle handles[64];
+	for (U32 index = 0; index < count; ++index)
+	{
+		handles[index] = ThreadCreate(cb, &threads[index], L"Litmus");
+	}
+	for (U32 index = 0; index < count; ++index)
+	{
+		ThreadJoin(handles[index]);
+	}
+}
+
+static void SpinUntil(volatile U32* value, U32 wanted, atomic_order order)
+{
+	while (wanted != AtomicLoad(value, order))
+	{
+		ThreadYield();
+	}
+}
+
+static bool Report(const char* name, U32 failures, const char* detail)
+{
+	printf("%-22s %s%s\n", name, (0 == failures) ? "ok" : "FAILED, ", (0 == failures) ? "" : detail);
+	return 0 == failures;
+}
+
+// Message passing: the payload is written plainly, then published with a
+// release store; the reader that sees the flag with an acquire load must
+// see the whole payload.  The acknowledgement hands the payload back.
+static void MessagePassingWriter(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	atomic_order publish = g_options.m_relaxed ? ATOMIC_RELAXED : ATOMIC_RELEASE;
+	atomic_order observe = g_options.m_relaxed ? ATOMIC_RELAXED : ATOMIC_ACQUIRE;
+	for (U32 round = 1; round <= thread->m_rounds; ++round)
+	{
+		SpinUntil(&g_acknowledged, round - 1, observe);
+		g_payload.m_first = round * 3ULL;
+		g_payload.m_second = round * 7ULL;
+		g_payload.m_round = round;
+		AtomicStore(&g_published, round, publish);
+	}
+}
+
+static void MessagePassingReader(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	atomic_order publish = g_options.m_relaxed ? ATOMIC_RELAXED : ATOMIC_RELEASE;
+	atomic_order observe = g_options.m_relaxed ? ATOMIC_RELAXED : ATOMIC_ACQUIRE;
+	for (U32 round = 1; round <= thread->m_rounds; ++round)
+	{
+		SpinUntil(&g_published, round, observe);
+		if (round != g_payload.m_round || round * 3ULL != g_payload.m_first || round * 7ULL != g_payload.m_second)
+			++thread->m_failures;
+		AtomicStore(&g_acknowledged, round, publish);
+	}
+}
+
+static void MessagePassingEntry(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	if (0 == thread->m_index)
+		MessagePassingWriter(data);
+	else
+		MessagePassingReader(data);
+}
+
+static bool TestMessagePassing(U32 rounds)
+{
+	litmus_thread threads[2] = { { 0, rounds, 2, 0 }, { 1, rounds, 2, 0 } };
+	RunThreads(&MessagePassingEntry, threads, 2);
+	return Report("Message passing", threads[1].m_failures, "the reader saw a stale payload");
+}
+
+// Store buffering: with sequentially consistent stores and loads at least
+// one of the two threads must see the other's store.  x86 can buffer the
+// stores and let both see 0 unless the store is a full barrier.
+static void StoreBufferingEntry(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	volatile U32* mine = (0 == thread->m_index) ? &g_x : &g_y;
+	volatile U32* other = (0 == thread->m_index) ? &g_y : &g_x;
+	U32* seen = (0 == thread->m_index) ? &g_seen_y : &g_seen_x;
+	for (U32 round = 1; round <= thread->m_rounds; ++round)
+	{
+		SpinUntil(&g_round, round, ATOMIC_ACQUIRE);
+		AtomicStore(mine, (U32)1, ATOMIC_SEQ_CST);
+		*seen = AtomicLoad(other, ATOMIC_SEQ_CST);
+		AtomicFetchAdd(&g_finished, (U32)1, ATOMIC_RELEASE);
+	}
+}
+
+static bool TestStoreBuffering(U32 rounds)
+{
+	litmus_thread threads[2] = { { 0, rounds, 2, 0 }, { 1, rounds, 2, 0 } };
+	thread_handle handles[2];
+	for (U32 index = 0; index < 2; ++index)
+	{
+		handles[index] = ThreadCreate(&StoreBufferingEntry, &threads[index], L"Litmus");
+	}
+
+	U32 forbidden = 0;
+	for (U32 round = 1; round <= rounds; ++round)
+	{
+		AtomicStore(&g_x, (U32)0, ATOMIC_RELAXED);
+		AtomicStore(&g_y, (U32)0, ATOMIC_RELAXED);
+		AtomicStore(&g_round, round, ATOMIC_RELEASE);
+		SpinUntil(&g_finished, 2 * round, ATOMIC_ACQUIRE);
+		if (0 == g_seen_x && 0 == g_seen_y)
+			++forbidden;
+	}
+
+	for (U32 index = 0; index < 2; ++index)
+	{
+		ThreadJoin(handles[index]);
+	}
+	return Report("Store buffering", forbidden, "both threads missed the other's store");
+}
+
+// Read-modify-writes: relaxed adds and subtracts never lose an update, a
+// compare-exchange spin lock keeps a plain counter exact, and every thread
+// sets and clears its own bit with or and and.
+static void ReadModifyWriteEntry(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	U64 bit = (U64)1 << (32 + thread->m_index);
+	for (U32 round = 0; round < thread->m_rounds; ++round)
+	{
+		AtomicFetchAdd(&g_counter, (U64)3, ATOMIC_RELAXED);
+		AtomicFetchSub(&g_counter, (U64)1, ATOMIC_RELAXED);
+
+		U32 expected = 0;
+		while (!AtomicCompareExchange(&g_lock, &expected, (U32)1, ATOMIC_ACQUIRE))
+		{
+			expected = 0;
+			ThreadYield();
+		}
+		++g_locked_counter;
+		AtomicStore(&g_lock, (U32)0, ATOMIC_RELEASE);
+
+		U64 before = AtomicFetchOr(&g_bits, bit, ATOMIC_ACQ_REL);
+		if (0 != (before & bit))
+			++thread->m_failures;
+		before = AtomicFetchAnd(&g_bits, ~bit, ATOMIC_ACQ_REL);
+		if (0 == (before & bit))
+			++thread->m_failures;
+	}
+}
+
+static bool TestReadModifyWrite(U32 rounds, U32 thread_count)
+{
+	litmus_thread threads[32];
+	for (U32 index = 0; index < thread_count; ++index)
+	{
+		threads[index] = { index, rounds, thread_count, 0 };
+	}
+	RunThreads(&ReadModifyWriteEntry, threads, thread_count);
+
+	U32 failures = 0;
+	for (U32 index = 0; index < thread_count; ++index)
+	{
+		failures += threads[index].m_failures;
+	}
+	U64 expected = (U64)rounds * thread_count;
+	failures += (2 * expected != AtomicLoad(&g_counter)) ? 1 : 0;
+	failures += (expected != g_locked_counter) ? 1 : 0;
+	failures += (0 != AtomicLoad(&g_bits)) ? 1 : 0;
+	return Report("Read-modify-write", failures, "an update was lost");
+}
+
+// Exchange hands a pointer and the object behind it from one thread to the
+// next; whoever takes it out owns the object and may write it plainly.
+static void ExchangeEntry(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	for (U32 round = 0; round < thread->m_rounds; ++round)
+	{
+		litmus_payload* payload = AtomicExchange(&g_slot, (litmus_payload*)nullptr, ATOMIC_ACQ_REL);
+		if (nullptr == payload)
+		{
+			ThreadYield();
+			continue;
+		}
+
+		if (payload->m_first + payload->m_second != 100)
+			++thread->m_failures;
+		payload->m_first = thread->m_index;
+		payload->m_second = 100 - thread->m_index;
+		++payload->m_round;
+		AtomicFetchAdd(&g_slot_taken, (U32)1, ATOMIC_RELAXED);
+		AtomicExchange(&g_slot, payload, ATOMIC_ACQ_REL);
+	}
+}
+
+static bool TestExchange(U32 rounds, U32 thread_count)
+{
+	litmus_payload* payload = (litmus_payload*)malloc(sizeof(litmus_payload));
+	payload->m_first = 0;
+	payload->m_second = 100;
+	payload->m_round = 0;
+	AtomicStore(&g_slot, payload, ATOMIC_RELEASE);
+
+	litmus_thread threads[32];
+	for (U32 index = 0; index < thread_count; ++index)
+	{
+		threads[index] = { index, rounds, thread_count, 0 };
+	}
+	RunThreads(&ExchangeEntry, threads, thread_count);
+
+	U32 failures = 0;
+	for (U32 index = 0; index < thread_count; ++index)
+	{
+		failures += threads[index].m_failures;
+	}
+	payload = AtomicExchange(&g_slot, (litmus_payload*)nullptr, ATOMIC_ACQUIRE);
+	failures += (nullptr == payload || payload->m_round != AtomicLoad(&g_slot_taken)) ? 1 : 0;
+	free(payload);
+	return Report("Exchange hand-off", failures, "the object was seen torn or lost");
+}
+
+#if defined(ATOMIC_DOUBLE_WIDTH)
+// A Treiber stack on the tagged pointer: nodes are popped, written and
+// pushed back over and over, which is the ABA pattern the tag exists for.
+static void StackPush(litmus_node* node)
+{
+	tagged_pointer<litmus_node> top = g_stack.Load();
+	do
+	{
+		AtomicStore(&node->m_next, top.m_pointer, ATOMIC_RELAXED);
+	} while (!g_stack.CompareExchange(top, node));
+}
+
+static litmus_node* StackPop()
+{
+	tagged_pointer<litmus_node> top = g_stack.Load();
+	while (nullptr != top.m_pointer)
+	{
+		// May read a node another thread already took; the tag then fails the swap
+		litmus_node* next = AtomicLoad(&top.m_pointer->m_next, ATOMIC_RELAXED);
+		if (g_stack.CompareExchange(top, next))
+			return top.m_pointer;
+	}
+	return nullptr;
+}
+
+static void TaggedStackEntry(void* data)
+{
+	litmus_thread* thread = (litmus_thread*)data;
+	for (U32 round = 0; round < thread->m_rounds; ++round)
+	{
+		litmus_node* node = StackPop();
+		if (nullptr == node)
+			continue;
+
+		node->m_owner = thread->m_index;
+		++node->m_uses;
+		if (thread->m_index != node->m_owner)
+			++thread->m_failures;
+		StackPush(node);
+	}
+}
+
+static bool TestTaggedStack(U32 rounds, U32 thread_count)
+{
+	for (U32 index = 0; index < LITMUS_NODE_COUNT; ++index)
+	{
+		g_nodes[index].m_uses = 0;
+		StackPush(&g_nodes[index]);
+	}
+
+	litmus_thread threads[32];
+	for (U32 index = 0; index < thread_count; ++index)
+	{
+		threads[index] = { index, rounds, thread_count, 0 };
+	}
+	RunThreads(&TaggedStackEntry, threads, thread_count);
+
+	U32 failures = 0;
+	for (U32 index = 0; index < thread_count; ++index)
+	{
+		failures += threads[index].m_failures;
+	}
+
+	U32 count = 0;
+	U64 uses = 0;
+	for (litmus_node* node = StackPop(); nullptr != node; node = StackPop())
+	{
+		++count;
+		uses += node->m_uses;
+	}
+	failures += (LITMUS_NODE_COUNT != count) ? 1 : 0;
+	failures += (uses > (U64)rounds * thread_count) ? 1 : 0;
+	return Report("Tagged pointer stack", failures, "a node was lost or popped twice");
+}
+#endif
+
+static bool ParseOptions(int argc, char** argv, litmus_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-rounds") && has_value)
+			options->m_rounds = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-threads") && has_value)
+			options->m_threads = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-relaxed"))
+			options->m_relaxed = true;
+		else
+			return false;
+	}
+
+	return 0 != options->m_rounds && 2 <= options->m_threads && options->m_threads <= 32;
+}
+
+int main(int argc, char** argv)
+{
+	if (!ParseOptions(argc, argv, &g_options))
+	{
+		printf("usage: AtomicLitmus [-rounds N] [-threads N] [-relaxed]\n");
+		return 1;
+	}
+
+	bool passed = TestMessagePassing(g_options.m_rounds);
+	if (g_options.m_relaxed)
+		return passed ? 0 : 1;
+
+	passed = TestStoreBuffering(g_options.m_rounds) && passed;
+	passed = TestReadModifyWrite(g_options.m_rounds, g_options.m_threads) && passed;
+	passed = TestExchange(g_options.m_rounds, g_options.m_threads) && passed;
+	#if defined(ATOMIC_DOUBLE_WIDTH)
+		passed = TestTaggedStack(g_options.m_rounds, g_options.m_threads) && passed;
+	#else
+		printf("%-22s skipped, no 16 byte compare-exchange on this target\n", "Tagged pointer stack");
+	#endif
+
+	printf("%s\n", passed ? "All litmus tests passed" : "Some litmus tests failed");
+	return passed ? 0 : 1;
+}
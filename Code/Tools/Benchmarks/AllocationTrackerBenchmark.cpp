@@ -0,0 +1,158 @@
+// Cost of operator new and delete under the allocation tracker as the
+// number of live allocations grows into the millions.  At each step it
+// times a batch of fresh allocations and their deletes, then deletes and
+// replaces a batch from the long-lived set made at a different call site.
+// Verbose tracking keeps no list of live allocations: new captures the
+// callstack and interns it, and both new and delete add to the counters of
+// that stack's site.  What is timed is that capture, the table lookup and
+// the counter updates, none of which depend on how many allocations are
+// live or which one is freed, so every step should cost the same.  Verbose
+// tracking is the _DEBUG mode, so build the Debug configuration to measure
+// it; other builds time the basic or untracked paths.  Built as a console
+// program linked against the engine.
+//
+//	AllocationTrackerBenchmark [-max_live N] [-batch N]
+#include "Memory/AllocationTracker.hpp"
+#include "Core/NumberDef.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+	#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+	#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct benchmark_options
+{
+	U64 m_maxLive = 4000000;
+	U32 m_batch = 100000;
+};
+
+struct tracked_object
+{
+	U64 m_payload[4];
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// Separate call sites, so the live set spreads over more than one stack
+static BENCHMARK_NOINLINE tracked_object* CreateOld()
+{
+	return new tracked_object;
+}
+
+static BENCHMARK_NOINLINE tracked_object* CreateFresh()
+{
+	return new tracked_object;
+}
+
+static bool ParseOptions(int argc, char** argv, benchmark_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-max_live") && has_value)
+			options->m_maxLive = (U64)atof(argv[++index]);
+		else if (0 == strcmp(argument, "-batch") && has_value)
+			options->m_batch = (U32)atoi(argv[++index]);
+		else
+			return false;
+	}
+
+	return 0 != options->m_batch && options->m_batch <= options->m_maxLive;
+}
+
+int main(int argc, char** argv)
+{
+	benchmark_options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		printf("usage: AllocationTrackerBenchmark [-max_live N] [-batch N]\n");
+		return 1;
+	}
+
+	#if !defined(TRACK_MEMORY)
+		printf("Memory tracking is off in this build\n");
+	#elif TRACK_MEMORY_VERBOSE == TRACK_MEMORY
+		printf("Verbose memory tracking\n");
+	#elif TRACK_MEMORY_SAMPLED == TRACK_MEMORY
+		printf("Sampled memory tracking\n");
+	#else
+		printf("Basic memory tracking\n");
+	#endif
+
+	// Kept off the heap, so the benchmark's own bookkeeping is not tracked
+	tracked_object** live = (tracked_object**)malloc(options.m_maxLive * sizeof(tracked_object*));
+	tracked_object** batch = (tracked_object**)malloc(options.m_batch * sizeof(tracked_object*));
+	if (nullptr == live || nullptr == batch)
+	{
+		printf("Could not allocate %llu pointer(s)\n", (unsigned long long)options.m_maxLive);
+		return 1;
+	}
+
+	printf("%12s %14s %14s %18s\n", "Live", "new (ns)", "delete (ns)", "delete old (ns)");
+	U64 live_count = 0;
+	for (U64 target = 1000; target <= options.m_maxLive; target = (target * 10 > options.m_maxLive && target < options.m_maxLive) ? options.m_maxLive : target * 10)
+	{
+		for (; live_count < target; ++live_count)
+		{
+			live[live_count] = CreateOld();
+		}
+
+		U64 start = TimeGetOpCount();
+		for (U32 index = 0; index < options.m_batch; ++index)
+		{
+			batch[index] = CreateFresh();
+		}
+		U64 create_ticks = TimeGetOpCount() - start;
+
+		start = TimeGetOpCount();
+		for (U32 index = 0; index < options.m_batch; ++index)
+		{
+			delete batch[index];
+		}
+		U64 delete_ticks = TimeGetOpCount() - start;
+
+		// Long-lived ones from an earlier step, replaced so the live count holds
+		U32 old_count = (U32)((options.m_batch < live_count) ? options.m_batch : live_count);
+		start = TimeGetOpCount();
+		for (U32 index = 0; index < old_count; ++index)
+		{
+			delete live[index];
+		}
+		U64 delete_old_ticks = TimeGetOpCount() - start;
+		for (U32 index = 0; index < old_count; ++index)
+		{
+			live[index] = CreateOld();
+		}
+
+		printf("%12llu %14.1f %14.1f %18.1f\n", (unsigned long long)live_count,
+			(double)TimeOpCountTo_ns(create_ticks) / (double)options.m_batch,
+			(double)TimeOpCountTo_ns(delete_ticks) / (double)options.m_batch,
+			(double)TimeOpCountTo_ns(delete_old_ticks) / (double)old_count);
+
+		if (target == options.m_maxLive)
+			break;
+	}
+
+	printf("Tracker reports %llu live allocation(s)\n", (unsigned long long)GetCurrentAllocationCount());
+	for (U64 index = 0; index < live_count; ++index)
+	{
+		delete live[index];
+	}
+	free(batch);
+	free(live);
+	return 0;
+}
@@ -0,0 +1,149 @@
+// Cost of capturing a callstack, per capture and per frame, with the
+// capture made from the bottom of recursions of growing depth.  The walk
+// should cost about the same for every frame, so the per frame column holds
+// steady as the stack gets deeper.  Also times CallstackIntern, which
+// captures and then finds the stack already in the table.  Prints which walk
+// the build uses: frame pointers, a few ns per frame, in unoptimized builds
+// or ones defining CALLSTACK_FRAME_POINTERS, the unwinder, over a hundred,
+// in other builds outside Windows.  Built as a console program linked
+// against the engine.
+//
+//	CallstackBenchmark [-count N] [-repeat N] [-max_depth N]
+#include "IO/Callstack.hpp"
+#include "IO/CallstackTable.hpp"
+#include "Core/NumberDef.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+	#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+	#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct benchmark_options
+{
+	U32 m_count = 20000;
+	U32 m_repeat = 5;
+	U32 m_maxDepth = 64;
+};
+
+struct capture_result
+{
+	double m_captureNs;
+	double m_internNs;
+	U32 m_frames;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+static benchmark_options g_options;
+// Keeps the recursion from being folded away
+static volatile U32 g_sink = 0;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static void MeasureCapture(capture_result* result)
+{
+	void* frames[MAX_FRAMES_PER_CALLSTACK];
+	U64 best_capture = ~0ULL;
+	U64 best_intern = ~0ULL;
+	U32 frame_count = 0;
+	for (U32 run = 0; run < g_options.m_repeat; ++run)
+	{
+		U64 start = TimeGetOpCount();
+		for (U32 index = 0; index < g_options.m_count; ++index)
+		{
+			frame_count = CallstackCapture(frames, MAX_FRAMES_PER_CALLSTACK, 0);
+		}
+		U64 ticks = TimeGetOpCount() - start;
+		best_capture = (ticks < best_capture) ? ticks : best_capture;
+
+		U32 id = 0;
+		start = TimeGetOpCount();
+		for (U32 index = 0; index < g_options.m_count; ++index)
+		{
+			id += CallstackIntern(0);
+		}
+		ticks = TimeGetOpCount() - start;
+		best_intern = (ticks < best_intern) ? ticks : best_intern;
+		g_sink = id;
+	}
+
+	result->m_captureNs = (double)TimeOpCountTo_ns(best_capture) / (double)g_options.m_count;
+	result->m_internNs = (double)TimeOpCountTo_ns(best_intern) / (double)g_options.m_count;
+	result->m_frames = frame_count;
+}
+
+static BENCHMARK_NOINLINE U32 Recurse(U32 depth, capture_result* result)
+{
+	if (0 == depth)
+	{
+		MeasureCapture(result);
+		return 0;
+	}
+
+	U32 value = Recurse(depth - 1, result) + 1;
+	g_sink = value;
+	return value;
+}
+
+static bool ParseOptions(int argc, char** argv, benchmark_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-count") && has_value)
+			options->m_count = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-repeat") && has_value)
+			options->m_repeat = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-max_depth") && has_value)
+			options->m_maxDepth = (U32)atoi(argv[++index]);
+		else
+			return false;
+	}
+
+	return 0 != options->m_count && 0 != options->m_repeat;
+}
+
+int main(int argc, char** argv)
+{
+	if (!ParseOptions(argc, argv, &g_options))
+	{
+		printf("usage: CallstackBenchmark [-count N] [-repeat N] [-max_depth N]\n");
+		return 1;
+	}
+
+	#if defined(_WIN32)
+		printf("Captured with CaptureStackBackTrace\n");
+	#elif defined(CALLSTACK_FRAME_POINTERS)
+		printf("Captured by walking frame pointers\n");
+	#else
+		printf("Captured with _Unwind_Backtrace\n");
+	#endif
+
+	printf("%8s %8s %14s %14s %14s\n", "Depth", "Frames", "capture (ns)", "per frame (ns)", "intern (ns)");
+	for (U32 depth = 0; depth <= g_options.m_maxDepth; depth = (0 == depth) ? 4 : depth * 2)
+	{
+		capture_result result = {};
+		Recurse(depth, &result);
+		printf("%8u %8u %14.1f %14.2f %14.1f\n", depth, result.m_frames, result.m_captureNs,
+			(0 != result.m_frames) ? result.m_captureNs / (double)result.m_frames : 0.0, result.m_internNs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,243 @@
+// Read-side cost of epoch based reclamation.  Times reads of a shared node
+// bare, inside SCOPE_EPOCH, and inside nested sections, first on one thread
+// and then with readers running while a writer keeps replacing the node and
+// retiring the old one through a pool allocator.  The overhead per section
+// should be a few nanoseconds, close to nothing next to the read itself.
+// Built as a console program linked against the engine.
+//
+//	EpochBenchmark [-count N] [-readers N] [-repeat N]
+#include "Multithreading/Epoch.hpp"
+#include "Multithreading/Atomic.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include "Allocation/PoolAllocator.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct benchmark_options
+{
+	U32 m_count = 20000000;
+	U32 m_readers = 2;
+	U32 m_repeat = 5;
+};
+
+struct shared_node
+{
+	U64 m_value;
+	U64 m_check;
+};
+
+struct reader_result
+{
+	U64 m_reads;
+	U64 m_ticks;
+	U64 m_bad;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+#define BENCHMARK_POOL_NODES (1 << 16)
+
+static benchmark_options g_options;
+static PoolAllocator<shared_node> g_pool(BENCHMARK_POOL_NODES);
+static shared_node* volatile g_current = nullptr;
+static volatile U32 g_stop = 0;
+// Keeps the reads from being optimized away
+static volatile U64 g_sink = 0;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static double BenchmarkBare(U32 count)
+{
+	U64 sum = 0;
+	U64 start = TimeGetOpCount();
+	for (U32 index = 0; index < count; ++index)
+	{
+		sum += AtomicLoad(&g_current, ATOMIC_ACQUIRE)->m_value;
+	}
+	U64 ticks = TimeGetOpCount() - start;
+	g_sink = sum;
+	return (double)TimeOpCountTo_ns(ticks) / (double)count;
+}
+
+static double BenchmarkSection(U32 count)
+{
+	U64 sum = 0;
+	U64 start = TimeGetOpCount();
+	for (U32 index = 0; index < count; ++index)
+	{
+		SCOPE_EPOCH();
+		sum += AtomicLoad(&g_current, ATOMIC_ACQUIRE)->m_value;
+	}
+	U64 ticks = TimeGetOpCount() - start;
+	g_sink = sum;
+	return (double)TimeOpCountTo_ns(ticks) / (double)count;
+}
+
+static double BenchmarkNested(U32 count)
+{
+	U64 sum = 0;
+	U64 start = TimeGetOpCount();
+	for (U32 index = 0; index < count; ++index)
+	{
+		SCOPE_EPOCH();
+		{
+			SCOPE_EPOCH();
+			sum += AtomicLoad(&g_current, ATOMIC_ACQUIRE)->m_value;
+		}
+	}
+	U64 ticks = TimeGetOpCount() - start;
+	g_sink = sum;
+	return (double)TimeOpCountTo_ns(ticks) / (double)count;
+}
+
+static shared_node* CreateNode(U64 value)
+{
+	shared_node* node = g_pool.Create<shared_node>();
+	if (nullptr != node)
+	{
+		node->m_value = value;
+		node->m_check = ~value;
+	}
+	return node;
+}
+
+// Every read checks the node was not freed and reused under it
+static void ReaderEntry(void* data)
+{
+	reader_result* result = (reader_result*)data;
+	U64 reads = 0;
+	U64 bad = 0;
+	U64 start = TimeGetOpCount();
+	while (0 == AtomicLoad(&g_stop, ATOMIC_RELAXED))
+	{
+		for (U32 index = 0; index < 1024; ++index)
+		{
+			SCOPE_EPOCH();
+			shared_node* node = AtomicLoad(&g_current, ATOMIC_ACQUIRE);
+			if (node->m_value != ~node->m_check)
+				++bad;
+		}
+		reads += 1024;
+	}
+	result->m_ticks = TimeGetOpCount() - start;
+	result->m_reads = reads;
+	result->m_bad = bad;
+	EpochThreadRelease();
+}
+
+static void BenchmarkContended(U32 readers, U32 count)
+{
+	reader_result results[64];
+	thread_handle threads[64];
+	memset(results, 0, sizeof(results));
+	AtomicStore(&g_stop, (U32)0, ATOMIC_RELEASE);
+	for (U32 index = 0; index < readers; ++index)
+	{
+		threads[index] = ThreadCreate(&ReaderEntry, &results[index], L"Epoch reader");
+	}
+
+	U64 replaced = 0;
+	for (U32 index = 0; index < count / 64; ++index)
+	{
+		shared_node* node = CreateNode(index + 1);
+		if (nullptr == node)
+		{
+			// Every node is waiting on a reader, let the epoch move on
+			ThreadYield();
+			EpochCollect();
+			continue;
+		}
+
+		g_pool.Retire(AtomicExchange(&g_current, node, ATOMIC_ACQ_REL));
+		++replaced;
+		if (0 == (index & 255))
+			ThreadYield();
+	}
+
+	AtomicStore(&g_stop, (U32)1, ATOMIC_RELEASE);
+	U64 reads = 0;
+	U64 ticks = 0;
+	U64 bad = 0;
+	for (U32 index = 0; index < readers; ++index)
+	{
+		ThreadJoin(threads[index]);
+		reads += results[index].m_reads;
+		ticks += results[index].m_ticks;
+		bad += results[index].m_bad;
+	}
+	EpochFlush();
+
+	printf("  %u reader(s): %.2f ns per read in a section, %llu read(s), %llu node(s) replaced, %llu bad read(s), %u pending\n", readers,
+		(0 == reads) ? 0.0 : (double)TimeOpCountTo_ns(ticks) / (double)reads, (unsigned long long)reads, (unsigned long long)replaced,
+		(unsigned long long)bad, EpochGetPendingCount());
+}
+
+static bool ParseOptions(int argc, char** argv, benchmark_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-count") && has_value)
+			options->m_count = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-readers") && has_value)
+			options->m_readers = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-repeat") && has_value)
+			options->m_repeat = (U32)atoi(argv[++index]);
+		else
+			return false;
+	}
+
+	return 0 != options->m_count && 0 != options->m_repeat && options->m_readers <= 64;
+}
+
+int main(int argc, char** argv)
+{
+	if (!ParseOptions(argc, argv, &g_options))
+	{
+		printf("usage: EpochBenchmark [-count N] [-readers N] [-repeat N]\n");
+		return 1;
+	}
+
+	AtomicStore(&g_current, CreateNode(0), ATOMIC_RELEASE);
+
+	printf("One thread, %u read(s) per run\n", g_options.m_count);
+	double best_bare = 1.0e300;
+	double best_section = 1.0e300;
+	double best_nested = 1.0e300;
+	for (U32 run = 0; run < g_options.m_repeat; ++run)
+	{
+		double bare = BenchmarkBare(g_options.m_count);
+		double section = BenchmarkSection(g_options.m_count);
+		double nested = BenchmarkNested(g_options.m_count);
+		best_bare = (bare < best_bare) ? bare : best_bare;
+		best_section = (section < best_section) ? section : best_section;
+		best_nested = (nested < best_nested) ? nested : best_nested;
+		printf("  run %u: bare %.2f ns, in a section %.2f ns, nested %.2f ns\n", run + 1, bare, section, nested);
+	}
+	printf("  best: bare %.2f ns, in a section %.2f ns (+%.2f), nested %.2f ns (+%.2f)\n", best_bare, best_section, best_section - best_bare,
+		best_nested, best_nested - best_bare);
+
+	if (0 != g_options.m_readers)
+	{
+		printf("\nReaders against a writer retiring the node they read\n");
+		BenchmarkContended(g_options.m_readers, g_options.m_count);
+	}
+
+	g_pool.Retire(AtomicExchange(&g_current, (shared_node*)nullptr, ATOMIC_ACQ_REL));
+	EpochFlush();
+	return 0;
+}
@@ -0,0 +1,168 @@
+// Measures what it costs to move between fibers: the bare FiberSwitch there
+// and back, and a JobWait that parks its fiber, runs the job it waits on, and
+// resumes where it left off.  The target is well under a microsecond for
+// both.  Built as a console program linked against the engine.
+//
+//	FiberSwitchBenchmark [-count N] [-repeat N]
+#include "Multithreading/Fiber.hpp"
+#include "Multithreading/JobSystem.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct benchmark_options
+{
+	U32 m_count = 1000000;
+	U32 m_repeat = 5;
+};
+
+struct wait_data
+{
+	U32 m_count;
+	U64 m_ticks;
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+static Fiber* g_main_fiber = nullptr;
+static Fiber* g_ping_fiber = nullptr;
+static volatile U64 g_ping_count = 0;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+static void PingEntry(void*)
+{
+	for (;;)
+	{
+		g_ping_count = g_ping_count + 1;
+		FiberSwitch(g_ping_fiber, g_main_fiber);
+	}
+}
+
+static void EmptyJob(void*)
+{
+}
+
+// Runs as a job so JobWait parks a pooled fiber instead of helping out
+static void WaitLoopJob(void* data)
+{
+	wait_data* wait = (wait_data*)data;
+	U64 start = TimeGetOpCount();
+	for (U32 index = 0; index < wait->m_count; ++index)
+	{
+		JobCounter counter;
+		JobRun(&EmptyJob, nullptr, &counter);
+		JobWait(&counter);
+	}
+	wait->m_ticks = TimeGetOpCount() - start;
+}
+
+static double BenchmarkSwitch(U32 count)
+{
+	U64 start = TimeGetOpCount();
+	for (U32 index = 0; index < count; ++index)
+	{
+		FiberSwitch(g_main_fiber, g_ping_fiber);
+	}
+	U64 ticks = TimeGetOpCount() - start;
+
+	// Two switches per round trip
+	return (double)TimeOpCountTo_ns(ticks) / (2.0 * (double)count);
+}
+
+// The empty job alone, so the park and resume can be told apart from it
+static double BenchmarkJobs(U32 count)
+{
+	U64 start = TimeGetOpCount();
+	for (U32 index = 0; index < count; ++index)
+	{
+		JobCounter counter;
+		JobRun(&EmptyJob, nullptr, &counter);
+		while (JobRunPending()) {}
+	}
+	U64 ticks = TimeGetOpCount() - start;
+	return (double)TimeOpCountTo_ns(ticks) / (double)count;
+}
+
+static double BenchmarkWait(U32 count)
+{
+	wait_data wait = { count, 0 };
+	JobCounter counter;
+	JobRun(&WaitLoopJob, &wait, &counter);
+	JobWait(&counter);
+	return (double)TimeOpCountTo_ns(wait.m_ticks) / (double)count;
+}
+
+static bool ParseOptions(int argc, char** argv, benchmark_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-count") && has_value)
+			options->m_count = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-repeat") && has_value)
+			options->m_repeat = (U32)atoi(argv[++index]);
+		else
+			return false;
+	}
+
+	return 0 != options->m_count && 0 != options->m_repeat;
+}
+
+int main(int argc, char** argv)
+{
+	benchmark_options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		printf("usage: FiberSwitchBenchmark [-count N] [-repeat N]\n");
+		return 1;
+	}
+
+	g_main_fiber = FiberConvertThread();
+	g_ping_fiber = FiberCreate(&PingEntry, nullptr);
+
+	printf("FiberSwitch, %u round trip(s) per run\n", options.m_count);
+	double best = 1.0e300;
+	for (U32 run = 0; run < options.m_repeat; ++run)
+	{
+		double ns = BenchmarkSwitch(options.m_count);
+		best = (ns < best) ? ns : best;
+		printf("  run %u: %.2f ns per switch\n", run + 1, ns);
+	}
+	printf("  best %.2f ns per switch\n", best);
+
+	FiberDestroy(g_ping_fiber);
+	FiberRevertThread(g_main_fiber);
+
+	// One worker, so every wait parks and the same thread resumes it
+	JobSystemInit(1);
+
+	printf("\nJobRun and JobWait, %u wait(s) per run on one worker\n", options.m_count);
+	double best_job = 1.0e300;
+	double best_wait = 1.0e300;
+	for (U32 run = 0; run < options.m_repeat; ++run)
+	{
+		double job_ns = BenchmarkJobs(options.m_count);
+		double wait_ns = BenchmarkWait(options.m_count);
+		best_job = (job_ns < best_job) ? job_ns : best_job;
+		best_wait = (wait_ns < best_wait) ? wait_ns : best_wait;
+		printf("  run %u: %.2f ns per job, %.2f ns per parked wait\n", run + 1, job_ns, wait_ns);
+	}
+	printf("  best %.2f ns per job, %.2f ns per parked wait, %.2f ns of it parking and resuming\n", best_job, best_wait, best_wait - best_job);
+
+	JobSystemDeinit();
+	return 0;
+}
@@ -0,0 +1,229 @@
+// Scaling of the parallel algorithms in Multithreading/Parallel.hpp over
+// one to N workers, on arrays growing tenfold from 1e4 elements.  Each case
+// is timed as the best of a few runs and printed with its speedup over one
+// worker.  ParallelFor, ParallelReduce and ParallelScan stream through
+// 32 bit integers and are bound by memory bandwidth past the caches; the
+// sorts are compute bound.  Built as a console program linked against the
+// engine.  The default 1e8 elements need about 1.2 GB; -max_size lowers it.
+//
+//	ParallelBenchmark [-workers N] [-min_size N] [-max_size N] [-repeat N]
+#include "Multithreading/Parallel.hpp"
+#include "Multithreading/CriticalSection.hpp"
+#include "Time/Utils.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////
+//													//
+//					  Datatypes						//
+//													//
+//////////////////////////////////////////////////////
+struct benchmark_options
+{
+	U32 m_workers = 0;
+	U64 m_minSize = 10000;
+	U64 m_maxSize = 100000000;
+	U32 m_repeat = 3;
+};
+
+enum benchmark_case
+{
+	BENCHMARK_FOR = 0,
+	BENCHMARK_REDUCE,
+	BENCHMARK_SCAN,
+	BENCHMARK_SORT,
+	BENCHMARK_RADIX_SORT,
+	BENCHMARK_CASE_COUNT
+};
+
+//////////////////////////////////////////////////////
+//													//
+//					Definitions						//
+//													//
+//////////////////////////////////////////////////////
+static const char* g_case_names[BENCHMARK_CASE_COUNT] = { "ParallelFor", "ParallelReduce", "ParallelScan", "ParallelSort", "ParallelRadixSort" };
+// Keeps the reduction from being optimized away
+static volatile U64 g_sink = 0;
+
+//////////////////////////////////////////////////////
+//													//
+//					Functions						//
+//													//
+//////////////////////////////////////////////////////
+// xorshift, the same keys for every worker count
+static void FillRandom(U32* data, U64 count)
+{
+	U64 state = 0x9E3779B97F4A7C15ULL;
+	for (U64 index = 0; index < count; ++index)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		data[index] = (U32)(state >> 32);
+	}
+}
+
+static bool IsSorted(const U32* data, U64 count)
+{
+	for (U64 index = 1; index < count; ++index)
+	{
+		if (data[index - 1] > data[index])
+			return false;
+	}
+	return true;
+}
+
+// Milliseconds for one run; the sorts start again from the same keys
+static double RunCase(benchmark_case which, const U32* source, U32* data, U32* output, U64 count)
+{
+	if (BENCHMARK_SORT == which || BENCHMARK_RADIX_SORT == which)
+		memcpy(data, source, count * sizeof(U32));
+
+	U64 start = TimeGetOpCount();
+	switch (which)
+	{
+	case BENCHMARK_FOR:
+		ParallelFor(0, count, [data](U64 begin, U64 end)
+		{
+			for (U64 index = begin; index < end; ++index)
+			{
+				data[index] = data[index] * 3 + 1;
+			}
+		});
+		break;
+	case BENCHMARK_REDUCE:
+		g_sink = ParallelReduce(0, count, (U64)0, [data](U64 begin, U64 end)
+		{
+			U64 sum = 0;
+			for (U64 index = begin; index < end; ++index)
+			{
+				sum += data[index];
+			}
+			return sum;
+		}, [](U64 a, U64 b) { return a + b; });
+		break;
+	case BENCHMARK_SCAN:
+		ParallelScan(data, output, count, (U32)0, [](U32 a, U32 b) { return a + b; });
+		break;
+	case BENCHMARK_SORT:
+		ParallelSort(data, count, [](U32 a, U32 b) { return a < b; });
+		break;
+	case BENCHMARK_RADIX_SORT:
+		ParallelRadixSort(data, count);
+		break;
+	default:
+		break;
+	}
+	U64 ticks = TimeGetOpCount() - start;
+
+	if ((BENCHMARK_SORT == which || BENCHMARK_RADIX_SORT == which) && !IsSorted(data, count))
+		printf("  %s left %llu element(s) out of order\n", g_case_names[which], (unsigned long long)count);
+
+	return (double)TimeOpCountTo_ns(ticks) / 1.0e6;
+}
+
+static bool ParseOptions(int argc, char** argv, benchmark_options* options)
+{
+	for (int index = 1; index < argc; ++index)
+	{
+		const char* argument = argv[index];
+		bool has_value = (index + 1 < argc);
+		if (0 == strcmp(argument, "-workers") && has_value)
+			options->m_workers = (U32)atoi(argv[++index]);
+		else if (0 == strcmp(argument, "-min_size") && has_value)
+			options->m_minSize = (U64)atof(argv[++index]);
+		else if (0 == strcmp(argument, "-max_size") && has_value)
+			options->m_maxSize = (U64)atof(argv[++index]);
+		else if (0 == strcmp(argument, "-repeat") && has_value)
+			options->m_repeat = (U32)atoi(argv[++index]);
+		else
+			return false;
+	}
+
+	return 0 != options->m_minSize && options->m_minSize <= options->m_maxSize && 0 != options->m_repeat;
+}
+
+int main(int argc, char** argv)
+{
+	benchmark_options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		printf("usage: ParallelBenchmark [-workers N] [-min_size N] [-max_size N] [-repeat N]\n");
+		return 1;
+	}
+
+	U32 max_workers = (0 == options.m_workers) ? (U32)ThreadGetProcessorCount() : options.m_workers;
+	max_workers = (0 == max_workers) ? 1 : max_workers;
+
+	U32 size_count = 0;
+	for (U64 size = options.m_minSize; size <= options.m_maxSize; size *= 10)
+	{
+		++size_count;
+	}
+
+	U32* source = (U32*)malloc(options.m_maxSize * sizeof(U32));
+	U32* data = (U32*)malloc(options.m_maxSize * sizeof(U32));
+	U32* output = (U32*)malloc(options.m_maxSize * sizeof(U32));
+	if (nullptr == source || nullptr == data || nullptr == output)
+	{
+		printf("Could not allocate %llu element(s)\n", (unsigned long long)options.m_maxSize);
+		return 1;
+	}
+	FillRandom(source, options.m_maxSize);
+
+	// Milliseconds by worker count, size and case
+	double* results = (double*)calloc((size_t)max_workers * size_count * BENCHMARK_CASE_COUNT, sizeof(double));
+	for (U32 workers = 1; workers <= max_workers; ++workers)
+	{
+		JobSystemInit(workers);
+
+		U32 size_index = 0;
+		for (U64 size = options.m_minSize; size <= options.m_maxSize; size *= 10, ++size_index)
+		{
+			memcpy(data, source, size * sizeof(U32));
+			for (U32 which = 0; which < BENCHMARK_CASE_COUNT; ++which)
+			{
+				double best = 1.0e300;
+				for (U32 run = 0; run < options.m_repeat; ++run)
+				{
+					double ms = RunCase((benchmark_case)which, source, data, output, size);
+					best = (ms < best) ? ms : best;
+				}
+				results[((workers - 1) * size_count + size_index) * BENCHMARK_CASE_COUNT + which] = best;
+			}
+		}
+
+		JobSystemDeinit();
+	}
+
+	for (U32 which = 0; which < BENCHMARK_CASE_COUNT; ++which)
+	{
+		printf("\n%s, milliseconds (speedup over 1 worker)\n", g_case_names[which]);
+		printf("%12s", "Elements");
+		for (U32 workers = 1; workers <= max_workers; ++workers)
+		{
+			printf(" %10u %-7s", workers, (1 == workers) ? "worker" : "workers");
+		}
+		printf("\n");
+
+		U32 size_index = 0;
+		for (U64 size = options.m_minSize; size <= options.m_maxSize; size *= 10, ++size_index)
+		{
+			printf("%12llu", (unsigned long long)size);
+			double single = results[size_index * BENCHMARK_CASE_COUNT + which];
+			for (U32 workers = 1; workers <= max_workers; ++workers)
+			{
+				double ms = results[((workers - 1) * size_count + size_index) * BENCHMARK_CASE_COUNT + which];
+				printf(" %10.3f (%4.2fx)", ms, (ms > 0.0) ? single / ms : 0.0);
+			}
+			printf("\n");
+		}
+	}
+
+	free(results);
+	free(output);
+	free(data);
+	free(source);
+	return 0;
+}